@@ -0,0 +1,137 @@
+#include <libetpan/libetpan.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+/*
+  decode-bench measures the decoding of RFC 2047 encoded headers.
+  The headers are read from the given file, one per line, or taken
+  from a built-in set of subjects and display names.
+*/
+
+static const char * default_corpus[] = {
+	"Re: [libetpan] build failure on 1.9",
+	"=?UTF-8?Q?R=C3=A9union_de_l=27=C3=A9quipe?=",
+	"=?utf-8?B?0J/RgNC40LLQtdGCLCDQvNC40YAh?=",
+	"=?ISO-8859-1?Q?Andr=E9?= Pirard <PIRARD@vm1.ulg.ac.be>",
+	"=?iso-8859-1?q?this=20is=20some=20text?=",
+	"=?UTF-8?B?5pel5pys6Kqe44Gu5Lu25ZCN44Gn44GZ?= =?UTF-8?B?44CC5L2V44GL44GU55So44Gn44GZ44GL77yf?=",
+	"=?ISO-2022-JP?B?GyRCJEYkOSRIGyhC?=",
+	"=?windows-1252?Q?=93Quoted=94_price:_10=80?=",
+	"Fwd: =?UTF-8?Q?Votre_commande_n=C2=B0_123456_a_=C3=A9t=C3=A9_exp?= =?UTF-8?Q?=C3=A9di=C3=A9e?=",
+	"=?GB2312?B?xOO6w6Osysfqx7jmtcTTyrz+?=",
+	"\"Dinh, Hoa\" <hoa@example.com>",
+	"=?utf-8?Q?J=C3=B6rg_M=C3=BCller?= <joerg@example.de>",
+	"=?KOI8-R?B?7sHQz83JzsHOycU=?=",
+	"Weekly status report",
+	"=?UTF-8?B?8J+OiSBIYXBweSBiaXJ0aGRheSE=?=",
+	NULL,
+};
+
+static double now(void)
+{
+	struct timeval tv;
+	
+	gettimeofday(&tv, NULL);
+	
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static carray * read_corpus(const char * filename)
+{
+	carray * corpus;
+	char line[4096];
+	FILE * f;
+	
+	corpus = carray_new(64);
+	if (corpus == NULL)
+		return NULL;
+	
+	if (filename == NULL) {
+		unsigned int i;
+		
+		for(i = 0 ; default_corpus[i] != NULL ; i ++)
+			carray_add(corpus, strdup(default_corpus[i]), NULL);
+		return corpus;
+	}
+	
+	f = fopen(filename, "r");
+	if (f == NULL) {
+		carray_free(corpus);
+		return NULL;
+	}
+	while (fgets(line, sizeof(line), f) != NULL) {
+		size_t len;
+		
+		len = strlen(line);
+		while ((len > 0) && ((line[len - 1] == '\n') || (line[len - 1] == '\r')))
+			len --;
+		line[len] = '\0';
+		if (len == 0)
+			continue;
+		carray_add(corpus, strdup(line), NULL);
+	}
+	fclose(f);
+	
+	return corpus;
+}
+
+int main(int argc, char ** argv)
+{
+	carray * corpus;
+	unsigned int iterations;
+	unsigned int i;
+	unsigned int j;
+	size_t input_size;
+	double start;
+	double elapsed;
+	
+	corpus = read_corpus(argc >= 2 ? argv[1] : NULL);
+	if (corpus == NULL) {
+		fprintf(stderr, "syntax: decode-bench [headers-file] [iterations]\n");
+		exit(EXIT_FAILURE);
+	}
+	if (carray_count(corpus) == 0) {
+		fprintf(stderr, "no header\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	iterations = 100000;
+	if (argc >= 3)
+		iterations = strtoul(argv[2], NULL, 10);
+	
+	input_size = 0;
+	start = now();
+	for(i = 0 ; i < iterations ; i ++) {
+		for(j = 0 ; j < carray_count(corpus) ; j ++) {
+			char * header;
+			char * decoded;
+			size_t cur_token;
+			int r;
+			
+			header = carray_get(corpus, j);
+			cur_token = 0;
+			r = mailmime_encoded_phrase_parse("iso-8859-1",
+			    header, strlen(header), &cur_token, "utf-8", &decoded);
+			if (r != MAILIMF_NO_ERROR)
+				continue;
+			if (i == 0)
+				printf("%s\n", decoded);
+			input_size += strlen(header);
+			free(decoded);
+		}
+	}
+	elapsed = now() - start;
+	
+	printf("%u headers decoded in %.3f s: %.0f headers/s, %.1f MB/s\n",
+	    iterations * carray_count(corpus), elapsed,
+	    iterations * carray_count(corpus) / elapsed,
+	    input_size / elapsed / 1000000.0);
+	
+	for(j = 0 ; j < carray_count(corpus) ; j ++)
+		free(carray_get(corpus, j));
+	carray_free(corpus);
+	
+	return EXIT_SUCCESS;
+}
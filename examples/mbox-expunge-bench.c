@@ -0,0 +1,117 @@
+#include <libetpan/libetpan.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+/*
+  mbox-expunge-bench creates a mailbox and measures the time needed to
+  expunge it when a single message is deleted at different positions.
+  Messages in the first half of the mailbox require a rewrite of the
+  file, the others are expunged in place.
+*/
+
+static void check_error(int r, char * msg)
+{
+	if (r == MAILMBOX_NO_ERROR)
+		return;
+	
+	fprintf(stderr, "%s\n", msg);
+	exit(EXIT_FAILURE);
+}
+
+static double now(void)
+{
+	struct timeval tv;
+	
+	gettimeofday(&tv, NULL);
+	
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void create_mailbox(const char * filename,
+    unsigned int count, unsigned int body_size)
+{
+	struct mailmbox_folder * folder;
+	FILE * f;
+	unsigned int i;
+	unsigned int j;
+	int r;
+	
+	unlink(filename);
+	f = fopen(filename, "w");
+	if (f == NULL) {
+		fprintf(stderr, "could not create %s\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	for(i = 0 ; i < count ; i ++) {
+		fprintf(f, "From sender@example.com Mon Jan  1 00:00:00 2024\n");
+		fprintf(f, "From: sender@example.com\n");
+		fprintf(f, "Subject: message %u\n\n", i);
+		for(j = 0 ; j < body_size ; j += 64)
+			fprintf(f, "%063u\n", j);
+		fprintf(f, "\n");
+	}
+	fclose(f);
+	
+	/* write the UID of the messages once */
+	r = mailmbox_init(filename, 0, 0, 0, &folder);
+	check_error(r, "open failed");
+	mailmbox_done(folder);
+}
+
+int main(int argc, char ** argv)
+{
+	static const unsigned int percent[] = { 1, 25, 49, 51, 75, 90, 99 };
+	unsigned int count;
+	unsigned int body_size;
+	unsigned int i;
+	char * filename;
+	
+	if (argc < 2) {
+		fprintf(stderr, "syntax: mbox-expunge-bench [mailbox] [message-count] [body-size]\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	filename = argv[1];
+	count = 20000;
+	if (argc >= 3)
+		count = strtoul(argv[2], NULL, 10);
+	body_size = 4096;
+	if (argc >= 4)
+		body_size = strtoul(argv[3], NULL, 10);
+	if (count == 0) {
+		fprintf(stderr, "no message\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	create_mailbox(filename, count, body_size);
+	
+	for(i = 0 ; i < sizeof(percent) / sizeof(percent[0]) ; i ++) {
+		struct mailmbox_folder * folder;
+		struct mailmbox_msg_info * info;
+		unsigned int index;
+		double start;
+		int r;
+		
+		r = mailmbox_init(filename, 0, 0, 0, &folder);
+		check_error(r, "open failed");
+		
+		index = carray_count(folder->mb_tab) * percent[i] / 100;
+		info = carray_get(folder->mb_tab, index);
+		r = mailmbox_delete_msg(folder, info->msg_uid);
+		check_error(r, "delete failed");
+		
+		start = now();
+		r = mailmbox_expunge(folder);
+		check_error(r, "expunge failed");
+		printf("deleted message at %2u%% of %lu bytes: %.3f s\n",
+		    percent[i], (unsigned long) folder->mb_mapping_size,
+		    now() - start);
+		
+		mailmbox_done(folder);
+	}
+	
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,149 @@
+#include <libetpan/libetpan.h>
+#include "smtp-sink.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+/*
+  smtp-pipelining-bench sends messages with many recipients to a local
+  SMTP sink and compares one round trip per command, PIPELINING and
+  PIPELINING with CHUNKING (BDAT).
+*/
+
+static double now(void)
+{
+	struct timeval tv;
+	
+	gettimeofday(&tv, NULL);
+	
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static double run(const char * name, int flags, unsigned int latency,
+    unsigned int count, clist * addresses, const char * message, size_t size)
+{
+	mailsmtp * smtp;
+	mailstream * stream;
+	int fds[2];
+	pid_t pid;
+	unsigned int i;
+	double start;
+	double elapsed;
+	int r;
+	
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+		perror("socketpair");
+		exit(EXIT_FAILURE);
+	}
+	fflush(stdout);
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		exit(EXIT_FAILURE);
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		smtp_sink_run(fds[1], flags, latency);
+		_exit(EXIT_SUCCESS);
+	}
+	close(fds[1]);
+	
+	smtp = mailsmtp_new(0, NULL);
+	stream = mailstream_socket_open(fds[0]);
+	if ((smtp == NULL) || (stream == NULL)) {
+		fprintf(stderr, "could not create session\n");
+		exit(EXIT_FAILURE);
+	}
+	r = mailsmtp_connect(smtp, stream);
+	if (r == MAILSMTP_NO_ERROR)
+		r = mailesmtp_ehlo(smtp);
+	if (r != MAILSMTP_NO_ERROR) {
+		fprintf(stderr, "%s: %s\n", name, mailsmtp_strerror(r));
+		exit(EXIT_FAILURE);
+	}
+	
+	start = now();
+	for(i = 0 ; i < count ; i ++) {
+		r = mailesmtp_send(smtp, "sender@example.com", 0, NULL,
+		    addresses, message, size);
+		if (r != MAILSMTP_NO_ERROR) {
+			fprintf(stderr, "%s: %s\n", name, mailsmtp_strerror(r));
+			exit(EXIT_FAILURE);
+		}
+	}
+	elapsed = now() - start;
+	
+	mailsmtp_free(smtp);
+	waitpid(pid, NULL, 0);
+	
+	printf("%-22s %u messages in %.3f s\n", name, count, elapsed);
+	
+	return elapsed;
+}
+
+int main(int argc, char ** argv)
+{
+	clist * addresses;
+	unsigned int count;
+	unsigned int rcpt_count;
+	unsigned int latency;
+	size_t size;
+	char * message;
+	size_t i;
+	
+	count = 20;
+	if (argc >= 2)
+		count = strtoul(argv[1], NULL, 10);
+	rcpt_count = 200;
+	if (argc >= 3)
+		rcpt_count = strtoul(argv[2], NULL, 10);
+	latency = 1000;
+	if (argc >= 4)
+		latency = strtoul(argv[3], NULL, 10);
+	size = 64 * 1024;
+	if (argc >= 5)
+		size = strtoul(argv[4], NULL, 10);
+	
+	signal(SIGPIPE, SIG_IGN);
+	
+	addresses = esmtp_address_list_new();
+	for(i = 0 ; i < rcpt_count ; i ++) {
+		char address[64];
+		
+		snprintf(address, sizeof(address), "user%lu@example.com", (unsigned long) i);
+		esmtp_address_list_add(addresses, address, 0, NULL);
+	}
+	
+	message = malloc(size + 1);
+	if (message == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	for(i = 0 ; i < size ; i ++) {
+		if (i % 72 == 71)
+			message[i] = '\n';
+		else if (i % 72 == 0)
+			message[i] = '.';
+		else
+			message[i] = 'a' + i % 26;
+	}
+	message[size] = '\0';
+	
+	printf("%u recipients, %lu bytes, %u us per round trip\n",
+	    rcpt_count, (unsigned long) size, latency);
+	run("one command at a time", 0, latency, count, addresses, message, size);
+	run("PIPELINING", SINK_PIPELINING, latency, count, addresses, message, size);
+	run("PIPELINING+CHUNKING", SINK_PIPELINING | SINK_CHUNKING, latency,
+	    count, addresses, message, size);
+	
+	free(message);
+	esmtp_address_list_free(addresses);
+	
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,208 @@
+#include <libetpan/libetpan.h>
+#include "smtp-sink.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+/*
+  smtp-pool-bench sends messages from several threads to a local SMTP
+  sink, either with a new connection for each message or through a
+  mailsmtp_pool of different sizes.
+  Each connection to the sink costs a delay that stands for the TCP, TLS
+  and authentication handshakes, each round trip costs the given latency.
+*/
+
+static unsigned int latency;
+static unsigned int handshake;
+
+static uint16_t start_sink(pid_t * p_pid)
+{
+	struct sockaddr_in addr;
+	socklen_t len;
+	pid_t pid;
+	int s;
+	
+	s = socket(AF_INET, SOCK_STREAM, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+	len = sizeof(addr);
+	if ((s < 0) || (bind(s, (struct sockaddr *) &addr, sizeof(addr)) < 0) ||
+	    (listen(s, 64) < 0) ||
+	    (getsockname(s, (struct sockaddr *) &addr, &len) < 0)) {
+		perror("sink");
+		exit(EXIT_FAILURE);
+	}
+	
+	fflush(stdout);
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		exit(EXIT_FAILURE);
+	}
+	if (pid == 0) {
+		signal(SIGCHLD, SIG_IGN);
+		while (1) {
+			int fd;
+			
+			fd = accept(s, NULL, NULL);
+			if (fd < 0)
+				continue;
+			if (fork() == 0) {
+				close(s);
+				usleep(handshake);
+				smtp_sink_run(fd, SINK_PIPELINING, latency);
+				_exit(EXIT_SUCCESS);
+			}
+			close(fd);
+		}
+	}
+	close(s);
+	* p_pid = pid;
+	
+	return ntohs(addr.sin_port);
+}
+
+struct worker {
+	pthread_t thread;
+	struct mailsmtp_pool * pool;
+	uint16_t port;
+	unsigned int count;
+	clist * addresses;
+	const char * message;
+};
+
+static void * worker_main(void * data)
+{
+	struct worker * worker;
+	unsigned int i;
+	int r;
+	
+	worker = data;
+	for(i = 0 ; i < worker->count ; i ++) {
+		if (worker->pool != NULL) {
+			r = mailsmtp_pool_send(worker->pool, "sender@example.com", 0, NULL,
+			    worker->addresses, worker->message, strlen(worker->message));
+		}
+		else {
+			mailsmtp * smtp;
+			
+			smtp = mailsmtp_new(0, NULL);
+			r = mailsmtp_socket_connect(smtp, "127.0.0.1", worker->port);
+			if (r == MAILSMTP_NO_ERROR)
+				r = mailsmtp_init(smtp);
+			if (r == MAILSMTP_NO_ERROR)
+				r = mailesmtp_send(smtp, "sender@example.com", 0, NULL,
+				    worker->addresses, worker->message, strlen(worker->message));
+			mailsmtp_free(smtp);
+		}
+		if (r != MAILSMTP_NO_ERROR) {
+			fprintf(stderr, "send failed: %s\n", mailsmtp_strerror(r));
+			exit(EXIT_FAILURE);
+		}
+	}
+	
+	return NULL;
+}
+
+static void run(unsigned int pool_size, uint16_t port, unsigned int thread_count,
+    unsigned int count, clist * addresses, const char * message)
+{
+	struct mailsmtp_pool * pool;
+	struct worker * workers;
+	struct timeval start;
+	struct timeval end;
+	double elapsed;
+	unsigned int i;
+	
+	pool = NULL;
+	if (pool_size != 0) {
+		pool = mailsmtp_pool_new("127.0.0.1", port,
+		    MAILSMTP_POOL_CONNECTION_PLAIN, NULL, NULL, NULL, pool_size);
+		if (pool == NULL) {
+			fprintf(stderr, "could not create pool\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	
+	workers = malloc(sizeof(* workers) * thread_count);
+	gettimeofday(&start, NULL);
+	for(i = 0 ; i < thread_count ; i ++) {
+		workers[i].pool = pool;
+		workers[i].port = port;
+		workers[i].count = count / thread_count;
+		workers[i].addresses = addresses;
+		workers[i].message = message;
+		pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+	}
+	for(i = 0 ; i < thread_count ; i ++)
+		pthread_join(workers[i].thread, NULL);
+	gettimeofday(&end, NULL);
+	free(workers);
+	
+	if (pool != NULL)
+		mailsmtp_pool_free(pool);
+	
+	elapsed = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+	if (pool_size == 0)
+		printf("connection per message: ");
+	else
+		printf("pool of %2u sessions:    ", pool_size);
+	printf("%u messages in %.3f s, %.0f messages/s\n",
+	    count / thread_count * thread_count, elapsed,
+	    count / thread_count * thread_count / elapsed);
+}
+
+int main(int argc, char ** argv)
+{
+	static const unsigned int pool_sizes[] = { 0, 1, 2, 4, 8 };
+	clist * addresses;
+	unsigned int thread_count;
+	unsigned int count;
+	unsigned int i;
+	uint16_t port;
+	pid_t pid;
+	
+	count = 400;
+	if (argc >= 2)
+		count = strtoul(argv[1], NULL, 10);
+	thread_count = 8;
+	if (argc >= 3)
+		thread_count = strtoul(argv[2], NULL, 10);
+	latency = 1000;
+	if (argc >= 4)
+		latency = strtoul(argv[3], NULL, 10);
+	handshake = 20000;
+	if (argc >= 5)
+		handshake = strtoul(argv[4], NULL, 10);
+	if (thread_count == 0)
+		thread_count = 1;
+	
+	signal(SIGPIPE, SIG_IGN);
+	
+	addresses = esmtp_address_list_new();
+	esmtp_address_list_add(addresses, "user@example.com", 0, NULL);
+	
+	port = start_sink(&pid);
+	printf("%u threads, %u us per round trip, %u us per handshake\n",
+	    thread_count, latency, handshake);
+	for(i = 0 ; i < sizeof(pool_sizes) / sizeof(pool_sizes[0]) ; i ++)
+		run(pool_sizes[i], port, thread_count, count, addresses,
+		    "Subject: test\r\n\r\nhello\r\n");
+	
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+	esmtp_address_list_free(addresses);
+	
+	return EXIT_SUCCESS;
+}
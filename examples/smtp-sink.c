@@ -0,0 +1,158 @@
+#include "smtp-sink.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <poll.h>
+
+struct sink {
+	int fd;
+	char buffer[65536];
+	size_t begin;
+	size_t end;
+	char reply[65536];
+	size_t reply_len;
+	unsigned int latency;
+};
+
+static int sink_fill(struct sink * sink)
+{
+	ssize_t r;
+	
+	if (sink->begin > 0) {
+		memmove(sink->buffer, sink->buffer + sink->begin, sink->end - sink->begin);
+		sink->end -= sink->begin;
+		sink->begin = 0;
+	}
+	r = read(sink->fd, sink->buffer + sink->end, sizeof(sink->buffer) - sink->end);
+	if (r <= 0)
+		return -1;
+	sink->end += r;
+	
+	return 0;
+}
+
+static void sink_flush(struct sink * sink)
+{
+	if (sink->reply_len == 0)
+		return;
+	
+	if (sink->latency != 0)
+		usleep(sink->latency);
+	if (write(sink->fd, sink->reply, sink->reply_len) < 0)
+		_exit(EXIT_FAILURE);
+	sink->reply_len = 0;
+}
+
+/* replies are sent when the client waits for them */
+static int sink_wait_input(struct sink * sink)
+{
+	struct pollfd pfd;
+	
+	pfd.fd = sink->fd;
+	pfd.events = POLLIN;
+	if (poll(&pfd, 1, 0) <= 0)
+		sink_flush(sink);
+	
+	return sink_fill(sink);
+}
+
+static void sink_reply(struct sink * sink, const char * reply)
+{
+	size_t len;
+	
+	len = strlen(reply);
+	if (sink->reply_len + len > sizeof(sink->reply))
+		sink_flush(sink);
+	memcpy(sink->reply + sink->reply_len, reply, len);
+	sink->reply_len += len;
+}
+
+static char * sink_read_line(struct sink * sink)
+{
+	while (1) {
+		char * lf;
+		
+		lf = memchr(sink->buffer + sink->begin, '\n', sink->end - sink->begin);
+		if (lf != NULL) {
+			char * line;
+			
+			line = sink->buffer + sink->begin;
+			* lf = '\0';
+			sink->begin = lf + 1 - sink->buffer;
+			return line;
+		}
+		if (sink_wait_input(sink) < 0)
+			return NULL;
+	}
+}
+
+static int sink_skip(struct sink * sink, size_t size)
+{
+	while (size > 0) {
+		size_t count;
+		
+		if (sink->begin == sink->end) {
+			if (sink_wait_input(sink) < 0)
+				return -1;
+		}
+		count = sink->end - sink->begin;
+		if (count > size)
+			count = size;
+		sink->begin += count;
+		size -= count;
+	}
+	
+	return 0;
+}
+
+void smtp_sink_run(int fd, int flags, unsigned int latency)
+{
+	struct sink sink;
+	char * line;
+	
+	sink.fd = fd;
+	sink.begin = 0;
+	sink.end = 0;
+	sink.reply_len = 0;
+	sink.latency = latency;
+	
+	sink_reply(&sink, "220 sink ESMTP\r\n");
+	sink_flush(&sink);
+	while ((line = sink_read_line(&sink)) != NULL) {
+		if (strncasecmp(line, "EHLO", 4) == 0) {
+			sink_reply(&sink, "250-sink\r\n");
+			if ((flags & SINK_PIPELINING) != 0)
+				sink_reply(&sink, "250-PIPELINING\r\n");
+			if ((flags & SINK_CHUNKING) != 0)
+				sink_reply(&sink, "250-CHUNKING\r\n");
+			sink_reply(&sink, "250 8BITMIME\r\n");
+		}
+		else if (strncasecmp(line, "DATA", 4) == 0) {
+			sink_reply(&sink, "354 go ahead\r\n");
+			sink_flush(&sink);
+			while ((line = sink_read_line(&sink)) != NULL) {
+				if (strcmp(line, ".\r") == 0)
+					break;
+			}
+			sink_reply(&sink, "250 queued\r\n");
+		}
+		else if (strncasecmp(line, "BDAT", 4) == 0) {
+			if (sink_skip(&sink, strtoul(line + 5, NULL, 10)) < 0)
+				break;
+			sink_reply(&sink, "250 ok\r\n");
+		}
+		else if (strncasecmp(line, "QUIT", 4) == 0) {
+			sink_reply(&sink, "221 bye\r\n");
+			sink_flush(&sink);
+			break;
+		}
+		else {
+			sink_reply(&sink, "250 ok\r\n");
+		}
+	}
+	
+	close(fd);
+}
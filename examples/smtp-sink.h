@@ -0,0 +1,18 @@
+#ifndef SMTP_SINK_H
+
+#define SMTP_SINK_H
+
+/*
+  smtp_sink_run() answers an SMTP client on fd and drops the messages.
+  It waits for latency microseconds before each batch of replies to
+  simulate the round trip time to a remote server.
+*/
+
+enum {
+	SINK_PIPELINING = 1,
+	SINK_CHUNKING = 2
+};
+
+void smtp_sink_run(int fd, int flags, unsigned int latency);
+
+#endif
@@ -48,6 +48,13 @@
 #include <errno.h>
 
 #include "mmapstring.h"
+#include "charconv_private.h"
+
+#ifdef LIBETPAN_REENTRANT
+#	if HAVE_PTHREAD_H
+#		include <pthread.h>
+#	endif
+#endif
 
 int (*extended_charconv)(const char * tocode, const char * fromcode, const char * str, size_t length,
     char * result, size_t* result_len) = NULL;
@@ -145,20 +152,346 @@ static const char * get_valid_charset(const char * fromcode)
   return fromcode;
 }
 
+/*
+  charsets that are converted to UTF-8 without iconv
+*/
+
+enum {
+  CHARSET_OTHER,
+  CHARSET_UTF8,
+  CHARSET_ASCII,
+  CHARSET_LATIN1,
+  CHARSET_CP1252
+};
+
+static struct {
+  const char * name;
+  int kind;
+} charset_aliases[] = {
+  { "utf-8", CHARSET_UTF8 },
+  { "utf8", CHARSET_UTF8 },
+  { "us-ascii", CHARSET_ASCII },
+  { "ascii", CHARSET_ASCII },
+  { "ansi_x3.4-1968", CHARSET_ASCII },
+  { "iso646-us", CHARSET_ASCII },
+  { "iso-8859-1", CHARSET_LATIN1 },
+  { "iso8859-1", CHARSET_LATIN1 },
+  { "iso_8859-1", CHARSET_LATIN1 },
+  { "iso_8859-1:1987", CHARSET_LATIN1 },
+  { "latin1", CHARSET_LATIN1 },
+  { "l1", CHARSET_LATIN1 },
+  { "windows-1252", CHARSET_CP1252 },
+  { "cp1252", CHARSET_CP1252 },
+  { "x-cp1252", CHARSET_CP1252 },
+  { NULL, CHARSET_OTHER }
+};
+
+static int get_charset_kind(const char * charset)
+{
+  int i;
+
+  for(i = 0 ; charset_aliases[i].name != NULL ; i ++) {
+    if (strcasecmp(charset, charset_aliases[i].name) == 0)
+      return charset_aliases[i].kind;
+  }
+
+  return CHARSET_OTHER;
+}
+
+/* characters 0x80 to 0x9f of windows-1252, 0 when not defined */
+
+static const unsigned short cp1252_table[32] = {
+  0x20ac, 0, 0x201a, 0x0192, 0x201e, 0x2026, 0x2020, 0x2021,
+  0x02c6, 0x2030, 0x0160, 0x2039, 0x0152, 0, 0x017d, 0,
+  0, 0x2018, 0x2019, 0x201c, 0x201d, 0x2022, 0x2013, 0x2014,
+  0x02dc, 0x2122, 0x0161, 0x203a, 0x0153, 0, 0x017e, 0x0178
+};
+
+static int is_valid_utf8(const unsigned char * str, size_t length)
+{
+  size_t i;
+
+  i = 0;
+  while (i < length) {
+    unsigned char ch;
+    unsigned int codepoint;
+    size_t count;
+    size_t k;
+
+    ch = str[i];
+    if (ch < 0x80) {
+      i ++;
+      continue;
+    }
+
+    if ((ch & 0xe0) == 0xc0) {
+      count = 1;
+      codepoint = ch & 0x1f;
+    }
+    else if ((ch & 0xf0) == 0xe0) {
+      count = 2;
+      codepoint = ch & 0x0f;
+    }
+    else if ((ch & 0xf8) == 0xf0) {
+      count = 3;
+      codepoint = ch & 0x07;
+    }
+    else {
+      return 0;
+    }
+
+    if (length - i <= count)
+      return 0;
+
+    for(k = 1 ; k <= count ; k ++) {
+      if ((str[i + k] & 0xc0) != 0x80)
+        return 0;
+      codepoint = (codepoint << 6) | (str[i + k] & 0x3f);
+    }
+
+    /* overlong forms, surrogates and values out of range */
+    if ((count == 1) && (codepoint < 0x80))
+      return 0;
+    if ((count == 2) && (codepoint < 0x800))
+      return 0;
+    if ((count == 3) && ((codepoint < 0x10000) || (codepoint > 0x10ffff)))
+      return 0;
+    if ((codepoint >= 0xd800) && (codepoint <= 0xdfff))
+      return 0;
+
+    i += count + 1;
+  }
+
+  return 1;
+}
+
+/*
+  converts to UTF-8 without iconv, out must have room for 3 * length
+  bytes. MAIL_CHARCONV_ERROR_UNKNOWN_CHARSET is returned when the
+  conversion needs iconv.
+*/
+
+static int fast_charconv(const char * tocode, const char * fromcode,
+    const char * str, size_t length,
+    char * out, size_t * result_len)
+{
+  const unsigned char * p;
+  unsigned char * pout;
+  size_t i;
+  int from_kind;
+
+  if (get_charset_kind(tocode) != CHARSET_UTF8)
+    return MAIL_CHARCONV_ERROR_UNKNOWN_CHARSET;
+
+  p = (const unsigned char *) str;
+  from_kind = get_charset_kind(fromcode);
+  switch (from_kind) {
+  case CHARSET_UTF8:
+    /* invalid sequences are replaced by iconv */
+    if (!is_valid_utf8(p, length))
+      return MAIL_CHARCONV_ERROR_UNKNOWN_CHARSET;
+    memcpy(out, str, length);
+    * result_len = length;
+    return MAIL_CHARCONV_NO_ERROR;
+
+  case CHARSET_ASCII:
+    for(i = 0 ; i < length ; i ++) {
+      if (p[i] >= 0x80)
+        return MAIL_CHARCONV_ERROR_UNKNOWN_CHARSET;
+    }
+    memcpy(out, str, length);
+    * result_len = length;
+    return MAIL_CHARCONV_NO_ERROR;
+
+  case CHARSET_LATIN1:
+  case CHARSET_CP1252:
+    pout = (unsigned char *) out;
+    for(i = 0 ; i < length ; i ++) {
+      unsigned int codepoint;
+
+      codepoint = p[i];
+      if ((from_kind == CHARSET_CP1252) &&
+          (codepoint >= 0x80) && (codepoint < 0xa0)) {
+        codepoint = cp1252_table[codepoint - 0x80];
+        if (codepoint == 0) {
+          /* as iconv does for invalid characters */
+          * pout ++ = '?';
+          continue;
+        }
+      }
+
+      if (codepoint < 0x80) {
+        * pout ++ = codepoint;
+      }
+      else if (codepoint < 0x800) {
+        * pout ++ = 0xc0 | (codepoint >> 6);
+        * pout ++ = 0x80 | (codepoint & 0x3f);
+      }
+      else {
+        * pout ++ = 0xe0 | (codepoint >> 12);
+        * pout ++ = 0x80 | ((codepoint >> 6) & 0x3f);
+        * pout ++ = 0x80 | (codepoint & 0x3f);
+      }
+    }
+    * result_len = (char *) pout - out;
+    return MAIL_CHARCONV_NO_ERROR;
+
+  default:
+    return MAIL_CHARCONV_ERROR_UNKNOWN_CHARSET;
+  }
+}
+
+#ifdef HAVE_ICONV
+/*
+  iconv_open() is expensive, the descriptors are kept once they have
+  been used. A descriptor is removed from the cache while it is used
+  so that it is never shared by two threads.
+*/
+
+#define ICONV_CACHE_SIZE 16
+#define ICONV_CACHE_NAME_SIZE 40
+
+struct iconv_cache_entry {
+  char tocode[ICONV_CACHE_NAME_SIZE];
+  char fromcode[ICONV_CACHE_NAME_SIZE];
+  iconv_t conv;
+};
+
+static struct iconv_cache_entry iconv_cache[ICONV_CACHE_SIZE];
+static unsigned int iconv_cache_count = 0;
+
+#ifdef LIBETPAN_REENTRANT
+#	if HAVE_PTHREAD_H
+		static pthread_mutex_t iconv_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+#		define MUTEX_LOCK(x) pthread_mutex_lock(x)
+#		define MUTEX_UNLOCK(x) pthread_mutex_unlock(x)
+#	elif (defined WIN32)
+		static CRITICAL_SECTION iconv_cache_lock;
+#		define MUTEX_LOCK(x) EnterCriticalSection(x)
+#		define MUTEX_UNLOCK(x) LeaveCriticalSection(x)
+#	else
+#		error "What are your threads?"
+#	endif
+#else
+#	define MUTEX_LOCK(x)
+#	define MUTEX_UNLOCK(x)
+#endif
+
+static iconv_t iconv_cache_open(const char * tocode, const char * fromcode)
+{
+  unsigned int i;
+  iconv_t conv;
+
+  MUTEX_LOCK(&iconv_cache_lock);
+  for(i = 0 ; i < iconv_cache_count ; i ++) {
+    if ((strcasecmp(iconv_cache[i].tocode, tocode) == 0) &&
+        (strcasecmp(iconv_cache[i].fromcode, fromcode) == 0)) {
+      conv = iconv_cache[i].conv;
+      iconv_cache_count --;
+      iconv_cache[i] = iconv_cache[iconv_cache_count];
+      MUTEX_UNLOCK(&iconv_cache_lock);
+      return conv;
+    }
+  }
+  MUTEX_UNLOCK(&iconv_cache_lock);
+
+  return iconv_open(tocode, fromcode);
+}
+
+static void iconv_cache_close(const char * tocode, const char * fromcode,
+    iconv_t conv)
+{
+  iconv_t evicted;
+
+  if ((strlen(tocode) >= ICONV_CACHE_NAME_SIZE) ||
+      (strlen(fromcode) >= ICONV_CACHE_NAME_SIZE)) {
+    iconv_close(conv);
+    return;
+  }
+
+  /* back to the initial state */
+  iconv(conv, NULL, NULL, NULL, NULL);
+
+  evicted = (iconv_t) -1;
+
+  MUTEX_LOCK(&iconv_cache_lock);
+  if (iconv_cache_count == ICONV_CACHE_SIZE) {
+    evicted = iconv_cache[0].conv;
+    iconv_cache_count --;
+    memmove(&iconv_cache[0], &iconv_cache[1],
+        iconv_cache_count * sizeof(iconv_cache[0]));
+  }
+  strcpy(iconv_cache[iconv_cache_count].tocode, tocode);
+  strcpy(iconv_cache[iconv_cache_count].fromcode, fromcode);
+  iconv_cache[iconv_cache_count].conv = conv;
+  iconv_cache_count ++;
+  MUTEX_UNLOCK(&iconv_cache_lock);
+
+  if (evicted != (iconv_t) -1)
+    iconv_close(evicted);
+}
+#endif
+
+void charconv_init_lock(void)
+{
+#if defined (HAVE_ICONV) && defined (LIBETPAN_REENTRANT) && !defined (HAVE_PTHREAD_H) && defined (WIN32)
+  InitializeCriticalSection(&iconv_cache_lock);
+#endif
+}
+
+/*
+  converts str into out, which has room for 6 * length bytes,
+  (* result_len) is the size of the result.
+*/
+
+static int charconv_to_buffer(const char * tocode, const char * fromcode,
+    const char * str, size_t length,
+    char * out, size_t * result_len)
+{
+#ifdef HAVE_ICONV
+  iconv_t conv;
+  size_t r;
+  char * pout;
+  size_t out_size;
+#endif
+  int res;
+
+  res = fast_charconv(tocode, fromcode, str, length, out, result_len);
+  if (res != MAIL_CHARCONV_ERROR_UNKNOWN_CHARSET)
+    return res;
+
+#ifndef HAVE_ICONV
+  return MAIL_CHARCONV_ERROR_UNKNOWN_CHARSET;
+#else
+  conv = iconv_cache_open(tocode, fromcode);
+  if (conv == (iconv_t) -1)
+    return MAIL_CHARCONV_ERROR_UNKNOWN_CHARSET;
+
+  out_size = 6 * length; /* UTF-8 can be encoded up to 6 bytes */
+  pout = out;
+
+  r = mail_iconv(conv, &str, &length, &pout, &out_size, NULL, "?");
+  if (r == (size_t) -1) {
+    iconv_close(conv);
+    return MAIL_CHARCONV_ERROR_CONV;
+  }
+
+  iconv_cache_close(tocode, fromcode, conv);
+
+  * result_len = pout - out;
+
+  return MAIL_CHARCONV_NO_ERROR;
+#endif
+}
+
 LIBETPAN_EXPORT
 int charconv(const char * tocode, const char * fromcode,
     const char * str, size_t length,
     char ** result)
 {
-#ifdef HAVE_ICONV
-	iconv_t conv;
-	size_t r;
+	char * out;
 	char * pout;
-	size_t out_size;
-	size_t old_out_size;
 	size_t count;
-#endif
-	char * out;
 	int res;
 
   fromcode = get_valid_charset(fromcode);
@@ -185,38 +518,17 @@ int charconv(const char * tocode, const char * fromcode,
 		/* else, let's try with iconv, if available */
 	}
 
-#ifndef HAVE_ICONV
-  return MAIL_CHARCONV_ERROR_UNKNOWN_CHARSET;
-#else
-  
-  conv = iconv_open(tocode, fromcode);
-  if (conv == (iconv_t) -1) {
-    res = MAIL_CHARCONV_ERROR_UNKNOWN_CHARSET;
-    goto err;
-  }
-
-  out_size = 6 * length; /* UTF-8 can be encoded up to 6 bytes */
-
-  out = malloc(out_size + 1);
+  out = malloc(6 * length + 1);
   if (out == NULL) {
     res = MAIL_CHARCONV_ERROR_MEMORY;
-    goto close_iconv;
+    goto err;
   }
 
-  pout = out;
-  old_out_size = out_size;
-
-  r = mail_iconv(conv, &str, &length, &pout, &out_size, NULL, "?");
-
-  if (r == (size_t) -1) {
-    res = MAIL_CHARCONV_ERROR_CONV;
+  res = charconv_to_buffer(tocode, fromcode, str, length, out, &count);
+  if (res != MAIL_CHARCONV_NO_ERROR)
     goto free;
-  }
 
-  iconv_close(conv);
-
-  * pout = '\0';
-  count = old_out_size - out_size;
+  out[count] = '\0';
   pout = realloc(out, count + 1);
   if (pout != NULL)
     out = pout;
@@ -227,11 +539,8 @@ int charconv(const char * tocode, const char * fromcode,
 
  free:
   free(out);
- close_iconv:
-  iconv_close(conv);
  err:
   return res;
-#endif
 }
 
 LIBETPAN_EXPORT
@@ -239,16 +548,8 @@ int charconv_buffer(const char * tocode, const char * fromcode,
 		    const char * str, size_t length,
 		    char ** result, size_t * result_len)
 {
-#ifdef HAVE_ICONV
-	iconv_t conv;
-	size_t iconv_r;
 	int r;
-	char * out;
-	char * pout;
-	size_t out_size;
-	size_t old_out_size;
 	size_t count;
-#endif
 	int res;
 	MMAPString * mmapstr;
 
@@ -287,41 +588,18 @@ int charconv_buffer(const char * tocode, const char * fromcode,
 		/* else, let's try with iconv, if available */
 	}
 
-#ifndef HAVE_ICONV
-  return MAIL_CHARCONV_ERROR_UNKNOWN_CHARSET;
-#else
-
-  conv = iconv_open(tocode, fromcode);
-  if (conv == (iconv_t) -1) {
-    res = MAIL_CHARCONV_ERROR_UNKNOWN_CHARSET;
-    goto err;
-  }
-
-  out_size = 6 * length; /* UTF-8 can be encoded up to 6 bytes */
-
-  mmapstr = mmap_string_sized_new(out_size + 1);
+  mmapstr = mmap_string_sized_new(6 * length + 1);
   if (mmapstr == NULL) {
     res = MAIL_CHARCONV_ERROR_MEMORY;
     goto err;
   }
 
-  out = mmapstr->str;
-
-  pout = out;
-  old_out_size = out_size;
-
-  iconv_r = mail_iconv(conv, &str, &length, &pout, &out_size, NULL, "?");
-
-  if (iconv_r == (size_t) -1) {
-    res = MAIL_CHARCONV_ERROR_CONV;
+  res = charconv_to_buffer(tocode, fromcode, str, length,
+      mmapstr->str, &count);
+  if (res != MAIL_CHARCONV_NO_ERROR)
     goto free;
-  }
 
-  iconv_close(conv);
-
-  * pout = '\0';
-
-  count = old_out_size - out_size;
+  mmapstr->str[count] = '\0';
 
   r = mmap_string_ref(mmapstr);
   if (r < 0) {
@@ -329,7 +607,7 @@ int charconv_buffer(const char * tocode, const char * fromcode,
     goto free;
   }
 
-  * result = out;
+  * result = mmapstr->str;
   * result_len = count;
 
   return MAIL_CHARCONV_NO_ERROR;
@@ -338,7 +616,6 @@ int charconv_buffer(const char * tocode, const char * fromcode,
   mmap_string_free(mmapstr);
  err:
   return res;
-#endif
 }
 
 LIBETPAN_EXPORT
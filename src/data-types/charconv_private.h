@@ -0,0 +1,7 @@
+#ifndef CHARCONV_PRIVATE_H
+
+#define CHARCONV_PRIVATE_H
+
+extern void charconv_init_lock(void);
+
+#endif
@@ -58,6 +58,7 @@
 #	include <sys/socket.h>
 #	include <unistd.h>
 #       include <arpa/inet.h>
+#	include <poll.h>
 #endif
 
 uint16_t mail_get_service_port(const char * name, char * protocol)
@@ -105,8 +106,12 @@ static int verify_sock_errors(int s)
 
 static int wait_connect(int s, int r)
 {
-  fd_set fds;
   struct timeval timeout;
+#ifdef WIN32
+  fd_set fds;
+#else
+  struct pollfd pfd;
+#endif
   
   if (r == 0) {
     /* connected immediately */
@@ -121,9 +126,10 @@ static int wait_connect(int s, int r)
     }
   }
   
+  timeout = mailstream_network_delay;
+#ifdef WIN32
   FD_ZERO(&fds);
   FD_SET(s, &fds);
-  timeout = mailstream_network_delay;
   /* TODO: how to cancel this ? */
   r = select(s + 1, NULL, &fds, NULL, &timeout);
   if (r <= 0) {
@@ -134,6 +140,21 @@ static int wait_connect(int s, int r)
     /* though, it's strange */
     return -1;
   }
+#else
+  pfd.fd = s;
+  pfd.events = POLLOUT;
+  pfd.revents = 0;
+  /* TODO: how to cancel this ? */
+  r = poll(&pfd, 1, timeout.tv_sec * 1000 + timeout.tv_usec / 1000);
+  if (r <= 0) {
+    return -1;
+  }
+  
+  if ((pfd.revents & POLLOUT) == 0) {
+    /* connection refused or hang up */
+    return -1;
+  }
+#endif
   
   return 0;
 }
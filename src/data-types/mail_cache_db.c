@@ -48,13 +48,15 @@
 #include "libetpan-config.h"
 
 #include "maillock.h"
+#include "mail.h"
 
 #if DBVERS >= 1
 #include <db.h>
+#else
+#include "mail_cache_db_log.h"
 #endif
 
-#if DBVERS >= 1
-static struct mail_cache_db * mail_cache_db_new(DB * db)
+static struct mail_cache_db * mail_cache_db_new(void * db)
 {
   struct mail_cache_db * cache_db;
   
@@ -70,7 +72,6 @@ static void mail_cache_db_free(struct mail_cache_db * cache_db)
 {
   free(cache_db);
 }
-#endif
 
 int mail_cache_db_open(const char * filename,
     struct mail_cache_db ** pcache_db)
@@ -127,6 +128,25 @@ int mail_cache_db_open(const char * filename,
  err:
   return -1;
 #else
+  struct mail_cache_db_log * log;
+  struct mail_cache_db * cache_db;
+  int r;
+
+  r = mail_cache_db_log_open(filename, &log);
+  if (r < 0)
+    goto err;
+
+  cache_db = mail_cache_db_new(log);
+  if (cache_db == NULL)
+    goto close_log;
+
+  * pcache_db = cache_db;
+
+  return 0;
+
+ close_log:
+  mail_cache_db_log_close(log);
+ err:
   return -1;
 #endif
 }
@@ -144,6 +164,9 @@ void mail_cache_db_close(struct mail_cache_db * cache_db)
   dbp->close(cache_db->internal_database);
 #endif
   
+  mail_cache_db_free(cache_db);
+#else
+  mail_cache_db_log_close(cache_db->internal_database);
   mail_cache_db_free(cache_db);
 #endif
 }
@@ -210,7 +233,8 @@ int mail_cache_db_put(struct mail_cache_db * cache_db,
   
   return 0;
 #else
-  return -1;
+  return mail_cache_db_log_put(cache_db->internal_database,
+      key, key_len, value, value_len);
 #endif
 }
 
@@ -246,7 +270,8 @@ int mail_cache_db_get(struct mail_cache_db * cache_db,
   
   return 0;
 #else
-  return -1;
+  return mail_cache_db_log_get(cache_db->internal_database,
+      key, key_len, pvalue, pvalue_len);
 #endif
 }
 
@@ -276,7 +301,7 @@ int mail_cache_db_del(struct mail_cache_db * cache_db,
   
   return 0;
 #else
-  return -1;
+  return mail_cache_db_log_del(cache_db->internal_database, key, key_len);
 #endif
 }
 
@@ -368,7 +393,7 @@ int mail_cache_db_clean_up(struct mail_cache_db * cache_db,
 int mail_cache_db_clean_up(struct mail_cache_db * cache_db,
     chash * exist)
 {
-  return -1;
+  return mail_cache_db_log_clean_up(cache_db->internal_database, exist);
 }
 #endif
 
@@ -407,7 +432,8 @@ int mail_cache_db_get_size(struct mail_cache_db * cache_db,
   
   return 0;
 #else
-  return -1;
+  return mail_cache_db_log_get_size(cache_db->internal_database,
+      key, key_len, pvalue_len);
 #endif
 }
 
@@ -495,6 +521,35 @@ int mail_cache_db_get_keys(struct mail_cache_db * cache_db,
 int mail_cache_db_get_keys(struct mail_cache_db * cache_db,
     chash * keys)
 {
-  return -1;
+  return mail_cache_db_log_get_keys(cache_db->internal_database, keys);
 }
 #endif
+
+int mail_cache_db_begin_batch(struct mail_cache_db * cache_db)
+{
+#if DBVERS >= 1
+  UNUSED(cache_db);
+
+  return 0;
+#else
+  return mail_cache_db_log_begin_batch(cache_db->internal_database);
+#endif
+}
+
+int mail_cache_db_end_batch(struct mail_cache_db * cache_db)
+{
+#if DBVERS >= 1
+  DB * dbp;
+  int r;
+
+  dbp = cache_db->internal_database;
+
+  r = dbp->sync(dbp, 0);
+  if (r != 0)
+    return -1;
+
+  return 0;
+#else
+  return mail_cache_db_log_end_batch(cache_db->internal_database);
+#endif
+}
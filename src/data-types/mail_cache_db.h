@@ -49,6 +49,7 @@ extern "C" {
   this module will handle a database "f(key) -> value" in a file
   
   berkeley DB or other can be used for implementation of low-level file.
+  When berkeley DB is not available, a built-in implementation is used.
 */
 
 /*
@@ -151,6 +152,24 @@ int mail_cache_db_clean_up(struct mail_cache_db * cache_db,
 int mail_cache_db_get_keys(struct mail_cache_db * cache_db,
     chash * keys);
 
+/*
+  mail_cache_db_begin_batch()
+
+  This function starts a batch of changes. The changes made until
+  mail_cache_db_end_batch() are written to the file at once.
+  Batches can be nested.
+*/
+
+int mail_cache_db_begin_batch(struct mail_cache_db * cache_db);
+
+/*
+  mail_cache_db_end_batch()
+
+  This function ends a batch of changes and writes them to the file.
+*/
+
+int mail_cache_db_end_batch(struct mail_cache_db * cache_db);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,678 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2011 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include "mail_cache_db_log.h"
+
+#ifdef WIN32
+#	include "win_etpan.h"
+#else
+#	include <unistd.h>
+#	include <sys/mman.h>
+#endif
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mmapstring.h"
+
+/*
+  The file begins with LOG_MAGIC, followed by the records.
+  A record is the length of the key and the length of the value as
+  32 bits integers in host byte order, then the key and the value.
+  A deletion is a record without value, its value length is
+  LOG_DELETED.
+
+  Records are appended, a record that was not completely written
+  is removed when the file is opened.
+*/
+
+#define LOG_MAGIC "etpandb1"
+#define LOG_MAGIC_SIZE 8
+#define LOG_DELETED 0xffffffffU
+#define LOG_RECORD_HEADER_SIZE 8
+#define LOG_COMPACT_MIN_SIZE (64 * 1024)
+#define LOG_COPY_SIZE (64 * 1024)
+
+struct log_entry {
+  size_t value_offset;
+  size_t value_len;
+  size_t record_size;
+};
+
+struct mail_cache_db_log {
+  char * filename;
+  int fd;
+
+  char * mapping;
+  size_t mapping_size;
+
+  /* size of the data written to the file */
+  size_t written_size;
+  /* size of the records which are still in use */
+  size_t live_size;
+  /* records which are not written yet */
+  MMAPString * pending;
+
+  int batch_level;
+  int unsynced;
+
+  /* key -> struct log_entry */
+  chash * entries;
+};
+
+static int log_map(struct mail_cache_db_log * log)
+{
+  char * mapping;
+
+  if ((log->mapping != NULL) && (log->mapping_size == log->written_size))
+    return 0;
+
+  if (log->mapping != NULL) {
+    munmap(log->mapping, log->mapping_size);
+    log->mapping = NULL;
+    log->mapping_size = 0;
+  }
+
+  if (log->written_size == 0)
+    return 0;
+
+  mapping = mmap(NULL, log->written_size, PROT_READ, MAP_SHARED,
+      log->fd, 0);
+  if (mapping == (char *) MAP_FAILED)
+    return -1;
+
+  log->mapping = mapping;
+  log->mapping_size = log->written_size;
+
+  return 0;
+}
+
+static int write_all(int fd, const char * data, size_t len)
+{
+  while (len > 0) {
+    ssize_t written;
+
+    written = write(fd, data, len);
+    if (written <= 0)
+      return -1;
+
+    data += written;
+    len -= written;
+  }
+
+  return 0;
+}
+
+static int log_write_pending(struct mail_cache_db_log * log)
+{
+  int r;
+
+  if (log->pending->len == 0)
+    return 0;
+
+  if (lseek(log->fd, log->written_size, SEEK_SET) == (off_t) -1)
+    return -1;
+
+  r = write_all(log->fd, log->pending->str, log->pending->len);
+  if (r < 0) {
+    /* remove what could have been written */
+    r = ftruncate(log->fd, log->written_size);
+    return -1;
+  }
+
+  log->written_size += log->pending->len;
+  mmap_string_truncate(log->pending, 0);
+  log->unsynced = 1;
+
+  return 0;
+}
+
+static int log_sync(struct mail_cache_db_log * log)
+{
+  int r;
+
+  r = log_write_pending(log);
+  if (r < 0)
+    return -1;
+
+  if (log->unsynced) {
+    r = fsync(log->fd);
+    if (r < 0)
+      return -1;
+    log->unsynced = 0;
+  }
+
+  return 0;
+}
+
+/* called after a change, the change is written unless in a batch */
+
+static int log_commit(struct mail_cache_db_log * log)
+{
+  if (log->batch_level > 0)
+    return 0;
+
+  return log_sync(log);
+}
+
+static int log_append(struct mail_cache_db_log * log,
+    const void * key, size_t key_len, const void * value, uint32_t value_len,
+    struct log_entry * entry)
+{
+  uint32_t header[2];
+  size_t record_size;
+  size_t old_len;
+
+  header[0] = key_len;
+  header[1] = value_len;
+
+  record_size = LOG_RECORD_HEADER_SIZE + key_len;
+  if (value_len != LOG_DELETED)
+    record_size += value_len;
+
+  old_len = log->pending->len;
+  if (mmap_string_append_len(log->pending, (char *) header,
+          LOG_RECORD_HEADER_SIZE) == NULL)
+    goto err;
+  if (mmap_string_append_len(log->pending, key, key_len) == NULL)
+    goto err;
+  if (value_len != LOG_DELETED) {
+    if (mmap_string_append_len(log->pending, value, value_len) == NULL)
+      goto err;
+  }
+
+  entry->value_offset = log->written_size + old_len +
+    LOG_RECORD_HEADER_SIZE + key_len;
+  entry->value_len = value_len;
+  entry->record_size = record_size;
+
+  return 0;
+
+ err:
+  mmap_string_truncate(log->pending, old_len);
+  return -1;
+}
+
+/* updates the entries, value_len is LOG_DELETED to remove the key */
+
+static int log_set_entry(struct mail_cache_db_log * log,
+    const void * key, size_t key_len, struct log_entry * entry)
+{
+  chashdatum hash_key;
+  chashdatum hash_value;
+  int r;
+
+  hash_key.data = (void *) key;
+  hash_key.len = key_len;
+
+  r = chash_get(log->entries, &hash_key, &hash_value);
+  if (r == 0) {
+    struct log_entry * old_entry;
+
+    old_entry = hash_value.data;
+    log->live_size -= old_entry->record_size;
+
+    if (entry->value_len == LOG_DELETED) {
+      chash_delete(log->entries, &hash_key, NULL);
+    }
+    else {
+      * old_entry = * entry;
+      log->live_size += entry->record_size;
+    }
+
+    return 0;
+  }
+
+  if (entry->value_len == LOG_DELETED)
+    return 0;
+
+  hash_value.data = entry;
+  hash_value.len = sizeof(* entry);
+  r = chash_set(log->entries, &hash_key, &hash_value, NULL);
+  if (r < 0)
+    return -1;
+
+  log->live_size += entry->record_size;
+
+  return 0;
+}
+
+static int log_reset(struct mail_cache_db_log * log)
+{
+  int r;
+
+  r = ftruncate(log->fd, 0);
+  if (r < 0)
+    return -1;
+
+  log->written_size = 0;
+  if (mmap_string_append_len(log->pending, LOG_MAGIC, LOG_MAGIC_SIZE) == NULL)
+    return -1;
+
+  return log_sync(log);
+}
+
+static int log_load(struct mail_cache_db_log * log)
+{
+  struct stat stat_info;
+  size_t cur_token;
+  int r;
+
+  r = fstat(log->fd, &stat_info);
+  if (r < 0)
+    return -1;
+
+  log->written_size = stat_info.st_size;
+  r = log_map(log);
+  if (r < 0)
+    return -1;
+
+  /* a new file or one whose magic was never completely written */
+  if (log->written_size < LOG_MAGIC_SIZE) {
+    if ((log->written_size != 0) &&
+        (memcmp(log->mapping, LOG_MAGIC, log->written_size) != 0))
+      return -1;
+    return log_reset(log);
+  }
+
+  /* another format, it must not be overwritten */
+  if (memcmp(log->mapping, LOG_MAGIC, LOG_MAGIC_SIZE) != 0)
+    return -1;
+
+  cur_token = LOG_MAGIC_SIZE;
+  while (log->written_size - cur_token >= LOG_RECORD_HEADER_SIZE) {
+    uint32_t header[2];
+    struct log_entry entry;
+    size_t key_len;
+
+    memcpy(header, log->mapping + cur_token, LOG_RECORD_HEADER_SIZE);
+    key_len = header[0];
+
+    entry.value_offset = cur_token + LOG_RECORD_HEADER_SIZE + key_len;
+    entry.value_len = header[1];
+    entry.record_size = LOG_RECORD_HEADER_SIZE + key_len;
+    if (entry.value_len != LOG_DELETED)
+      entry.record_size += entry.value_len;
+
+    if (entry.record_size > log->written_size - cur_token)
+      break;
+
+    r = log_set_entry(log, log->mapping + cur_token + LOG_RECORD_HEADER_SIZE,
+        key_len, &entry);
+    if (r < 0)
+      return -1;
+
+    cur_token += entry.record_size;
+  }
+
+  if (cur_token != log->written_size) {
+    /* incomplete record */
+    r = ftruncate(log->fd, cur_token);
+    if (r < 0)
+      return -1;
+    log->written_size = cur_token;
+    r = log_map(log);
+    if (r < 0)
+      return -1;
+  }
+
+  return 0;
+}
+
+int mail_cache_db_log_open(const char * filename,
+    struct mail_cache_db_log ** plog)
+{
+  struct mail_cache_db_log * log;
+  int r;
+
+  log = malloc(sizeof(* log));
+  if (log == NULL)
+    goto err;
+
+  log->filename = strdup(filename);
+  if (log->filename == NULL)
+    goto free;
+
+  log->mapping = NULL;
+  log->mapping_size = 0;
+  log->written_size = 0;
+  log->live_size = 0;
+  log->batch_level = 0;
+  log->unsynced = 0;
+
+  log->pending = mmap_string_new("");
+  if (log->pending == NULL)
+    goto free_filename;
+
+  log->entries = chash_new(CHASH_DEFAULTSIZE, CHASH_COPYALL);
+  if (log->entries == NULL)
+    goto free_pending;
+
+  log->fd = open(filename, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+  if (log->fd < 0)
+    goto free_entries;
+
+  r = log_load(log);
+  if (r < 0)
+    goto close;
+
+  * plog = log;
+
+  return 0;
+
+ close:
+  if (log->mapping != NULL)
+    munmap(log->mapping, log->mapping_size);
+  close(log->fd);
+ free_entries:
+  chash_free(log->entries);
+ free_pending:
+  mmap_string_free(log->pending);
+ free_filename:
+  free(log->filename);
+ free:
+  free(log);
+ err:
+  return -1;
+}
+
+/* write the records in use to a new file which replaces the log */
+
+static int log_compact(struct mail_cache_db_log * log)
+{
+  char tmp_filename[PATH_MAX];
+  chashiter * iter;
+  MMAPString * buffer;
+  int fd;
+  int r;
+
+  r = snprintf(tmp_filename, sizeof(tmp_filename), "%sXXXXXX",
+      log->filename);
+  if ((r < 0) || ((size_t) r >= sizeof(tmp_filename)))
+    goto err;
+
+  r = log_map(log);
+  if (r < 0)
+    goto err;
+
+  buffer = mmap_string_new_len(LOG_MAGIC, LOG_MAGIC_SIZE);
+  if (buffer == NULL)
+    goto err;
+
+  fd = mkstemp(tmp_filename);
+  if (fd < 0)
+    goto free;
+
+  for(iter = chash_begin(log->entries) ; iter != NULL ;
+      iter = chash_next(log->entries, iter)) {
+    struct log_entry * entry;
+    chashdatum value;
+    size_t record_start;
+
+    chash_value(iter, &value);
+    entry = value.data;
+    record_start = entry->value_offset + entry->value_len -
+      entry->record_size;
+    if (mmap_string_append_len(buffer, log->mapping + record_start,
+            entry->record_size) == NULL)
+      goto close;
+
+    if (buffer->len >= LOG_COPY_SIZE) {
+      r = write_all(fd, buffer->str, buffer->len);
+      if (r < 0)
+        goto close;
+      mmap_string_truncate(buffer, 0);
+    }
+  }
+
+  r = write_all(fd, buffer->str, buffer->len);
+  if (r < 0)
+    goto close;
+
+  r = fsync(fd);
+  if (r < 0)
+    goto close;
+  close(fd);
+
+  r = rename(tmp_filename, log->filename);
+  if (r < 0)
+    goto unlink;
+
+  mmap_string_free(buffer);
+
+  return 0;
+
+ close:
+  close(fd);
+ unlink:
+  unlink(tmp_filename);
+ free:
+  mmap_string_free(buffer);
+ err:
+  return -1;
+}
+
+void mail_cache_db_log_close(struct mail_cache_db_log * log)
+{
+  int r;
+
+  r = log_sync(log);
+  if ((r == 0) && (log->written_size > LOG_COMPACT_MIN_SIZE) &&
+      (log->live_size < log->written_size / 2)) {
+    log_compact(log);
+  }
+
+  if (log->mapping != NULL)
+    munmap(log->mapping, log->mapping_size);
+  close(log->fd);
+  chash_free(log->entries);
+  mmap_string_free(log->pending);
+  free(log->filename);
+  free(log);
+}
+
+int mail_cache_db_log_put(struct mail_cache_db_log * log,
+    const void * key, size_t key_len, const void * value, size_t value_len)
+{
+  struct log_entry entry;
+  int r;
+
+  if (value_len >= LOG_DELETED)
+    return -1;
+
+  r = log_append(log, key, key_len, value, value_len, &entry);
+  if (r < 0)
+    return -1;
+
+  r = log_set_entry(log, key, key_len, &entry);
+  if (r < 0)
+    return -1;
+
+  return log_commit(log);
+}
+
+static struct log_entry * log_get_entry(struct mail_cache_db_log * log,
+    const void * key, size_t key_len)
+{
+  chashdatum hash_key;
+  chashdatum hash_value;
+  int r;
+
+  hash_key.data = (void *) key;
+  hash_key.len = key_len;
+
+  r = chash_get(log->entries, &hash_key, &hash_value);
+  if (r < 0)
+    return NULL;
+
+  return hash_value.data;
+}
+
+int mail_cache_db_log_get(struct mail_cache_db_log * log,
+    const void * key, size_t key_len, void ** pvalue, size_t * pvalue_len)
+{
+  struct log_entry * entry;
+  int r;
+
+  entry = log_get_entry(log, key, key_len);
+  if (entry == NULL)
+    return -1;
+
+  /* value written in the current batch */
+  if (entry->value_offset + entry->value_len > log->written_size) {
+    r = log_write_pending(log);
+    if (r < 0)
+      return -1;
+  }
+
+  r = log_map(log);
+  if (r < 0)
+    return -1;
+
+  * pvalue = log->mapping + entry->value_offset;
+  * pvalue_len = entry->value_len;
+
+  return 0;
+}
+
+int mail_cache_db_log_get_size(struct mail_cache_db_log * log,
+    const void * key, size_t key_len, size_t * pvalue_len)
+{
+  struct log_entry * entry;
+
+  entry = log_get_entry(log, key, key_len);
+  if (entry == NULL)
+    return -1;
+
+  * pvalue_len = entry->value_len;
+
+  return 0;
+}
+
+static int log_del(struct mail_cache_db_log * log,
+    const void * key, size_t key_len)
+{
+  struct log_entry entry;
+  int r;
+
+  r = log_append(log, key, key_len, NULL, LOG_DELETED, &entry);
+  if (r < 0)
+    return -1;
+
+  return log_set_entry(log, key, key_len, &entry);
+}
+
+int mail_cache_db_log_del(struct mail_cache_db_log * log,
+    const void * key, size_t key_len)
+{
+  int r;
+
+  if (log_get_entry(log, key, key_len) == NULL)
+    return -1;
+
+  r = log_del(log, key, key_len);
+  if (r < 0)
+    return -1;
+
+  return log_commit(log);
+}
+
+int mail_cache_db_log_clean_up(struct mail_cache_db_log * log,
+    chash * exist)
+{
+  chashiter * iter;
+  chashiter * next;
+  int r;
+
+  for(iter = chash_begin(log->entries) ; iter != NULL ; iter = next) {
+    chashdatum hash_key;
+    chashdatum hash_value;
+
+    next = chash_next(log->entries, iter);
+
+    chash_key(iter, &hash_key);
+    r = chash_get(exist, &hash_key, &hash_value);
+    if (r < 0) {
+      r = log_del(log, hash_key.data, hash_key.len);
+      if (r < 0)
+        return -1;
+    }
+  }
+
+  return log_commit(log);
+}
+
+int mail_cache_db_log_get_keys(struct mail_cache_db_log * log,
+    chash * keys)
+{
+  chashiter * iter;
+  int r;
+
+  for(iter = chash_begin(log->entries) ; iter != NULL ;
+      iter = chash_next(log->entries, iter)) {
+    chashdatum hash_key;
+    chashdatum hash_value;
+
+    chash_key(iter, &hash_key);
+    hash_value.data = NULL;
+    hash_value.len = 0;
+
+    r = chash_set(keys, &hash_key, &hash_value, NULL);
+    if (r < 0)
+      return -1;
+  }
+
+  return 0;
+}
+
+int mail_cache_db_log_begin_batch(struct mail_cache_db_log * log)
+{
+  log->batch_level ++;
+
+  return 0;
+}
+
+int mail_cache_db_log_end_batch(struct mail_cache_db_log * log)
+{
+  if (log->batch_level == 0)
+    return -1;
+
+  log->batch_level --;
+
+  return log_commit(log);
+}
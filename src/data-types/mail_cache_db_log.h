@@ -0,0 +1,86 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2011 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MAIL_CACHE_DB_LOG_H
+
+#define MAIL_CACHE_DB_LOG_H
+
+#include <sys/types.h>
+#include "chash.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+  built-in implementation of mail_cache_db, used when Berkeley DB
+  is not available.
+
+  The file is a log of records, a record is either a key and its
+  value or the deletion of a key. The offsets of the live values
+  are kept in memory and the file is compacted when it is closed
+  if most of it is no longer used.
+*/
+
+struct mail_cache_db_log;
+
+int mail_cache_db_log_open(const char * filename,
+    struct mail_cache_db_log ** plog);
+
+void mail_cache_db_log_close(struct mail_cache_db_log * log);
+
+int mail_cache_db_log_put(struct mail_cache_db_log * log,
+    const void * key, size_t key_len, const void * value, size_t value_len);
+
+int mail_cache_db_log_get(struct mail_cache_db_log * log,
+    const void * key, size_t key_len, void ** pvalue, size_t * pvalue_len);
+
+int mail_cache_db_log_get_size(struct mail_cache_db_log * log,
+    const void * key, size_t key_len, size_t * pvalue_len);
+
+int mail_cache_db_log_del(struct mail_cache_db_log * log,
+    const void * key, size_t key_len);
+
+int mail_cache_db_log_clean_up(struct mail_cache_db_log * log,
+    chash * exist);
+
+int mail_cache_db_log_get_keys(struct mail_cache_db_log * log,
+    chash * keys);
+
+int mail_cache_db_log_begin_batch(struct mail_cache_db_log * log);
+
+int mail_cache_db_log_end_batch(struct mail_cache_db_log * log);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
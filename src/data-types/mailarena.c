@@ -0,0 +1,321 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2011 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include "mailarena.h"
+#include "mailarena_private.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef LIBETPAN_REENTRANT
+#	if HAVE_PTHREAD_H
+#		include <pthread.h>
+#	elif !defined (WIN32)
+#		error "What are your threads?"
+#	endif
+#endif
+
+/*
+  The memory of an arena is a list of chunks, allocations are taken
+  from the first chunk. When it is full, a new chunk, twice as big
+  as the previous one, is put in front of the list.
+  Allocations larger than a quarter of a chunk get a chunk of their
+  own, placed after the first chunk so that it can still be used.
+*/
+
+#define ARENA_FIRST_CHUNK_SIZE 4096
+#define ARENA_MAX_CHUNK_SIZE (1024 * 1024)
+
+union arena_align {
+  void * p;
+  long l;
+  double d;
+};
+
+#define ARENA_ALIGN sizeof(union arena_align)
+#define ARENA_ROUND(size) (((size) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+struct arena_chunk {
+  struct arena_chunk * next;
+  char * data;
+  size_t size;
+  size_t used;
+};
+
+#define ARENA_CHUNK_HEADER_SIZE ARENA_ROUND(sizeof(struct arena_chunk))
+
+struct mailarena {
+  struct arena_chunk * chunks;
+  size_t next_chunk_size;
+  /* last allocation of the first chunk, it can be given back */
+  char * last;
+};
+
+#ifdef LIBETPAN_REENTRANT
+#	if HAVE_PTHREAD_H
+static pthread_once_t current_arena_once = PTHREAD_ONCE_INIT;
+static pthread_key_t current_arena_key;
+
+static void current_arena_key_init(void)
+{
+  pthread_key_create(&current_arena_key, NULL);
+}
+
+static struct mailarena * get_current_arena(void)
+{
+  pthread_once(&current_arena_once, current_arena_key_init);
+  return pthread_getspecific(current_arena_key);
+}
+
+static void set_current_arena(struct mailarena * arena)
+{
+  pthread_once(&current_arena_once, current_arena_key_init);
+  pthread_setspecific(current_arena_key, arena);
+}
+#	else
+static __declspec(thread) struct mailarena * current_arena = NULL;
+#		define get_current_arena() (current_arena)
+#		define set_current_arena(arena) (current_arena = (arena))
+#	endif
+#else
+static struct mailarena * current_arena = NULL;
+#	define get_current_arena() (current_arena)
+#	define set_current_arena(arena) (current_arena = (arena))
+#endif
+
+/*
+  whether an arena has ever been the current arena, the allocations
+  go straight to malloc() until then.
+*/
+
+static int arena_used = 0;
+
+static struct arena_chunk * arena_chunk_new(size_t size)
+{
+  struct arena_chunk * chunk;
+
+  chunk = malloc(ARENA_CHUNK_HEADER_SIZE + size);
+  if (chunk == NULL)
+    return NULL;
+
+  chunk->next = NULL;
+  chunk->data = (char *) chunk + ARENA_CHUNK_HEADER_SIZE;
+  chunk->size = size;
+  chunk->used = 0;
+
+  return chunk;
+}
+
+struct mailarena * mailarena_new(void)
+{
+  struct mailarena * arena;
+
+  arena = malloc(sizeof(* arena));
+  if (arena == NULL)
+    return NULL;
+
+  arena->chunks = NULL;
+  arena->next_chunk_size = ARENA_FIRST_CHUNK_SIZE;
+  arena->last = NULL;
+
+  return arena;
+}
+
+void mailarena_free(struct mailarena * arena)
+{
+  struct arena_chunk * chunk;
+  struct arena_chunk * next;
+
+  if (get_current_arena() == arena)
+    set_current_arena(NULL);
+
+  for(chunk = arena->chunks ; chunk != NULL ; chunk = next) {
+    next = chunk->next;
+    free(chunk);
+  }
+  free(arena);
+}
+
+struct mailarena * mailarena_set_current(struct mailarena * arena)
+{
+  struct mailarena * previous;
+
+  if (arena != NULL)
+    arena_used = 1;
+
+  previous = get_current_arena();
+  set_current_arena(arena);
+
+  return previous;
+}
+
+struct mailarena * mailarena_get_current(void)
+{
+  if (!arena_used)
+    return NULL;
+
+  return get_current_arena();
+}
+
+static void * arena_alloc(struct mailarena * arena, size_t size)
+{
+  struct arena_chunk * chunk;
+  char * data;
+
+  size = ARENA_ROUND(size);
+  if (size == 0)
+    size = ARENA_ALIGN;
+
+  chunk = arena->chunks;
+  if ((chunk == NULL) || (chunk->size - chunk->used < size)) {
+    if ((chunk != NULL) && (size > arena->next_chunk_size / 4)) {
+      /* large allocation */
+      chunk = arena_chunk_new(size);
+      if (chunk == NULL)
+        return NULL;
+      chunk->used = size;
+      chunk->next = arena->chunks->next;
+      arena->chunks->next = chunk;
+
+      return chunk->data;
+    }
+
+    while (arena->next_chunk_size < size)
+      arena->next_chunk_size *= 2;
+
+    chunk = arena_chunk_new(arena->next_chunk_size);
+    if (chunk == NULL)
+      return NULL;
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    arena->last = NULL;
+
+    if (arena->next_chunk_size < ARENA_MAX_CHUNK_SIZE)
+      arena->next_chunk_size *= 2;
+  }
+
+  data = chunk->data + chunk->used;
+  chunk->used += size;
+  arena->last = data;
+
+  return data;
+}
+
+static int arena_contains(struct mailarena * arena, void * ptr)
+{
+  struct arena_chunk * chunk;
+
+  for(chunk = arena->chunks ; chunk != NULL ; chunk = chunk->next) {
+    if (((char *) ptr >= chunk->data) &&
+        ((char *) ptr < chunk->data + chunk->size))
+      return 1;
+  }
+
+  return 0;
+}
+
+void * mailarena_malloc(size_t size)
+{
+  struct mailarena * arena;
+
+  arena = mailarena_get_current();
+  if (arena == NULL)
+    return malloc(size);
+
+  return arena_alloc(arena, size);
+}
+
+char * mailarena_strdup(const char * str)
+{
+  struct mailarena * arena;
+  size_t len;
+  char * dup;
+
+  arena = mailarena_get_current();
+  if (arena == NULL)
+    return strdup(str);
+
+  len = strlen(str) + 1;
+  dup = arena_alloc(arena, len);
+  if (dup == NULL)
+    return NULL;
+  memcpy(dup, str, len);
+
+  return dup;
+}
+
+char * mailarena_strndup(const char * str, size_t length)
+{
+  struct mailarena * arena;
+  char * dup;
+
+  arena = mailarena_get_current();
+  if (arena == NULL)
+    return strndup(str, length);
+
+  length = strnlen(str, length);
+  dup = arena_alloc(arena, length + 1);
+  if (dup == NULL)
+    return NULL;
+  memcpy(dup, str, length);
+  dup[length] = '\0';
+
+  return dup;
+}
+
+void mailarena_release(void * ptr)
+{
+  struct mailarena * arena;
+
+  arena = mailarena_get_current();
+  if (arena == NULL) {
+    free(ptr);
+    return;
+  }
+
+  if (ptr == NULL)
+    return;
+
+  if (ptr == arena->last) {
+    /* the parsers often free what they have just allocated
+       when they backtrack */
+    arena->chunks->used = (char *) ptr - arena->chunks->data;
+    arena->last = NULL;
+    return;
+  }
+
+  if (!arena_contains(arena, ptr))
+    free(ptr);
+}
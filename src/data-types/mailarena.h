@@ -0,0 +1,90 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2011 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MAILARENA_H
+
+#define MAILARENA_H
+
+#ifndef LIBETPAN_CONFIG_H
+#	include <libetpan/libetpan-config.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+  An arena is a region of memory where the parsers of libetpan can
+  allocate the trees they build.
+
+  When an arena is the current arena of the thread, the structures
+  allocated by mailimf (header parsing), mailmime (MIME parsing) and
+  clist come from the arena. They are not released one by one but
+  all at once by mailarena_free().
+
+    arena = mailarena_new();
+    previous = mailarena_set_current(arena);
+    r = mailmime_parse(message, length, &indx, &mime);
+    mailarena_set_current(previous);
+    ...
+    mailarena_free(arena);
+
+  A tree allocated in an arena must not be freed with the *_free()
+  functions unless the arena is the current arena, in which case
+  they do nothing. Other data must not be attached to the tree or
+  taken from it.
+*/
+
+struct mailarena;
+
+LIBETPAN_EXPORT
+struct mailarena * mailarena_new(void);
+
+LIBETPAN_EXPORT
+void mailarena_free(struct mailarena * arena);
+
+/*
+  mailarena_set_current() sets the arena where the structures are
+  allocated by the current thread, NULL to use malloc() again.
+  The previous current arena is returned.
+*/
+
+LIBETPAN_EXPORT
+struct mailarena * mailarena_set_current(struct mailarena * arena);
+
+LIBETPAN_EXPORT
+struct mailarena * mailarena_get_current(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -49,6 +49,9 @@
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#ifndef WIN32
+#	include <poll.h>
+#endif
 
 #define DEFAULT_NETWORK_TIMEOUT 300
 
@@ -340,10 +343,17 @@ int mailstream_wait_idle(mailstream * s, int max_idle_delay)
   int fd;
   int idle_fd;
   int cancel_fd;
+  int r;
+  int has_data;
+  int interrupted;
+  int cancelled;
+#ifdef WIN32
   int maxfd;
   fd_set readfds;
   struct timeval delay;
-  int r;
+#else
+  struct pollfd pfd[3];
+#endif
   
   if (s->low->driver == mailstream_cfstream_driver) {
     return mailstream_cfstream_wait_idle(s, max_idle_delay);
@@ -359,6 +369,7 @@ int mailstream_wait_idle(mailstream * s, int max_idle_delay)
   idle_fd = mailstream_cancel_get_fd(s->idle);
   cancel_fd = mailstream_cancel_get_fd(mailstream_low_get_cancel(mailstream_get_low(s)));
   
+#ifdef WIN32
   FD_ZERO(&readfds);
   FD_SET(fd, &readfds);
   FD_SET(idle_fd, &readfds);
@@ -374,6 +385,26 @@ int mailstream_wait_idle(mailstream * s, int max_idle_delay)
   delay.tv_usec = 0;
   
   r = select(maxfd + 1, &readfds, NULL, NULL, &delay);
+  has_data = (r > 0) && FD_ISSET(fd, &readfds);
+  interrupted = (r > 0) && FD_ISSET(idle_fd, &readfds);
+  cancelled = (r > 0) && FD_ISSET(cancel_fd, &readfds);
+#else
+  pfd[0].fd = fd;
+  pfd[0].events = POLLIN;
+  pfd[0].revents = 0;
+  pfd[1].fd = idle_fd;
+  pfd[1].events = POLLIN;
+  pfd[1].revents = 0;
+  pfd[2].fd = cancel_fd;
+  pfd[2].events = POLLIN;
+  pfd[2].revents = 0;
+  
+  r = poll(pfd, 3, max_idle_delay * 1000);
+  /* a hang up will be reported by the next read */
+  has_data = (pfd[0].revents & (POLLIN | POLLHUP | POLLERR)) != 0;
+  interrupted = (pfd[1].revents & POLLIN) != 0;
+  cancelled = (pfd[2].revents & POLLIN) != 0;
+#endif
   if (r == 0) {
     // timeout
     return MAILSTREAM_IDLE_TIMEOUT;
@@ -383,16 +414,16 @@ int mailstream_wait_idle(mailstream * s, int max_idle_delay)
     return MAILSTREAM_IDLE_ERROR;
   }
   else {
-    if (FD_ISSET(fd, &readfds)) {
+    if (has_data) {
       // has something on socket
       return MAILSTREAM_IDLE_HASDATA;
     }
-    if (FD_ISSET(idle_fd, &readfds)) {
+    if (interrupted) {
       // idle interrupted
       mailstream_cancel_ack(s->idle);
       return MAILSTREAM_IDLE_INTERRUPTED;
     }
-    if (FD_ISSET(cancel_fd, &readfds)) {
+    if (cancelled) {
       // idle cancelled
       mailstream_cancel_ack(mailstream_low_get_cancel(mailstream_get_low(s)));
       return MAILSTREAM_IDLE_CANCELLED;
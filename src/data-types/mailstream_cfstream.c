@@ -138,6 +138,7 @@ static mailstream_low_driver local_mailstream_cfstream_driver = {
   /* mailstream_free */ mailstream_low_cfstream_free,
   /* mailstream_cancel */ mailstream_low_cfstream_cancel,
   /* mailstream_get_cancel_fd */ NULL,
+  /* mailstream_set_nonblocking */ NULL,
 };
 
 mailstream_low_driver * mailstream_cfstream_driver =
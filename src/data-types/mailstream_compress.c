@@ -0,0 +1,334 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2005 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include "mailstream_compress.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_ZLIB
+#	include <zlib.h>
+#endif
+
+#include "mailstream_low.h"
+#include "mmapstring.h"
+#include "mail.h"
+
+#ifdef HAVE_ZLIB
+
+#define COMPRESS_BUFFER_SIZE 8192
+
+struct mailstream_compress_data {
+  mailstream_low * ms;
+
+  z_stream inflate_stream;
+  char inflate_buffer[COMPRESS_BUFFER_SIZE];
+  /* the last call filled the output, zlib may hold more */
+  int inflate_pending;
+
+  z_stream deflate_stream;
+  char deflate_buffer[COMPRESS_BUFFER_SIZE];
+  /* compressed data not sent yet in non-blocking mode */
+  MMAPString * deflate_pending;
+  size_t deflate_pending_pos;
+  /* size of the data given by the caller it was made from */
+  size_t deflate_pending_count;
+};
+
+static ssize_t mailstream_low_compress_read(mailstream_low * s,
+    void * buf, size_t count);
+static ssize_t mailstream_low_compress_write(mailstream_low * s,
+    const void * buf, size_t count);
+static int mailstream_low_compress_close(mailstream_low * s);
+static int mailstream_low_compress_get_fd(mailstream_low * s);
+static void mailstream_low_compress_free(mailstream_low * s);
+static void mailstream_low_compress_cancel(mailstream_low * s);
+static struct mailstream_cancel * mailstream_low_compress_get_cancel(mailstream_low * s);
+static int mailstream_low_compress_set_nonblocking(mailstream_low * s, int nonblocking);
+
+static mailstream_low_driver local_mailstream_compress_driver = {
+  /* mailstream_read */ mailstream_low_compress_read,
+  /* mailstream_write */ mailstream_low_compress_write,
+  /* mailstream_close */ mailstream_low_compress_close,
+  /* mailstream_get_fd */ mailstream_low_compress_get_fd,
+  /* mailstream_free */ mailstream_low_compress_free,
+  /* mailstream_cancel */ mailstream_low_compress_cancel,
+  /* mailstream_get_cancel */ mailstream_low_compress_get_cancel,
+  /* mailstream_set_nonblocking */ mailstream_low_compress_set_nonblocking,
+};
+
+mailstream_low_driver * mailstream_compress_driver =
+&local_mailstream_compress_driver;
+
+mailstream_low * mailstream_low_compress_open(mailstream_low * ms)
+{
+  struct mailstream_compress_data * compress_data;
+  mailstream_low * s;
+  int r;
+
+  compress_data = malloc(sizeof(* compress_data));
+  if (compress_data == NULL)
+    goto err;
+
+  compress_data->ms = ms;
+  compress_data->inflate_pending = 0;
+  compress_data->deflate_pending_pos = 0;
+  compress_data->deflate_pending_count = 0;
+
+  compress_data->deflate_pending = mmap_string_new("");
+  if (compress_data->deflate_pending == NULL)
+    goto free;
+
+  memset(&compress_data->inflate_stream, 0, sizeof(compress_data->inflate_stream));
+  /* negative window bits : raw deflate, without zlib header */
+  r = inflateInit2(&compress_data->inflate_stream, -15);
+  if (r != Z_OK)
+    goto free_pending;
+
+  memset(&compress_data->deflate_stream, 0, sizeof(compress_data->deflate_stream));
+  r = deflateInit2(&compress_data->deflate_stream, Z_DEFAULT_COMPRESSION,
+      Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+  if (r != Z_OK)
+    goto free_inflate;
+
+  s = mailstream_low_new(compress_data, mailstream_compress_driver);
+  if (s == NULL)
+    goto free_deflate;
+
+  return s;
+
+ free_deflate:
+  deflateEnd(&compress_data->deflate_stream);
+ free_inflate:
+  inflateEnd(&compress_data->inflate_stream);
+ free_pending:
+  mmap_string_free(compress_data->deflate_pending);
+ free:
+  free(compress_data);
+ err:
+  return NULL;
+}
+
+static ssize_t mailstream_low_compress_read(mailstream_low * s,
+    void * buf, size_t count)
+{
+  struct mailstream_compress_data * compress_data;
+  z_stream * strm;
+
+  compress_data = s->data;
+  strm = &compress_data->inflate_stream;
+
+  while (1) {
+    if ((strm->avail_in > 0) || compress_data->inflate_pending) {
+      size_t produced;
+      int r;
+
+      strm->next_out = buf;
+      strm->avail_out = count;
+      r = inflate(strm, Z_SYNC_FLUSH);
+      if ((r != Z_OK) && (r != Z_BUF_ERROR) && (r != Z_STREAM_END))
+        return -1;
+
+      produced = count - strm->avail_out;
+      compress_data->inflate_pending = (strm->avail_out == 0);
+      if (produced > 0)
+        return produced;
+      if (r == Z_STREAM_END)
+        return 0;
+    }
+
+    /* in non-blocking mode, -1 and errno are given back to the caller */
+    {
+      ssize_t r;
+
+      r = mailstream_low_read(compress_data->ms,
+          compress_data->inflate_buffer, sizeof(compress_data->inflate_buffer));
+      if (r <= 0)
+        return r;
+
+      strm->next_in = (Bytef *) compress_data->inflate_buffer;
+      strm->avail_in = r;
+    }
+  }
+}
+
+/*
+  compressed data is written out entirely, so that the peer can
+  decompress a whole command as soon as it is flushed.
+
+  In non-blocking mode, what could not be sent is kept and -1 is
+  returned with errno set to EAGAIN. As with SSL, the caller must then
+  write the same data again once the stream is writable: the pending
+  compressed data is sent and the size of the data is returned.
+*/
+
+static int compress_flush_pending(struct mailstream_compress_data * compress_data)
+{
+  MMAPString * pending;
+
+  pending = compress_data->deflate_pending;
+  while (compress_data->deflate_pending_pos < pending->len) {
+    ssize_t r;
+
+    r = mailstream_low_write(compress_data->ms,
+        pending->str + compress_data->deflate_pending_pos,
+        pending->len - compress_data->deflate_pending_pos);
+    /*
+      errno tells EAGAIN in non-blocking mode, the pending data is
+      then kept. In blocking mode, the stream already waited with its
+      timeout, a timeout or a cancel is not retried.
+    */
+    if (r <= 0)
+      return -1;
+
+    compress_data->deflate_pending_pos += r;
+  }
+
+  mmap_string_truncate(pending, 0);
+  compress_data->deflate_pending_pos = 0;
+
+  return 0;
+}
+
+static ssize_t mailstream_low_compress_write(mailstream_low * s,
+    const void * buf, size_t count)
+{
+  struct mailstream_compress_data * compress_data;
+  z_stream * strm;
+  size_t written;
+
+  compress_data = s->data;
+  strm = &compress_data->deflate_stream;
+
+  /* the data of the previous call was already compressed */
+  if (compress_data->deflate_pending->len > 0) {
+    if (compress_flush_pending(compress_data) < 0)
+      return -1;
+
+    written = compress_data->deflate_pending_count;
+    compress_data->deflate_pending_count = 0;
+    return written;
+  }
+
+  strm->next_in = (Bytef *) buf;
+  strm->avail_in = count;
+  do {
+    size_t len;
+    int r;
+
+    strm->next_out = (Bytef *) compress_data->deflate_buffer;
+    strm->avail_out = sizeof(compress_data->deflate_buffer);
+    r = deflate(strm, Z_SYNC_FLUSH);
+    if ((r != Z_OK) && (r != Z_BUF_ERROR))
+      return -1;
+
+    len = sizeof(compress_data->deflate_buffer) - strm->avail_out;
+    if (mmap_string_append_len(compress_data->deflate_pending,
+            compress_data->deflate_buffer, len) == NULL)
+      return -1;
+  } while ((strm->avail_in > 0) || (strm->avail_out == 0));
+
+  compress_data->deflate_pending_count = count;
+  if (compress_flush_pending(compress_data) < 0)
+    return -1;
+  compress_data->deflate_pending_count = 0;
+
+  return count;
+}
+
+static int mailstream_low_compress_close(mailstream_low * s)
+{
+  struct mailstream_compress_data * compress_data;
+
+  compress_data = s->data;
+  return mailstream_low_close(compress_data->ms);
+}
+
+static int mailstream_low_compress_get_fd(mailstream_low * s)
+{
+  struct mailstream_compress_data * compress_data;
+
+  compress_data = s->data;
+  return mailstream_low_get_fd(compress_data->ms);
+}
+
+static void mailstream_low_compress_free(mailstream_low * s)
+{
+  struct mailstream_compress_data * compress_data;
+
+  compress_data = s->data;
+  mailstream_low_free(compress_data->ms);
+  inflateEnd(&compress_data->inflate_stream);
+  deflateEnd(&compress_data->deflate_stream);
+  mmap_string_free(compress_data->deflate_pending);
+  free(compress_data);
+  free(s);
+}
+
+static void mailstream_low_compress_cancel(mailstream_low * s)
+{
+  struct mailstream_compress_data * compress_data;
+
+  compress_data = s->data;
+  mailstream_low_cancel(compress_data->ms);
+}
+
+static struct mailstream_cancel * mailstream_low_compress_get_cancel(mailstream_low * s)
+{
+  struct mailstream_compress_data * compress_data;
+
+  compress_data = s->data;
+  return mailstream_low_get_cancel(compress_data->ms);
+}
+
+static int mailstream_low_compress_set_nonblocking(mailstream_low * s, int nonblocking)
+{
+  struct mailstream_compress_data * compress_data;
+
+  compress_data = s->data;
+  return mailstream_low_set_nonblocking(compress_data->ms, nonblocking);
+}
+
+#else
+
+mailstream_low_driver * mailstream_compress_driver = NULL;
+
+mailstream_low * mailstream_low_compress_open(mailstream_low * ms)
+{
+  UNUSED(ms);
+  return NULL;
+}
+
+#endif
@@ -0,0 +1,63 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2005 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MAILSTREAM_COMPRESS_H
+
+#define MAILSTREAM_COMPRESS_H
+
+#include <libetpan/mailstream.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+  deflate compression layer (RFC 1951 raw deflate, as used by
+  IMAP COMPRESS=DEFLATE, RFC 4978)
+
+  mailstream_low_compress_open() returns a low stream that compresses
+  what is written to ms and decompresses what is read from it. It takes
+  ownership of ms. It can be installed on an existing stream with
+  mailstream_set_low() once the protocol has negotiated compression.
+
+  NULL is returned if libetpan was built without zlib.
+*/
+
+extern mailstream_low_driver * mailstream_compress_driver;
+
+LIBETPAN_EXPORT
+mailstream_low * mailstream_low_compress_open(mailstream_low * ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -62,17 +62,20 @@ char * mailstream_read_line(mailstream * stream, MMAPString * line)
   return mailstream_read_line_append(stream, line);
 }
 
-static char * mailstream_read_len_append(mailstream * stream,
-					 MMAPString * line,
-					 size_t i)
-{
-  size_t cur_size;
+/* append count bytes of the read buffer to line and remove them from the buffer */
 
-  cur_size = line->len;
-  if (mmap_string_set_size(line, line->len + i) == NULL)
-    return NULL;
-  if (mailstream_read(stream, line->str + cur_size, i) < 0)
+static char * mailstream_read_buffer_append(mailstream * stream,
+					    MMAPString * line,
+					    size_t count)
+{
+  if (mmap_string_append_len(line, stream->read_buffer, count) == NULL)
     return NULL;
+
+  stream->read_buffer_len -= count;
+  if (stream->read_buffer_len != 0)
+    memmove(stream->read_buffer, stream->read_buffer + count,
+	    stream->read_buffer_len);
+
   return line->str;
 }
 
@@ -83,16 +86,14 @@ char * mailstream_read_line_append(mailstream * stream, MMAPString * line)
 
   do {
     if (stream->read_buffer_len > 0) {
-      size_t i;
-
-      i = 0;
-      while (i < stream->read_buffer_len) {
-        if (stream->read_buffer[i] == '\n')
-          return mailstream_read_len_append(stream, line, i + 1);
-        i++;
-      }
-      if (mailstream_read_len_append(stream, line,
-				     stream->read_buffer_len) == NULL)
+      char * eol;
+
+      eol = memchr(stream->read_buffer, '\n', stream->read_buffer_len);
+      if (eol != NULL)
+        return mailstream_read_buffer_append(stream, line,
+					     eol - stream->read_buffer + 1);
+      if (mailstream_read_buffer_append(stream, line,
+					stream->read_buffer_len) == NULL)
         return NULL;
     }
     else {
@@ -230,11 +231,11 @@ char * mailstream_read_multiline(mailstream * stream, size_t size,
       i = 0;
       while (i < stream->read_buffer_len) {
 	if (end_of_multiline(stream->read_buffer, i + 1))
-	  return mailstream_read_len_append(stream, line, i + 1);
+	  return mailstream_read_buffer_append(stream, line, i + 1);
 	i++;
       }
-      if (mailstream_read_len_append(stream, line,
-				     stream->read_buffer_len) == NULL)
+      if (mailstream_read_buffer_append(stream, line,
+					stream->read_buffer_len) == NULL)
 	return NULL;
       if (end_of_multiline(line->str, line->len))
 	return line->str;
@@ -251,100 +252,49 @@ char * mailstream_read_multiline(mailstream * stream, size_t size,
 
 
 
-static inline ssize_t send_data_line(mailstream * s,
-    const char * line, size_t length)
-{
-  int fix_eol;
-  const char * start;
-  size_t count;
-
-  start = line;
-
-  fix_eol = 0;
-  count = 0;
-
-  while (1) {
-    if (length == 0)
-      break;
-
-    if (* line == '\r') {
-      line ++;
-
-      count ++;
-      length --;
-
-      if (length == 0) {
-        fix_eol = 1;
-        break;
-      }
-      
-      if (* line == '\n') {
-	line ++;
-
-	count ++;
-	length --;
-	
-	break;
-      }
-      else {
-        fix_eol = 1;
-        break;
-      }
-    }
-    else if (* line == '\n') {
-      line ++;
-
-      count ++;
-      length --;
+/*
+  get_line_length() returns the length of the line at the beginning of
+  data, including its line break.
+  fix_eol is set when the line break is a bare CR or a bare LF. It is
+  then the last byte of the line and has to be replaced with CRLF.
+*/
 
-      fix_eol = 1;
+static inline size_t get_line_length(const char * data, size_t length,
+    int * p_fix_eol)
+{
+  const char * cur;
+  const char * end;
+
+  /*
+    both line ends are looked for in a single pass, a search for one
+    over the whole buffer would be quadratic on data without the other.
+  */
+  end = data + length;
+  for(cur = data ; cur < end ; cur ++) {
+    if ((* cur == '\r') || (* cur == '\n'))
       break;
-    }
-
-    line ++;
-    length --;
-    count ++;
   }
 
-  if (fix_eol) {
-    if (mailstream_write(s, start, count - 1) == -1)
-      goto err;
-    if (mailstream_write(s, "\r\n", 2) == -1)
-      goto err;
-  }
-  else {
-    if (mailstream_write(s, start, count) == -1)
-      goto err;
+  if (cur == end) {
+    * p_fix_eol = 0;
+    return length;
   }
-  
 
-#if 0
-  while (* line != '\n') {
-    if (* line == '\r')
-      pos = line;
-    if (* line == '\0')
-      return line;
-    if (mailstream_write(s, line, 1) == -1)
-      goto err;
-    line ++;
+  if ((* cur == '\r') && (cur + 1 < end) && (cur[1] == '\n')) {
+    * p_fix_eol = 0;
+    return cur - data + 2;
   }
-  if (pos + 1 == line) {
-    if (mailstream_write(s, line, 1) == -1)
-      goto err;
-  }
-  else {
-    if (mailstream_write(s, "\r\n", 2) == -1)
-      goto err;
-  }
-  line ++;
-#endif
 
-  return count;
-  
- err:
-  return -1;
+  * p_fix_eol = 1;
+  return cur - data + 1;
 }
 
+/*
+  Data that needs no change is sent as a whole run,
+  a write is only done to fix a line break, to quote a '.'
+  or before reporting progress.
+*/
+
 static inline int send_data_crlf_progress(mailstream * s, const char * message,
                                           size_t size,
                                           int quoted,
@@ -354,6 +304,7 @@ static inline int send_data_crlf_progress(mailstream * s, const char * message,
                                           void * context)
 {
   const char * current;
+  const char * run_begin;
   size_t count;
   size_t last;
   size_t remaining;
@@ -362,26 +313,43 @@ static inline int send_data_crlf_progress(mailstream * s, const char * message,
   last = 0;
 
   current = message;
+  run_begin = message;
   remaining = size;
 
   while (remaining > 0) {
-    ssize_t length;
+    size_t length;
+    int fix_eol;
     
     if (quoted) {
-      if (current[0] == '.')
+      if (current[0] == '.') {
+        if (mailstream_write(s, run_begin, current - run_begin) == -1)
+          goto err;
+        run_begin = current;
         if (mailstream_write(s, ".", 1) == -1)
           goto err;
+      }
     }
     
-    length = send_data_line(s, current, remaining);
-    if (length < 0)
-      goto err;
+    length = get_line_length(current, remaining, &fix_eol);
 
     current += length;
+    remaining -= length;
+
+    if (fix_eol) {
+      if (mailstream_write(s, run_begin, current - 1 - run_begin) == -1)
+        goto err;
+      if (mailstream_write(s, "\r\n", 2) == -1)
+        goto err;
+      run_begin = current;
+    }
 
     count += length;
     if (progr_rate != 0) {
       if (count - last >= progr_rate) {
+        if (mailstream_write(s, run_begin, current - run_begin) == -1)
+          goto err;
+        run_begin = current;
+
         if (progr_fun != NULL) {
           (* progr_fun)(count, size);
         }
@@ -391,10 +359,11 @@ static inline int send_data_crlf_progress(mailstream * s, const char * message,
         last = count;
       }
     }
-    
-    remaining -= length;
   }
   
+  if (mailstream_write(s, run_begin, current - run_begin) == -1)
+    goto err;
+
   return 0;
   
  err:
@@ -484,87 +453,103 @@ int mailstream_send_data_with_context(mailstream * s, const char * message,
                                        progr_fun, context);
 }
 
-static inline ssize_t get_data_size(const char * line, size_t length,
-    size_t * result)
+/*
+  mailstream_send_data_crlf_partial() writes data that is given in several
+  parts, as mailstream_send_data_crlf() would write the whole of it.
+  The position in the line is kept in * p_state between two calls.
+  A CR at the end of a part is written with the next part, since the
+  next part can start with the matching LF.
+*/
+
+int mailstream_send_data_crlf_partial(mailstream * s, const char * message,
+    size_t size, int quoted, int * p_state)
 {
-  size_t count;
-  size_t fixed_count;
+  const char * end;
+  int state;
+  int hold_cr;
 
-  count = 0;
-  fixed_count = 0;
-  
-  while (1) {
-    if (length == 0)
-      break;
+  state = * p_state;
 
-    if (* line == '\r') {
-      line ++;
+  if ((state == MAILSTREAM_DATA_PENDING_CR) && (size > 0)) {
+    if (mailstream_write(s, "\r\n", 2) == -1)
+      return -1;
+    if (message[0] == '\n') {
+      message ++;
+      size --;
+    }
+    state = MAILSTREAM_DATA_LINE_BEGIN;
+  }
 
-      count ++;
-      length --;
+  hold_cr = (size > 0) && (message[size - 1] == '\r');
+  if (hold_cr)
+    size --;
 
-      if (length == 0) {
-        fixed_count ++;
-        break;
-      }
-      
-      if (* line == '\n') {
-	line ++;
+  if (size > 0) {
+    end = message + size;
 
-	count ++;
-	length --;
-	
-	break;
-      }
-      else {
-        fixed_count ++;
-        break;
-      }
-    }
-    else if (* line == '\n') {
-      line ++;
+    if (state == MAILSTREAM_DATA_IN_LINE) {
+      size_t length;
+      int fix_eol;
 
-      count ++;
-      length --;
+      /* the end of the current line is never quoted */
+      length = get_line_length(message, size, &fix_eol);
+      if (send_data_crlf_progress(s, message, length, 0,
+              0, NULL, NULL, NULL) == -1)
+        return -1;
+      message += length;
+      size -= length;
+    }
 
-      fixed_count ++;
-      break;
+    if (size > 0) {
+      if (send_data_crlf_progress(s, message, size, quoted,
+              0, NULL, NULL, NULL) == -1)
+        return -1;
     }
 
-    line ++;
-    length --;
-    count ++;
+    if ((end[-1] == '\n') || (end[-1] == '\r'))
+      state = MAILSTREAM_DATA_LINE_BEGIN;
+    else
+      state = MAILSTREAM_DATA_IN_LINE;
   }
-  
-  * result = count + fixed_count;
-  
-  return count;
+
+  if (hold_cr)
+    state = MAILSTREAM_DATA_PENDING_CR;
+
+  * p_state = state;
+
+  return 0;
+}
+
+int mailstream_send_data_crlf_finish(mailstream * s, int * p_state)
+{
+  if (* p_state == MAILSTREAM_DATA_PENDING_CR) {
+    if (mailstream_write(s, "\r\n", 2) == -1)
+      return -1;
+    * p_state = MAILSTREAM_DATA_LINE_BEGIN;
+  }
+
+  return 0;
 }
 
 size_t mailstream_get_data_crlf_size(const char * message, size_t size)
 {
   const char * current;
-  size_t count;
   size_t remaining;
   size_t fixed_count;
   
-  count = 0;
   fixed_count = 0;
   
   current = message;
   remaining = size;
 
   while (remaining > 0) {
-    ssize_t length;
-    size_t line_count;
+    size_t length;
+    int fix_eol;
     
-    length = get_data_size(current, remaining, &line_count);
+    length = get_line_length(current, remaining, &fix_eol);
     
-    fixed_count += line_count;
+    fixed_count += length + fix_eol;
     current += length;
-
-    count += length;
-    
     remaining -= length;
   }
   
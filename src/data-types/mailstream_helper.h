@@ -80,6 +80,24 @@ int mailstream_send_data_with_context(mailstream * s, const char * message,
 
 size_t mailstream_get_data_crlf_size(const char * message, size_t size);
 
+enum {
+  MAILSTREAM_DATA_LINE_BEGIN,
+  MAILSTREAM_DATA_IN_LINE,
+  MAILSTREAM_DATA_PENDING_CR
+};
+
+/*
+  mailstream_send_data_crlf_partial() sends a part of a message and fixes
+  its line breaks. When quoted is set, a '.' at the beginning of a line
+  is doubled.
+  * p_state must be MAILSTREAM_DATA_LINE_BEGIN before the first part and
+  mailstream_send_data_crlf_finish() must be called after the last one.
+*/
+int mailstream_send_data_crlf_partial(mailstream * s, const char * message,
+    size_t size, int quoted, int * p_state);
+
+int mailstream_send_data_crlf_finish(mailstream * s, int * p_state);
+
 #ifdef __cplusplus
 }
 #endif
@@ -39,6 +39,7 @@
 
 #include "mailstream_low.h"
 #include <stdlib.h>
+#include <errno.h>
 
 #ifdef LIBETPAN_MAILSTREAM_DEBUG
 
@@ -215,7 +216,12 @@ ssize_t mailstream_low_read(mailstream_low * s, void * buf, size_t count)
 #endif
   
   if (r < 0) {
+    int saved_errno;
+
+    /* errno tells EAGAIN in non-blocking mode */
+    saved_errno = errno;
     STREAM_LOG_ERROR(s, 4, buf, 0);
+    errno = saved_errno;
   }
   
   return r;
@@ -244,7 +250,11 @@ ssize_t mailstream_low_write(mailstream_low * s,
   r = s->driver->mailstream_write(s, buf, count);
   
   if (r < 0) {
+    int saved_errno;
+
+    saved_errno = errno;
     STREAM_LOG_ERROR(s, 4 | 1, buf, 0);
+    errno = saved_errno;
   }
   
   return r;
@@ -289,3 +299,14 @@ const char * mailstream_low_get_identifier(mailstream_low * s)
 {
 	return s->identifier;
 }
+
+int mailstream_low_set_nonblocking(mailstream_low * s, int nonblocking)
+{
+  if (s == NULL)
+    return -1;
+  
+  if (s->driver->mailstream_set_nonblocking == NULL)
+    return -1;
+  
+  return s->driver->mailstream_set_nonblocking(s, nonblocking);
+}
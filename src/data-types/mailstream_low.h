@@ -84,6 +84,15 @@ int mailstream_low_set_identifier(mailstream_low * s,
 LIBETPAN_EXPORT
 const char * mailstream_low_get_identifier(mailstream_low * s);
 
+/*
+  In non-blocking mode, read and write don't wait for the connection
+  to be ready, they return -1 with errno set to EAGAIN instead.
+  Returns -1 if the driver does not support it.
+*/
+
+LIBETPAN_EXPORT
+int mailstream_low_set_nonblocking(mailstream_low * s, int nonblocking);
+
 #ifdef __cplusplus
 }
 #endif
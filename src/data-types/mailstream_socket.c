@@ -65,6 +65,7 @@
 #	ifdef HAVE_SYS_SELECT_H
 #		include <sys/select.h>
 #	endif
+#	include <poll.h>
 #endif
 
 #include "mailstream_cancel.h"
@@ -73,6 +74,9 @@ struct mailstream_socket_data {
   int fd;
   struct mailstream_cancel * cancel;
   int use_read;
+  int nonblocking;
+  /* O_NONBLOCK was set by mailstream_low_socket_set_nonblocking() */
+  int nonblock_flag_set;
 };
 
 /* mailstream_low, socket */
@@ -86,6 +90,7 @@ static void mailstream_low_socket_free(mailstream_low * s);
 static int mailstream_low_socket_get_fd(mailstream_low * s);
 static void mailstream_low_socket_cancel(mailstream_low * s);
 static struct mailstream_cancel * mailstream_low_socket_get_cancel(mailstream_low * s);
+static int mailstream_low_socket_set_nonblocking(mailstream_low * s, int nonblocking);
 
 static mailstream_low_driver local_mailstream_socket_driver = {
   /* mailstream_read */ mailstream_low_socket_read,
@@ -95,6 +100,7 @@ static mailstream_low_driver local_mailstream_socket_driver = {
   /* mailstream_free */ mailstream_low_socket_free,
   /* mailstream_cancel */ mailstream_low_socket_cancel,
   /* mailstream_get_cancel */ mailstream_low_socket_get_cancel,
+  /* mailstream_set_nonblocking */ mailstream_low_socket_set_nonblocking,
 };
 
 mailstream_low_driver * mailstream_socket_driver =
@@ -112,6 +118,8 @@ static struct mailstream_socket_data * socket_data_new(int fd)
   
   socket_data->fd = fd;
   socket_data->use_read = 0;
+  socket_data->nonblocking = 0;
+  socket_data->nonblock_flag_set = 0;
   socket_data->cancel = mailstream_cancel_new();
   if (socket_data->cancel == NULL)
     goto free;
@@ -203,26 +211,26 @@ static ssize_t mailstream_low_socket_read(mailstream_low * s,
     return -1;
   
   /* timeout */
-  {
-    fd_set fds_read;
+  if (!socket_data->nonblocking) {
     struct timeval timeout;
     int r;
     int fd;
     int cancelled;
     int got_data;
 #ifdef WIN32
+    fd_set fds_read;
     HANDLE event;
 #else
-    int max_fd;
+    struct pollfd pfd[2];
 #endif
     
     timeout = mailstream_network_delay;
     
-    FD_ZERO(&fds_read);
     fd = mailstream_cancel_get_fd(socket_data->cancel);
-    FD_SET(fd, &fds_read);
     
 #ifdef WIN32
+    FD_ZERO(&fds_read);
+    FD_SET(fd, &fds_read);
     event = CreateEvent(NULL, TRUE, FALSE, NULL);
     WSAEventSelect(socket_data->fd, event, FD_READ | FD_CLOSE);
     FD_SET(event, &fds_read);
@@ -238,16 +246,19 @@ static ssize_t mailstream_low_socket_read(mailstream_low * s,
 		WSAEventSelect(socket_data->fd, event, 0);
 		CloseHandle(event);
 #else
-    FD_SET(socket_data->fd, &fds_read);
-    max_fd = socket_data->fd;
-    if (fd > max_fd)
-      max_fd = fd;
-    r = select(max_fd + 1, &fds_read, NULL,/* &fds_excp*/ NULL, &timeout);
+    pfd[0].fd = socket_data->fd;
+    pfd[0].events = POLLIN;
+    pfd[0].revents = 0;
+    pfd[1].fd = fd;
+    pfd[1].events = POLLIN;
+    pfd[1].revents = 0;
+    r = poll(pfd, 2, timeout.tv_sec * 1000 + timeout.tv_usec / 1000);
     if (r <= 0)
       return -1;
     
-    cancelled = FD_ISSET(fd, &fds_read);
-    got_data = FD_ISSET(socket_data->fd, &fds_read);
+    cancelled = (pfd[1].revents & POLLIN) != 0;
+    /* a hang up or an error will be reported by read() */
+    got_data = (pfd[0].revents & (POLLIN | POLLHUP | POLLERR)) != 0;
 #endif
     
     if (cancelled) {
@@ -279,26 +290,25 @@ static ssize_t mailstream_low_socket_write(mailstream_low * s,
     return -1;
   
   /* timeout */
-  {
-    fd_set fds_read;
-    fd_set fds_write;
+  if (!socket_data->nonblocking) {
     struct timeval timeout;
     int r;
     int fd;
-    int max_fd;
     int cancelled;
     int write_enabled;
 #ifdef WIN32
+    fd_set fds_read;
     HANDLE event;
+#else
+    struct pollfd pfd[2];
 #endif
     
     timeout = mailstream_network_delay;
     
-    FD_ZERO(&fds_read);
     fd = mailstream_cancel_get_fd(socket_data->cancel);
-    FD_SET(fd, &fds_read);
-    FD_ZERO(&fds_write);
 #ifdef WIN32
+    FD_ZERO(&fds_read);
+    FD_SET(fd, &fds_read);
     event = CreateEvent(NULL, TRUE, FALSE, NULL);
     WSAEventSelect(socket_data->fd, event, FD_WRITE | FD_CLOSE);
     FD_SET(event, &fds_read);
@@ -314,16 +324,19 @@ static ssize_t mailstream_low_socket_write(mailstream_low * s,
 		WSAEventSelect(socket_data->fd, event, 0);
 		CloseHandle(event);
 #else
-    FD_SET(socket_data->fd, &fds_write);
-    max_fd = socket_data->fd;
-    if (fd > max_fd)
-      max_fd = fd;
-    r = select(max_fd + 1, &fds_read, &fds_write, /*&fds_excp */ NULL, &timeout);
+    pfd[0].fd = socket_data->fd;
+    pfd[0].events = POLLOUT;
+    pfd[0].revents = 0;
+    pfd[1].fd = fd;
+    pfd[1].events = POLLIN;
+    pfd[1].revents = 0;
+    r = poll(pfd, 2, timeout.tv_sec * 1000 + timeout.tv_usec / 1000);
     if (r <= 0)
       return -1;
 
-    cancelled = FD_ISSET(fd, &fds_read);
-    write_enabled = FD_ISSET(socket_data->fd, &fds_write);
+    cancelled = (pfd[1].revents & POLLIN) != 0;
+    /* a hang up or an error will be reported by send() */
+    write_enabled = (pfd[0].revents & (POLLOUT | POLLHUP | POLLERR)) != 0;
 #endif
     
     if (cancelled) {
@@ -388,3 +401,34 @@ static struct mailstream_cancel * mailstream_low_socket_get_cancel(mailstream_lo
   socket_data = (struct mailstream_socket_data *) s->data;
   return socket_data->cancel;
 }
+
+static int mailstream_low_socket_set_nonblocking(mailstream_low * s, int nonblocking)
+{
+  struct mailstream_socket_data * socket_data;
+  
+  socket_data = (struct mailstream_socket_data *) s->data;
+#ifndef WIN32
+  if (nonblocking) {
+    int fd_flags;
+    
+    fd_flags = fcntl(socket_data->fd, F_GETFL, 0);
+    if ((fd_flags & O_NONBLOCK) == 0) {
+      if (fcntl(socket_data->fd, F_SETFL, fd_flags | O_NONBLOCK) < 0)
+        return -1;
+      socket_data->nonblock_flag_set = 1;
+    }
+  }
+  else if (socket_data->nonblock_flag_set) {
+    int fd_flags;
+    
+    /* the descriptor is given back in the mode it was opened in */
+    fd_flags = fcntl(socket_data->fd, F_GETFL, 0);
+    if (fcntl(socket_data->fd, F_SETFL, fd_flags & ~O_NONBLOCK) < 0)
+      return -1;
+    socket_data->nonblock_flag_set = 0;
+  }
+#endif
+  socket_data->nonblocking = nonblocking;
+  
+  return 0;
+}
@@ -70,6 +70,8 @@
 #	ifdef HAVE_SYS_SELECT_H
 #		include <sys/select.h>
 #	endif
+#	include <sys/socket.h>
+#	include <poll.h>
 #endif
 
 #if LIBETPAN_APPLE_SSL
@@ -81,6 +83,7 @@
 #ifdef USE_SSL
 # ifndef USE_GNUTLS
 #  include <openssl/ssl.h>
+#  include <errno.h>
 # else
 #  include <errno.h>
 #  include <gnutls/gnutls.h>
@@ -94,6 +97,7 @@
 #endif
 
 #include "mailstream_cancel.h"
+#include "chash.h"
 
 #include "mail.h"
 
@@ -121,6 +125,8 @@ struct mailstream_ssl_data {
   SSL * ssl_conn;
   SSL_CTX * ssl_ctx;
   struct mailstream_cancel * cancel;
+  chashdatum session_key;
+  int nonblocking;
 };
 
 #else
@@ -129,6 +135,8 @@ struct mailstream_ssl_data {
   gnutls_session session;
   gnutls_certificate_credentials_t xcred;
   struct mailstream_cancel * cancel;
+  chashdatum session_key;
+  int nonblocking;
 };
 #endif
 #endif
@@ -152,6 +160,24 @@ struct mailstream_ssl_data {
 #endif
 static int gnutls_init_done = 0;
 static int openssl_init_done = 0;
+
+/*
+  Connections opened without a callback share a process-wide context
+  (SSL_CTX or GnuTLS credentials) and remember their TLS session, keyed
+  by the address of the server, so that the next connection to the same
+  server can resume it instead of doing a full handshake.
+*/
+
+#define SSL_SESSION_CACHE_MAX_COUNT 1024
+
+static int ssl_session_cache_enabled = 1;
+static chash * ssl_session_cache = NULL;
+#ifndef USE_GNUTLS
+static SSL_CTX * ssl_shared_ctx[2] = { NULL, NULL };
+#else
+static gnutls_certificate_credentials_t ssl_shared_xcred = NULL;
+static unsigned int ssl_shared_xcred_count = 0;
+#endif
 #endif
 
 // Used to make OpenSSL thread safe
@@ -261,6 +287,48 @@ void mailstream_ssl_init_not_required(void)
   mailstream_openssl_init_not_required();
 }
 
+void mailstream_ssl_set_session_cache(int enabled)
+{
+#ifdef USE_SSL
+  MUTEX_LOCK(&ssl_lock);
+  ssl_session_cache_enabled = enabled;
+  MUTEX_UNLOCK(&ssl_lock);
+#else
+  UNUSED(enabled);
+#endif
+}
+
+void mailstream_ssl_flush_cache(void)
+{
+#ifdef USE_SSL
+#ifndef USE_GNUTLS
+  unsigned int i;
+#endif
+
+  MUTEX_LOCK(&ssl_lock);
+  if (ssl_session_cache != NULL) {
+    chash_free(ssl_session_cache);
+    ssl_session_cache = NULL;
+  }
+#ifndef USE_GNUTLS
+  /* connections still opened keep a reference to the context */
+  for(i = 0 ; i < sizeof(ssl_shared_ctx) / sizeof(ssl_shared_ctx[0]) ; i ++) {
+    if (ssl_shared_ctx[i] != NULL) {
+      SSL_CTX_free(ssl_shared_ctx[i]);
+      ssl_shared_ctx[i] = NULL;
+    }
+  }
+#else
+  /* credentials are kept while connections are using them */
+  if ((ssl_shared_xcred != NULL) && (ssl_shared_xcred_count == 0)) {
+    gnutls_certificate_free_credentials(ssl_shared_xcred);
+    ssl_shared_xcred = NULL;
+  }
+#endif
+  MUTEX_UNLOCK(&ssl_lock);
+#endif
+}
+
 static inline void mailstream_ssl_init(void)
 {
 #ifdef USE_SSL
@@ -307,11 +375,98 @@ static inline int mailstream_prepare_fd(int fd)
 }
 #endif
 
+#ifdef USE_SSL
+static int ssl_session_key_init(chashdatum * key, int fd, int starttls)
+{
+  struct sockaddr_storage addr;
+  socklen_t addr_len;
+  char * data;
+
+  key->data = NULL;
+  key->len = 0;
+
+  memset(&addr, 0, sizeof(addr));
+  addr_len = sizeof(addr);
+  if (getpeername(fd, (struct sockaddr *) &addr, &addr_len) < 0)
+    return -1;
+
+  data = malloc(addr_len + 1);
+  if (data == NULL)
+    return -1;
+
+  data[0] = starttls ? 't' : 's';
+  memcpy(data + 1, &addr, addr_len);
+
+  key->data = data;
+  key->len = addr_len + 1;
+
+  return 0;
+}
+
+static void ssl_session_key_done(chashdatum * key)
+{
+  free(key->data);
+  key->data = NULL;
+  key->len = 0;
+}
+
+static void ssl_session_cache_store(chashdatum * key, void * data, size_t len)
+{
+  chashdatum value;
+
+  MUTEX_LOCK(&ssl_lock);
+  if (ssl_session_cache == NULL)
+    ssl_session_cache = chash_new(CHASH_DEFAULTSIZE, CHASH_COPYALL);
+  if (ssl_session_cache != NULL) {
+    if (chash_count(ssl_session_cache) >= SSL_SESSION_CACHE_MAX_COUNT)
+      chash_clear(ssl_session_cache);
+    value.data = data;
+    value.len = len;
+    chash_set(ssl_session_cache, key, &value, NULL);
+  }
+  MUTEX_UNLOCK(&ssl_lock);
+}
+
+/* returns a copy of the cached session data, to be released with free() */
+
+static void * ssl_session_cache_lookup(chashdatum * key, size_t * p_len)
+{
+  chashdatum value;
+  void * data;
+  int r;
+
+  data = NULL;
+  MUTEX_LOCK(&ssl_lock);
+  if (ssl_session_cache != NULL) {
+    r = chash_get(ssl_session_cache, key, &value);
+    if (r == 0) {
+      data = malloc(value.len);
+      if (data != NULL) {
+        memcpy(data, value.data, value.len);
+        * p_len = value.len;
+      }
+    }
+  }
+  MUTEX_UNLOCK(&ssl_lock);
+
+  return data;
+}
+
+static void ssl_session_cache_remove(chashdatum * key)
+{
+  MUTEX_LOCK(&ssl_lock);
+  if (ssl_session_cache != NULL)
+    chash_delete(ssl_session_cache, key, NULL);
+  MUTEX_UNLOCK(&ssl_lock);
+}
+#endif
+
 static int wait_SSL_connect(int s, int want_read)
 {
-  fd_set fds;
   struct timeval timeout;
   int r;
+#ifdef WIN32
+  fd_set fds;
 
   FD_ZERO(&fds);
   FD_SET(s, &fds);
@@ -329,6 +484,24 @@ static int wait_SSL_connect(int s, int want_read)
     /* though, it's strange */
     return -1;
   }
+#else
+  struct pollfd pfd;
+
+  pfd.fd = s;
+  pfd.events = want_read ? POLLIN : POLLOUT;
+  pfd.revents = 0;
+  timeout = mailstream_network_delay;
+  /* TODO: how to cancel this ? */
+  r = poll(&pfd, 1, timeout.tv_sec * 1000 + timeout.tv_usec / 1000);
+  if (r <= 0) {
+    return -1;
+  }
+
+  if ((pfd.revents & pfd.events) == 0) {
+    /* hang up or error */
+    return -1;
+  }
+#endif
 
   return 0;
 }
@@ -343,6 +516,7 @@ static void mailstream_low_ssl_free(mailstream_low * s);
 static int mailstream_low_ssl_get_fd(mailstream_low * s);
 static void mailstream_low_ssl_cancel(mailstream_low * s);
 static struct mailstream_cancel * mailstream_low_ssl_get_cancel(mailstream_low * s);
+static int mailstream_low_ssl_set_nonblocking(mailstream_low * s, int nonblocking);
 
 static mailstream_low_driver local_mailstream_ssl_driver = {
   /* mailstream_read */ mailstream_low_ssl_read,
@@ -352,6 +526,7 @@ static mailstream_low_driver local_mailstream_ssl_driver = {
   /* mailstream_free */ mailstream_low_ssl_free,
   /* mailstream_cancel */ mailstream_low_ssl_cancel,
   /* mailstream_get_cancel */ mailstream_low_ssl_get_cancel,
+  /* mailstream_set_nonblocking */ mailstream_low_ssl_set_nonblocking,
 };
 
 mailstream_low_driver * mailstream_ssl_driver = &local_mailstream_ssl_driver;
@@ -385,7 +560,70 @@ static int mailstream_openssl_client_cert_cb(SSL *ssl, X509 **x509, EVP_PKEY **p
 		return 0;
 }
 
-static struct mailstream_ssl_data * ssl_data_new_full(int fd, SSL_METHOD * method, void (* callback)(struct mailstream_ssl_context * ssl_context, void * cb_data), void * cb_data)
+static SSL_CTX * ssl_shared_ctx_get(int starttls, SSL_METHOD * method)
+{
+  SSL_CTX * ctx;
+
+  MUTEX_LOCK(&ssl_lock);
+  ctx = ssl_shared_ctx[starttls];
+  if (ctx == NULL) {
+    ctx = SSL_CTX_new(method);
+    if (ctx != NULL) {
+      SSL_CTX_set_app_data(ctx, NULL);
+      SSL_CTX_set_client_cert_cb(ctx, mailstream_openssl_client_cert_cb);
+      ssl_shared_ctx[starttls] = ctx;
+    }
+  }
+  MUTEX_UNLOCK(&ssl_lock);
+
+  return ctx;
+}
+
+static void ssl_session_restore(SSL * ssl_conn, chashdatum * session_key)
+{
+  SSL_SESSION * session;
+  unsigned char * data;
+  const unsigned char * p;
+  size_t len;
+
+  data = ssl_session_cache_lookup(session_key, &len);
+  if (data == NULL)
+    return;
+
+  p = data;
+  session = d2i_SSL_SESSION(NULL, &p, len);
+  if (session != NULL) {
+    SSL_set_session(ssl_conn, session);
+    SSL_SESSION_free(session);
+  }
+  free(data);
+}
+
+static void ssl_session_save(SSL * ssl_conn, chashdatum * session_key)
+{
+  SSL_SESSION * session;
+  unsigned char * data;
+  unsigned char * p;
+  int len;
+
+  session = SSL_get1_session(ssl_conn);
+  if (session == NULL)
+    return;
+
+  len = i2d_SSL_SESSION(session, NULL);
+  if (len > 0) {
+    data = malloc(len);
+    if (data != NULL) {
+      p = data;
+      i2d_SSL_SESSION(session, &p);
+      ssl_session_cache_store(session_key, data, len);
+      free(data);
+    }
+  }
+  SSL_SESSION_free(session);
+}
+
+static struct mailstream_ssl_data * ssl_data_new_full(int fd, int starttls, SSL_METHOD * method, void (* callback)(struct mailstream_ssl_context * ssl_context, void * cb_data), void * cb_data)
 {
   struct mailstream_ssl_data * ssl_data;
   SSL * ssl_conn;
@@ -393,23 +631,44 @@ static struct mailstream_ssl_data * ssl_data_new_full(int fd, SSL_METHOD * metho
   SSL_CTX * tmp_ctx;
   struct mailstream_cancel * cancel;
   struct mailstream_ssl_context * ssl_context = NULL;
+  chashdatum session_key;
 
   mailstream_ssl_init();
 
-  tmp_ctx = SSL_CTX_new(method);
-  if (tmp_ctx == NULL)
-    goto err;
+  session_key.data = NULL;
+  session_key.len = 0;
+
+  if (callback == NULL) {
+    /* shared context, owned by ssl_shared_ctx */
+    ssl_conn = NULL;
+    tmp_ctx = ssl_shared_ctx_get(starttls, method);
+    if (tmp_ctx == NULL)
+      goto err;
+
+    ssl_conn = (SSL *) SSL_new(tmp_ctx);
+    if (ssl_conn == NULL)
+      goto err;
+    tmp_ctx = NULL;
+
+    if (ssl_session_cache_enabled) {
+      if (ssl_session_key_init(&session_key, fd, starttls) == 0)
+        ssl_session_restore(ssl_conn, &session_key);
+    }
+  }
+  else {
+    tmp_ctx = SSL_CTX_new(method);
+    if (tmp_ctx == NULL)
+      goto err;
 
-  if (callback != NULL) {
     ssl_context = mailstream_ssl_context_new(tmp_ctx, fd);
     callback(ssl_context, cb_data);
-  }
 
-  SSL_CTX_set_app_data(tmp_ctx, ssl_context);
-  SSL_CTX_set_client_cert_cb(tmp_ctx, mailstream_openssl_client_cert_cb);
-  ssl_conn = (SSL *) SSL_new(tmp_ctx);
-  if (ssl_conn == NULL)
-    goto free_ctx;
+    SSL_CTX_set_app_data(tmp_ctx, ssl_context);
+    SSL_CTX_set_client_cert_cb(tmp_ctx, mailstream_openssl_client_cert_cb);
+    ssl_conn = (SSL *) SSL_new(tmp_ctx);
+    if (ssl_conn == NULL)
+      goto free_ctx;
+  }
 
   if (SSL_set_fd(ssl_conn, fd) == 0)
     goto free_ssl_conn;
@@ -452,6 +711,8 @@ again:
   ssl_data->ssl_conn = ssl_conn;
   ssl_data->ssl_ctx = tmp_ctx;
   ssl_data->cancel = cancel;
+  ssl_data->session_key = session_key;
+  ssl_data->nonblocking = 0;
   mailstream_ssl_context_free(ssl_context);
 
   return ssl_data;
@@ -460,8 +721,14 @@ again:
   mailstream_cancel_free(cancel);
  free_ssl_conn:
   SSL_free(ssl_conn);
+  if (session_key.data != NULL) {
+    /* don't try to resume a session that failed */
+    ssl_session_cache_remove(&session_key);
+    ssl_session_key_done(&session_key);
+  }
  free_ctx:
-  SSL_CTX_free(tmp_ctx);
+  if (tmp_ctx != NULL)
+    SSL_CTX_free(tmp_ctx);
   mailstream_ssl_context_free(ssl_context);
  err:
   return NULL;
@@ -469,12 +736,12 @@ again:
 
 static struct mailstream_ssl_data * ssl_data_new(int fd, void (* callback)(struct mailstream_ssl_context * ssl_context, void * cb_data), void * cb_data)
 {
-  return ssl_data_new_full(fd, SSLv23_client_method(), callback, cb_data);
+  return ssl_data_new_full(fd, 0, SSLv23_client_method(), callback, cb_data);
 }
 
 static struct mailstream_ssl_data * tls_data_new(int fd, void (* callback)(struct mailstream_ssl_context * ssl_context, void * cb_data), void * cb_data)
 {
-  return ssl_data_new_full(fd, TLSv1_client_method(), callback, cb_data);
+  return ssl_data_new_full(fd, 1, TLSv1_client_method(), callback, cb_data);
 }
 
 #else
@@ -505,7 +772,63 @@ static int mailstream_gnutls_client_cert_cb(gnutls_session session,
 	return 0;
 }
 
-static struct mailstream_ssl_data * ssl_data_new(int fd, void (* callback)(struct mailstream_ssl_context * ssl_context, void * cb_data), void * cb_data)
+/*
+  the client certificate is looked up through the session pointer,
+  so the same credentials can be used by all the connections.
+*/
+
+static gnutls_certificate_credentials_t ssl_shared_xcred_get(void)
+{
+  gnutls_certificate_credentials_t xcred;
+
+  MUTEX_LOCK(&ssl_lock);
+  if (ssl_shared_xcred == NULL) {
+    if (gnutls_certificate_allocate_credentials(&ssl_shared_xcred) != 0)
+      ssl_shared_xcred = NULL;
+    else
+      gnutls_certificate_client_set_retrieve_function(ssl_shared_xcred,
+          mailstream_gnutls_client_cert_cb);
+  }
+  xcred = ssl_shared_xcred;
+  if (xcred != NULL)
+    ssl_shared_xcred_count ++;
+  MUTEX_UNLOCK(&ssl_lock);
+
+  return xcred;
+}
+
+static void ssl_shared_xcred_release(void)
+{
+  MUTEX_LOCK(&ssl_lock);
+  ssl_shared_xcred_count --;
+  MUTEX_UNLOCK(&ssl_lock);
+}
+
+static void ssl_session_restore(gnutls_session session, chashdatum * session_key)
+{
+  void * data;
+  size_t len;
+
+  data = ssl_session_cache_lookup(session_key, &len);
+  if (data == NULL)
+    return;
+
+  gnutls_session_set_data(session, data, len);
+  free(data);
+}
+
+static void ssl_session_save(gnutls_session session, chashdatum * session_key)
+{
+  gnutls_datum_t data;
+
+  if (gnutls_session_get_data2(session, &data) < 0)
+    return;
+
+  ssl_session_cache_store(session_key, data.data, data.size);
+  gnutls_free(data.data);
+}
+
+static struct mailstream_ssl_data * ssl_data_new_full(int fd, int starttls, void (* callback)(struct mailstream_ssl_context * ssl_context, void * cb_data), void * cb_data)
 {
   struct mailstream_ssl_data * ssl_data;
   gnutls_session session;
@@ -513,15 +836,22 @@ static struct mailstream_ssl_data * ssl_data_new(int fd, void (* callback)(struc
   gnutls_certificate_credentials_t xcred;
   int r;
   struct mailstream_ssl_context * ssl_context = NULL;
+  chashdatum session_key;
 
   mailstream_ssl_init();
 
-  if (gnutls_certificate_allocate_credentials (&xcred) != 0)
+  session_key.data = NULL;
+  session_key.len = 0;
+
+  xcred = ssl_shared_xcred_get();
+  if (xcred == NULL)
     return NULL;
 
   r = gnutls_init(&session, GNUTLS_CLIENT);
-  if (session == NULL || r != 0)
+  if (session == NULL || r != 0) {
+    ssl_shared_xcred_release();
     return NULL;
+  }
 
   if (callback != NULL) {
     ssl_context = mailstream_ssl_context_new(session, fd);
@@ -530,7 +860,12 @@ static struct mailstream_ssl_data * ssl_data_new(int fd, void (* callback)(struc
 
   gnutls_session_set_ptr(session, ssl_context);
   gnutls_credentials_set(session, GNUTLS_CRD_CERTIFICATE, xcred);
-  gnutls_certificate_client_set_retrieve_function(xcred, mailstream_gnutls_client_cert_cb);
+
+  /* only resume the sessions of connections that use the default setup */
+  if ((callback == NULL) && ssl_session_cache_enabled) {
+    if (ssl_session_key_init(&session_key, fd, starttls) == 0)
+      ssl_session_restore(session, &session_key);
+  }
 
   gnutls_set_default_priority(session);
   gnutls_priority_set_direct(session, "NORMAL", NULL);
@@ -568,6 +903,8 @@ static struct mailstream_ssl_data * ssl_data_new(int fd, void (* callback)(struc
   ssl_data->session = session;
   ssl_data->xcred = xcred;
   ssl_data->cancel = cancel;
+  ssl_data->session_key = session_key;
+  ssl_data->nonblocking = 0;
 
   mailstream_ssl_context_free(ssl_context);
 
@@ -576,30 +913,46 @@ static struct mailstream_ssl_data * ssl_data_new(int fd, void (* callback)(struc
  free_cancel:
   mailstream_cancel_free(cancel);
  free_ssl_conn:
-  gnutls_certificate_free_credentials(xcred);
+  if (session_key.data != NULL) {
+    /* don't try to resume a session that failed */
+    ssl_session_cache_remove(&session_key);
+    ssl_session_key_done(&session_key);
+  }
   mailstream_ssl_context_free(ssl_context);
   gnutls_deinit(session);
+  ssl_shared_xcred_release();
  err:
   return NULL;
 }
+
+static struct mailstream_ssl_data * ssl_data_new(int fd, void (* callback)(struct mailstream_ssl_context * ssl_context, void * cb_data), void * cb_data)
+{
+  return ssl_data_new_full(fd, 0, callback, cb_data);
+}
+
 static struct mailstream_ssl_data * tls_data_new(int fd, void (* callback)(struct mailstream_ssl_context * ssl_context, void * cb_data), void * cb_data)
 {
-  return ssl_data_new(fd, callback, cb_data);
+  return ssl_data_new_full(fd, 1, callback, cb_data);
 }
 #endif
 
 static void  ssl_data_free(struct mailstream_ssl_data * ssl_data)
 {
   mailstream_cancel_free(ssl_data->cancel);
+  if (ssl_data->session_key.data != NULL)
+    ssl_session_key_done(&ssl_data->session_key);
   free(ssl_data);
 }
 
 #ifndef USE_GNUTLS
 static void  ssl_data_close(struct mailstream_ssl_data * ssl_data)
 {
+  if (ssl_data->session_key.data != NULL)
+    ssl_session_save(ssl_data->ssl_conn, &ssl_data->session_key);
   SSL_free(ssl_data->ssl_conn);
   ssl_data->ssl_conn = NULL;
-  SSL_CTX_free(ssl_data->ssl_ctx);
+  if (ssl_data->ssl_ctx != NULL)
+    SSL_CTX_free(ssl_data->ssl_ctx);
   ssl_data->ssl_ctx  = NULL;
 #ifdef WIN32
   closesocket(ssl_data->fd);
@@ -611,9 +964,12 @@ static void  ssl_data_close(struct mailstream_ssl_data * ssl_data)
 #else
 static void  ssl_data_close(struct mailstream_ssl_data * ssl_data)
 {
-  gnutls_certificate_free_credentials(ssl_data->xcred);
+  if (ssl_data->session_key.data != NULL)
+    ssl_session_save(ssl_data->session, &ssl_data->session_key);
   gnutls_deinit(ssl_data->session);
   ssl_data->session = NULL;
+  ssl_shared_xcred_release();
+  ssl_data->xcred = NULL;
 #ifdef WIN32
   closesocket(socket_data->fd);
 #else
@@ -696,15 +1052,16 @@ static int mailstream_low_ssl_get_fd(mailstream_low * s)
 
 static int wait_read(mailstream_low * s)
 {
-  fd_set fds_read;
   struct timeval timeout;
   int fd;
   struct mailstream_ssl_data * ssl_data;
-  int max_fd;
   int r;
   int cancelled;
 #ifdef WIN32
+  fd_set fds_read;
   HANDLE event;
+#else
+  struct pollfd pfd[2];
 #endif
 
   ssl_data = (struct mailstream_ssl_data *) s->data;
@@ -715,10 +1072,10 @@ static int wait_read(mailstream_low * s)
     return 0;
 #endif
 
-  FD_ZERO(&fds_read);
   fd = mailstream_cancel_get_fd(ssl_data->cancel);
-  FD_SET(fd, &fds_read);
 #ifdef WIN32
+  FD_ZERO(&fds_read);
+  FD_SET(fd, &fds_read);
   event = CreateEvent(NULL, TRUE, FALSE, NULL);
   WSAEventSelect(ssl_data->fd, event, FD_READ | FD_CLOSE);
   FD_SET(event, &fds_read);
@@ -734,16 +1091,17 @@ static int wait_read(mailstream_low * s)
 	WSAEventSelect(ssl_data->fd, event, 0);
 	CloseHandle(event);
 #else
-  FD_SET(ssl_data->fd, &fds_read);
-  max_fd = ssl_data->fd;
-  if (fd > max_fd)
-    max_fd = fd;
-  r = select(max_fd + 1, &fds_read, NULL, NULL, &timeout);
+  pfd[0].fd = ssl_data->fd;
+  pfd[0].events = POLLIN;
+  pfd[0].revents = 0;
+  pfd[1].fd = fd;
+  pfd[1].events = POLLIN;
+  pfd[1].revents = 0;
+  r = poll(pfd, 2, timeout.tv_sec * 1000 + timeout.tv_usec / 1000);
   if (r <= 0)
     return -1;
 
-  cancelled = (FD_ISSET(fd, &fds_read));
-  FD_ISSET(ssl_data->fd, &fds_read);
+  cancelled = (pfd[1].revents & POLLIN) != 0;
 #endif
   if (cancelled) {
     /* cancelled */
@@ -782,6 +1140,13 @@ static ssize_t mailstream_low_ssl_read(mailstream_low * s,
       return r;
 
     case SSL_ERROR_WANT_READ:
+    case SSL_ERROR_WANT_WRITE:
+      if (ssl_data->nonblocking) {
+        errno = EAGAIN;
+        return -1;
+      }
+      if (ssl_r == SSL_ERROR_WANT_WRITE)
+        return -1;
       r = wait_read(s);
       if (r < 0)
         return r;
@@ -819,6 +1184,10 @@ static ssize_t mailstream_low_ssl_read(mailstream_low * s,
       break; /* re-receive */
     case GNUTLS_E_AGAIN:
     case GNUTLS_E_INTERRUPTED:
+      if (ssl_data->nonblocking) {
+        errno = EAGAIN;
+        return -1;
+      }
       r = wait_read(s);
       if (r < 0)
         return r;
@@ -833,17 +1202,17 @@ static ssize_t mailstream_low_ssl_read(mailstream_low * s,
 
 static int wait_write(mailstream_low * s)
 {
-  fd_set fds_read;
-  fd_set fds_write;
   struct timeval timeout;
   int r;
   int fd;
   struct mailstream_ssl_data * ssl_data;
-  int max_fd;
   int cancelled;
   int write_enabled;
 #ifdef WIN32
+  fd_set fds_read;
   HANDLE event;
+#else
+  struct pollfd pfd[2];
 #endif
 
   ssl_data = (struct mailstream_ssl_data *) s->data;
@@ -852,11 +1221,10 @@ static int wait_write(mailstream_low * s)
 
   timeout = mailstream_network_delay;
 
-  FD_ZERO(&fds_read);
   fd = mailstream_cancel_get_fd(ssl_data->cancel);
-  FD_SET(fd, &fds_read);
-  FD_ZERO(&fds_write);
 #ifdef WIN32
+  FD_ZERO(&fds_read);
+  FD_SET(fd, &fds_read);
   event = CreateEvent(NULL, TRUE, FALSE, NULL);
   WSAEventSelect(ssl_data->fd, event, FD_WRITE | FD_CLOSE);
   FD_SET(event, &fds_read);
@@ -872,18 +1240,20 @@ static int wait_write(mailstream_low * s)
 	WSAEventSelect(ssl_data->fd, event, 0);
 	CloseHandle(event);
 #else
-  FD_SET(ssl_data->fd, &fds_write);
-
-  max_fd = ssl_data->fd;
-  if (fd > max_fd)
-    max_fd = fd;
-
-  r = select(max_fd + 1, &fds_read, &fds_write, NULL, &timeout);
+  pfd[0].fd = ssl_data->fd;
+  pfd[0].events = POLLOUT;
+  pfd[0].revents = 0;
+  pfd[1].fd = fd;
+  pfd[1].events = POLLIN;
+  pfd[1].revents = 0;
+
+  r = poll(pfd, 2, timeout.tv_sec * 1000 + timeout.tv_usec / 1000);
   if (r <= 0)
     return -1;
 
-  cancelled = FD_ISSET(fd, &fds_read);
-  write_enabled = FD_ISSET(ssl_data->fd, &fds_write);
+  cancelled = (pfd[1].revents & POLLIN) != 0;
+  /* a hang up or an error will be reported by the write */
+  write_enabled = (pfd[0].revents & (POLLOUT | POLLHUP | POLLERR)) != 0;
 #endif
 
   if (cancelled) {
@@ -907,9 +1277,14 @@ static ssize_t mailstream_low_ssl_write(mailstream_low * s,
   int r;
 
   ssl_data = (struct mailstream_ssl_data *) s->data;
-  r = wait_write(s);
-  if (r <= 0)
-    return r;
+  if (!ssl_data->nonblocking) {
+    r = wait_write(s);
+    if (r <= 0)
+      return r;
+  }
+  else if (mailstream_cancel_cancelled(ssl_data->cancel)) {
+    return -1;
+  }
 
   r = SSL_write(ssl_data->ssl_conn, buf, count);
   if (r > 0)
@@ -923,7 +1298,12 @@ static ssize_t mailstream_low_ssl_write(mailstream_low * s,
   case SSL_ERROR_ZERO_RETURN:
     return -1;
 
+  case SSL_ERROR_WANT_READ:
   case SSL_ERROR_WANT_WRITE:
+    if (ssl_data->nonblocking) {
+      errno = EAGAIN;
+      return -1;
+    }
     return 0;
 
   default:
@@ -938,9 +1318,14 @@ static ssize_t mailstream_low_ssl_write(mailstream_low * s,
   int r;
 
   ssl_data = (struct mailstream_ssl_data *) s->data;
-  r = wait_write(s);
-  if (r <= 0)
-    return r;
+  if (!ssl_data->nonblocking) {
+    r = wait_write(s);
+    if (r <= 0)
+      return r;
+  }
+  else if (mailstream_cancel_cancelled(ssl_data->cancel)) {
+    return -1;
+  }
 
   r = gnutls_record_send(ssl_data->session, buf, count);
   if (r > 0)
@@ -952,6 +1337,10 @@ static ssize_t mailstream_low_ssl_write(mailstream_low * s,
 
   case GNUTLS_E_AGAIN:
   case GNUTLS_E_INTERRUPTED:
+    if (ssl_data->nonblocking) {
+      errno = EAGAIN;
+      return -1;
+    }
     return 0;
 
   default:
@@ -1266,3 +1655,15 @@ static struct mailstream_cancel * mailstream_low_ssl_get_cancel(mailstream_low *
   return NULL;
 #endif
 }
+
+#ifdef USE_SSL
+static int mailstream_low_ssl_set_nonblocking(mailstream_low * s, int nonblocking)
+{
+  struct mailstream_ssl_data * data;
+
+  /* the descriptor is already in non-blocking mode, see mailstream_prepare_fd() */
+  data = s->data;
+  data->nonblocking = nonblocking;
+  return 0;
+}
+#endif
@@ -77,6 +77,20 @@ void mailstream_openssl_init_not_required(void);
 LIBETPAN_EXPORT
 void mailstream_ssl_init_not_required(void);
 
+/*
+  Connections opened without a callback share a process-wide SSL context
+  and resume the TLS session of the last connection to the same server.
+  mailstream_ssl_set_session_cache() enables or disables the resumption
+  (enabled by default), mailstream_ssl_flush_cache() releases the
+  shared context and the cached sessions.
+*/
+
+LIBETPAN_EXPORT
+void mailstream_ssl_set_session_cache(int enabled);
+
+LIBETPAN_EXPORT
+void mailstream_ssl_flush_cache(void);
+
 LIBETPAN_EXPORT
 ssize_t mailstream_ssl_get_certificate(mailstream *stream, unsigned char **cert_DER);
 
@@ -77,6 +77,7 @@ struct mailstream_low_driver {
   void (* mailstream_free)(mailstream_low *);
   void (* mailstream_cancel)(mailstream_low *);
   struct mailstream_cancel * (* mailstream_get_cancel)(mailstream_low *);
+  int (* mailstream_set_nonblocking)(mailstream_low *, int);
 };
 
 typedef struct mailstream_low_driver mailstream_low_driver;
@@ -173,6 +173,8 @@ static int flags_store_process(mailsession * session)
     goto free_mmapstr;
   }
 
+  mail_cache_db_begin_batch(maildb);
+
   for(i = 0 ; i < carray_count(flags_store->fls_tab) ; i ++) {
     mailmessage * msg;
     char key[PATH_MAX];
@@ -185,6 +187,8 @@ static int flags_store_process(mailsession * session)
         key, msg->msg_flags);
   }
 
+  mail_cache_db_end_batch(maildb);
+
   mail_flags_store_clear(flags_store);
 
   mail_cache_db_close_unlock(data->db_filename, maildb);
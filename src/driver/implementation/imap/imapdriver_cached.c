@@ -242,6 +242,9 @@ static int imapdriver_cached_initialize(mailsession * session)
   if (data->imap_uid_list == NULL)
     goto free_session;
   data->imap_uidvalidity = 0;
+  data->imap_qresync_enabled = 0;
+  data->imap_has_modseq = 0;
+  data->imap_select_modseq = 0;
   
   session->sess_data = data;
   
@@ -329,6 +332,76 @@ static int update_uid_cache(mailsession * session,
   return res;
 }
 
+static int uid_set_contains(struct mailimap_set * set, uint32_t uid)
+{
+  clistiter * cur;
+
+  for(cur = clist_begin(set->set_list) ; cur != NULL ; cur = clist_next(cur)) {
+    struct mailimap_set_item * item;
+    uint32_t first;
+    uint32_t last;
+
+    item = clist_content(cur);
+    if (item->set_first <= item->set_last) {
+      first = item->set_first;
+      last = item->set_last;
+    }
+    else {
+      first = item->set_last;
+      last = item->set_first;
+    }
+    if ((uid >= first) && (uid <= last))
+      return 1;
+  }
+
+  return 0;
+}
+
+/* with QRESYNC enabled, expunged messages are given as VANISHED UIDs */
+
+static void check_for_vanished_uid(mailsession * session)
+{
+  mailimap * imap;
+  struct imap_cached_session_state_data * data;
+  clistiter * cur;
+
+  data = get_cached_data(session);
+  imap = get_imap_session(session);
+
+  for(cur = clist_begin(imap->imap_response_info->rsp_extension_list) ;
+      cur != NULL ; cur = clist_next(cur)) {
+    struct mailimap_extension_data * ext_data;
+    struct mailimap_qresync_vanished * vanished;
+    unsigned int i;
+    unsigned int dest;
+
+    ext_data = clist_content(cur);
+    if (ext_data->ext_extension != &mailimap_extension_qresync)
+      continue;
+    if (ext_data->ext_type != MAILIMAP_QRESYNC_TYPE_VANISHED)
+      continue;
+
+    vanished = ext_data->ext_data;
+    if (vanished == NULL)
+      continue;
+
+    dest = 0;
+    for(i = 0 ; i < carray_count(data->imap_uid_list) ; i ++) {
+      struct uid_cache_item * cache_item;
+
+      cache_item = carray_get(data->imap_uid_list, i);
+      if (uid_set_contains(vanished->qr_known_uids, cache_item->uid)) {
+        free(cache_item);
+      }
+      else {
+        carray_set(data->imap_uid_list, dest, cache_item);
+        dest ++;
+      }
+    }
+    carray_set_size(data->imap_uid_list, dest);
+  }
+}
+
 static void check_for_uid_cache(mailsession * session)
 {
 #if 0
@@ -356,6 +429,8 @@ static void check_for_uid_cache(mailsession * session)
   if (imap->imap_response_info == NULL)
     return;
 
+  check_for_vanished_uid(session);
+
   list = imap->imap_response_info->rsp_expunged;
   if (list == NULL)
     return;
@@ -657,16 +732,35 @@ static int imapdriver_cached_select_folder(mailsession * session, const char * m
   char * quoted_mb;
   struct imap_cached_session_state_data * data;
   char * old_mb;
+  mailimap * imap;
   
   old_mb = get_ancestor_data(session)->imap_mailbox;
   if (old_mb != NULL)
     if (strcmp(mb, old_mb) == 0)
       return MAIL_NO_ERROR;
   
+  data = get_cached_data(session);
+  imap = get_imap_session(session);
+
+  /*
+    QRESYNC can only be enabled before the first SELECT, the flags
+    cache can then be resynchronized along with the expunged messages.
+  */
+  if ((!data->imap_qresync_enabled) &&
+      (imap->imap_state == MAILIMAP_STATE_AUTHENTICATED) &&
+      mailimap_has_qresync(imap)) {
+    r = mailimap_qresync_enable(imap);
+    if (r == MAILIMAP_NO_ERROR)
+      data->imap_qresync_enabled = 1;
+  }
+
   r = mailsession_select_folder(get_ancestor(session), mb);
   if (r != MAIL_NO_ERROR)
     return r;
 
+  data->imap_has_modseq = mailimap_get_highestmodseq(imap,
+      &data->imap_select_modseq);
+
   check_for_uid_cache(session);
 
   quoted_mb = NULL;
@@ -674,7 +768,6 @@ static int imapdriver_cached_select_folder(mailsession * session, const char * m
   if (r != MAIL_NO_ERROR)
     return r;
 
-  data = get_cached_data(session);
   if (data->imap_quoted_mb != NULL)
     free(data->imap_quoted_mb);
   data->imap_quoted_mb = quoted_mb;
@@ -1121,61 +1214,387 @@ static int imapdriver_cached_get_messages_list(mailsession * session,
   return res;
 }
 
-#define IMAP_SET_MAX_COUNT 100
+#define FLAGS_NAME "flags.db"
+#define MODSEQ_KEY "modseq"
 
-static int get_flags_list(mailsession * session,
-			  struct mailmessage_list * env_list)
+/*
+  When the mailbox has persistent mod-sequences (CONDSTORE), the flags
+  are kept in FLAGS_NAME along with the mod-sequence they are in sync
+  with, stored as "uidvalidity-modseq" under MODSEQ_KEY. The next sync
+  only fetches the flags that changed since that mod-sequence.
+*/
+
+static int read_cached_modseq(struct mail_cache_db * cache_db,
+    uint32_t uidvalidity, uint64_t * result)
 {
-  struct mailimap_set * set;
-  struct mailimap_fetch_att * fetch_att;
-  struct mailimap_fetch_type * fetch_type;
-  int res;
-  clist * fetch_result;
+  void * value;
+  size_t value_len;
+  char buf[64];
+  char * p;
+  uint64_t modseq;
   int r;
-  clist * msg_list;
-#if 0
-  struct imap_session_state_data * data;
-#endif
-  unsigned i;
-  unsigned dest;
-  clistiter * set_iter;
 
-#if 0
-  data = session->data;
-#endif
+  r = mail_cache_db_get(cache_db, MODSEQ_KEY, strlen(MODSEQ_KEY),
+      &value, &value_len);
+  if (r < 0)
+    return MAIL_ERROR_CACHE_MISS;
+
+  if (value_len >= sizeof(buf))
+    return MAIL_ERROR_CACHE_MISS;
+  memcpy(buf, value, value_len);
+  buf[value_len] = '\0';
+
+  if (strtoul(buf, &p, 10) != uidvalidity)
+    return MAIL_ERROR_CACHE_MISS;
+  if (* p != '-')
+    return MAIL_ERROR_CACHE_MISS;
+  p ++;
+
+  modseq = 0;
+  while ((* p >= '0') && (* p <= '9')) {
+    modseq = modseq * 10 + (* p - '0');
+    p ++;
+  }
+  if ((* p != '\0') || (modseq == 0))
+    return MAIL_ERROR_CACHE_MISS;
+
+  * result = modseq;
+
+  return MAIL_NO_ERROR;
+}
+
+static int write_cached_modseq(struct mail_cache_db * cache_db,
+    uint32_t uidvalidity, uint64_t modseq)
+{
+  char buf[64];
+  int r;
+
+  snprintf(buf, sizeof(buf), "%lu-%llu", (unsigned long) uidvalidity,
+      (unsigned long long) modseq);
+
+  r = mail_cache_db_put(cache_db, MODSEQ_KEY, strlen(MODSEQ_KEY),
+      buf, strlen(buf));
+  if (r < 0)
+    return MAIL_ERROR_FILE;
+
+  return MAIL_NO_ERROR;
+}
+
+static int get_flags_fetch_type(int with_modseq,
+    struct mailimap_fetch_type ** result)
+{
+  struct mailimap_fetch_type * fetch_type;
+  struct mailimap_fetch_att * fetch_att;
+  int r;
 
   fetch_type = mailimap_fetch_type_new_fetch_att_list_empty();
-  if (fetch_type == NULL) {
-    res = MAIL_ERROR_MEMORY;
+  if (fetch_type == NULL)
     goto err;
-  }
 
   fetch_att = mailimap_fetch_att_new_uid();
-  if (fetch_att == NULL) {
-    res = MAIL_ERROR_MEMORY;
+  if (fetch_att == NULL)
     goto free_fetch_type;
-  }
 
   r = mailimap_fetch_type_new_fetch_att_list_add(fetch_type, fetch_att);
   if (r != MAILIMAP_NO_ERROR) {
     mailimap_fetch_att_free(fetch_att);
-    res = MAIL_ERROR_MEMORY;
     goto free_fetch_type;
   }
 
   fetch_att = mailimap_fetch_att_new_flags();
-  if (fetch_att == NULL) {
-    res = MAIL_ERROR_MEMORY;
+  if (fetch_att == NULL)
     goto free_fetch_type;
-  }
 
   r = mailimap_fetch_type_new_fetch_att_list_add(fetch_type, fetch_att);
   if (r != MAILIMAP_NO_ERROR) {
     mailimap_fetch_att_free(fetch_att);
-    res = MAIL_ERROR_MEMORY;
     goto free_fetch_type;
   }
 
+  if (with_modseq) {
+    fetch_att = mailimap_fetch_att_new_modseq();
+    if (fetch_att == NULL)
+      goto free_fetch_type;
+
+    r = mailimap_fetch_type_new_fetch_att_list_add(fetch_type, fetch_att);
+    if (r != MAILIMAP_NO_ERROR) {
+      mailimap_fetch_att_free(fetch_att);
+      goto free_fetch_type;
+    }
+  }
+
+  * result = fetch_type;
+
+  return MAIL_NO_ERROR;
+
+ free_fetch_type:
+  mailimap_fetch_type_free(fetch_type);
+ err:
+  return MAIL_ERROR_MEMORY;
+}
+
+/*
+  get_changed_flags_list() fills the flags of the messages of env_list
+  from the flags cache and from the flags changed on the server since
+  the cached mod-sequence. The messages reported as expunged are removed
+  from env_list. The messages whose flags were read from the cache are
+  added to cached_uids.
+
+  Without QRESYNC, the expunged messages cannot be known, the cache is
+  only used when the number of messages matches the mailbox.
+*/
+
+static int get_changed_flags_list(mailsession * session,
+    struct mailmessage_list * env_list,
+    struct mail_cache_db * cache_db, MMAPString * mmapstr,
+    chash * cached_uids)
+{
+  struct imap_cached_session_state_data * data;
+  mailimap * imap;
+  uint64_t modseq;
+  struct mailimap_set * set;
+  struct mailimap_fetch_type * fetch_type;
+  struct mailimap_qresync_vanished * vanished;
+  clist * fetch_result;
+  clistiter * cur;
+  chash * msg_hash;
+  unsigned int i;
+  unsigned int dest;
+  int res;
+  int r;
+
+  data = get_cached_data(session);
+  imap = get_imap_session(session);
+
+  r = read_cached_modseq(cache_db,
+      imap->imap_selection_info->sel_uidvalidity, &modseq);
+  if (r != MAIL_NO_ERROR)
+    return MAIL_NO_ERROR;
+
+  if (!data->imap_qresync_enabled) {
+    if (carray_count(env_list->msg_tab) !=
+        imap->imap_selection_info->sel_exists)
+      return MAIL_NO_ERROR;
+  }
+
+  set = mailimap_set_new_interval(1, 0);
+  if (set == NULL) {
+    res = MAIL_ERROR_MEMORY;
+    goto err;
+  }
+
+  r = get_flags_fetch_type(1, &fetch_type);
+  if (r != MAIL_NO_ERROR) {
+    mailimap_set_free(set);
+    res = r;
+    goto err;
+  }
+
+  vanished = NULL;
+  if (data->imap_qresync_enabled)
+    r = mailimap_uid_fetch_qresync(imap, set, fetch_type, modseq,
+        &fetch_result, &vanished);
+  else
+    r = mailimap_uid_fetch_changedsince(imap, set, fetch_type, modseq,
+        &fetch_result);
+  mailimap_fetch_type_free(fetch_type);
+  mailimap_set_free(set);
+  if (r != MAILIMAP_NO_ERROR) {
+    res = imap_error_to_mail_error(r);
+    goto err;
+  }
+
+  /* remove expunged messages */
+  if (vanished != NULL) {
+    dest = 0;
+    for(i = 0 ; i < carray_count(env_list->msg_tab) ; i ++) {
+      mailmessage * msg;
+
+      msg = carray_get(env_list->msg_tab, i);
+      if (uid_set_contains(vanished->qr_known_uids, msg->msg_index)) {
+        mailmessage_free(msg);
+      }
+      else {
+        carray_set(env_list->msg_tab, dest, msg);
+        dest ++;
+      }
+    }
+    carray_set_size(env_list->msg_tab, dest);
+    mailimap_qresync_vanished_free(vanished);
+  }
+
+  /* changed flags */
+  msg_hash = chash_new(CHASH_DEFAULTSIZE, CHASH_COPYKEY);
+  if (msg_hash == NULL) {
+    res = MAIL_ERROR_MEMORY;
+    goto free_fetch_result;
+  }
+
+  for(i = 0 ; i < carray_count(env_list->msg_tab) ; i ++) {
+    mailmessage * msg;
+    chashdatum key;
+    chashdatum value;
+
+    msg = carray_get(env_list->msg_tab, i);
+    if (msg->msg_flags != NULL)
+      continue;
+
+    key.data = &msg->msg_index;
+    key.len = sizeof(msg->msg_index);
+    value.data = msg;
+    value.len = 0;
+    r = chash_set(msg_hash, &key, &value, NULL);
+    if (r < 0) {
+      res = MAIL_ERROR_MEMORY;
+      goto free_hash;
+    }
+  }
+
+  for(cur = clist_begin(fetch_result) ; cur != NULL ; cur = clist_next(cur)) {
+    struct mailimap_msg_att * msg_att;
+    struct mailimap_msg_att_dynamic * att_dyn;
+    struct mail_flags * flags;
+    mailmessage * msg;
+    chashdatum key;
+    chashdatum value;
+    uint32_t uid;
+
+    msg_att = clist_content(cur);
+    r = imap_get_msg_att_info(msg_att, &uid, NULL, NULL, NULL, &att_dyn, NULL);
+    if (r != MAIL_NO_ERROR)
+      continue;
+    if ((uid == 0) || (att_dyn == NULL))
+      continue;
+
+    key.data = &uid;
+    key.len = sizeof(uid);
+    r = chash_get(msg_hash, &key, &value);
+    if (r < 0)
+      continue;
+
+    msg = value.data;
+    r = imap_flags_to_flags(att_dyn, &flags);
+    if (r == MAIL_NO_ERROR)
+      msg->msg_flags = flags;
+  }
+
+  /* unchanged flags */
+  for(i = 0 ; i < carray_count(env_list->msg_tab) ; i ++) {
+    mailmessage * msg;
+    struct mail_flags * flags;
+    char keyname[PATH_MAX];
+    chashdatum key;
+    chashdatum value;
+
+    msg = carray_get(env_list->msg_tab, i);
+    if (msg->msg_flags != NULL)
+      continue;
+
+    snprintf(keyname, PATH_MAX, "%s-flags", msg->msg_uid);
+    r = generic_cache_flags_read(cache_db, mmapstr, keyname, &flags);
+    if (r != MAIL_NO_ERROR)
+      continue;
+
+    msg->msg_flags = flags;
+
+    key.data = &msg->msg_index;
+    key.len = sizeof(msg->msg_index);
+    value.data = NULL;
+    value.len = 0;
+    r = chash_set(cached_uids, &key, &value, NULL);
+    if (r < 0) {
+      res = MAIL_ERROR_MEMORY;
+      goto free_hash;
+    }
+  }
+
+  chash_free(msg_hash);
+  mailimap_fetch_list_free(fetch_result);
+
+  return MAIL_NO_ERROR;
+
+ free_hash:
+  chash_free(msg_hash);
+ free_fetch_result:
+  mailimap_fetch_list_free(fetch_result);
+ err:
+  return res;
+}
+
+static int write_flags_list(mailsession * session,
+    struct mailmessage_list * env_list,
+    struct mail_cache_db * cache_db, MMAPString * mmapstr,
+    chash * cached_uids, uint64_t modseq)
+{
+  mailimap * imap;
+  unsigned int i;
+  int r;
+
+  imap = get_imap_session(session);
+
+  mail_cache_db_begin_batch(cache_db);
+
+  for(i = 0 ; i < carray_count(env_list->msg_tab) ; i ++) {
+    mailmessage * msg;
+    char keyname[PATH_MAX];
+    chashdatum key;
+    chashdatum value;
+
+    msg = carray_get(env_list->msg_tab, i);
+    if (msg->msg_flags == NULL)
+      continue;
+
+    key.data = &msg->msg_index;
+    key.len = sizeof(msg->msg_index);
+    if (chash_get(cached_uids, &key, &value) == 0)
+      continue;
+
+    snprintf(keyname, PATH_MAX, "%s-flags", msg->msg_uid);
+    r = generic_cache_flags_write(cache_db, mmapstr, keyname, msg->msg_flags);
+    if (r != MAIL_NO_ERROR) {
+      mail_cache_db_end_batch(cache_db);
+      return r;
+    }
+  }
+
+  maildriver_cache_clean_up(NULL, cache_db, env_list);
+
+  r = write_cached_modseq(cache_db,
+      imap->imap_selection_info->sel_uidvalidity, modseq);
+
+  mail_cache_db_end_batch(cache_db);
+
+  return r;
+}
+
+#define IMAP_SET_MAX_COUNT 100
+
+static int fetch_flags_list(mailsession * session,
+    struct mailmessage_list * env_list, int with_modseq)
+{
+  struct mailimap_set * set;
+  struct mailimap_fetch_type * fetch_type;
+  int res;
+  clist * fetch_result;
+  int r;
+  clist * msg_list;
+#if 0
+  struct imap_session_state_data * data;
+#endif
+  unsigned i;
+  unsigned dest;
+  clistiter * set_iter;
+
+#if 0
+  data = session->data;
+#endif
+
+  r = get_flags_fetch_type(with_modseq, &fetch_type);
+  if (r != MAIL_NO_ERROR) {
+    res = r;
+    goto err;
+  }
+
   r = maildriver_env_list_to_msg_list_no_flags(env_list, &msg_list);
   if (r != MAIL_NO_ERROR) {
     res = MAIL_ERROR_MEMORY;
@@ -1320,6 +1739,84 @@ static int get_flags_list(mailsession * session,
   return res;
 }
 
+static int get_flags_list(mailsession * session,
+			  struct mailmessage_list * env_list)
+{
+  struct imap_cached_session_state_data * data;
+  struct mail_cache_db * cache_db;
+  MMAPString * mmapstr;
+  chash * cached_uids;
+  char filename[PATH_MAX];
+  uint64_t modseq;
+  int r;
+  int res;
+
+  data = get_cached_data(session);
+
+  /*
+    the flags are stored as being in sync with the mod-sequence of the
+    mailbox when it was selected, before the first FETCH. The highest
+    mod-sequence of the responses can't be used, a message fetched in
+    an earlier batch may have changed meanwhile with a lower one.
+  */
+  modseq = data->imap_select_modseq;
+
+  if ((!data->imap_has_modseq) || (data->imap_quoted_mb == NULL))
+    return fetch_flags_list(session, env_list, 0);
+
+  mmapstr = mmap_string_new("");
+  if (mmapstr == NULL) {
+    res = MAIL_ERROR_MEMORY;
+    goto err;
+  }
+
+  cached_uids = chash_new(CHASH_DEFAULTSIZE, CHASH_COPYKEY);
+  if (cached_uids == NULL) {
+    res = MAIL_ERROR_MEMORY;
+    goto free_mmapstr;
+  }
+
+  snprintf(filename, PATH_MAX, "%s/%s", data->imap_quoted_mb, FLAGS_NAME);
+
+  r = mail_cache_db_open_lock(filename, &cache_db);
+  if (r < 0) {
+    chash_free(cached_uids);
+    mmap_string_free(mmapstr);
+    return fetch_flags_list(session, env_list, 1);
+  }
+
+  r = get_changed_flags_list(session, env_list, cache_db, mmapstr,
+      cached_uids);
+  if (r != MAIL_NO_ERROR) {
+    res = r;
+    goto close_db;
+  }
+
+  /* messages that are neither in the cache nor new */
+  r = fetch_flags_list(session, env_list, 1);
+  if (r != MAIL_NO_ERROR) {
+    res = r;
+    goto close_db;
+  }
+
+  write_flags_list(session, env_list, cache_db, mmapstr,
+      cached_uids, modseq);
+
+  mail_cache_db_close_unlock(filename, cache_db);
+  chash_free(cached_uids);
+  mmap_string_free(mmapstr);
+
+  return MAIL_NO_ERROR;
+
+ close_db:
+  mail_cache_db_close_unlock(filename, cache_db);
+  chash_free(cached_uids);
+ free_mmapstr:
+  mmap_string_free(mmapstr);
+ err:
+  return res;
+}
+
 
 static int
 imapdriver_cached_get_envelopes_list(mailsession * session,
@@ -1405,6 +1902,8 @@ imapdriver_cached_get_envelopes_list(mailsession * session,
     goto free_mmapstr;
   }
 
+  mail_cache_db_begin_batch(cache_db);
+
   for(i = 0 ; i < carray_count(env_list->msg_tab) ; i ++) {
     mailmessage * msg;
 
@@ -1421,6 +1920,8 @@ imapdriver_cached_get_envelopes_list(mailsession * session,
   /* flush cache */
   
   maildriver_cache_clean_up(cache_db, NULL, env_list);
+
+  mail_cache_db_end_batch(cache_db);
   
   mail_cache_db_close_unlock(filename, cache_db);
   mmap_string_free(mmapstr);
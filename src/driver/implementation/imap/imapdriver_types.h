@@ -80,6 +80,10 @@ struct imap_cached_session_state_data {
   char imap_cache_directory[PATH_MAX];
   carray * imap_uid_list;
   uint32_t imap_uidvalidity;
+  /* CONDSTORE / QRESYNC */
+  int imap_qresync_enabled;
+  int imap_has_modseq;
+  uint64_t imap_select_modseq;
 };
 
 
@@ -266,6 +266,8 @@ static int flags_store_process(char * flags_directory, char * quoted_mb,
     goto close_db_flags;
   }
 
+  mail_cache_db_begin_batch(cache_db_flags);
+
   for(i = 0 ; i < carray_count(flags_store->fls_tab) ; i ++) {
     mailmessage * msg;
 
@@ -278,6 +280,8 @@ static int flags_store_process(char * flags_directory, char * quoted_mb,
     }
   }
 
+  mail_cache_db_end_batch(cache_db_flags);
+
   mmap_string_free(mmapstr);
   mail_cache_db_close_unlock(filename_flags, cache_db_flags);
 
@@ -666,6 +670,8 @@ static int get_messages_list(mailsession * session,
     memcpy(&max_uid, value, sizeof(max_uid));
   }
 
+  mail_cache_db_begin_batch(uid_db);
+
   for(i = 0 ; i < carray_count(env_list->msg_tab) ; i ++) {
     mailmessage * msg;
     uint32_t indx;
@@ -695,6 +701,8 @@ static int get_messages_list(mailsession * session,
 
   uid_clean_up(uid_db, env_list);
 
+  mail_cache_db_end_batch(uid_db);
+
   mail_cache_db_close_unlock(filename, uid_db);
 
   * result = env_list;
@@ -904,6 +912,9 @@ static int get_envelopes_list(mailsession * session,
 
   /* must write cache */
 
+  mail_cache_db_begin_batch(cache_db_env);
+  mail_cache_db_begin_batch(cache_db_flags);
+
   for(i = 0 ; i < carray_count(env_list->msg_tab) ; i ++) {
     mailmessage * msg;
 
@@ -927,6 +938,9 @@ static int get_envelopes_list(mailsession * session,
 
   maildriver_cache_clean_up(cache_db_env, cache_db_flags, env_list);
 
+  mail_cache_db_end_batch(cache_db_flags);
+  mail_cache_db_end_batch(cache_db_env);
+
   mail_cache_db_close_unlock(filename_flags, cache_db_flags);
   mail_cache_db_close_unlock(filename_env, cache_db_env);
 
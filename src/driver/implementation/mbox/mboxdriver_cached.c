@@ -311,6 +311,8 @@ static int mbox_flags_store_process(char * flags_directory, char * quoted_mb,
     goto close_db_flags;
   }
 
+  mail_cache_db_begin_batch(cache_db_flags);
+
   for(i = 0 ; i < carray_count(flags_store->fls_tab) ; i ++) {
     mailmessage * msg;
 
@@ -323,6 +325,8 @@ static int mbox_flags_store_process(char * flags_directory, char * quoted_mb,
     }
   }
 
+  mail_cache_db_end_batch(cache_db_flags);
+
   mmap_string_free(mmapstr);
   mail_cache_db_close_unlock(filename_flags, cache_db_flags);
 
@@ -1240,6 +1244,9 @@ mboxdriver_cached_get_envelopes_list(mailsession * session,
 
   /* must write cache */
 
+  mail_cache_db_begin_batch(cache_db_env);
+  mail_cache_db_begin_batch(cache_db_flags);
+
   for(i = 0 ; i < carray_count(env_list->msg_tab) ; i ++) {
     mailmessage * msg;
 
@@ -1263,6 +1270,9 @@ mboxdriver_cached_get_envelopes_list(mailsession * session,
 
   maildriver_cache_clean_up(cache_db_env, cache_db_flags, env_list);
 
+  mail_cache_db_end_batch(cache_db_flags);
+  mail_cache_db_end_batch(cache_db_env);
+
   mail_cache_db_close_unlock(filename_flags, cache_db_flags);
   mail_cache_db_close_unlock(filename_env, cache_db_env);
 
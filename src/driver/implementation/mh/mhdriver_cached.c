@@ -436,6 +436,8 @@ static int mh_flags_store_process(char * flags_directory, char * quoted_mb,
     goto close_db_flags;
   }
   
+  mail_cache_db_begin_batch(cache_db_flags);
+
   for(i = 0 ; i < carray_count(flags_store->fls_tab) ; i ++) {
     mailmessage * msg;
 
@@ -445,6 +447,8 @@ static int mh_flags_store_process(char * flags_directory, char * quoted_mb,
         msg->msg_uid, msg->msg_flags);
   }
 
+  mail_cache_db_end_batch(cache_db_flags);
+
   mmap_string_free(mmapstr);
   mail_cache_db_close_unlock(filename_flags, cache_db_flags);
 
@@ -1207,6 +1211,9 @@ mhdriver_cached_get_envelopes_list(mailsession * session,
 
   /* must write cache */
 
+  mail_cache_db_begin_batch(cache_db_env);
+  mail_cache_db_begin_batch(cache_db_flags);
+
   for(i = 0 ; i < carray_count(env_list->msg_tab) ; i ++) {
     mailmessage * msg;
 
@@ -1228,6 +1235,9 @@ mhdriver_cached_get_envelopes_list(mailsession * session,
   /* flush cache */
   
   maildriver_cache_clean_up(cache_db_env, cache_db_flags, env_list);
+
+  mail_cache_db_end_batch(cache_db_flags);
+  mail_cache_db_end_batch(cache_db_env);
   
   mail_cache_db_close_unlock(filename_flags, cache_db_flags);
   mail_cache_db_close_unlock(filename_env, cache_db_env);
@@ -195,6 +195,9 @@ static int nntpdriver_initialize(mailsession * session)
 
   data->nntp_mode_reader = FALSE;
 
+  data->nntp_capabilities_checked = FALSE;
+  data->nntp_authenticated = FALSE;
+
   session->sess_data = data;
 
   return MAIL_NO_ERROR;
@@ -648,10 +651,112 @@ static int nntpdriver_append_message_flags(mailsession * session,
 }
 
 
-static int xover_resp_to_fields(struct newsnntp_xover_resp_item * item,
+static int xover_resp_to_fields(struct newsnntp_over_line * item,
 				struct mailimf_fields ** result);
 
 
+/* use OVER and COMPRESS DEFLATE when the server offers them */
+
+static int nntpdriver_check_capabilities(mailsession * session)
+{
+  newsnntp * nntp;
+  struct nntp_session_state_data * data;
+  int r;
+
+  nntp = get_nntp_session(session);
+
+  data = get_data(session);
+
+  if (data->nntp_capabilities_checked)
+    return MAIL_NO_ERROR;
+
+  data->nntp_capabilities_checked = TRUE;
+
+  r = newsnntp_capabilities(nntp);
+  if (r == NEWSNNTP_ERROR_STREAM)
+    return MAIL_ERROR_STREAM;
+  if (r != NEWSNNTP_NO_ERROR)
+    return MAIL_NO_ERROR;
+
+  if (!newsnntp_has_compress_deflate(nntp))
+    return MAIL_NO_ERROR;
+
+  /*
+    the credentials are not sent in the compressed stream, COMPRESS
+    waits until the authentication when the server may ask for it
+  */
+  if ((data->nntp_userid != NULL) && !data->nntp_authenticated &&
+      newsnntp_has_capability(nntp, "AUTHINFO"))
+    return MAIL_NO_ERROR;
+
+  r = newsnntp_compress(nntp);
+  switch (r) {
+  case NEWSNNTP_NO_ERROR:
+    break;
+
+  case NEWSNNTP_ERROR_STREAM:
+  case NEWSNNTP_ERROR_MEMORY:
+    return nntpdriver_nntp_error_to_mail_error(r);
+
+  default:
+    return MAIL_NO_ERROR;
+  }
+
+  /* the capabilities are fetched again after COMPRESS */
+  r = newsnntp_capabilities(nntp);
+  if (r == NEWSNNTP_ERROR_STREAM)
+    return MAIL_ERROR_STREAM;
+
+  return MAIL_NO_ERROR;
+}
+
+struct envelopes_over_state {
+  struct mailmessage_list * env_list;
+  unsigned int index;
+};
+
+static int over_line_to_envelope(struct newsnntp_over_line * line,
+    void * context)
+{
+  struct envelopes_over_state * state;
+  carray * msg_tab;
+  mailmessage * info;
+  struct mailimf_fields * fields;
+  int r;
+
+  state = context;
+  msg_tab = state->env_list->msg_tab;
+
+  /* both the messages and the overview are sorted by article number */
+  while (state->index < carray_count(msg_tab)) {
+    info = carray_get(msg_tab, state->index);
+    if (info->msg_index >= line->ovr_article)
+      break;
+    state->index ++;
+  }
+
+  if (state->index >= carray_count(msg_tab))
+    return NEWSNNTP_NO_ERROR;
+
+  info = carray_get(msg_tab, state->index);
+  if (info->msg_index != line->ovr_article)
+    return NEWSNNTP_NO_ERROR;
+
+  if (info->msg_fields == NULL) {
+    fields = NULL;
+    r = xover_resp_to_fields(line, &fields);
+    if (r == MAIL_NO_ERROR) {
+      info->msg_fields = fields;
+    }
+
+    info->msg_size = line->ovr_size;
+  }
+
+  state->index ++;
+
+  return NEWSNNTP_NO_ERROR;
+}
+
 static int
 nntpdriver_get_envelopes_list(mailsession * session,
 			      struct mailmessage_list * env_list)
@@ -659,9 +764,8 @@ nntpdriver_get_envelopes_list(mailsession * session,
   newsnntp * nntp;
   int r;
   struct nntp_session_state_data * data;
-  clist * list;
+  struct envelopes_over_state state;
   int done;
-  clistiter * cur;
   uint32_t first_seq;
   unsigned int i;
 
@@ -701,189 +805,56 @@ nntpdriver_get_envelopes_list(mailsession * session,
     }
   }
 
-  if (first_seq > data->nntp_group_info->grp_last) {
-    list = NULL;
-  }
-  else {
-    done = FALSE;
-    do {
-      r = newsnntp_xover_range(nntp, first_seq,
-          data->nntp_group_info->grp_last, &list);
-
-      switch (r) {
-      case NEWSNNTP_ERROR_REQUEST_AUTHORIZATION_USERNAME:
-	r = nntpdriver_authenticate_user(session);
-	if (r != MAIL_NO_ERROR)
-	  return r;
-	break;
-
-      case NEWSNNTP_WARNING_REQUEST_AUTHORIZATION_PASSWORD:
-	r = nntpdriver_authenticate_password(session);
-	if (r != MAIL_NO_ERROR)
-	  return r;
-	break;
-
-      case NEWSNNTP_NO_ERROR:
-	done = TRUE;
-	break;
-
-      default:
-	return nntpdriver_nntp_error_to_mail_error(r);
-      }
-    }
-    while (!done);
-  }
-
-#if 0
-  i = 0;
-  j = 0;
-
-  if (list != NULL) {
-    for(cur = clist_begin(list) ; cur != NULL ; cur = clist_next(cur)) {
-      struct newsnntp_xover_resp_item * item;
-      struct mailimf_fields * fields;
-
-      item = clist_content(cur);
-
-      while (i < carray_count(env_list->msg_tab)) {
-	mailmessage * info;
-
-	info = carray_get(env_list->msg_tab, i);
-
-	if (item->ovr_article == info->msg_index) {
-
-	  if (info->fields == NULL) {
-	    r = xover_resp_to_fields(item, &fields);
-	    if (r == MAIL_NO_ERROR) {
-	      info->fields = fields;
-	    }
-
-	    info->size = item->ovr_size;
-
-	    carray_set(env_list->msg_tab, j, info);
-	    j ++;
-	    i ++;
-	    break;
-	  }
-	  else {
-	    carray_set(env_list->msg_tab, j, info);
-	    j ++;
-	  }
-	}
-	else {
-	  if (info->fields != NULL) {
-	    carray_set(env_list->msg_tab, j, info);
-	    j ++;
-	  }
-	  else {
-            if (info->flags != NULL) {
-              info->flags->flags &= ~MAIL_FLAG_NEW;
-              info->flags->flags |= MAIL_FLAG_SEEN | MAIL_FLAG_DELETED;
-              mailmessage_check(info);
-            }
-	    mailmessage_free(info);
-	    carray_set(env_list->msg_tab, i, NULL);
-	  }
-	}
-
-	i ++;
-      }
-    }
-  }
-
-  while (i < carray_count(env_list->msg_tab)) {
-    mailmessage * info;
-
-    info = carray_get(env_list->msg_tab, i);
-    if (info->fields != NULL) {
-      carray_set(env_list->msg_tab, j, info);
-      j ++;
-    }
-    else {
-      if (info->flags != NULL) {
-        info->flags->flags &= ~MAIL_FLAG_NEW;
-        info->flags->flags |= MAIL_FLAG_SEEN | MAIL_FLAG_DELETED;
-        mailmessage_check(info);
-      }
-      mailmessage_free(info);
-      carray_set(env_list->msg_tab, i, NULL);
-    }
-
-    i ++;
-  }
+  if (first_seq > data->nntp_group_info->grp_last)
+    return MAIL_NO_ERROR;
 
-  r = carray_set_size(env_list->msg_tab, j);
-  if (r < 0) {
-    if (list != NULL)
-      newsnntp_xover_resp_list_free(list);
-    return MAIL_ERROR_MEMORY;
-  }
-#endif
-  i = 0;
-
-  if (list != NULL) {
-    for(cur = clist_begin(list) ; cur != NULL ; cur = clist_next(cur)) {
-      struct newsnntp_xover_resp_item * item;
-      struct mailimf_fields * fields;
-
-      item = clist_content(cur);
-
-      while (i < carray_count(env_list->msg_tab)) {
-	mailmessage * info;
-
-	info = carray_get(env_list->msg_tab, i);
+  /*
+    the envelopes are built while the overview is read, the lines are
+    not kept in memory.
+  */
+  done = FALSE;
+  do {
+    /* the capabilities change after the authentication */
+    r = nntpdriver_check_capabilities(session);
+    if (r != MAIL_NO_ERROR)
+      return r;
 
-	if (item->ovr_article == info->msg_index) {
+    state.env_list = env_list;
+    state.index = 0;
 
-	  if (info->msg_fields == NULL) {
-            fields = NULL;
-	    r = xover_resp_to_fields(item, &fields);
-	    if (r == MAIL_NO_ERROR) {
-	      info->msg_fields = fields;
-	    }
+    r = newsnntp_over_range(nntp, first_seq,
+        data->nntp_group_info->grp_last, over_line_to_envelope, &state);
 
-	    info->msg_size = item->ovr_size;
+    switch (r) {
+    case NEWSNNTP_ERROR_REQUEST_AUTHORIZATION_USERNAME:
+      r = nntpdriver_authenticate_user(session);
+      if (r != MAIL_NO_ERROR)
+	return r;
+      break;
 
-	    i ++;
-	    break;
-	  }
-	}
-#if 0
-	else if ((info->fields == NULL) && (info->flags != NULL)) {
-          info->flags->flags &= ~MAIL_FLAG_NEW;
-          info->flags->flags |= MAIL_FLAG_CANCELLED;
-          mailmessage_check(info);
-	}
-#endif
+    case NEWSNNTP_WARNING_REQUEST_AUTHORIZATION_PASSWORD:
+      r = nntpdriver_authenticate_password(session);
+      if (r != MAIL_NO_ERROR)
+	return r;
+      break;
 
-	i ++;
-      }
-    }
-  }
+    case NEWSNNTP_NO_ERROR:
+    case NEWSNNTP_ERROR_INVALID_ARTICLE_NUMBER:
+      /* no article left in the range */
+      done = TRUE;
+      break;
 
-#if 0
-  while (i < env_list->msg_tab->len) {
-    mailmessage * info;
-
-    info = carray_get(env_list->msg_tab, i);
-    if ((info->fields == NULL) && (info->flags != NULL)) {
-      info->flags->flags &= ~MAIL_FLAG_NEW;
-      info->flags->flags |= MAIL_FLAG_CANCELLED;
-      mailmessage_check(info);
+    default:
+      return nntpdriver_nntp_error_to_mail_error(r);
     }
-
-    i ++;
   }
-#endif
-
-  if (list != NULL)
-    newsnntp_xover_resp_list_free(list);
+  while (!done);
 
   return MAIL_NO_ERROR;
 }
 
 
-static int xover_resp_to_fields(struct newsnntp_xover_resp_item * item,
+static int xover_resp_to_fields(struct newsnntp_over_line * item,
 				struct mailimf_fields ** result)
 {
   size_t cur_token;
@@ -241,6 +241,8 @@ static int nntpdriver_cached_initialize(mailsession * session)
   if (data->nntp_ancestor == NULL)
     goto free_store;
 
+  data->nntp_prefetch_window = 0;
+
   session->sess_data = data;
 
   return MAIL_NO_ERROR;
@@ -284,6 +286,8 @@ static int nntp_flags_store_process(char * flags_directory, char * group_name,
     goto close_db_flags;
   }
 
+  mail_cache_db_begin_batch(cache_db_flags);
+
   for(i = 0 ; i < carray_count(flags_store->fls_tab) ; i ++) {
     mailmessage * msg;
 
@@ -293,6 +297,8 @@ static int nntp_flags_store_process(char * flags_directory, char * group_name,
         msg->msg_index, msg->msg_flags);
   }
 
+  mail_cache_db_end_batch(cache_db_flags);
+
   mmap_string_free(mmapstr);
   mail_cache_db_close_unlock(filename_flags, cache_db_flags);
 
@@ -355,6 +361,10 @@ static int nntpdriver_cached_parameters(mailsession * session,
 
     return MAIL_NO_ERROR;
 
+  case NNTPDRIVER_CACHED_SET_PREFETCH_WINDOW:
+    cached_data->nntp_prefetch_window = * (uint32_t *) value;
+    return MAIL_NO_ERROR;
+
   default:
     return mailsession_parameters(get_ancestor(session), id, value);
   }
@@ -829,6 +839,88 @@ static void get_uid_from_filename(char * filename)
     * p = 0;
 }
 
+static int prefetch_store_article(uint32_t indx, int error,
+    char * content, size_t content_len, void * context)
+{
+  mailsession * session;
+  struct nntp_cached_session_state_data * cached_data;
+  struct nntp_session_state_data * ancestor_data;
+  char filename[PATH_MAX];
+
+  /* the article may have been cancelled since the overview was read */
+  if (error != NEWSNNTP_NO_ERROR)
+    return NEWSNNTP_NO_ERROR;
+
+  session = context;
+  cached_data = get_cached_data(session);
+  ancestor_data = get_ancestor_data(session);
+
+  snprintf(filename, PATH_MAX, "%s/%s/%i", cached_data->nntp_cache_directory,
+      ancestor_data->nntp_group_name, indx);
+
+  generic_cache_store(filename, content, content_len);
+  newsnntp_article_free(content);
+
+  return NEWSNNTP_NO_ERROR;
+}
+
+/*
+  fetch the articles of the list that are not in the cache yet,
+  the ARTICLE commands are pipelined.
+*/
+
+static int nntpdriver_cached_prefetch(mailsession * session,
+    struct mailmessage_list * env_list)
+{
+  struct nntp_cached_session_state_data * cached_data;
+  struct nntp_session_state_data * ancestor_data;
+  uint32_t * indexes;
+  unsigned int count;
+  unsigned int i;
+  char filename[PATH_MAX];
+  struct stat stat_info;
+  int r;
+
+  cached_data = get_cached_data(session);
+  ancestor_data = get_ancestor_data(session);
+
+  if (carray_count(env_list->msg_tab) == 0)
+    return MAIL_NO_ERROR;
+
+  indexes = malloc(carray_count(env_list->msg_tab) * sizeof(* indexes));
+  if (indexes == NULL)
+    return MAIL_ERROR_MEMORY;
+
+  count = 0;
+  for(i = 0 ; i < carray_count(env_list->msg_tab) ; i ++) {
+    mailmessage * msg;
+
+    msg = carray_get(env_list->msg_tab, i);
+
+    /* cancelled */
+    if (msg->msg_fields == NULL)
+      continue;
+
+    snprintf(filename, PATH_MAX, "%s/%s/%i",
+        cached_data->nntp_cache_directory,
+        ancestor_data->nntp_group_name, msg->msg_index);
+    if (stat(filename, &stat_info) == 0)
+      continue;
+
+    indexes[count] = msg->msg_index;
+    count ++;
+  }
+
+  r = MAIL_NO_ERROR;
+  if (count > 0)
+    r = nntpdriver_article_pipelined(get_ancestor(session), indexes, count,
+        cached_data->nntp_prefetch_window, prefetch_store_article, session);
+
+  free(indexes);
+
+  return r;
+}
+
 static int
 nntpdriver_cached_get_envelopes_list(mailsession * session,
 				     struct mailmessage_list * env_list)
@@ -960,6 +1052,9 @@ nntpdriver_cached_get_envelopes_list(mailsession * session,
 
   /* must write cache */
 
+  mail_cache_db_begin_batch(cache_db_env);
+  mail_cache_db_begin_batch(cache_db_flags);
+
   for(i = 0 ; i < carray_count(env_list->msg_tab) ; i ++) {
     mailmessage * msg;
 
@@ -998,6 +1093,9 @@ nntpdriver_cached_get_envelopes_list(mailsession * session,
 
   maildriver_cache_clean_up(cache_db_env, cache_db_flags, env_list);
 
+  mail_cache_db_end_batch(cache_db_flags);
+  mail_cache_db_end_batch(cache_db_env);
+
   /* remove cache files */
 
   snprintf(cache_dir, PATH_MAX, "%s/%s",
@@ -1010,6 +1108,10 @@ nntpdriver_cached_get_envelopes_list(mailsession * session,
   maildriver_message_cache_clean_up(cache_dir, env_list,
       get_uid_from_filename);
 
+  /* the envelopes are there even if the prefetch fails */
+  if (cached_data->nntp_prefetch_window != 0)
+    nntpdriver_cached_prefetch(session, env_list);
+
   return MAIL_NO_ERROR;
 
  close_db_env:
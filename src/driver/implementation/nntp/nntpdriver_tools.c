@@ -114,6 +114,9 @@ int nntpdriver_nntp_error_to_mail_error(int error)
   case NEWSNNTP_ERROR_AUTHENTICATION_OUT_OF_SEQUENCE:
     return MAIL_ERROR_BAD_STATE;
 
+  case NEWSNNTP_ERROR_COMPRESS:
+    return MAIL_ERROR_COMMAND_NOT_SUPPORTED;
+
   case NEWSNNTP_ERROR_REQUEST_AUTHORIZATION_USERNAME:
   case NEWSNNTP_WARNING_REQUEST_AUTHORIZATION_PASSWORD:
   default:
@@ -155,6 +158,14 @@ static inline newsnntp * cached_session_get_nntp_session(mailsession * session)
 }
 
 
+/* the capabilities are checked again once authenticated */
+
+static void set_authenticated(struct nntp_session_state_data * data)
+{
+  data->nntp_authenticated = TRUE;
+  data->nntp_capabilities_checked = FALSE;
+}
+
 int nntpdriver_authenticate_password(mailsession * session)
 {
   struct nntp_session_state_data * data;
@@ -167,6 +178,8 @@ int nntpdriver_authenticate_password(mailsession * session)
 
   r = newsnntp_authinfo_password(session_get_nntp_session(session),
       data->nntp_password);
+  if (r == NEWSNNTP_NO_ERROR)
+    set_authenticated(data);
 
   return nntpdriver_nntp_error_to_mail_error(r);
 }
@@ -225,6 +238,10 @@ int nntpdriver_authenticate_user(mailsession * session)
   case NEWSNNTP_WARNING_REQUEST_AUTHORIZATION_PASSWORD:
     return nntpdriver_authenticate_password(session);
 
+  case NEWSNNTP_NO_ERROR:
+    set_authenticated(data);
+    return MAIL_NO_ERROR;
+
   default:
     return nntpdriver_nntp_error_to_mail_error(r);
   }
@@ -273,6 +290,69 @@ int nntpdriver_article(mailsession * session, uint32_t indx,
   return MAIL_NO_ERROR;
 }
 
+struct pipelined_progress {
+  newsnntp_content_callback * callback;
+  void * context;
+  unsigned int done;
+};
+
+static int pipelined_progress_callback(uint32_t indx, int error,
+    char * content, size_t content_len, void * context)
+{
+  struct pipelined_progress * progress;
+
+  progress = context;
+  progress->done ++;
+
+  return progress->callback(indx, error, content, content_len,
+      progress->context);
+}
+
+int nntpdriver_article_pipelined(mailsession * session,
+    const uint32_t * indexes, unsigned int count, unsigned int window,
+    newsnntp_content_callback * callback, void * context)
+{
+  struct pipelined_progress progress;
+  int r;
+  int done;
+
+  progress.callback = callback;
+  progress.context = context;
+  progress.done = 0;
+
+  /* after authentication, resume after the last processed article */
+  done = FALSE;
+  do {
+    r = newsnntp_article_pipelined(session_get_nntp_session(session),
+        indexes + progress.done, count - progress.done, window,
+        pipelined_progress_callback, &progress);
+    
+    switch (r) {
+    case NEWSNNTP_ERROR_REQUEST_AUTHORIZATION_USERNAME:
+      r = nntpdriver_authenticate_user(session);
+      if (r != MAIL_NO_ERROR)
+	return r;
+      break;
+      
+    case NEWSNNTP_WARNING_REQUEST_AUTHORIZATION_PASSWORD:
+      r = nntpdriver_authenticate_password(session);
+      if (r != MAIL_NO_ERROR)
+	return r;
+      break;
+
+    case NEWSNNTP_NO_ERROR:
+      done = TRUE;
+      break;
+
+    default:
+      return nntpdriver_nntp_error_to_mail_error(r);
+    }
+  }
+  while (!done);
+
+  return MAIL_NO_ERROR;
+}
+
 int nntpdriver_head(mailsession * session, uint32_t indx,
 		    char ** result,
 		    size_t * result_len)
@@ -316,19 +396,30 @@ int nntpdriver_head(mailsession * session, uint32_t indx,
   return MAIL_NO_ERROR;
 }
 
+static int over_line_size(struct newsnntp_over_line * line, void * context)
+{
+  size_t * p_size;
+
+  p_size = context;
+  * p_size = line->ovr_size;
+
+  return NEWSNNTP_NO_ERROR;
+}
+
 int nntpdriver_size(mailsession * session, uint32_t indx,
 		    size_t * result)
 {
   newsnntp * nntp;
-  struct newsnntp_xover_resp_item * item;
+  size_t size;
   int r;
   int done;
 
   nntp = session_get_nntp_session(session);
 
+  size = 0;
   done = FALSE;
   do {
-    r = newsnntp_xover_single(nntp, indx, &item);
+    r = newsnntp_over_range(nntp, indx, indx, over_line_size, &size);
     switch (r) {
     case NEWSNNTP_ERROR_REQUEST_AUTHORIZATION_USERNAME:
       r = nntpdriver_authenticate_user(session);
@@ -352,9 +443,7 @@ int nntpdriver_size(mailsession * session, uint32_t indx,
   }
   while (!done);
 
-  * result = item->ovr_size;
-
-  xover_resp_item_free(item);
+  * result = size;
 
   return MAIL_NO_ERROR;
 }
@@ -53,6 +53,10 @@ int nntpdriver_authenticate_user(mailsession * session);
 int nntpdriver_article(mailsession * session, uint32_t indx,
 		       char ** result, size_t * result_len);
 
+int nntpdriver_article_pipelined(mailsession * session,
+    const uint32_t * indexes, unsigned int count, unsigned int window,
+    newsnntp_content_callback * callback, void * context);
+
 int nntpdriver_head(mailsession * session, uint32_t indx,
 		    char ** result,
 		    size_t * result_len);
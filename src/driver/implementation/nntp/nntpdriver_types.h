@@ -68,6 +68,9 @@ struct nntp_session_state_data {
   uint32_t nntp_max_articles;
 
   int nntp_mode_reader;
+
+  int nntp_capabilities_checked;
+  int nntp_authenticated;
 };
 
 /* cached NNTP driver for session */
@@ -77,7 +80,13 @@ enum {
   NNTPDRIVER_CACHED_SET_MAX_ARTICLES = 1,
   /* cache specific */
   NNTPDRIVER_CACHED_SET_CACHE_DIRECTORY,
-  NNTPDRIVER_CACHED_SET_FLAGS_DIRECTORY
+  NNTPDRIVER_CACHED_SET_FLAGS_DIRECTORY,
+  /*
+    value is a uint32_t *. When it is not 0, the articles that are not
+    in the cache are fetched when the envelopes are fetched, with up
+    to this number of pipelined ARTICLE commands.
+  */
+  NNTPDRIVER_CACHED_SET_PREFETCH_WINDOW
 };
 
 struct nntp_cached_session_state_data {
@@ -85,6 +94,7 @@ struct nntp_cached_session_state_data {
   char nntp_cache_directory[PATH_MAX];
   char nntp_flags_directory[PATH_MAX];
   struct mail_flags_store * nntp_flags_store;
+  uint32_t nntp_prefetch_window;
 };
 
 
@@ -267,6 +267,8 @@ static int pop3_flags_store_process(char * flags_directory,
     goto close_db_flags;
   }
 
+  mail_cache_db_begin_batch(cache_db_flags);
+
   for(i = 0 ; i < carray_count(flags_store->fls_tab) ; i ++) {
     mailmessage * msg;
 
@@ -276,6 +278,8 @@ static int pop3_flags_store_process(char * flags_directory,
         msg->msg_uid, msg->msg_flags);
   }
 
+  mail_cache_db_end_batch(cache_db_flags);
+
   mmap_string_free(mmapstr);
   mail_cache_db_close_unlock(filename_flags, cache_db_flags);
 
@@ -826,6 +830,9 @@ pop3driver_cached_get_envelopes_list(mailsession * session,
 
   /* must write cache */
 
+  mail_cache_db_begin_batch(cache_db_env);
+  mail_cache_db_begin_batch(cache_db_flags);
+
   for(i = 0 ; i < carray_count(env_list->msg_tab) ; i ++) {
     mailmessage * msg;
 
@@ -848,6 +855,9 @@ pop3driver_cached_get_envelopes_list(mailsession * session,
 
   maildriver_cache_clean_up(cache_db_env, cache_db_flags, env_list);
 
+  mail_cache_db_end_batch(cache_db_flags);
+  mail_cache_db_end_batch(cache_db_env);
+
   mail_cache_db_close_unlock(filename_flags, cache_db_flags);
   mail_cache_db_close_unlock(filename_env, cache_db_env);
   mmap_string_free(mmapstr);
@@ -42,50 +42,8 @@
 #include <stdlib.h>
 #include <string.h>
 
-static int mailimf_cache_field_write(MMAPString * mmapstr, size_t * indx,
-				     struct mailimf_field * field);
-static int mailimf_cache_orig_date_write(MMAPString * mmapstr, size_t * indx,
-					 struct mailimf_orig_date * date);
-static int mailimf_cache_date_time_write(MMAPString * mmapstr, size_t * indx,
-					 struct mailimf_date_time * date_time);
-static int mailimf_cache_from_write(MMAPString * mmapstr, size_t * indx,
-				    struct mailimf_from * from);
-static int mailimf_cache_sender_write(MMAPString * mmapstr, size_t * indx,
-				      struct mailimf_sender * sender);
-static int mailimf_cache_reply_to_write(MMAPString * mmapstr, size_t * indx,
-					struct mailimf_reply_to * reply_to);
-static int mailimf_cache_to_write(MMAPString * mmapstr, size_t * indx,
-				  struct mailimf_to * to);
-static int mailimf_cache_cc_write(MMAPString * mmapstr, size_t * indx,
-				  struct mailimf_cc * to);
-static int mailimf_cache_bcc_write(MMAPString * mmapstr, size_t * indx,
-				   struct mailimf_bcc * to);
-static int mailimf_cache_message_id_write(MMAPString * mmapstr, size_t * indx,
-					  struct mailimf_message_id * message_id);
-static int mailimf_cache_msg_id_list_write(MMAPString * mmapstr, size_t * indx,
-					   clist * list);
-static int mailimf_cache_in_reply_to_write(MMAPString * mmapstr, size_t * indx,
-					   struct mailimf_in_reply_to *
-					   in_reply_to);
-static int mailimf_cache_references_write(MMAPString * mmapstr, size_t * indx,
-					  struct mailimf_references * references);
-static int mailimf_cache_subject_write(MMAPString * mmapstr, size_t * indx,
-				       struct mailimf_subject * subject);
-static int mailimf_cache_address_list_write(MMAPString * mmapstr,
-					    size_t * indx,
-					    struct mailimf_address_list *
-					    addr_list);
-static int mailimf_cache_address_write(MMAPString * mmapstr, size_t * indx,
-				       struct mailimf_address * addr);
-static int mailimf_cache_group_write(MMAPString * mmapstr, size_t * indx,
-				     struct mailimf_group * group);
-static int mailimf_cache_mailbox_list_write(MMAPString * mmapstr,
-					    size_t * indx,
-					    struct mailimf_mailbox_list * mb_list);
-static int mailimf_cache_mailbox_write(MMAPString * mmapstr, size_t * indx,
-				       struct mailimf_mailbox * mb);
-
-
+static int mailimf_cache_old_fields_read(MMAPString * mmapstr, size_t * indx,
+    struct mailimf_fields ** result);
 static int mailimf_cache_field_read(MMAPString * mmapstr, size_t * indx,
 				    struct mailimf_field ** result);
 static int mailimf_cache_orig_date_read(MMAPString * mmapstr, size_t * indx,
@@ -266,41 +224,1160 @@ int mailimf_cache_string_read(MMAPString * mmapstr, size_t * indx,
     
     r = mail_serialize_read(mmapstr, indx, str, length);
     if (r != MAIL_NO_ERROR) {
-      free(str);
-      return MAIL_ERROR_FILE;
+      free(str);
+      return MAIL_ERROR_FILE;
+    }
+    
+    str[length] = 0;
+  }
+
+  * result = str;
+
+  return MAIL_NO_ERROR;
+}
+
+/*
+  compact format
+
+  The fields are written after a header which can not be the beginning
+  of the previous format (which began with the number of fields):
+  CACHE_FIELDS_MAGIC as a 32 bits integer, the version of the format
+  and the size of the records.
+
+  Each field is a record: its type, the size of its content and its
+  content. Integers are variable-length (7 bits per byte, least
+  significant first). A string is its length + 1 followed by its
+  characters, 0 is a NULL string. Lists are their number of items
+  followed by the items, the number of items is + 1 when the list can
+  be NULL.
+
+  Since records have a size, a field can be found and read without
+  reading the others, see mailimf_cache_fields_view_init().
+*/
+
+#define CACHE_FIELDS_MAGIC 0xffffffffU
+#define CACHE_FIELDS_VERSION 1
+
+struct cache_reader {
+  const unsigned char * cur;
+  const unsigned char * end;
+};
+
+static int cache_varint_write(MMAPString * mmapstr, uint32_t value)
+{
+  unsigned char buf[5];
+  size_t len;
+
+  len = 0;
+  while (value >= 0x80) {
+    buf[len ++] = (value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+  buf[len ++] = value;
+
+  if (mmap_string_append_len(mmapstr, (char *) buf, len) == NULL)
+    return MAIL_ERROR_MEMORY;
+
+  return MAIL_NO_ERROR;
+}
+
+static int cache_varint_read(struct cache_reader * reader, uint32_t * result)
+{
+  uint32_t value;
+  int shift;
+
+  value = 0;
+  for(shift = 0 ; shift < 35 ; shift += 7) {
+    unsigned char ch;
+
+    if (reader->cur >= reader->end)
+      return MAIL_ERROR_FILE;
+
+    ch = * reader->cur ++;
+    value |= (uint32_t) (ch & 0x7f) << shift;
+    if ((ch & 0x80) == 0) {
+      * result = value;
+      return MAIL_NO_ERROR;
+    }
+  }
+
+  return MAIL_ERROR_FILE;
+}
+
+static int cache_str_write(MMAPString * mmapstr, const char * str)
+{
+  size_t length;
+  int r;
+
+  if (str == NULL)
+    return cache_varint_write(mmapstr, 0);
+
+  length = strlen(str);
+  r = cache_varint_write(mmapstr, length + 1);
+  if (r != MAIL_NO_ERROR)
+    return r;
+
+  if (mmap_string_append_len(mmapstr, str, length) == NULL)
+    return MAIL_ERROR_MEMORY;
+
+  return MAIL_NO_ERROR;
+}
+
+/* the string is not terminated, * result is NULL for a NULL string */
+
+static int cache_str_view(struct cache_reader * reader,
+    const char ** result, size_t * result_len)
+{
+  uint32_t length;
+  int r;
+
+  r = cache_varint_read(reader, &length);
+  if (r != MAIL_NO_ERROR)
+    return r;
+
+  if (length == 0) {
+    * result = NULL;
+    * result_len = 0;
+    return MAIL_NO_ERROR;
+  }
+
+  length --;
+  if ((size_t) (reader->end - reader->cur) < length)
+    return MAIL_ERROR_FILE;
+
+  * result = (const char *) reader->cur;
+  * result_len = length;
+  reader->cur += length;
+
+  return MAIL_NO_ERROR;
+}
+
+static int cache_str_read(struct cache_reader * reader, char ** result)
+{
+  const char * data;
+  size_t length;
+  char * str;
+  int r;
+
+  r = cache_str_view(reader, &data, &length);
+  if (r != MAIL_NO_ERROR)
+    return r;
+
+  if (data == NULL) {
+    * result = NULL;
+    return MAIL_NO_ERROR;
+  }
+
+  str = malloc(length + 1);
+  if (str == NULL)
+    return MAIL_ERROR_MEMORY;
+  memcpy(str, data, length);
+  str[length] = '\0';
+
+  * result = str;
+
+  return MAIL_NO_ERROR;
+}
+
+static int cache_mailbox_write(MMAPString * mmapstr,
+    struct mailimf_mailbox * mb)
+{
+  int r;
+
+  r = cache_str_write(mmapstr, mb->mb_display_name);
+  if (r != MAIL_NO_ERROR)
+    return r;
+
+  return cache_str_write(mmapstr, mb->mb_addr_spec);
+}
+
+static int cache_mailbox_read(struct cache_reader * reader,
+    struct mailimf_mailbox ** result)
+{
+  char * dsp_name;
+  char * addr_spec;
+  struct mailimf_mailbox * mb;
+  int r;
+  int res;
+
+  r = cache_str_read(reader, &dsp_name);
+  if (r != MAIL_NO_ERROR) {
+    res = r;
+    goto err;
+  }
+
+  r = cache_str_read(reader, &addr_spec);
+  if (r != MAIL_NO_ERROR) {
+    res = r;
+    goto free_dsp_name;
+  }
+
+  mb = mailimf_mailbox_new(dsp_name, addr_spec);
+  if (mb == NULL) {
+    res = MAIL_ERROR_MEMORY;
+    goto free_addr;
+  }
+
+  * result = mb;
+
+  return MAIL_NO_ERROR;
+
+ free_addr:
+  free(addr_spec);
+ free_dsp_name:
+  free(dsp_name);
+ err:
+  return res;
+}
+
+static int cache_mailbox_list_write(MMAPString * mmapstr,
+    struct mailimf_mailbox_list * mb_list)
+{
+  clistiter * cur;
+  int r;
+
+  if (mb_list == NULL)
+    return cache_varint_write(mmapstr, 0);
+
+  r = cache_varint_write(mmapstr, clist_count(mb_list->mb_list) + 1);
+  if (r != MAIL_NO_ERROR)
+    return r;
+
+  for(cur = clist_begin(mb_list->mb_list) ; cur != NULL ;
+      cur = clist_next(cur)) {
+    r = cache_mailbox_write(mmapstr, clist_content(cur));
+    if (r != MAIL_NO_ERROR)
+      return r;
+  }
+
+  return MAIL_NO_ERROR;
+}
+
+static int cache_mailbox_list_read(struct cache_reader * reader,
+    struct mailimf_mailbox_list ** result)
+{
+  struct mailimf_mailbox_list * mb_list;
+  uint32_t count;
+  uint32_t i;
+  clist * list;
+  int r;
+  int res;
+
+  r = cache_varint_read(reader, &count);
+  if (r != MAIL_NO_ERROR) {
+    res = r;
+    goto err;
+  }
+
+  if (count == 0) {
+    * result = NULL;
+    return MAIL_NO_ERROR;
+  }
+
+  list = clist_new();
+  if (list == NULL) {
+    res = MAIL_ERROR_MEMORY;
+    goto err;
+  }
+
+  for(i = 0 ; i < count - 1 ; i ++) {
+    struct mailimf_mailbox * mb;
+
+    r = cache_mailbox_read(reader, &mb);
+    if (r != MAIL_NO_ERROR) {
+      res = r;
+      goto free_list;
+    }
+
+    r = clist_append(list, mb);
+    if (r < 0) {
+      mailimf_mailbox_free(mb);
+      res = MAIL_ERROR_MEMORY;
+      goto free_list;
+    }
+  }
+
+  mb_list = mailimf_mailbox_list_new(list);
+  if (mb_list == NULL) {
+    res = MAIL_ERROR_MEMORY;
+    goto free_list;
+  }
+
+  * result = mb_list;
+
+  return MAIL_NO_ERROR;
+
+ free_list:
+  clist_foreach(list, (clist_func) mailimf_mailbox_free, NULL);
+  clist_free(list);
+ err:
+  return res;
+}
+
+static int cache_address_list_write(MMAPString * mmapstr,
+    struct mailimf_address_list * addr_list)
+{
+  clistiter * cur;
+  int r;
+
+  if (addr_list == NULL)
+    return cache_varint_write(mmapstr, 0);
+
+  r = cache_varint_write(mmapstr, clist_count(addr_list->ad_list) + 1);
+  if (r != MAIL_NO_ERROR)
+    return r;
+
+  for(cur = clist_begin(addr_list->ad_list) ; cur != NULL ;
+      cur = clist_next(cur)) {
+    struct mailimf_address * addr;
+
+    addr = clist_content(cur);
+
+    r = cache_varint_write(mmapstr, addr->ad_type);
+    if (r != MAIL_NO_ERROR)
+      return r;
+
+    switch (addr->ad_type) {
+    case MAILIMF_ADDRESS_MAILBOX:
+      r = cache_mailbox_write(mmapstr, addr->ad_data.ad_mailbox);
+      break;
+    case MAILIMF_ADDRESS_GROUP:
+      r = cache_str_write(mmapstr, addr->ad_data.ad_group->grp_display_name);
+      if (r != MAIL_NO_ERROR)
+        return r;
+      r = cache_mailbox_list_write(mmapstr,
+          addr->ad_data.ad_group->grp_mb_list);
+      break;
+    default:
+      r = MAIL_ERROR_INVAL;
+      break;
+    }
+    if (r != MAIL_NO_ERROR)
+      return r;
+  }
+
+  return MAIL_NO_ERROR;
+}
+
+static int cache_address_read(struct cache_reader * reader,
+    struct mailimf_address ** result)
+{
+  struct mailimf_mailbox * mailbox;
+  struct mailimf_group * group;
+  struct mailimf_mailbox_list * mb_list;
+  struct mailimf_address * addr;
+  char * display_name;
+  uint32_t type;
+  int r;
+
+  r = cache_varint_read(reader, &type);
+  if (r != MAIL_NO_ERROR)
+    return r;
+
+  mailbox = NULL;
+  group = NULL;
+  switch (type) {
+  case MAILIMF_ADDRESS_MAILBOX:
+    r = cache_mailbox_read(reader, &mailbox);
+    if (r != MAIL_NO_ERROR)
+      return r;
+    break;
+
+  case MAILIMF_ADDRESS_GROUP:
+    r = cache_str_read(reader, &display_name);
+    if (r != MAIL_NO_ERROR)
+      return r;
+
+    r = cache_mailbox_list_read(reader, &mb_list);
+    if (r != MAIL_NO_ERROR) {
+      free(display_name);
+      return r;
+    }
+
+    group = mailimf_group_new(display_name, mb_list);
+    if (group == NULL) {
+      if (mb_list != NULL)
+        mailimf_mailbox_list_free(mb_list);
+      free(display_name);
+      return MAIL_ERROR_MEMORY;
+    }
+    break;
+
+  default:
+    return MAIL_ERROR_FILE;
+  }
+
+  addr = mailimf_address_new(type, mailbox, group);
+  if (addr == NULL) {
+    if (mailbox != NULL)
+      mailimf_mailbox_free(mailbox);
+    if (group != NULL)
+      mailimf_group_free(group);
+    return MAIL_ERROR_MEMORY;
+  }
+
+  * result = addr;
+
+  return MAIL_NO_ERROR;
+}
+
+static int cache_address_list_read(struct cache_reader * reader,
+    struct mailimf_address_list ** result)
+{
+  struct mailimf_address_list * addr_list;
+  uint32_t count;
+  uint32_t i;
+  clist * list;
+  int r;
+  int res;
+
+  r = cache_varint_read(reader, &count);
+  if (r != MAIL_NO_ERROR) {
+    res = r;
+    goto err;
+  }
+
+  if (count == 0) {
+    * result = NULL;
+    return MAIL_NO_ERROR;
+  }
+
+  list = clist_new();
+  if (list == NULL) {
+    res = MAIL_ERROR_MEMORY;
+    goto err;
+  }
+
+  for(i = 0 ; i < count - 1 ; i ++) {
+    struct mailimf_address * addr;
+
+    r = cache_address_read(reader, &addr);
+    if (r != MAIL_NO_ERROR) {
+      res = r;
+      goto free_list;
+    }
+
+    r = clist_append(list, addr);
+    if (r < 0) {
+      mailimf_address_free(addr);
+      res = MAIL_ERROR_MEMORY;
+      goto free_list;
+    }
+  }
+
+  addr_list = mailimf_address_list_new(list);
+  if (addr_list == NULL) {
+    res = MAIL_ERROR_MEMORY;
+    goto free_list;
+  }
+
+  * result = addr_list;
+
+  return MAIL_NO_ERROR;
+
+ free_list:
+  clist_foreach(list, (clist_func) mailimf_address_free, NULL);
+  clist_free(list);
+ err:
+  return res;
+}
+
+static int cache_msg_id_list_write(MMAPString * mmapstr, clist * list)
+{
+  clistiter * cur;
+  int r;
+
+  r = cache_varint_write(mmapstr, clist_count(list));
+  if (r != MAIL_NO_ERROR)
+    return r;
+
+  for(cur = clist_begin(list) ; cur != NULL ; cur = clist_next(cur)) {
+    r = cache_str_write(mmapstr, clist_content(cur));
+    if (r != MAIL_NO_ERROR)
+      return r;
+  }
+
+  return MAIL_NO_ERROR;
+}
+
+static int cache_msg_id_list_read(struct cache_reader * reader,
+    clist ** result)
+{
+  uint32_t count;
+  uint32_t i;
+  clist * list;
+  int r;
+  int res;
+
+  r = cache_varint_read(reader, &count);
+  if (r != MAIL_NO_ERROR) {
+    res = r;
+    goto err;
+  }
+
+  list = clist_new();
+  if (list == NULL) {
+    res = MAIL_ERROR_MEMORY;
+    goto err;
+  }
+
+  for(i = 0 ; i < count ; i ++) {
+    char * msgid;
+
+    r = cache_str_read(reader, &msgid);
+    if (r != MAIL_NO_ERROR) {
+      res = r;
+      goto free_list;
+    }
+
+    r = clist_append(list, msgid);
+    if (r < 0) {
+      free(msgid);
+      res = MAIL_ERROR_MEMORY;
+      goto free_list;
+    }
+  }
+
+  * result = list;
+
+  return MAIL_NO_ERROR;
+
+ free_list:
+  clist_foreach(list, (clist_func) free, NULL);
+  clist_free(list);
+ err:
+  return res;
+}
+
+static int cache_date_time_write(MMAPString * mmapstr,
+    struct mailimf_date_time * date_time)
+{
+  uint32_t zone;
+  int r;
+
+  r = cache_varint_write(mmapstr, date_time->dt_day);
+  if (r != MAIL_NO_ERROR)
+    return r;
+  r = cache_varint_write(mmapstr, date_time->dt_month);
+  if (r != MAIL_NO_ERROR)
+    return r;
+  r = cache_varint_write(mmapstr, date_time->dt_year);
+  if (r != MAIL_NO_ERROR)
+    return r;
+  r = cache_varint_write(mmapstr, date_time->dt_hour);
+  if (r != MAIL_NO_ERROR)
+    return r;
+  r = cache_varint_write(mmapstr, date_time->dt_min);
+  if (r != MAIL_NO_ERROR)
+    return r;
+  r = cache_varint_write(mmapstr, date_time->dt_sec);
+  if (r != MAIL_NO_ERROR)
+    return r;
+
+  /* the zone can be negative */
+  if (date_time->dt_zone < 0)
+    zone = ((uint32_t) -date_time->dt_zone << 1) | 1;
+  else
+    zone = (uint32_t) date_time->dt_zone << 1;
+
+  return cache_varint_write(mmapstr, zone);
+}
+
+static int cache_date_time_read(struct cache_reader * reader,
+    struct mailimf_date_time ** result)
+{
+  uint32_t value[7];
+  struct mailimf_date_time * date_time;
+  int zone;
+  int i;
+  int r;
+
+  for(i = 0 ; i < 7 ; i ++) {
+    r = cache_varint_read(reader, &value[i]);
+    if (r != MAIL_NO_ERROR)
+      return r;
+  }
+
+  zone = value[6] >> 1;
+  if ((value[6] & 1) != 0)
+    zone = -zone;
+
+  date_time = mailimf_date_time_new(value[0], value[1], value[2],
+      value[3], value[4], value[5], zone);
+  if (date_time == NULL)
+    return MAIL_ERROR_MEMORY;
+
+  * result = date_time;
+
+  return MAIL_NO_ERROR;
+}
+
+static int cache_field_content_write(MMAPString * mmapstr,
+    struct mailimf_field * field)
+{
+  switch (field->fld_type) {
+  case MAILIMF_FIELD_ORIG_DATE:
+    return cache_date_time_write(mmapstr,
+        field->fld_data.fld_orig_date->dt_date_time);
+  case MAILIMF_FIELD_FROM:
+    return cache_mailbox_list_write(mmapstr,
+        field->fld_data.fld_from->frm_mb_list);
+  case MAILIMF_FIELD_SENDER:
+    return cache_mailbox_write(mmapstr, field->fld_data.fld_sender->snd_mb);
+  case MAILIMF_FIELD_REPLY_TO:
+    return cache_address_list_write(mmapstr,
+        field->fld_data.fld_reply_to->rt_addr_list);
+  case MAILIMF_FIELD_TO:
+    return cache_address_list_write(mmapstr,
+        field->fld_data.fld_to->to_addr_list);
+  case MAILIMF_FIELD_CC:
+    return cache_address_list_write(mmapstr,
+        field->fld_data.fld_cc->cc_addr_list);
+  case MAILIMF_FIELD_BCC:
+    return cache_address_list_write(mmapstr,
+        field->fld_data.fld_bcc->bcc_addr_list);
+  case MAILIMF_FIELD_MESSAGE_ID:
+    return cache_str_write(mmapstr,
+        field->fld_data.fld_message_id->mid_value);
+  case MAILIMF_FIELD_IN_REPLY_TO:
+    return cache_msg_id_list_write(mmapstr,
+        field->fld_data.fld_in_reply_to->mid_list);
+  case MAILIMF_FIELD_REFERENCES:
+    return cache_msg_id_list_write(mmapstr,
+        field->fld_data.fld_references->mid_list);
+  case MAILIMF_FIELD_SUBJECT:
+    return cache_str_write(mmapstr, field->fld_data.fld_subject->sbj_value);
+  default:
+    return MAIL_ERROR_INVAL;
+  }
+}
+
+static int cache_fields_types_supported(int type)
+{
+  switch (type) {
+  case MAILIMF_FIELD_ORIG_DATE:
+  case MAILIMF_FIELD_FROM:
+  case MAILIMF_FIELD_SENDER:
+  case MAILIMF_FIELD_REPLY_TO:
+  case MAILIMF_FIELD_TO:
+  case MAILIMF_FIELD_CC:
+  case MAILIMF_FIELD_BCC:
+  case MAILIMF_FIELD_MESSAGE_ID:
+  case MAILIMF_FIELD_IN_REPLY_TO:
+  case MAILIMF_FIELD_REFERENCES:
+  case MAILIMF_FIELD_SUBJECT:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+int mailimf_cache_fields_write(MMAPString * mmapstr, size_t * indx,
+			       struct mailimf_fields * fields)
+{
+  MMAPString * records;
+  MMAPString * content;
+  clistiter * cur;
+  unsigned char version;
+  int r;
+  int res;
+
+  records = mmap_string_new("");
+  if (records == NULL) {
+    res = MAIL_ERROR_MEMORY;
+    goto err;
+  }
+
+  content = mmap_string_new("");
+  if (content == NULL) {
+    res = MAIL_ERROR_MEMORY;
+    goto free_records;
+  }
+
+  for(cur = clist_begin(fields->fld_list) ; cur != NULL ;
+      cur = clist_next(cur)) {
+    struct mailimf_field * field;
+
+    field = clist_content(cur);
+
+    /* only the fields of the envelope are kept */
+    if (!cache_fields_types_supported(field->fld_type))
+      continue;
+
+    mmap_string_truncate(content, 0);
+    r = cache_field_content_write(content, field);
+    if (r != MAIL_NO_ERROR) {
+      res = r;
+      goto free_content;
+    }
+
+    r = cache_varint_write(records, field->fld_type);
+    if (r != MAIL_NO_ERROR) {
+      res = r;
+      goto free_content;
+    }
+    r = cache_varint_write(records, content->len);
+    if (r != MAIL_NO_ERROR) {
+      res = r;
+      goto free_content;
+    }
+    if (mmap_string_append_len(records, content->str, content->len) == NULL) {
+      res = MAIL_ERROR_MEMORY;
+      goto free_content;
+    }
+  }
+
+  r = mailimf_cache_int_write(mmapstr, indx, CACHE_FIELDS_MAGIC);
+  if (r != MAIL_NO_ERROR) {
+    res = r;
+    goto free_content;
+  }
+
+  version = CACHE_FIELDS_VERSION;
+  r = mail_serialize_write(mmapstr, indx, (char *) &version, 1);
+  if (r != MAIL_NO_ERROR) {
+    res = r;
+    goto free_content;
+  }
+
+  mmap_string_truncate(content, 0);
+  r = cache_varint_write(content, records->len);
+  if (r != MAIL_NO_ERROR) {
+    res = r;
+    goto free_content;
+  }
+  r = mail_serialize_write(mmapstr, indx, content->str, content->len);
+  if (r != MAIL_NO_ERROR) {
+    res = r;
+    goto free_content;
+  }
+
+  r = mail_serialize_write(mmapstr, indx, records->str, records->len);
+  if (r != MAIL_NO_ERROR) {
+    res = r;
+    goto free_content;
+  }
+
+  mmap_string_free(content);
+  mmap_string_free(records);
+
+  return MAIL_NO_ERROR;
+
+ free_content:
+  mmap_string_free(content);
+ free_records:
+  mmap_string_free(records);
+ err:
+  return res;
+}
+
+int mailimf_cache_fields_view_init(struct mailimf_cache_fields_view * view,
+    MMAPString * mmapstr, size_t * indx)
+{
+  struct cache_reader reader;
+  uint32_t magic;
+  uint32_t length;
+  size_t cur_token;
+  int r;
+
+  cur_token = * indx;
+  r = mailimf_cache_int_read(mmapstr, &cur_token, &magic);
+  if (r != MAIL_NO_ERROR)
+    return r;
+
+  if ((magic != CACHE_FIELDS_MAGIC) || (cur_token >= mmapstr->len) ||
+      (mmapstr->str[cur_token] != CACHE_FIELDS_VERSION))
+    return MAIL_ERROR_INVAL;
+  cur_token ++;
+
+  reader.cur = (const unsigned char *) mmapstr->str + cur_token;
+  reader.end = (const unsigned char *) mmapstr->str + mmapstr->len;
+  r = cache_varint_read(&reader, &length);
+  if (r != MAIL_NO_ERROR)
+    return r;
+  if ((size_t) (reader.end - reader.cur) < length)
+    return MAIL_ERROR_FILE;
+
+  view->fv_data = (const char *) reader.cur;
+  view->fv_length = length;
+
+  * indx = (reader.cur - (const unsigned char *) mmapstr->str) + length;
+
+  return MAIL_NO_ERROR;
+}
+
+int mailimf_cache_fields_view_next(struct mailimf_cache_fields_view * view,
+    size_t * iter, struct mailimf_cache_field_view * result)
+{
+  struct cache_reader reader;
+  uint32_t type;
+  uint32_t length;
+  int r;
+
+  if (* iter >= view->fv_length)
+    return MAIL_ERROR_MSG_NOT_FOUND;
+
+  reader.cur = (const unsigned char *) view->fv_data + * iter;
+  reader.end = (const unsigned char *) view->fv_data + view->fv_length;
+
+  r = cache_varint_read(&reader, &type);
+  if (r != MAIL_NO_ERROR)
+    return r;
+  r = cache_varint_read(&reader, &length);
+  if (r != MAIL_NO_ERROR)
+    return r;
+  if ((size_t) (reader.end - reader.cur) < length)
+    return MAIL_ERROR_FILE;
+
+  result->fv_type = type;
+  result->fv_data = (const char *) reader.cur;
+  result->fv_length = length;
+
+  * iter = (reader.cur - (const unsigned char *) view->fv_data) + length;
+
+  return MAIL_NO_ERROR;
+}
+
+int mailimf_cache_fields_view_find(struct mailimf_cache_fields_view * view,
+    int type, struct mailimf_cache_field_view * result)
+{
+  size_t iter;
+  int r;
+
+  iter = 0;
+  while (1) {
+    r = mailimf_cache_fields_view_next(view, &iter, result);
+    if (r != MAIL_NO_ERROR)
+      return r;
+
+    if (result->fv_type == type)
+      return MAIL_NO_ERROR;
+  }
+}
+
+int mailimf_cache_field_view_get_string(struct mailimf_cache_field_view * field,
+    const char ** result, size_t * result_len)
+{
+  struct cache_reader reader;
+
+  if ((field->fv_type != MAILIMF_FIELD_SUBJECT) &&
+      (field->fv_type != MAILIMF_FIELD_MESSAGE_ID))
+    return MAIL_ERROR_INVAL;
+
+  reader.cur = (const unsigned char *) field->fv_data;
+  reader.end = reader.cur + field->fv_length;
+
+  return cache_str_view(&reader, result, result_len);
+}
+
+int mailimf_cache_field_view_read(struct mailimf_cache_field_view * field,
+    struct mailimf_field ** result)
+{
+  struct cache_reader reader;
+  struct mailimf_date_time * date_time;
+  struct mailimf_mailbox_list * mb_list;
+  struct mailimf_mailbox * mb;
+  struct mailimf_address_list * addr_list;
+  clist * msg_id_list;
+  char * str;
+  struct mailimf_orig_date * orig_date;
+  struct mailimf_from * from;
+  struct mailimf_sender * sender;
+  struct mailimf_to * to;
+  struct mailimf_reply_to * reply_to;
+  struct mailimf_cc * cc;
+  struct mailimf_bcc * bcc;
+  struct mailimf_message_id * message_id;
+  struct mailimf_in_reply_to * in_reply_to;
+  struct mailimf_references * references;
+  struct mailimf_subject * subject;
+  struct mailimf_field * imf_field;
+  int r;
+  int res;
+
+  orig_date = NULL;
+  from = NULL;
+  sender = NULL;
+  to = NULL;
+  reply_to = NULL;
+  cc = NULL;
+  bcc = NULL;
+  message_id = NULL;
+  in_reply_to = NULL;
+  references = NULL;
+  subject = NULL;
+
+  reader.cur = (const unsigned char *) field->fv_data;
+  reader.end = reader.cur + field->fv_length;
+
+  switch (field->fv_type) {
+  case MAILIMF_FIELD_ORIG_DATE:
+    r = cache_date_time_read(&reader, &date_time);
+    if (r != MAIL_NO_ERROR) {
+      res = r;
+      goto err;
+    }
+    orig_date = mailimf_orig_date_new(date_time);
+    if (orig_date == NULL) {
+      mailimf_date_time_free(date_time);
+      res = MAIL_ERROR_MEMORY;
+      goto err;
+    }
+    break;
+
+  case MAILIMF_FIELD_FROM:
+    r = cache_mailbox_list_read(&reader, &mb_list);
+    if (r != MAIL_NO_ERROR) {
+      res = r;
+      goto err;
+    }
+    from = mailimf_from_new(mb_list);
+    if (from == NULL) {
+      if (mb_list != NULL)
+        mailimf_mailbox_list_free(mb_list);
+      res = MAIL_ERROR_MEMORY;
+      goto err;
+    }
+    break;
+
+  case MAILIMF_FIELD_SENDER:
+    r = cache_mailbox_read(&reader, &mb);
+    if (r != MAIL_NO_ERROR) {
+      res = r;
+      goto err;
+    }
+    sender = mailimf_sender_new(mb);
+    if (sender == NULL) {
+      mailimf_mailbox_free(mb);
+      res = MAIL_ERROR_MEMORY;
+      goto err;
+    }
+    break;
+
+  case MAILIMF_FIELD_REPLY_TO:
+  case MAILIMF_FIELD_TO:
+  case MAILIMF_FIELD_CC:
+  case MAILIMF_FIELD_BCC:
+    r = cache_address_list_read(&reader, &addr_list);
+    if (r != MAIL_NO_ERROR) {
+      res = r;
+      goto err;
+    }
+    switch (field->fv_type) {
+    case MAILIMF_FIELD_REPLY_TO:
+      reply_to = mailimf_reply_to_new(addr_list);
+      r = (reply_to == NULL);
+      break;
+    case MAILIMF_FIELD_TO:
+      to = mailimf_to_new(addr_list);
+      r = (to == NULL);
+      break;
+    case MAILIMF_FIELD_CC:
+      cc = mailimf_cc_new(addr_list);
+      r = (cc == NULL);
+      break;
+    default:
+      bcc = mailimf_bcc_new(addr_list);
+      r = (bcc == NULL);
+      break;
+    }
+    if (r) {
+      if (addr_list != NULL)
+        mailimf_address_list_free(addr_list);
+      res = MAIL_ERROR_MEMORY;
+      goto err;
+    }
+    break;
+
+  case MAILIMF_FIELD_MESSAGE_ID:
+    r = cache_str_read(&reader, &str);
+    if (r != MAIL_NO_ERROR) {
+      res = r;
+      goto err;
+    }
+    message_id = mailimf_message_id_new(str);
+    if (message_id == NULL) {
+      free(str);
+      res = MAIL_ERROR_MEMORY;
+      goto err;
+    }
+    break;
+
+  case MAILIMF_FIELD_SUBJECT:
+    r = cache_str_read(&reader, &str);
+    if (r != MAIL_NO_ERROR) {
+      res = r;
+      goto err;
+    }
+    if (str == NULL) {
+      str = strdup("");
+      if (str == NULL) {
+        res = MAIL_ERROR_MEMORY;
+        goto err;
+      }
+    }
+    subject = mailimf_subject_new(str);
+    if (subject == NULL) {
+      free(str);
+      res = MAIL_ERROR_MEMORY;
+      goto err;
+    }
+    break;
+
+  case MAILIMF_FIELD_IN_REPLY_TO:
+  case MAILIMF_FIELD_REFERENCES:
+    r = cache_msg_id_list_read(&reader, &msg_id_list);
+    if (r != MAIL_NO_ERROR) {
+      res = r;
+      goto err;
+    }
+    if (field->fv_type == MAILIMF_FIELD_IN_REPLY_TO) {
+      in_reply_to = mailimf_in_reply_to_new(msg_id_list);
+      r = (in_reply_to == NULL);
+    }
+    else {
+      references = mailimf_references_new(msg_id_list);
+      r = (references == NULL);
+    }
+    if (r) {
+      clist_foreach(msg_id_list, (clist_func) free, NULL);
+      clist_free(msg_id_list);
+      res = MAIL_ERROR_MEMORY;
+      goto err;
+    }
+    break;
+
+  default:
+    res = MAIL_ERROR_INVAL;
+    goto err;
+  }
+
+  imf_field = mailimf_field_new(field->fv_type, NULL, NULL, NULL, NULL, NULL,
+      NULL, NULL, NULL, orig_date, from, sender, reply_to,
+      to, cc, bcc, message_id,
+      in_reply_to, references,
+      subject, NULL, NULL, NULL);
+  if (imf_field == NULL) {
+    res = MAIL_ERROR_MEMORY;
+    goto free;
+  }
+
+  * result = imf_field;
+
+  return MAIL_NO_ERROR;
+
+ free:
+  if (orig_date != NULL)
+    mailimf_orig_date_free(orig_date);
+  if (from != NULL)
+    mailimf_from_free(from);
+  if (sender != NULL)
+    mailimf_sender_free(sender);
+  if (reply_to != NULL)
+    mailimf_reply_to_free(reply_to);
+  if (to != NULL)
+    mailimf_to_free(to);
+  if (cc != NULL)
+    mailimf_cc_free(cc);
+  if (bcc != NULL)
+    mailimf_bcc_free(bcc);
+  if (message_id != NULL)
+    mailimf_message_id_free(message_id);
+  if (in_reply_to != NULL)
+    mailimf_in_reply_to_free(in_reply_to);
+  if (references != NULL)
+    mailimf_references_free(references);
+  if (subject != NULL)
+    mailimf_subject_free(subject);
+ err:
+  return res;
+}
+
+static int cache_fields_read(MMAPString * mmapstr, size_t * indx,
+    struct mailimf_fields ** result)
+{
+  struct mailimf_cache_fields_view view;
+  struct mailimf_cache_field_view field_view;
+  struct mailimf_fields * fields;
+  size_t iter;
+  clist * list;
+  int r;
+  int res;
+
+  r = mailimf_cache_fields_view_init(&view, mmapstr, indx);
+  if (r != MAIL_NO_ERROR) {
+    res = r;
+    goto err;
+  }
+
+  list = clist_new();
+  if (list == NULL) {
+    res = MAIL_ERROR_MEMORY;
+    goto err;
+  }
+
+  iter = 0;
+  while (1) {
+    struct mailimf_field * field;
+
+    r = mailimf_cache_fields_view_next(&view, &iter, &field_view);
+    if (r == MAIL_ERROR_MSG_NOT_FOUND)
+      break;
+    if (r != MAIL_NO_ERROR) {
+      res = r;
+      goto free_list;
+    }
+
+    r = mailimf_cache_field_view_read(&field_view, &field);
+    if (r == MAIL_ERROR_INVAL) {
+      /* field written by a later version */
+      continue;
+    }
+    if (r != MAIL_NO_ERROR) {
+      res = r;
+      goto free_list;
+    }
+
+    r = clist_append(list, field);
+    if (r < 0) {
+      mailimf_field_free(field);
+      res = MAIL_ERROR_MEMORY;
+      goto free_list;
     }
-    
-    str[length] = 0;
   }
 
-  * result = str;
+  fields = mailimf_fields_new(list);
+  if (fields == NULL) {
+    res = MAIL_ERROR_MEMORY;
+    goto free_list;
+  }
+
+  * result = fields;
 
   return MAIL_NO_ERROR;
+
+ free_list:
+  clist_foreach(list, (clist_func) mailimf_field_free, NULL);
+  clist_free(list);
+ err:
+  return res;
 }
 
-int mailimf_cache_fields_write(MMAPString * mmapstr, size_t * indx,
-			       struct mailimf_fields * fields)
+int mailimf_cache_fields_read(MMAPString * mmapstr, size_t * indx,
+			      struct mailimf_fields ** result)
 {
-  clistiter * cur;
   int r;
 
-  r = mailimf_cache_int_write(mmapstr, indx,
-      clist_count(fields->fld_list));
-  if (r != MAIL_NO_ERROR)
+  r = cache_fields_read(mmapstr, indx, result);
+  if (r != MAIL_ERROR_INVAL)
     return r;
-  
-  for(cur = clist_begin(fields->fld_list) ; cur != NULL ;
-      cur = clist_next(cur)) {
-    r = mailimf_cache_field_write(mmapstr, indx, clist_content(cur));
-    if (r != MAIL_NO_ERROR)
-      return r;
-  }
 
-  return MAIL_NO_ERROR;
+  /* written in the format of previous versions */
+  return mailimf_cache_old_fields_read(mmapstr, indx, result);
 }
 
-int mailimf_cache_fields_read(MMAPString * mmapstr, size_t * indx,
-			      struct mailimf_fields ** result)
+static int mailimf_cache_old_fields_read(MMAPString * mmapstr, size_t * indx,
+    struct mailimf_fields ** result)
 {
   clist * list;
   int r;
@@ -357,70 +1434,6 @@ int mailimf_cache_fields_read(MMAPString * mmapstr, size_t * indx,
 }
 
 
-static int mailimf_cache_field_write(MMAPString * mmapstr, size_t * indx,
-				     struct mailimf_field * field)
-{
-  int r;
-  
-  r = mailimf_cache_int_write(mmapstr, indx, field->fld_type);
-  if (r != MAIL_NO_ERROR)
-    return r;
-  
-  switch (field->fld_type) {
-  case MAILIMF_FIELD_ORIG_DATE:
-    r = mailimf_cache_orig_date_write(mmapstr, indx,
-        field->fld_data.fld_orig_date);
-    break;
-  case MAILIMF_FIELD_FROM:
-    r = mailimf_cache_from_write(mmapstr, indx,
-        field->fld_data.fld_from);
-    break;
-  case MAILIMF_FIELD_SENDER:
-    r = mailimf_cache_sender_write(mmapstr, indx,
-        field->fld_data.fld_sender);
-    break;
-  case MAILIMF_FIELD_REPLY_TO:
-    r = mailimf_cache_reply_to_write(mmapstr, indx,
-        field->fld_data.fld_reply_to);
-    break;
-  case MAILIMF_FIELD_TO:
-    r = mailimf_cache_to_write(mmapstr, indx,
-        field->fld_data.fld_to);
-    break;
-  case MAILIMF_FIELD_CC:
-    r = mailimf_cache_cc_write(mmapstr, indx,
-        field->fld_data.fld_cc);
-    break;
-  case MAILIMF_FIELD_BCC:
-    r = mailimf_cache_bcc_write(mmapstr, indx,
-        field->fld_data.fld_bcc);
-    break;
-  case MAILIMF_FIELD_MESSAGE_ID:
-    r = mailimf_cache_message_id_write(mmapstr, indx,
-        field->fld_data.fld_message_id);
-    break;
-  case MAILIMF_FIELD_IN_REPLY_TO:
-    r = mailimf_cache_in_reply_to_write(mmapstr, indx,
-        field->fld_data.fld_in_reply_to);
-    break;
-  case MAILIMF_FIELD_REFERENCES:
-    r = mailimf_cache_references_write(mmapstr, indx,
-        field->fld_data.fld_references);
-    break;
-  case MAILIMF_FIELD_SUBJECT:
-    r = mailimf_cache_subject_write(mmapstr, indx,
-        field->fld_data.fld_subject);
-    break;
-  default:
-    r = 0;
-    break;
-  }
-
-  if (r != MAIL_NO_ERROR)
-    return r;
-
-  return MAIL_NO_ERROR;
-}
 
 
 static int mailimf_cache_field_read(MMAPString * mmapstr, size_t * indx,
@@ -546,11 +1559,6 @@ static int mailimf_cache_field_read(MMAPString * mmapstr, size_t * indx,
   return res;
 }
 
-static int mailimf_cache_orig_date_write(MMAPString * mmapstr, size_t * indx,
-					 struct mailimf_orig_date * date)
-{
-  return mailimf_cache_date_time_write(mmapstr, indx, date->dt_date_time);
-}
 
 static int mailimf_cache_orig_date_read(MMAPString * mmapstr, size_t * indx,
 					struct mailimf_orig_date ** result)
@@ -574,41 +1582,6 @@ static int mailimf_cache_orig_date_read(MMAPString * mmapstr, size_t * indx,
   return MAIL_NO_ERROR;
 }
 
-static int mailimf_cache_date_time_write(MMAPString * mmapstr, size_t * indx,
-					 struct mailimf_date_time * date_time)
-{
-  int r;
-
-  r = mailimf_cache_int_write(mmapstr, indx, date_time->dt_day);
-  if (r != MAIL_NO_ERROR)
-    return r;
-
-  r = mailimf_cache_int_write(mmapstr, indx, date_time->dt_month);
-  if (r != MAIL_NO_ERROR)
-    return r;
-
-  r = mailimf_cache_int_write(mmapstr, indx, date_time->dt_year);
-  if (r != MAIL_NO_ERROR)
-    return r;
-
-  r = mailimf_cache_int_write(mmapstr, indx, date_time->dt_hour);
-  if (r != MAIL_NO_ERROR)
-    return r;
-
-  r = mailimf_cache_int_write(mmapstr, indx, date_time->dt_min);
-  if (r != MAIL_NO_ERROR)
-    return r;
-
-  r = mailimf_cache_int_write(mmapstr, indx, date_time->dt_sec);
-  if (r != MAIL_NO_ERROR)
-    return r;
-
-  r = mailimf_cache_int_write(mmapstr, indx, date_time->dt_zone);
-  if (r != MAIL_NO_ERROR)
-    return r;
-
-  return MAIL_NO_ERROR;
-}
 
 static int mailimf_cache_date_time_read(MMAPString * mmapstr, size_t * indx,
 					struct mailimf_date_time ** result)
@@ -662,11 +1635,6 @@ static int mailimf_cache_date_time_read(MMAPString * mmapstr, size_t * indx,
 }
 
 
-static int mailimf_cache_from_write(MMAPString * mmapstr, size_t * indx,
-				    struct mailimf_from * from)
-{
-  return mailimf_cache_mailbox_list_write(mmapstr, indx, from->frm_mb_list);
-}
 
 static int mailimf_cache_from_read(MMAPString * mmapstr, size_t * indx,
 				   struct mailimf_from ** result)
@@ -690,11 +1658,6 @@ static int mailimf_cache_from_read(MMAPString * mmapstr, size_t * indx,
   return MAIL_NO_ERROR;
 }
 
-static int mailimf_cache_sender_write(MMAPString * mmapstr, size_t * indx,
-				      struct mailimf_sender * sender)
-{
-  return mailimf_cache_mailbox_write(mmapstr, indx, sender->snd_mb);
-}
 
 static int mailimf_cache_sender_read(MMAPString * mmapstr, size_t * indx,
 				     struct mailimf_sender ** result)
@@ -718,12 +1681,6 @@ static int mailimf_cache_sender_read(MMAPString * mmapstr, size_t * indx,
   return MAIL_NO_ERROR;
 }
 
-static int mailimf_cache_reply_to_write(MMAPString * mmapstr, size_t * indx,
-					struct mailimf_reply_to * reply_to)
-{
-  return mailimf_cache_address_list_write(mmapstr, indx,
-      reply_to->rt_addr_list);
-}
 
 static int mailimf_cache_reply_to_read(MMAPString * mmapstr, size_t * indx,
 				       struct mailimf_reply_to ** result)
@@ -747,11 +1704,6 @@ static int mailimf_cache_reply_to_read(MMAPString * mmapstr, size_t * indx,
   return MAIL_NO_ERROR;
 }
 
-static int mailimf_cache_to_write(MMAPString * mmapstr, size_t * indx,
-				  struct mailimf_to * to)
-{
-  return mailimf_cache_address_list_write(mmapstr, indx, to->to_addr_list);
-}
 
 static int mailimf_cache_to_read(MMAPString * mmapstr, size_t * indx,
 				 struct mailimf_to ** result)
@@ -775,11 +1727,6 @@ static int mailimf_cache_to_read(MMAPString * mmapstr, size_t * indx,
   return MAIL_NO_ERROR;
 }
 
-static int mailimf_cache_cc_write(MMAPString * mmapstr, size_t * indx,
-				  struct mailimf_cc * cc)
-{
-  return mailimf_cache_address_list_write(mmapstr, indx, cc->cc_addr_list);
-}
 
 static int mailimf_cache_cc_read(MMAPString * mmapstr, size_t * indx,
     struct mailimf_cc ** result)
@@ -803,11 +1750,6 @@ static int mailimf_cache_cc_read(MMAPString * mmapstr, size_t * indx,
   return MAIL_NO_ERROR;
 }
 
-static int mailimf_cache_bcc_write(MMAPString * mmapstr, size_t * indx,
-				   struct mailimf_bcc * bcc)
-{
-  return mailimf_cache_address_list_write(mmapstr, indx, bcc->bcc_addr_list);
-}
 
 static int mailimf_cache_bcc_read(MMAPString * mmapstr, size_t * indx,
 				  struct mailimf_bcc ** result)
@@ -831,13 +1773,6 @@ static int mailimf_cache_bcc_read(MMAPString * mmapstr, size_t * indx,
   return MAIL_NO_ERROR;
 }
 
-static int
-mailimf_cache_message_id_write(MMAPString * mmapstr, size_t * indx,
-			       struct mailimf_message_id * message_id)
-{
-  return mailimf_cache_string_write(mmapstr, indx,
-      message_id->mid_value, strlen(message_id->mid_value));
-}
 
 static int mailimf_cache_message_id_read(MMAPString * mmapstr, size_t * indx,
 					 struct mailimf_message_id ** result)
@@ -861,29 +1796,6 @@ static int mailimf_cache_message_id_read(MMAPString * mmapstr, size_t * indx,
   return MAIL_NO_ERROR;
 }
 
-static int
-mailimf_cache_msg_id_list_write(MMAPString * mmapstr, size_t * indx,
-				clist * list)
-{
-  clistiter * cur;
-  int r;
-
-  r = mailimf_cache_int_write(mmapstr, indx, clist_count(list));
-  if (r != MAIL_NO_ERROR)
-    return r;
-  
-  for(cur = clist_begin(list) ; cur != NULL ; cur = clist_next(cur)) {
-    char * msgid;
-
-    msgid = clist_content(cur);
-
-    r = mailimf_cache_string_write(mmapstr, indx, msgid, strlen(msgid));
-    if (r != MAIL_NO_ERROR)
-      return r;
-  }
-
-  return MAIL_NO_ERROR;
-}
 
 static int mailimf_cache_msg_id_list_read(MMAPString * mmapstr, size_t * indx,
 					  clist ** result)
@@ -934,13 +1846,6 @@ static int mailimf_cache_msg_id_list_read(MMAPString * mmapstr, size_t * indx,
   return res;
 }
 
-static int
-mailimf_cache_in_reply_to_write(MMAPString * mmapstr, size_t * indx,
-				struct mailimf_in_reply_to * in_reply_to)
-{
-  return mailimf_cache_msg_id_list_write(mmapstr, indx,
-      in_reply_to->mid_list);
-}
 
 static int mailimf_cache_in_reply_to_read(MMAPString * mmapstr, size_t * indx,
 					  struct mailimf_in_reply_to ** result)
@@ -965,12 +1870,6 @@ static int mailimf_cache_in_reply_to_read(MMAPString * mmapstr, size_t * indx,
   return MAIL_NO_ERROR;
 }
 
-static int mailimf_cache_references_write(MMAPString * mmapstr, size_t * indx,
-					  struct mailimf_references * references)
-{
-  return mailimf_cache_msg_id_list_write(mmapstr, indx,
-      references->mid_list);
-}
 
 static int mailimf_cache_references_read(MMAPString * mmapstr, size_t * indx,
 					 struct mailimf_references ** result)
@@ -996,12 +1895,6 @@ static int mailimf_cache_references_read(MMAPString * mmapstr, size_t * indx,
 }
 
 
-static int mailimf_cache_subject_write(MMAPString * mmapstr, size_t * indx,
-				       struct mailimf_subject * subject)
-{
-  return mailimf_cache_string_write(mmapstr, indx,
-      subject->sbj_value, strlen(subject->sbj_value));
-}
 
 static int mailimf_cache_subject_read(MMAPString * mmapstr, size_t * indx,
 				      struct mailimf_subject ** result)
@@ -1032,42 +1925,6 @@ static int mailimf_cache_subject_read(MMAPString * mmapstr, size_t * indx,
 }
 
 
-static int
-mailimf_cache_address_list_write(MMAPString * mmapstr, size_t * indx,
-				 struct mailimf_address_list * addr_list)
-{
-  clistiter * cur;
-  int r;
-
-  if (addr_list == NULL) {
-    r = mailimf_cache_int_write(mmapstr, indx, CACHE_NULL_POINTER);
-    if (r != MAIL_NO_ERROR)
-      return r;
-  }
-  else {
-    r = mailimf_cache_int_write(mmapstr, indx, CACHE_NOT_NULL);
-    if (r != MAIL_NO_ERROR)
-      return r;
-    
-    r = mailimf_cache_int_write(mmapstr, indx,
-        clist_count(addr_list->ad_list));
-    if (r != MAIL_NO_ERROR)
-      return r;
-    
-    for(cur = clist_begin(addr_list->ad_list) ; cur != NULL ;
-        cur = clist_next(cur)) {
-      struct mailimf_address * addr;
-      
-      addr = clist_content(cur);
-      
-      r = mailimf_cache_address_write(mmapstr, indx, addr);
-      if (r != MAIL_NO_ERROR)
-	return r;
-    }
-  }
-
-  return MAIL_NO_ERROR;
-}
 
 static int
 mailimf_cache_address_list_read(MMAPString * mmapstr, size_t * indx,
@@ -1138,33 +1995,6 @@ mailimf_cache_address_list_read(MMAPString * mmapstr, size_t * indx,
   return res;
 }
 
-static int mailimf_cache_address_write(MMAPString * mmapstr, size_t * indx,
-				       struct mailimf_address * addr)
-{
-  int r;
-
-  r = mailimf_cache_int_write(mmapstr, indx, addr->ad_type);
-  if (r != MAIL_NO_ERROR)
-    return r;
-  
-  switch(addr->ad_type) {
-  case MAILIMF_ADDRESS_MAILBOX:
-    r = mailimf_cache_mailbox_write(mmapstr, indx, addr->ad_data.ad_mailbox);
-    if (r != MAIL_NO_ERROR)
-      return r;
-
-    break;
-
-  case MAILIMF_ADDRESS_GROUP:
-    r = mailimf_cache_group_write(mmapstr, indx, addr->ad_data.ad_group);
-    if (r != MAIL_NO_ERROR)
-      return r;
-    
-    break;
-  }
-
-  return MAIL_NO_ERROR;
-}
 
 static int mailimf_cache_address_read(MMAPString * mmapstr, size_t * indx,
 				      struct mailimf_address ** result)
@@ -1214,22 +2044,6 @@ static int mailimf_cache_address_read(MMAPString * mmapstr, size_t * indx,
   return MAIL_ERROR_MEMORY;
 }
 
-static int mailimf_cache_group_write(MMAPString * mmapstr, size_t * indx,
-				     struct mailimf_group * group)
-{
-  int r;
-
-  r = mailimf_cache_string_write(mmapstr, indx, group->grp_display_name,
-			   strlen(group->grp_display_name));
-  if (r != MAIL_NO_ERROR)
-    return r;
-  
-  r = mailimf_cache_mailbox_list_write(mmapstr, indx, group->grp_mb_list);
-  if (r != MAIL_NO_ERROR)
-    return r;
-  
-  return MAIL_NO_ERROR;
-}
 
 static int mailimf_cache_group_read(MMAPString * mmapstr, size_t * indx,
 				    struct mailimf_group ** result)
@@ -1270,42 +2084,6 @@ static int mailimf_cache_group_read(MMAPString * mmapstr, size_t * indx,
   return res;
 }
 
-static int
-mailimf_cache_mailbox_list_write(MMAPString * mmapstr, size_t * indx,
-				 struct mailimf_mailbox_list * mb_list)
-{
-  clistiter * cur;
-  int r;
-
-  if (mb_list == NULL) {
-    r = mailimf_cache_int_write(mmapstr, indx, CACHE_NULL_POINTER);
-    if (r != MAIL_NO_ERROR)
-      return r;
-  }
-  else {
-    r = mailimf_cache_int_write(mmapstr, indx, CACHE_NOT_NULL);
-    if (r != MAIL_NO_ERROR)
-      return r;
-    
-    r = mailimf_cache_int_write(mmapstr, indx,
-        clist_count(mb_list->mb_list));
-    if (r != MAIL_NO_ERROR)
-      return r;
-    
-    for(cur = clist_begin(mb_list->mb_list) ; cur != NULL ;
-        cur = clist_next(cur)) {
-      struct mailimf_mailbox * mb;
-      
-      mb = clist_content(cur);
-      
-      r = mailimf_cache_mailbox_write(mmapstr, indx, mb);
-      if (r != MAIL_NO_ERROR)
-        return r;
-    }
-  }
-
-  return MAIL_NO_ERROR;
-}
 
 static int
 mailimf_cache_mailbox_list_read(MMAPString * mmapstr, size_t * indx,
@@ -1376,30 +2154,6 @@ mailimf_cache_mailbox_list_read(MMAPString * mmapstr, size_t * indx,
   return res;
 }
 
-static int mailimf_cache_mailbox_write(MMAPString * mmapstr, size_t * indx,
-				       struct mailimf_mailbox * mb)
-{
-  int r;
-
-  if (mb->mb_display_name) {
-    r = mailimf_cache_string_write(mmapstr, indx, 
-        mb->mb_display_name, strlen(mb->mb_display_name));
-    if (r != MAIL_NO_ERROR)
-      return r;
-  }
-  else {
-    r = mailimf_cache_string_write(mmapstr, indx, NULL, 0);
-    if (r != MAIL_NO_ERROR)
-      return r;
-  }
-
-  r = mailimf_cache_string_write(mmapstr, indx,
-      mb->mb_addr_spec, strlen(mb->mb_addr_spec));
-  if (r != MAIL_NO_ERROR)
-    return r;
-
-  return MAIL_NO_ERROR;
-}
 
 static int mailimf_cache_mailbox_read(MMAPString * mmapstr, size_t * indx,
 				      struct mailimf_mailbox ** result)
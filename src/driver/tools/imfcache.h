@@ -68,6 +68,52 @@ int mailimf_cache_fields_write(MMAPString * mmapstr, size_t * indx,
 int mailimf_cache_fields_read(MMAPString * mmapstr, size_t * indx,
 			      struct mailimf_fields ** result);
 
+/*
+  view of cached fields
+
+  mailimf_cache_fields_view_init() gives access to the fields written
+  by mailimf_cache_fields_write() without reading them. The view refers
+  to the content of mmapstr, which must not change while it is used.
+  It returns MAIL_ERROR_INVAL for fields written by previous versions,
+  which can only be read with mailimf_cache_fields_read().
+
+  mailimf_cache_fields_view_next() iterates over the fields, iter must
+  be 0 the first time, MAIL_ERROR_MSG_NOT_FOUND is returned after the
+  last field. mailimf_cache_fields_view_find() returns the first field
+  of the given type (MAILIMF_FIELD_XXX).
+
+  mailimf_cache_field_view_get_string() returns the value of a Subject
+  or a Message-ID field, the string is not terminated by '\0' and
+  refers to the content of mmapstr. mailimf_cache_field_view_read()
+  builds the field.
+*/
+
+struct mailimf_cache_fields_view {
+  const char * fv_data;
+  size_t fv_length;
+};
+
+struct mailimf_cache_field_view {
+  int fv_type;
+  const char * fv_data;
+  size_t fv_length;
+};
+
+int mailimf_cache_fields_view_init(struct mailimf_cache_fields_view * view,
+    MMAPString * mmapstr, size_t * indx);
+
+int mailimf_cache_fields_view_next(struct mailimf_cache_fields_view * view,
+    size_t * iter, struct mailimf_cache_field_view * result);
+
+int mailimf_cache_fields_view_find(struct mailimf_cache_fields_view * view,
+    int type, struct mailimf_cache_field_view * result);
+
+int mailimf_cache_field_view_get_string(struct mailimf_cache_field_view * field,
+    const char ** result, size_t * result_len);
+
+int mailimf_cache_field_view_read(struct mailimf_cache_field_view * field,
+    struct mailimf_field ** result);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,570 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2011 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include "condstore.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "clist.h"
+#include "mailimap_types_helper.h"
+#include "mailimap_extension.h"
+#include "mailimap_keywords.h"
+#include "mailimap_parser.h"
+#include "mailimap_sender.h"
+#include "mailimap.h"
+#include "uidplus_parser.h"
+#include "mail.h"
+
+static int
+mailimap_condstore_extension_parse(int calling_parser, mailstream * fd,
+    MMAPString * buffer, size_t * indx,
+    struct mailimap_extension_data ** result,
+    size_t progr_rate, progress_function * progr_fun);
+
+static void
+mailimap_condstore_extension_data_free(struct mailimap_extension_data * ext_data);
+
+LIBETPAN_EXPORT
+struct mailimap_extension_api mailimap_extension_condstore = {
+  /* name */          "CONDSTORE",
+  /* extension_id */  MAILIMAP_EXTENSION_CONDSTORE,
+  /* parser */        mailimap_condstore_extension_parse,
+  /* free */          mailimap_condstore_extension_data_free
+};
+
+LIBETPAN_EXPORT
+int mailimap_has_condstore(mailimap * session)
+{
+  return mailimap_has_extension(session, "CONDSTORE") ||
+    mailimap_has_extension(session, "QRESYNC");
+}
+
+LIBETPAN_EXPORT
+struct mailimap_fetch_att * mailimap_fetch_att_new_modseq(void)
+{
+  char * keyword;
+  struct mailimap_fetch_att * att;
+
+  keyword = strdup("MODSEQ");
+  if (keyword == NULL)
+    return NULL;
+
+  att = mailimap_fetch_att_new_extension(keyword);
+  if (att == NULL) {
+    free(keyword);
+    return NULL;
+  }
+
+  return att;
+}
+
+LIBETPAN_EXPORT
+int mailimap_msg_att_get_modseq(struct mailimap_msg_att * msg_att,
+    uint64_t * p_mod_sequence_value)
+{
+  clistiter * cur;
+
+  for(cur = clist_begin(msg_att->att_list) ; cur != NULL ;
+      cur = clist_next(cur)) {
+    struct mailimap_msg_att_item * item;
+    struct mailimap_extension_data * ext_data;
+    struct mailimap_condstore_fetch_mod_resp * fetch_data;
+
+    item = clist_content(cur);
+    if (item->att_type != MAILIMAP_MSG_ATT_ITEM_EXTENSION)
+      continue;
+
+    ext_data = item->att_data.att_extension_data;
+    if (ext_data->ext_extension != &mailimap_extension_condstore)
+      continue;
+    if (ext_data->ext_type != MAILIMAP_CONDSTORE_TYPE_FETCH_DATA)
+      continue;
+
+    fetch_data = ext_data->ext_data;
+    * p_mod_sequence_value = fetch_data->cs_modseq_value;
+    return 1;
+  }
+
+  return 0;
+}
+
+LIBETPAN_EXPORT
+int mailimap_get_highestmodseq(mailimap * session,
+    uint64_t * p_mod_sequence_value)
+{
+  clistiter * cur;
+
+  if (session->imap_response_info == NULL)
+    return 0;
+
+  for(cur = clist_begin(session->imap_response_info->rsp_extension_list) ;
+      cur != NULL ; cur = clist_next(cur)) {
+    struct mailimap_extension_data * ext_data;
+    struct mailimap_condstore_resptextcode * resptextcode;
+
+    ext_data = clist_content(cur);
+    if (ext_data->ext_extension != &mailimap_extension_condstore)
+      continue;
+    if (ext_data->ext_type != MAILIMAP_CONDSTORE_TYPE_RESP_TEXT_CODE)
+      continue;
+
+    resptextcode = ext_data->ext_data;
+    if (resptextcode->cs_type != MAILIMAP_CONDSTORE_RESPTEXTCODE_HIGHESTMODSEQ)
+      continue;
+
+    * p_mod_sequence_value = resptextcode->cs_data.cs_modseq_value;
+    return 1;
+  }
+
+  return 0;
+}
+
+/* parser */
+
+/*
+   fetch-mod-resp      = "MODSEQ" SP "(" permsg-modsequence ")"
+
+   permsg-modsequence  = mod-sequence-value
+*/
+
+static int fetch_data_modseq_parse(mailstream * fd,
+    MMAPString * buffer, size_t * indx,
+    struct mailimap_condstore_fetch_mod_resp ** result)
+{
+  size_t cur_token;
+  uint64_t modseq;
+  struct mailimap_condstore_fetch_mod_resp * fetch_data;
+  int r;
+
+  cur_token = * indx;
+
+  r = mailimap_token_case_insensitive_parse(fd, buffer,
+      &cur_token, "MODSEQ");
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_space_parse(fd, buffer, &cur_token);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_oparenth_parse(fd, buffer, &cur_token);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_mod_sequence_value_parse(fd, buffer, &cur_token, &modseq);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_cparenth_parse(fd, buffer, &cur_token);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  fetch_data = malloc(sizeof(* fetch_data));
+  if (fetch_data == NULL)
+    return MAILIMAP_ERROR_MEMORY;
+  fetch_data->cs_modseq_value = modseq;
+
+  * indx = cur_token;
+  * result = fetch_data;
+
+  return MAILIMAP_NO_ERROR;
+}
+
+/*
+   resp-text-code      =/ "HIGHESTMODSEQ" SP mod-sequence-value /
+                          "NOMODSEQ" /
+                          "MODIFIED" SP sequence-set
+*/
+
+static int resp_text_code_parse(mailstream * fd,
+    MMAPString * buffer, size_t * indx,
+    struct mailimap_condstore_resptextcode ** result)
+{
+  size_t cur_token;
+  struct mailimap_condstore_resptextcode * resptextcode;
+  uint64_t modseq;
+  struct mailimap_set * set;
+  int type;
+  int r;
+
+  cur_token = * indx;
+  modseq = 0;
+  set = NULL;
+
+  r = mailimap_token_case_insensitive_parse(fd, buffer,
+      &cur_token, "HIGHESTMODSEQ");
+  if (r == MAILIMAP_NO_ERROR) {
+    r = mailimap_space_parse(fd, buffer, &cur_token);
+    if (r != MAILIMAP_NO_ERROR)
+      return r;
+
+    r = mailimap_mod_sequence_value_parse(fd, buffer, &cur_token, &modseq);
+    if (r != MAILIMAP_NO_ERROR)
+      return r;
+
+    type = MAILIMAP_CONDSTORE_RESPTEXTCODE_HIGHESTMODSEQ;
+  }
+
+  if (r == MAILIMAP_ERROR_PARSE) {
+    r = mailimap_token_case_insensitive_parse(fd, buffer,
+        &cur_token, "NOMODSEQ");
+    if (r == MAILIMAP_NO_ERROR)
+      type = MAILIMAP_CONDSTORE_RESPTEXTCODE_NOMODSEQ;
+  }
+
+  if (r == MAILIMAP_ERROR_PARSE) {
+    r = mailimap_token_case_insensitive_parse(fd, buffer,
+        &cur_token, "MODIFIED");
+    if (r == MAILIMAP_NO_ERROR) {
+      r = mailimap_space_parse(fd, buffer, &cur_token);
+      if (r != MAILIMAP_NO_ERROR)
+        return r;
+
+      r = mailimap_uid_set_parse(fd, buffer, &cur_token, &set);
+      if (r != MAILIMAP_NO_ERROR)
+        return r;
+
+      type = MAILIMAP_CONDSTORE_RESPTEXTCODE_MODIFIED;
+    }
+  }
+
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  resptextcode = malloc(sizeof(* resptextcode));
+  if (resptextcode == NULL) {
+    if (set != NULL)
+      mailimap_set_free(set);
+    return MAILIMAP_ERROR_MEMORY;
+  }
+
+  resptextcode->cs_type = type;
+  if (type == MAILIMAP_CONDSTORE_RESPTEXTCODE_MODIFIED)
+    resptextcode->cs_data.cs_modified_set = set;
+  else
+    resptextcode->cs_data.cs_modseq_value = modseq;
+
+  * indx = cur_token;
+  * result = resptextcode;
+
+  return MAILIMAP_NO_ERROR;
+}
+
+static void
+mailimap_condstore_resptextcode_free(struct mailimap_condstore_resptextcode * resptextcode)
+{
+  if (resptextcode->cs_type == MAILIMAP_CONDSTORE_RESPTEXTCODE_MODIFIED)
+    mailimap_set_free(resptextcode->cs_data.cs_modified_set);
+  free(resptextcode);
+}
+
+static int
+mailimap_condstore_extension_parse(int calling_parser, mailstream * fd,
+    MMAPString * buffer, size_t * indx,
+    struct mailimap_extension_data ** result,
+    size_t progr_rate, progress_function * progr_fun)
+{
+  size_t cur_token;
+  int type;
+  void * data;
+  struct mailimap_condstore_fetch_mod_resp * fetch_data;
+  struct mailimap_condstore_resptextcode * resptextcode;
+  struct mailimap_extension_data * ext_data;
+  int r;
+  UNUSED(progr_rate); UNUSED(progr_fun);
+
+  cur_token = * indx;
+
+  switch (calling_parser) {
+  case MAILIMAP_EXTENDED_PARSER_FETCH_DATA:
+    r = fetch_data_modseq_parse(fd, buffer, &cur_token, &fetch_data);
+    if (r != MAILIMAP_NO_ERROR)
+      return r;
+
+    type = MAILIMAP_CONDSTORE_TYPE_FETCH_DATA;
+    data = fetch_data;
+    break;
+
+  case MAILIMAP_EXTENDED_PARSER_RESP_TEXT_CODE:
+    r = resp_text_code_parse(fd, buffer, &cur_token, &resptextcode);
+    if (r != MAILIMAP_NO_ERROR)
+      return r;
+
+    type = MAILIMAP_CONDSTORE_TYPE_RESP_TEXT_CODE;
+    data = resptextcode;
+    break;
+
+  default:
+    return MAILIMAP_ERROR_PARSE;
+  }
+
+  ext_data = mailimap_extension_data_new(&mailimap_extension_condstore,
+      type, data);
+  if (ext_data == NULL) {
+    if (type == MAILIMAP_CONDSTORE_TYPE_FETCH_DATA)
+      free(data);
+    else
+      mailimap_condstore_resptextcode_free(data);
+    return MAILIMAP_ERROR_MEMORY;
+  }
+
+  * result = ext_data;
+  * indx = cur_token;
+
+  return MAILIMAP_NO_ERROR;
+}
+
+static void
+mailimap_condstore_extension_data_free(struct mailimap_extension_data * ext_data)
+{
+  if (ext_data == NULL)
+    return;
+
+  if (ext_data->ext_data != NULL) {
+    switch (ext_data->ext_type) {
+    case MAILIMAP_CONDSTORE_TYPE_FETCH_DATA:
+      free(ext_data->ext_data);
+      break;
+    case MAILIMAP_CONDSTORE_TYPE_RESP_TEXT_CODE:
+      mailimap_condstore_resptextcode_free(ext_data->ext_data);
+      break;
+    }
+  }
+  free(ext_data);
+}
+
+/* sender */
+
+static int mailimap_select_condstore_send(mailstream * fd, const char * mb)
+{
+  int r;
+
+  r = mailimap_select_send(fd, mb);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_space_send(fd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_token_send(fd, "(CONDSTORE)");
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  return MAILIMAP_NO_ERROR;
+}
+
+/*
+   fetch-modifier      =/ chgsince-fetch-mod
+
+   chgsince-fetch-mod  = "CHANGEDSINCE" SP mod-sequence-value
+*/
+
+static int mailimap_fetch_changedsince_send(mailstream * fd, int uid,
+    struct mailimap_set * set,
+    struct mailimap_fetch_type * fetch_type,
+    uint64_t mod_sequence_value)
+{
+  int r;
+
+  if (uid)
+    r = mailimap_uid_fetch_send(fd, set, fetch_type);
+  else
+    r = mailimap_fetch_send(fd, set, fetch_type);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_space_send(fd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_token_send(fd, "(CHANGEDSINCE");
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_space_send(fd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_mod_sequence_value_send(fd, mod_sequence_value);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_char_send(fd, ')');
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  return MAILIMAP_NO_ERROR;
+}
+
+/* commands */
+
+LIBETPAN_EXPORT
+int mailimap_select_condstore(mailimap * session, const char * mb,
+    uint64_t * p_mod_sequence_value)
+{
+  struct mailimap_response * response;
+  int r;
+  int error_code;
+  uint64_t modseq;
+
+  if ((session->imap_state != MAILIMAP_STATE_AUTHENTICATED) &&
+      (session->imap_state != MAILIMAP_STATE_SELECTED))
+    return MAILIMAP_ERROR_BAD_STATE;
+
+  r = mailimap_send_current_tag(session);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_select_condstore_send(session->imap_stream, mb);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_crlf_send(session->imap_stream);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  if (mailstream_flush(session->imap_stream) == -1)
+    return MAILIMAP_ERROR_STREAM;
+
+  if (mailimap_read_line(session) == NULL)
+    return MAILIMAP_ERROR_STREAM;
+
+  if (session->imap_selection_info != NULL)
+    mailimap_selection_info_free(session->imap_selection_info);
+  session->imap_selection_info = mailimap_selection_info_new();
+
+  r = mailimap_parse_response(session, &response);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  error_code = response->rsp_resp_done->rsp_data.rsp_tagged->rsp_cond_state->rsp_type;
+
+  mailimap_response_free(response);
+
+  switch (error_code) {
+  case MAILIMAP_RESP_COND_STATE_OK:
+    session->imap_state = MAILIMAP_STATE_SELECTED;
+    if (!mailimap_get_highestmodseq(session, &modseq))
+      modseq = 0;
+    * p_mod_sequence_value = modseq;
+    return MAILIMAP_NO_ERROR;
+
+  default:
+    mailimap_selection_info_free(session->imap_selection_info);
+    session->imap_selection_info = NULL;
+    session->imap_state = MAILIMAP_STATE_AUTHENTICATED;
+    return MAILIMAP_ERROR_SELECT;
+  }
+}
+
+static int fetch_changedsince(mailimap * session, int uid,
+    struct mailimap_set * set,
+    struct mailimap_fetch_type * fetch_type,
+    uint64_t mod_sequence_value,
+    clist ** result)
+{
+  struct mailimap_response * response;
+  int r;
+  int error_code;
+
+  if (session->imap_state != MAILIMAP_STATE_SELECTED)
+    return MAILIMAP_ERROR_BAD_STATE;
+
+  r = mailimap_send_current_tag(session);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_fetch_changedsince_send(session->imap_stream, uid,
+      set, fetch_type, mod_sequence_value);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_crlf_send(session->imap_stream);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  if (mailstream_flush(session->imap_stream) == -1)
+    return MAILIMAP_ERROR_STREAM;
+
+  if (mailimap_read_line(session) == NULL)
+    return MAILIMAP_ERROR_STREAM;
+
+  r = mailimap_parse_response(session, &response);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  * result = session->imap_response_info->rsp_fetch_list;
+  session->imap_response_info->rsp_fetch_list = NULL;
+
+  error_code = response->rsp_resp_done->rsp_data.rsp_tagged->rsp_cond_state->rsp_type;
+
+  mailimap_response_free(response);
+
+  switch (error_code) {
+  case MAILIMAP_RESP_COND_STATE_OK:
+    return MAILIMAP_NO_ERROR;
+
+  default:
+    mailimap_fetch_list_free(* result);
+    if (uid)
+      return MAILIMAP_ERROR_UID_FETCH;
+    else
+      return MAILIMAP_ERROR_FETCH;
+  }
+}
+
+LIBETPAN_EXPORT
+int mailimap_fetch_changedsince(mailimap * session,
+    struct mailimap_set * set,
+    struct mailimap_fetch_type * fetch_type,
+    uint64_t mod_sequence_value,
+    clist ** result)
+{
+  return fetch_changedsince(session, 0, set, fetch_type,
+      mod_sequence_value, result);
+}
+
+LIBETPAN_EXPORT
+int mailimap_uid_fetch_changedsince(mailimap * session,
+    struct mailimap_set * set,
+    struct mailimap_fetch_type * fetch_type,
+    uint64_t mod_sequence_value,
+    clist ** result)
+{
+  return fetch_changedsince(session, 1, set, fetch_type,
+      mod_sequence_value, result);
+}
@@ -0,0 +1,138 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2011 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef CONDSTORE_H
+
+#define CONDSTORE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <libetpan/libetpan-config.h>
+#include <libetpan/mailimap_extension.h>
+
+/* CONDSTORE (RFC 7162) */
+
+enum {
+  MAILIMAP_CONDSTORE_TYPE_FETCH_DATA,
+  MAILIMAP_CONDSTORE_TYPE_RESP_TEXT_CODE
+};
+
+/* MODSEQ fetch item */
+
+struct mailimap_condstore_fetch_mod_resp {
+  uint64_t cs_modseq_value;
+};
+
+enum {
+  MAILIMAP_CONDSTORE_RESPTEXTCODE_HIGHESTMODSEQ,
+  MAILIMAP_CONDSTORE_RESPTEXTCODE_NOMODSEQ,
+  MAILIMAP_CONDSTORE_RESPTEXTCODE_MODIFIED
+};
+
+/*
+  - cs_modseq_value is the value of HIGHESTMODSEQ
+  - cs_modified_set is the set of MODIFIED
+*/
+
+struct mailimap_condstore_resptextcode {
+  int cs_type;
+  union {
+    uint64_t cs_modseq_value;
+    struct mailimap_set * cs_modified_set;
+  } cs_data;
+};
+
+LIBETPAN_EXPORT
+extern struct mailimap_extension_api mailimap_extension_condstore;
+
+LIBETPAN_EXPORT
+int mailimap_has_condstore(mailimap * session);
+
+LIBETPAN_EXPORT
+struct mailimap_fetch_att * mailimap_fetch_att_new_modseq(void);
+
+/*
+  mailimap_msg_att_get_modseq() returns 1 and sets p_mod_sequence_value
+  if the fetch result contains a MODSEQ item, 0 otherwise.
+*/
+
+LIBETPAN_EXPORT
+int mailimap_msg_att_get_modseq(struct mailimap_msg_att * msg_att,
+    uint64_t * p_mod_sequence_value);
+
+/*
+  mailimap_get_highestmodseq() looks for the HIGHESTMODSEQ response
+  code in the last response (SELECT or EXAMINE). It returns 1 and sets
+  p_mod_sequence_value if it was found, 0 otherwise (for example when
+  the mailbox does not support persistent mod-sequences).
+*/
+
+LIBETPAN_EXPORT
+int mailimap_get_highestmodseq(mailimap * session,
+    uint64_t * p_mod_sequence_value);
+
+/*
+  mailimap_select_condstore() sends SELECT mb (CONDSTORE).
+  p_mod_sequence_value is set to HIGHESTMODSEQ or to 0 when the
+  mailbox reported NOMODSEQ.
+*/
+
+LIBETPAN_EXPORT
+int mailimap_select_condstore(mailimap * session, const char * mb,
+    uint64_t * p_mod_sequence_value);
+
+/*
+  mailimap_fetch_changedsince() and mailimap_uid_fetch_changedsince()
+  send FETCH with the CHANGEDSINCE modifier, only the messages whose
+  mod-sequence is greater than mod_sequence_value are returned.
+*/
+
+LIBETPAN_EXPORT
+int mailimap_fetch_changedsince(mailimap * session,
+    struct mailimap_set * set,
+    struct mailimap_fetch_type * fetch_type,
+    uint64_t mod_sequence_value,
+    clist ** result);
+
+LIBETPAN_EXPORT
+int mailimap_uid_fetch_changedsince(mailimap * session,
+    struct mailimap_set * set,
+    struct mailimap_fetch_type * fetch_type,
+    uint64_t mod_sequence_value,
+    clist ** result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
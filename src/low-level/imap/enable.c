@@ -0,0 +1,287 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2011 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include "enable.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "clist.h"
+#include "mailimap_extension.h"
+#include "mailimap_keywords.h"
+#include "mailimap_parser.h"
+#include "mailimap_sender.h"
+#include "mailimap.h"
+#include "mail.h"
+
+static int
+mailimap_enable_extension_parse(int calling_parser, mailstream * fd,
+    MMAPString * buffer, size_t * indx,
+    struct mailimap_extension_data ** result,
+    size_t progr_rate, progress_function * progr_fun);
+
+static void
+mailimap_enable_extension_data_free(struct mailimap_extension_data * ext_data);
+
+LIBETPAN_EXPORT
+struct mailimap_extension_api mailimap_extension_enable = {
+  /* name */          "ENABLE",
+  /* extension_id */  MAILIMAP_EXTENSION_ENABLE,
+  /* parser */        mailimap_enable_extension_parse,
+  /* free */          mailimap_enable_extension_data_free
+};
+
+static void capability_list_free(clist * list)
+{
+  clist_foreach(list, (clist_func) free, NULL);
+  clist_free(list);
+}
+
+/*
+   response-data =/ "*" SP enable-data CRLF
+
+   enable-data   = "ENABLED" *(SP capability)
+*/
+
+static int mailimap_enable_data_parse(mailstream * fd,
+    MMAPString * buffer, size_t * indx,
+    clist ** result,
+    size_t progr_rate, progress_function * progr_fun)
+{
+  size_t cur_token;
+  clist * list;
+  char * name;
+  int r;
+  int res;
+
+  cur_token = * indx;
+
+  r = mailimap_token_case_insensitive_parse(fd, buffer,
+      &cur_token, "ENABLED");
+  if (r != MAILIMAP_NO_ERROR) {
+    res = r;
+    goto err;
+  }
+
+  list = clist_new();
+  if (list == NULL) {
+    res = MAILIMAP_ERROR_MEMORY;
+    goto err;
+  }
+
+  while (1) {
+    size_t next_token;
+
+    next_token = cur_token;
+    r = mailimap_space_parse(fd, buffer, &next_token);
+    if (r == MAILIMAP_ERROR_PARSE)
+      break;
+    if (r != MAILIMAP_NO_ERROR) {
+      res = r;
+      goto free_list;
+    }
+
+    r = mailimap_atom_parse(fd, buffer, &next_token, &name,
+        progr_rate, progr_fun);
+    if (r == MAILIMAP_ERROR_PARSE)
+      break;
+    if (r != MAILIMAP_NO_ERROR) {
+      res = r;
+      goto free_list;
+    }
+
+    r = clist_append(list, name);
+    if (r < 0) {
+      free(name);
+      res = MAILIMAP_ERROR_MEMORY;
+      goto free_list;
+    }
+
+    cur_token = next_token;
+  }
+
+  * indx = cur_token;
+  * result = list;
+
+  return MAILIMAP_NO_ERROR;
+
+ free_list:
+  capability_list_free(list);
+ err:
+  return res;
+}
+
+static int
+mailimap_enable_extension_parse(int calling_parser, mailstream * fd,
+    MMAPString * buffer, size_t * indx,
+    struct mailimap_extension_data ** result,
+    size_t progr_rate, progress_function * progr_fun)
+{
+  size_t cur_token;
+  clist * list;
+  struct mailimap_extension_data * ext_data;
+  int r;
+
+  if (calling_parser != MAILIMAP_EXTENDED_PARSER_RESPONSE_DATA)
+    return MAILIMAP_ERROR_PARSE;
+
+  cur_token = * indx;
+
+  r = mailimap_enable_data_parse(fd, buffer, &cur_token, &list,
+      progr_rate, progr_fun);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  ext_data = mailimap_extension_data_new(&mailimap_extension_enable,
+      MAILIMAP_ENABLE_TYPE_ENABLED, list);
+  if (ext_data == NULL) {
+    capability_list_free(list);
+    return MAILIMAP_ERROR_MEMORY;
+  }
+
+  * result = ext_data;
+  * indx = cur_token;
+
+  return MAILIMAP_NO_ERROR;
+}
+
+static void
+mailimap_enable_extension_data_free(struct mailimap_extension_data * ext_data)
+{
+  if (ext_data == NULL)
+    return;
+
+  if (ext_data->ext_data != NULL) {
+    if (ext_data->ext_type == MAILIMAP_ENABLE_TYPE_ENABLED)
+      capability_list_free(ext_data->ext_data);
+  }
+  free(ext_data);
+}
+
+static int mailimap_enable_send(mailstream * fd, const char * capability)
+{
+  int r;
+
+  r = mailimap_token_send(fd, "ENABLE");
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_space_send(fd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_token_send(fd, capability);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  return MAILIMAP_NO_ERROR;
+}
+
+LIBETPAN_EXPORT
+int mailimap_enable(mailimap * session, const char * capability,
+    int * p_enabled)
+{
+  struct mailimap_response * response;
+  int r;
+  int error_code;
+  int enabled;
+  clistiter * cur;
+
+  if (session->imap_state != MAILIMAP_STATE_AUTHENTICATED)
+    return MAILIMAP_ERROR_BAD_STATE;
+
+  r = mailimap_send_current_tag(session);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_enable_send(session->imap_stream, capability);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_crlf_send(session->imap_stream);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  if (mailstream_flush(session->imap_stream) == -1)
+    return MAILIMAP_ERROR_STREAM;
+
+  if (mailimap_read_line(session) == NULL)
+    return MAILIMAP_ERROR_STREAM;
+
+  r = mailimap_parse_response(session, &response);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  error_code = response->rsp_resp_done->rsp_data.rsp_tagged->rsp_cond_state->rsp_type;
+
+  mailimap_response_free(response);
+
+  if (error_code != MAILIMAP_RESP_COND_STATE_OK)
+    return MAILIMAP_ERROR_EXTENSION;
+
+  enabled = 0;
+  for(cur = clist_begin(session->imap_response_info->rsp_extension_list) ;
+      cur != NULL ; cur = clist_next(cur)) {
+    struct mailimap_extension_data * ext_data;
+    clist * list;
+    clistiter * name_iter;
+
+    ext_data = clist_content(cur);
+    if (ext_data->ext_extension != &mailimap_extension_enable)
+      continue;
+    if (ext_data->ext_type != MAILIMAP_ENABLE_TYPE_ENABLED)
+      continue;
+
+    list = ext_data->ext_data;
+    for(name_iter = clist_begin(list) ; name_iter != NULL ;
+        name_iter = clist_next(name_iter)) {
+      char * name;
+
+      name = clist_content(name_iter);
+      if (strcasecmp(name, capability) == 0)
+        enabled = 1;
+    }
+  }
+
+  * p_enabled = enabled;
+
+  return MAILIMAP_NO_ERROR;
+}
+
+LIBETPAN_EXPORT
+int mailimap_has_enable(mailimap * session)
+{
+  return mailimap_has_extension(session, "ENABLE");
+}
@@ -0,0 +1,72 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2011 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef ENABLE_H
+
+#define ENABLE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <libetpan/libetpan-config.h>
+#include <libetpan/mailimap_extension.h>
+
+enum {
+  MAILIMAP_ENABLE_TYPE_ENABLED
+};
+
+/*
+  the ENABLED response data is a list of (char *), the names of the
+  capabilities the server enabled.
+*/
+
+LIBETPAN_EXPORT
+extern struct mailimap_extension_api mailimap_extension_enable;
+
+/*
+  mailimap_enable() sends ENABLE (RFC 5161) for the given capability.
+  enabled is set to 1 when the server listed the capability in its
+  ENABLED response and to 0 otherwise.
+*/
+
+LIBETPAN_EXPORT
+int mailimap_enable(mailimap * session, const char * capability,
+    int * p_enabled);
+
+LIBETPAN_EXPORT
+int mailimap_has_enable(mailimap * session);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
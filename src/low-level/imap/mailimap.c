@@ -41,6 +41,7 @@
 #include "mailimap_parser.h"
 #include "mailimap_sender.h"
 #include "mailimap_extension.h"
+#include "qresync.h"
 #include "mail.h"
 
 #include <stdio.h>
@@ -306,8 +307,12 @@ static void mailbox_data_store(mailimap * session,
 
   case MAILIMAP_MAILBOX_DATA_STATUS:
     if (session->imap_response_info) {
-      if (session->imap_response_info->rsp_status != NULL)
-        mailimap_mailbox_data_status_free(session->imap_response_info->rsp_status);
+      if (session->imap_response_info->rsp_status != NULL) {
+        r = clist_append(session->imap_response_info->rsp_status_list,
+            session->imap_response_info->rsp_status);
+        if (r < 0)
+          mailimap_mailbox_data_status_free(session->imap_response_info->rsp_status);
+      }
       session->imap_response_info->rsp_status = mb_data->mbd_data.mbd_status;
 #if 0
       if (session->imap_selection_info != NULL) {
@@ -411,6 +416,47 @@ message_data_store(mailimap * session,
   }
 }
 
+/*
+  a VANISHED response (QRESYNC) replaces the EXPUNGE responses,
+  the count of messages is updated the same way.
+*/
+
+static void
+vanished_store(mailimap * session,
+    struct mailimap_extension_data * ext_data)
+{
+  struct mailimap_qresync_vanished * vanished;
+  clistiter * cur;
+
+  if (session->imap_selection_info == NULL)
+    return;
+
+  if (ext_data->ext_extension != &mailimap_extension_qresync)
+    return;
+  if (ext_data->ext_type != MAILIMAP_QRESYNC_TYPE_VANISHED)
+    return;
+
+  vanished = ext_data->ext_data;
+  if (vanished->qr_earlier)
+    return;
+
+  for(cur = clist_begin(vanished->qr_known_uids->set_list) ; cur != NULL ;
+      cur = clist_next(cur)) {
+    struct mailimap_set_item * item;
+    uint32_t count;
+
+    item = clist_content(cur);
+    if (item->set_last >= item->set_first)
+      count = item->set_last - item->set_first + 1;
+    else
+      count = item->set_first - item->set_last + 1;
+
+    if (count > session->imap_selection_info->sel_exists)
+      count = session->imap_selection_info->sel_exists;
+    session->imap_selection_info->sel_exists -= count;
+  }
+}
+
 static void
 cont_req_or_resp_data_store(mailimap * session,
     struct mailimap_cont_req_or_resp_data * cont_req_or_resp_data)
@@ -439,6 +485,7 @@ cont_req_or_resp_data_store(mailimap * session,
       }
       break;
     case MAILIMAP_RESP_DATA_TYPE_EXTENSION_DATA:
+      vanished_store(session, resp_data->rsp_data.rsp_extension_data);
       mailimap_extension_data_store(session, &(resp_data->rsp_data.rsp_extension_data));
       break;
     }
@@ -2415,8 +2462,23 @@ int mailimap_send_current_tag(mailimap * session)
   return MAILIMAP_NO_ERROR;
 }
 
+static int parse_response(mailimap * session,
+    struct mailimap_response ** result, int check_tag);
+
 int mailimap_parse_response(mailimap * session,
     struct mailimap_response ** result)
+{
+  return parse_response(session, result, 1);
+}
+
+int mailimap_parse_response_any_tag(mailimap * session,
+    struct mailimap_response ** result)
+{
+  return parse_response(session, result, 0);
+}
+
+static int parse_response(mailimap * session,
+    struct mailimap_response ** result, int check_tag)
 {
   size_t indx;
   struct mailimap_response * response;
@@ -2435,7 +2497,18 @@ int mailimap_parse_response(mailimap * session,
 		session->imap_stream_buffer = buffer;
   }
 
-  if ((session->imap_body_progress_fun != NULL) ||
+  if (session->imap_literal_sink.sink_begin != NULL) {
+    r = mailimap_response_parse_with_literal_sink(session->imap_stream,
+                                                  session->imap_stream_buffer,
+                                                  &indx, &response,
+                                                  session->imap_body_progress_fun,
+                                                  session->imap_items_progress_fun,
+                                                  session->imap_progress_context,
+                                                  session->imap_msg_att_handler,
+                                                  session->imap_msg_att_handler_context,
+                                                  &session->imap_literal_sink);
+  }
+  else if ((session->imap_body_progress_fun != NULL) ||
       (session->imap_items_progress_fun != NULL)) {
     r = mailimap_response_parse_with_context(session->imap_stream,
                                              session->imap_stream_buffer,
@@ -2477,16 +2550,18 @@ int mailimap_parse_response(mailimap * session,
     return MAILIMAP_ERROR_FATAL;
   }
 
-  snprintf(tag_str, 15, "%i", session->imap_tag);
-  if (strcmp(response->rsp_resp_done->rsp_data.rsp_tagged->rsp_tag, tag_str) != 0) {
-    mailimap_response_free(response);
-    return MAILIMAP_ERROR_PROTOCOL;
-  }
+  if (check_tag) {
+    snprintf(tag_str, 15, "%i", session->imap_tag);
+    if (strcmp(response->rsp_resp_done->rsp_data.rsp_tagged->rsp_tag, tag_str) != 0) {
+      mailimap_response_free(response);
+      return MAILIMAP_ERROR_PROTOCOL;
+    }
 
-  if (response->rsp_resp_done->rsp_data.rsp_tagged->rsp_cond_state->rsp_type ==
-      MAILIMAP_RESP_COND_STATE_BAD) {
-    mailimap_response_free(response);
-    return MAILIMAP_ERROR_PROTOCOL;
+    if (response->rsp_resp_done->rsp_data.rsp_tagged->rsp_cond_state->rsp_type ==
+        MAILIMAP_RESP_COND_STATE_BAD) {
+      mailimap_response_free(response);
+      return MAILIMAP_ERROR_PROTOCOL;
+    }
   }
 
   * result = response;
@@ -2591,6 +2666,10 @@ mailimap * mailimap_new(size_t imap_progr_rate,
   f->imap_msg_att_handler = NULL;
   f->imap_msg_att_handler_context = NULL;
 
+  f->imap_literal_sink.sink_begin = NULL;
+  f->imap_literal_sink.sink_write = NULL;
+  f->imap_literal_sink.sink_context = NULL;
+
   return f;
 
  free_stream_buffer:
@@ -2647,4 +2726,15 @@ void mailimap_set_msg_att_handler(mailimap * session,
     session->imap_msg_att_handler_context = context;
 }
 
+LIBETPAN_EXPORT
+void mailimap_set_literal_sink(mailimap * session,
+                               mailimap_literal_sink_begin * begin,
+                               mailimap_literal_sink_write * write,
+                               void * context)
+{
+  session->imap_literal_sink.sink_begin = begin;
+  session->imap_literal_sink.sink_write = write;
+  session->imap_literal_sink.sink_context = context;
+}
+
 
@@ -52,10 +52,16 @@ extern "C" {
 #include <libetpan/annotatemore.h>
 #include <libetpan/uidplus.h>
 #include <libetpan/idle.h>
+#include <libetpan/mailimap_async.h>
+#include <libetpan/mailimap_pipeline.h>
+#include <libetpan/compress.h>
 #include <libetpan/quota.h>
 #include <libetpan/namespace.h>
 #include <libetpan/xlist.h>
 #include <libetpan/xgmlabels.h>
+#include <libetpan/enable.h>
+#include <libetpan/condstore.h>
+#include <libetpan/qresync.h>
 
 /*
   mailimap_connect()
@@ -656,6 +662,15 @@ char * mailimap_read_line(mailimap * session);
 int mailimap_parse_response(mailimap * session,
     struct mailimap_response ** result);
 
+/*
+  same as mailimap_parse_response() but the tag of the response
+  is not checked and BAD responses are returned, the caller matches
+  the response with the command.
+*/
+
+int mailimap_parse_response_any_tag(mailimap * session,
+    struct mailimap_response ** result);
+
 LIBETPAN_EXPORT
 void mailimap_set_progress_callback(mailimap * session,
                                     mailprogress_function * body_progr_fun,
@@ -667,6 +682,27 @@ void mailimap_set_msg_att_handler(mailimap * session,
                                   mailimap_msg_att_handler * handler,
                                   void * context);
 
+/*
+   mailimap_set_literal_sink()
+
+   This function will set the callbacks that receive the content of
+   the body sections fetched with mailimap_fetch() or mailimap_uid_fetch()
+   while it is read from the network, so that it is never entirely
+   stored in memory. See mailimap_literal_sink in mailimap_types.h.
+
+   @param session   IMAP session
+   @param begin     called before each body section content,
+     NULL to disable the sink
+   @param write     called for each chunk of content
+   @param context   given to both callbacks
+ */
+
+LIBETPAN_EXPORT
+void mailimap_set_literal_sink(mailimap * session,
+                               mailimap_literal_sink_begin * begin,
+                               mailimap_literal_sink_write * write,
+                               void * context);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,1304 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2005 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include "mailimap_async.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef WIN32
+#	include "win_etpan.h"
+#	define poll(fds, count, timeout) WSAPoll(fds, count, timeout)
+#else
+#	include <poll.h>
+#endif
+#ifdef HAVE_SYS_EPOLL_H
+#	include <sys/epoll.h>
+#	include <unistd.h>
+#endif
+
+#include "mailimap.h"
+#include "mailimap_sender.h"
+#include "mailstream_low.h"
+#include "carray.h"
+#include "mail.h"
+
+/*
+  The response parser is not resumable, it reads from a blocking
+  stream. Instead, incoming data is accumulated and scanned for line
+  ends and literals until the tagged response of the command is
+  complete. The session stream is then replaced by a stream reading from
+  that buffer and the usual parser is run on the complete response.
+
+  The same stream is used to serialize the commands into a buffer
+  with the usual senders.
+*/
+
+enum {
+  ASYNC_COMMAND_NOOP,
+  ASYNC_COMMAND_SELECT,
+  ASYNC_COMMAND_EXAMINE,
+  ASYNC_COMMAND_STATUS,
+  ASYNC_COMMAND_FETCH,
+  ASYNC_COMMAND_UID_FETCH,
+  ASYNC_COMMAND_STORE,
+  ASYNC_COMMAND_UID_STORE,
+  ASYNC_COMMAND_UID_SEARCH
+};
+
+struct mailimap_async_command {
+  int cmd_type;
+  int cmd_tag;
+  MMAPString * cmd_data;
+  mailimap_async_callback * cmd_callback;
+  void * cmd_cb_data;
+};
+
+struct mailimap_async {
+  mailimap * async_session;
+  int async_error;
+
+  /* connection stream, in non-blocking mode */
+  mailstream * async_stream;
+  /* stream given to the senders and to the parser */
+  mailstream * async_buffer_stream;
+
+  /* commands being serialized */
+  MMAPString * async_capture;
+
+  MMAPString * async_output;
+  size_t async_output_pos;
+
+  MMAPString * async_input;
+  size_t async_line_start;
+  size_t async_scan_pos;
+  size_t async_literal_left;
+  /* length of the complete response, 0 when incomplete */
+  size_t async_response_len;
+  size_t async_read_pos;
+
+  /* the first command is the one sent to the server */
+  clist * async_queue;
+
+  mailimap_async_loop * async_loop;
+  unsigned int async_loop_index;
+  int async_loop_events;
+};
+
+#define ASYNC_LOOP_MAX_EVENTS 256
+
+struct mailimap_async_loop {
+#ifdef HAVE_SYS_EPOLL_H
+  int loop_epoll_fd;
+  struct epoll_event loop_events[ASYNC_LOOP_MAX_EVENTS];
+#else
+  struct pollfd * loop_pollfd;
+  mailimap_async ** loop_ready;
+  unsigned int loop_pollfd_count;
+#endif
+  /*
+    number of sessions being processed by mailimap_async_loop_run_once(),
+    a session removed meanwhile by a callback is set to NULL there
+  */
+  unsigned int loop_ready_count;
+  carray * loop_sessions;
+};
+
+static void async_update_events(mailimap_async * async);
+
+/* buffer stream */
+
+static ssize_t async_buffer_read(mailstream_low * s, void * buf, size_t count)
+{
+  mailimap_async * async;
+  size_t left;
+
+  async = s->data;
+  left = async->async_response_len - async->async_read_pos;
+  if (count > left)
+    count = left;
+  memcpy(buf, async->async_input->str + async->async_read_pos, count);
+  async->async_read_pos += count;
+
+  return count;
+}
+
+static ssize_t async_buffer_write(mailstream_low * s,
+    const void * buf, size_t count)
+{
+  mailimap_async * async;
+
+  async = s->data;
+  if (async->async_capture == NULL)
+    return -1;
+
+  if (mmap_string_append_len(async->async_capture, buf, count) == NULL)
+    return -1;
+
+  return count;
+}
+
+static int async_buffer_close(mailstream_low * s)
+{
+  UNUSED(s);
+  return 0;
+}
+
+static int async_buffer_get_fd(mailstream_low * s)
+{
+  UNUSED(s);
+  return -1;
+}
+
+static void async_buffer_free(mailstream_low * s)
+{
+  free(s);
+}
+
+static void async_buffer_cancel(mailstream_low * s)
+{
+  UNUSED(s);
+}
+
+static struct mailstream_cancel * async_buffer_get_cancel(mailstream_low * s)
+{
+  UNUSED(s);
+  return NULL;
+}
+
+static mailstream_low_driver async_buffer_driver = {
+  /* mailstream_read */ async_buffer_read,
+  /* mailstream_write */ async_buffer_write,
+  /* mailstream_close */ async_buffer_close,
+  /* mailstream_get_fd */ async_buffer_get_fd,
+  /* mailstream_free */ async_buffer_free,
+  /* mailstream_cancel */ async_buffer_cancel,
+  /* mailstream_get_cancel */ async_buffer_get_cancel,
+  /* mailstream_set_nonblocking */ NULL,
+};
+
+/* commands */
+
+static struct mailimap_async_command *
+async_command_new(int type, mailimap_async_callback * callback, void * cb_data)
+{
+  struct mailimap_async_command * cmd;
+
+  cmd = malloc(sizeof(* cmd));
+  if (cmd == NULL)
+    return NULL;
+
+  cmd->cmd_data = mmap_string_new("");
+  if (cmd->cmd_data == NULL) {
+    free(cmd);
+    return NULL;
+  }
+  cmd->cmd_type = type;
+  cmd->cmd_tag = 0;
+  cmd->cmd_callback = callback;
+  cmd->cmd_cb_data = cb_data;
+
+  return cmd;
+}
+
+static void async_command_free(struct mailimap_async_command * cmd)
+{
+  mmap_string_free(cmd->cmd_data);
+  free(cmd);
+}
+
+static void async_fail(mailimap_async * async, int error)
+{
+  if (async->async_error == MAILIMAP_NO_ERROR)
+    async->async_error = error;
+
+  while (!clist_isempty(async->async_queue)) {
+    struct mailimap_async_command * cmd;
+
+    cmd = clist_content(clist_begin(async->async_queue));
+    clist_delete(async->async_queue, clist_begin(async->async_queue));
+
+    if (cmd->cmd_callback != NULL)
+      cmd->cmd_callback(async, async->async_error, NULL, cmd->cmd_cb_data);
+    async_command_free(cmd);
+  }
+
+  async_update_events(async);
+}
+
+static int async_flush_output(mailimap_async * async)
+{
+  mailstream_low * low;
+
+  low = async->async_stream->low;
+  while (async->async_output_pos < async->async_output->len) {
+    ssize_t r;
+
+    r = mailstream_low_write(low,
+        async->async_output->str + async->async_output_pos,
+        async->async_output->len - async->async_output_pos);
+    if (r < 0) {
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+        break;
+      return MAILIMAP_ERROR_STREAM;
+    }
+    async->async_output_pos += r;
+  }
+
+  if (async->async_output_pos == async->async_output->len) {
+    mmap_string_truncate(async->async_output, 0);
+    async->async_output_pos = 0;
+  }
+
+  return MAILIMAP_NO_ERROR;
+}
+
+/* sends the command at the head of the queue */
+
+static int async_command_start(mailimap_async * async)
+{
+  struct mailimap_async_command * cmd;
+
+  cmd = clist_content(clist_begin(async->async_queue));
+  if (mmap_string_append_len(async->async_output,
+          cmd->cmd_data->str, cmd->cmd_data->len) == NULL)
+    return MAILIMAP_ERROR_MEMORY;
+
+  return async_flush_output(async);
+}
+
+static int async_command_begin(mailimap_async * async, int type,
+    mailimap_async_callback * callback, void * cb_data,
+    struct mailimap_async_command ** result)
+{
+  struct mailimap_async_command * cmd;
+  int r;
+
+  if (async->async_error != MAILIMAP_NO_ERROR)
+    return async->async_error;
+
+  cmd = async_command_new(type, callback, cb_data);
+  if (cmd == NULL)
+    return MAILIMAP_ERROR_MEMORY;
+
+  async->async_capture = cmd->cmd_data;
+  r = mailimap_send_current_tag(async->async_session);
+  if (r != MAILIMAP_NO_ERROR) {
+    async->async_capture = NULL;
+    async->async_buffer_stream->write_buffer_len = 0;
+    async_command_free(cmd);
+    return r;
+  }
+  cmd->cmd_tag = async->async_session->imap_tag;
+
+  * result = cmd;
+
+  return MAILIMAP_NO_ERROR;
+}
+
+static int async_command_end(mailimap_async * async,
+    struct mailimap_async_command * cmd, int r)
+{
+  if (r == MAILIMAP_NO_ERROR)
+    r = mailimap_crlf_send(async->async_buffer_stream);
+  if (r == MAILIMAP_NO_ERROR) {
+    if (mailstream_flush(async->async_buffer_stream) == -1)
+      r = MAILIMAP_ERROR_STREAM;
+  }
+  async->async_capture = NULL;
+  if (r != MAILIMAP_NO_ERROR) {
+    async->async_buffer_stream->write_buffer_len = 0;
+    goto free_cmd;
+  }
+
+  r = clist_append(async->async_queue, cmd);
+  if (r < 0) {
+    r = MAILIMAP_ERROR_MEMORY;
+    goto free_cmd;
+  }
+
+  if (clist_count(async->async_queue) == 1) {
+    r = async_command_start(async);
+    if (r != MAILIMAP_NO_ERROR) {
+      /* the command is queued, the error is given to its callback */
+      async_fail(async, r);
+      return MAILIMAP_NO_ERROR;
+    }
+  }
+  async_update_events(async);
+
+  return MAILIMAP_NO_ERROR;
+
+ free_cmd:
+  async_command_free(cmd);
+  return r;
+}
+
+/* input */
+
+static int async_read_input(mailimap_async * async)
+{
+  mailstream * s;
+  char buf[4096];
+
+  s = async->async_stream;
+
+  /* data read by the blocking API before the switch */
+  if (s->read_buffer_len > 0) {
+    if (mmap_string_append_len(async->async_input,
+            s->read_buffer, s->read_buffer_len) == NULL)
+      return MAILIMAP_ERROR_MEMORY;
+    s->read_buffer_len = 0;
+  }
+
+  /* read until the connection would block, a TLS layer can hold
+     decrypted data the file descriptor won't signal. */
+  while (1) {
+    ssize_t r;
+
+    r = mailstream_low_read(s->low, buf, sizeof(buf));
+    if (r == 0)
+      return MAILIMAP_ERROR_STREAM;
+    if (r < 0) {
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+        break;
+      return MAILIMAP_ERROR_STREAM;
+    }
+
+    if (mmap_string_append_len(async->async_input, buf, r) == NULL)
+      return MAILIMAP_ERROR_MEMORY;
+  }
+
+  return MAILIMAP_NO_ERROR;
+}
+
+/*
+  scans the input for the end of the response,
+  a line that does not start with "*" or "+", outside of literals.
+*/
+
+static int async_response_complete(mailimap_async * async)
+{
+  MMAPString * input;
+
+  if (async->async_response_len != 0)
+    return 1;
+
+  input = async->async_input;
+  while (1) {
+    char * line_end;
+    size_t end;
+    size_t i;
+
+    if (async->async_literal_left > 0) {
+      size_t left;
+
+      left = input->len - async->async_scan_pos;
+      if (left < async->async_literal_left) {
+        async->async_scan_pos += left;
+        async->async_literal_left -= left;
+        return 0;
+      }
+      async->async_scan_pos += async->async_literal_left;
+      async->async_literal_left = 0;
+    }
+
+    line_end = memchr(input->str + async->async_scan_pos, '\n',
+        input->len - async->async_scan_pos);
+    if (line_end == NULL) {
+      async->async_scan_pos = input->len;
+      return 0;
+    }
+    end = line_end - input->str;
+    async->async_scan_pos = end + 1;
+
+    /* literal : "{" number ["+"] "}" CRLF */
+    i = end;
+    if ((i > async->async_line_start) && (input->str[i - 1] == '\r'))
+      i --;
+    if ((i > async->async_line_start) && (input->str[i - 1] == '}')) {
+      size_t digit_end;
+
+      i --;
+      if ((i > async->async_line_start) && (input->str[i - 1] == '+'))
+        i --;
+      digit_end = i;
+      while ((i > async->async_line_start) &&
+          (input->str[i - 1] >= '0') && (input->str[i - 1] <= '9'))
+        i --;
+      if ((i < digit_end) && (i > async->async_line_start) &&
+          (input->str[i - 1] == '{')) {
+        size_t count;
+
+        count = 0;
+        for( ; i < digit_end ; i ++)
+          count = count * 10 + (input->str[i] - '0');
+        async->async_literal_left = count;
+        continue;
+      }
+    }
+
+    if ((input->str[async->async_line_start] != '*') &&
+        (input->str[async->async_line_start] != '+')) {
+      async->async_response_len = async->async_scan_pos;
+      return 1;
+    }
+
+    async->async_line_start = async->async_scan_pos;
+  }
+}
+
+static int async_parse_response(mailimap_async * async,
+    struct mailimap_async_command * cmd,
+    struct mailimap_response ** result)
+{
+  mailimap * session;
+  int saved_tag;
+  int r;
+
+  session = async->async_session;
+
+  /* the parser checks the tag against the last one sent */
+  saved_tag = session->imap_tag;
+  session->imap_tag = cmd->cmd_tag;
+
+  async->async_read_pos = 0;
+  if (mailimap_read_line(session) == NULL)
+    r = MAILIMAP_ERROR_STREAM;
+  else
+    r = mailimap_parse_response(session, result);
+
+  session->imap_tag = saved_tag;
+
+  async->async_buffer_stream->read_buffer_len = 0;
+  mmap_string_erase(async->async_input, 0, async->async_response_len);
+  async->async_line_start = 0;
+  async->async_scan_pos = 0;
+  async->async_response_len = 0;
+  async->async_read_pos = 0;
+
+  return r;
+}
+
+static int async_command_finish(mailimap_async * async,
+    struct mailimap_async_command * cmd, void ** result)
+{
+  mailimap * session;
+  struct mailimap_response * response;
+  clist * list;
+  int error_code;
+  int r;
+
+  session = async->async_session;
+  * result = NULL;
+
+  switch (cmd->cmd_type) {
+  case ASYNC_COMMAND_SELECT:
+  case ASYNC_COMMAND_EXAMINE:
+    if (session->imap_selection_info != NULL)
+      mailimap_selection_info_free(session->imap_selection_info);
+    session->imap_selection_info = mailimap_selection_info_new();
+    break;
+  }
+
+  r = async_parse_response(async, cmd, &response);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  error_code = response->rsp_resp_done->rsp_data.rsp_tagged->rsp_cond_state->rsp_type;
+  mailimap_response_free(response);
+
+  switch (cmd->cmd_type) {
+  case ASYNC_COMMAND_NOOP:
+    if (error_code != MAILIMAP_RESP_COND_STATE_OK)
+      return MAILIMAP_ERROR_NOOP;
+    return MAILIMAP_NO_ERROR;
+
+  case ASYNC_COMMAND_SELECT:
+  case ASYNC_COMMAND_EXAMINE:
+    if (error_code != MAILIMAP_RESP_COND_STATE_OK) {
+      mailimap_selection_info_free(session->imap_selection_info);
+      session->imap_selection_info = NULL;
+      session->imap_state = MAILIMAP_STATE_AUTHENTICATED;
+      if (cmd->cmd_type == ASYNC_COMMAND_SELECT)
+        return MAILIMAP_ERROR_SELECT;
+      else
+        return MAILIMAP_ERROR_EXAMINE;
+    }
+    session->imap_state = MAILIMAP_STATE_SELECTED;
+    return MAILIMAP_NO_ERROR;
+
+  case ASYNC_COMMAND_STATUS:
+    if (error_code != MAILIMAP_RESP_COND_STATE_OK)
+      return MAILIMAP_ERROR_STATUS;
+    * result = session->imap_response_info->rsp_status;
+    session->imap_response_info->rsp_status = NULL;
+    return MAILIMAP_NO_ERROR;
+
+  case ASYNC_COMMAND_FETCH:
+  case ASYNC_COMMAND_UID_FETCH:
+    list = session->imap_response_info->rsp_fetch_list;
+    session->imap_response_info->rsp_fetch_list = NULL;
+    /* same as mailimap_fetch(), results are kept on NO */
+    if ((clist_count(list) == 0) &&
+        (error_code != MAILIMAP_RESP_COND_STATE_OK)) {
+      mailimap_fetch_list_free(list);
+      if (cmd->cmd_type == ASYNC_COMMAND_FETCH)
+        return MAILIMAP_ERROR_FETCH;
+      else
+        return MAILIMAP_ERROR_UID_FETCH;
+    }
+    * result = list;
+    return MAILIMAP_NO_ERROR;
+
+  case ASYNC_COMMAND_STORE:
+    if (error_code != MAILIMAP_RESP_COND_STATE_OK)
+      return MAILIMAP_ERROR_STORE;
+    return MAILIMAP_NO_ERROR;
+
+  case ASYNC_COMMAND_UID_STORE:
+    if (error_code != MAILIMAP_RESP_COND_STATE_OK)
+      return MAILIMAP_ERROR_UID_STORE;
+    return MAILIMAP_NO_ERROR;
+
+  case ASYNC_COMMAND_UID_SEARCH:
+    list = session->imap_response_info->rsp_search_result;
+    session->imap_response_info->rsp_search_result = NULL;
+    if (error_code != MAILIMAP_RESP_COND_STATE_OK) {
+      if (list != NULL)
+        mailimap_search_result_free(list);
+      return MAILIMAP_ERROR_UID_SEARCH;
+    }
+    * result = list;
+    return MAILIMAP_NO_ERROR;
+
+  default:
+    return MAILIMAP_ERROR_INVAL;
+  }
+}
+
+static int async_dispatch(mailimap_async * async)
+{
+  while (!clist_isempty(async->async_queue)) {
+    struct mailimap_async_command * cmd;
+    void * result;
+    int r;
+    int start_r;
+
+    if (!async_response_complete(async))
+      break;
+
+    cmd = clist_content(clist_begin(async->async_queue));
+    clist_delete(async->async_queue, clist_begin(async->async_queue));
+
+    r = async_command_finish(async, cmd, &result);
+
+    start_r = MAILIMAP_NO_ERROR;
+    switch (r) {
+    case MAILIMAP_ERROR_STREAM:
+    case MAILIMAP_ERROR_PARSE:
+    case MAILIMAP_ERROR_FATAL:
+    case MAILIMAP_ERROR_MEMORY:
+      /* the connection can't be used any more */
+      break;
+    default:
+      if (!clist_isempty(async->async_queue))
+        start_r = async_command_start(async);
+      break;
+    }
+
+    if (cmd->cmd_callback != NULL)
+      cmd->cmd_callback(async, r, result, cmd->cmd_cb_data);
+    async_command_free(cmd);
+
+    switch (r) {
+    case MAILIMAP_ERROR_STREAM:
+    case MAILIMAP_ERROR_PARSE:
+    case MAILIMAP_ERROR_FATAL:
+    case MAILIMAP_ERROR_MEMORY:
+      return r;
+    }
+    if (start_r != MAILIMAP_NO_ERROR)
+      return start_r;
+  }
+
+  return MAILIMAP_NO_ERROR;
+}
+
+/* session */
+
+LIBETPAN_EXPORT
+mailimap_async * mailimap_async_new(mailimap * session)
+{
+  mailimap_async * async;
+  mailstream_low * low;
+
+  if (session->imap_stream == NULL)
+    goto err;
+
+  async = malloc(sizeof(* async));
+  if (async == NULL)
+    goto err;
+
+  async->async_session = session;
+  async->async_error = MAILIMAP_NO_ERROR;
+  async->async_stream = session->imap_stream;
+  async->async_capture = NULL;
+  async->async_output_pos = 0;
+  async->async_line_start = 0;
+  async->async_scan_pos = 0;
+  async->async_literal_left = 0;
+  async->async_response_len = 0;
+  async->async_read_pos = 0;
+  async->async_loop = NULL;
+  async->async_loop_index = 0;
+  async->async_loop_events = 0;
+
+  async->async_output = mmap_string_new("");
+  if (async->async_output == NULL)
+    goto free;
+
+  async->async_input = mmap_string_new("");
+  if (async->async_input == NULL)
+    goto free_output;
+
+  async->async_queue = clist_new();
+  if (async->async_queue == NULL)
+    goto free_input;
+
+  low = mailstream_low_new(async, &async_buffer_driver);
+  if (low == NULL)
+    goto free_queue;
+
+  async->async_buffer_stream = mailstream_new(low, 8192);
+  if (async->async_buffer_stream == NULL)
+    goto free_low;
+
+  if (mailstream_low_set_nonblocking(async->async_stream->low, 1) < 0)
+    goto free_buffer_stream;
+
+  session->imap_stream = async->async_buffer_stream;
+
+  return async;
+
+ free_buffer_stream:
+  mailstream_close(async->async_buffer_stream);
+  goto free_queue;
+ free_low:
+  mailstream_low_free(low);
+ free_queue:
+  clist_free(async->async_queue);
+ free_input:
+  mmap_string_free(async->async_input);
+ free_output:
+  mmap_string_free(async->async_output);
+ free:
+  free(async);
+ err:
+  return NULL;
+}
+
+/*
+  data received but not parsed, an unsolicited response for example,
+  is given back to the stream for the blocking API
+*/
+
+static int async_give_back_input(mailimap_async * async)
+{
+  mailstream * s;
+  size_t len;
+
+  s = async->async_stream;
+  len = async->async_input->len + s->read_buffer_len;
+  if (len == s->read_buffer_len)
+    return 0;
+
+  /* the stream only fills an empty buffer, it can be larger */
+  if (len > s->buffer_max_size) {
+    char * read_buffer;
+
+    read_buffer = realloc(s->read_buffer, len);
+    if (read_buffer == NULL)
+      return -1;
+    s->read_buffer = read_buffer;
+  }
+
+  memmove(s->read_buffer + async->async_input->len, s->read_buffer,
+      s->read_buffer_len);
+  memcpy(s->read_buffer, async->async_input->str, async->async_input->len);
+  s->read_buffer_len = len;
+  mmap_string_truncate(async->async_input, 0);
+
+  return 0;
+}
+
+LIBETPAN_EXPORT
+void mailimap_async_free(mailimap_async * async)
+{
+  if (async->async_loop != NULL)
+    mailimap_async_loop_remove(async->async_loop, async);
+
+  async_fail(async, MAILIMAP_ERROR_STREAM);
+
+  async->async_session->imap_stream = async->async_stream;
+  mailstream_low_set_nonblocking(async->async_stream->low, 0);
+  async_give_back_input(async);
+
+  mailstream_close(async->async_buffer_stream);
+  clist_free(async->async_queue);
+  mmap_string_free(async->async_input);
+  mmap_string_free(async->async_output);
+  free(async);
+}
+
+LIBETPAN_EXPORT
+mailimap * mailimap_async_get_session(mailimap_async * async)
+{
+  return async->async_session;
+}
+
+LIBETPAN_EXPORT
+int mailimap_async_get_fd(mailimap_async * async)
+{
+  return mailstream_low_get_fd(async->async_stream->low);
+}
+
+LIBETPAN_EXPORT
+int mailimap_async_get_events(mailimap_async * async)
+{
+  int events;
+
+  if (async->async_error != MAILIMAP_NO_ERROR)
+    return 0;
+
+  events = MAILIMAP_ASYNC_EVENT_READ;
+  if (async->async_output_pos < async->async_output->len)
+    events |= MAILIMAP_ASYNC_EVENT_WRITE;
+
+  return events;
+}
+
+LIBETPAN_EXPORT
+int mailimap_async_process(mailimap_async * async, int events)
+{
+  int r;
+
+  if (async->async_error != MAILIMAP_NO_ERROR)
+    return async->async_error;
+
+  if ((events & MAILIMAP_ASYNC_EVENT_WRITE) != 0) {
+    r = async_flush_output(async);
+    if (r != MAILIMAP_NO_ERROR)
+      goto err;
+  }
+
+  if ((events & MAILIMAP_ASYNC_EVENT_READ) != 0) {
+    r = async_read_input(async);
+    if (r != MAILIMAP_NO_ERROR) {
+      /* deliver what was received before the connection was closed */
+      async_dispatch(async);
+      goto err;
+    }
+
+    r = async_dispatch(async);
+    if (r != MAILIMAP_NO_ERROR)
+      goto err;
+  }
+
+  async_update_events(async);
+
+  return MAILIMAP_NO_ERROR;
+
+ err:
+  async_fail(async, r);
+  return r;
+}
+
+LIBETPAN_EXPORT
+unsigned int mailimap_async_get_pending_count(mailimap_async * async)
+{
+  return clist_count(async->async_queue);
+}
+
+/* commands */
+
+LIBETPAN_EXPORT
+int mailimap_async_noop(mailimap_async * async,
+    mailimap_async_callback * callback, void * cb_data)
+{
+  struct mailimap_async_command * cmd;
+  int r;
+
+  r = async_command_begin(async, ASYNC_COMMAND_NOOP, callback, cb_data, &cmd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_noop_send(async->async_buffer_stream);
+
+  return async_command_end(async, cmd, r);
+}
+
+LIBETPAN_EXPORT
+int mailimap_async_select(mailimap_async * async, const char * mb,
+    mailimap_async_callback * callback, void * cb_data)
+{
+  struct mailimap_async_command * cmd;
+  int r;
+
+  r = async_command_begin(async, ASYNC_COMMAND_SELECT, callback, cb_data, &cmd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_select_send(async->async_buffer_stream, mb);
+
+  return async_command_end(async, cmd, r);
+}
+
+LIBETPAN_EXPORT
+int mailimap_async_examine(mailimap_async * async, const char * mb,
+    mailimap_async_callback * callback, void * cb_data)
+{
+  struct mailimap_async_command * cmd;
+  int r;
+
+  r = async_command_begin(async, ASYNC_COMMAND_EXAMINE, callback, cb_data, &cmd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_examine_send(async->async_buffer_stream, mb);
+
+  return async_command_end(async, cmd, r);
+}
+
+LIBETPAN_EXPORT
+int mailimap_async_status(mailimap_async * async, const char * mb,
+    struct mailimap_status_att_list * status_att_list,
+    mailimap_async_callback * callback, void * cb_data)
+{
+  struct mailimap_async_command * cmd;
+  int r;
+
+  r = async_command_begin(async, ASYNC_COMMAND_STATUS, callback, cb_data, &cmd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_status_send(async->async_buffer_stream, mb, status_att_list);
+
+  return async_command_end(async, cmd, r);
+}
+
+LIBETPAN_EXPORT
+int mailimap_async_fetch(mailimap_async * async,
+    struct mailimap_set * set,
+    struct mailimap_fetch_type * fetch_type,
+    mailimap_async_callback * callback, void * cb_data)
+{
+  struct mailimap_async_command * cmd;
+  int r;
+
+  r = async_command_begin(async, ASYNC_COMMAND_FETCH, callback, cb_data, &cmd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_fetch_send(async->async_buffer_stream, set, fetch_type);
+
+  return async_command_end(async, cmd, r);
+}
+
+LIBETPAN_EXPORT
+int mailimap_async_uid_fetch(mailimap_async * async,
+    struct mailimap_set * set,
+    struct mailimap_fetch_type * fetch_type,
+    mailimap_async_callback * callback, void * cb_data)
+{
+  struct mailimap_async_command * cmd;
+  int r;
+
+  r = async_command_begin(async, ASYNC_COMMAND_UID_FETCH, callback, cb_data, &cmd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_uid_fetch_send(async->async_buffer_stream, set, fetch_type);
+
+  return async_command_end(async, cmd, r);
+}
+
+LIBETPAN_EXPORT
+int mailimap_async_store(mailimap_async * async,
+    struct mailimap_set * set,
+    struct mailimap_store_att_flags * store_att_flags,
+    mailimap_async_callback * callback, void * cb_data)
+{
+  struct mailimap_async_command * cmd;
+  int r;
+
+  r = async_command_begin(async, ASYNC_COMMAND_STORE, callback, cb_data, &cmd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_store_send(async->async_buffer_stream, set, store_att_flags);
+
+  return async_command_end(async, cmd, r);
+}
+
+LIBETPAN_EXPORT
+int mailimap_async_uid_store(mailimap_async * async,
+    struct mailimap_set * set,
+    struct mailimap_store_att_flags * store_att_flags,
+    mailimap_async_callback * callback, void * cb_data)
+{
+  struct mailimap_async_command * cmd;
+  int r;
+
+  r = async_command_begin(async, ASYNC_COMMAND_UID_STORE, callback, cb_data, &cmd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_uid_store_send(async->async_buffer_stream, set, store_att_flags);
+
+  return async_command_end(async, cmd, r);
+}
+
+LIBETPAN_EXPORT
+int mailimap_async_uid_search(mailimap_async * async, const char * charset,
+    struct mailimap_search_key * key,
+    mailimap_async_callback * callback, void * cb_data)
+{
+  struct mailimap_async_command * cmd;
+  int r;
+
+  r = async_command_begin(async, ASYNC_COMMAND_UID_SEARCH, callback, cb_data, &cmd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_uid_search_send(async->async_buffer_stream, charset, key);
+
+  return async_command_end(async, cmd, r);
+}
+
+/* event loop */
+
+#ifdef HAVE_SYS_EPOLL_H
+static int async_epoll_events(int events)
+{
+  int epoll_events;
+
+  epoll_events = 0;
+  if ((events & MAILIMAP_ASYNC_EVENT_READ) != 0)
+    epoll_events |= EPOLLIN;
+  if ((events & MAILIMAP_ASYNC_EVENT_WRITE) != 0)
+    epoll_events |= EPOLLOUT;
+
+  return epoll_events;
+}
+#endif
+
+static void async_update_events(mailimap_async * async)
+{
+  int events;
+#ifdef HAVE_SYS_EPOLL_H
+  struct epoll_event ev;
+  int fd;
+  int op;
+#endif
+
+  if (async->async_loop == NULL)
+    return;
+
+  events = mailimap_async_get_events(async);
+  if (events == async->async_loop_events)
+    return;
+
+#ifdef HAVE_SYS_EPOLL_H
+  /* a failed session is removed from the epoll set, epoll would
+     report the hang up again and again */
+  if (async->async_loop_events == 0)
+    op = EPOLL_CTL_ADD;
+  else if (events == 0)
+    op = EPOLL_CTL_DEL;
+  else
+    op = EPOLL_CTL_MOD;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = async_epoll_events(events);
+  ev.data.ptr = async;
+  fd = mailimap_async_get_fd(async);
+  if (epoll_ctl(async->async_loop->loop_epoll_fd, op, fd, &ev) < 0)
+    return;
+#endif
+
+  async->async_loop_events = events;
+}
+
+LIBETPAN_EXPORT
+mailimap_async_loop * mailimap_async_loop_new(void)
+{
+  mailimap_async_loop * loop;
+
+  loop = malloc(sizeof(* loop));
+  if (loop == NULL)
+    goto err;
+
+  loop->loop_ready_count = 0;
+  loop->loop_sessions = carray_new(16);
+  if (loop->loop_sessions == NULL)
+    goto free;
+
+#ifdef HAVE_SYS_EPOLL_H
+  loop->loop_epoll_fd = epoll_create(256);
+  if (loop->loop_epoll_fd < 0)
+    goto free_sessions;
+#else
+  loop->loop_pollfd = NULL;
+  loop->loop_ready = NULL;
+  loop->loop_pollfd_count = 0;
+#endif
+
+  return loop;
+
+#ifdef HAVE_SYS_EPOLL_H
+ free_sessions:
+  carray_free(loop->loop_sessions);
+#endif
+ free:
+  free(loop);
+ err:
+  return NULL;
+}
+
+LIBETPAN_EXPORT
+void mailimap_async_loop_free(mailimap_async_loop * loop)
+{
+  while (carray_count(loop->loop_sessions) > 0)
+    mailimap_async_loop_remove(loop, carray_get(loop->loop_sessions, 0));
+
+#ifdef HAVE_SYS_EPOLL_H
+  close(loop->loop_epoll_fd);
+#else
+  free(loop->loop_pollfd);
+  free(loop->loop_ready);
+#endif
+  carray_free(loop->loop_sessions);
+  free(loop);
+}
+
+LIBETPAN_EXPORT
+int mailimap_async_loop_add(mailimap_async_loop * loop,
+    mailimap_async * async)
+{
+  int r;
+
+  if (async->async_loop != NULL)
+    return MAILIMAP_ERROR_INVAL;
+
+  r = carray_add(loop->loop_sessions, async, &async->async_loop_index);
+  if (r < 0)
+    return MAILIMAP_ERROR_MEMORY;
+
+  async->async_loop = loop;
+  async->async_loop_events = 0;
+  async_update_events(async);
+
+  return MAILIMAP_NO_ERROR;
+}
+
+LIBETPAN_EXPORT
+void mailimap_async_loop_remove(mailimap_async_loop * loop,
+    mailimap_async * async)
+{
+  unsigned int indx;
+  unsigned int i;
+
+  if (async->async_loop != loop)
+    return;
+
+  /* the session may be freed before the other ready ones are processed */
+  for(i = 0 ; i < loop->loop_ready_count ; i ++) {
+#ifdef HAVE_SYS_EPOLL_H
+    if (loop->loop_events[i].data.ptr == async)
+      loop->loop_events[i].data.ptr = NULL;
+#else
+    if (loop->loop_ready[i] == async)
+      loop->loop_ready[i] = NULL;
+#endif
+  }
+
+#ifdef HAVE_SYS_EPOLL_H
+  if (async->async_loop_events != 0) {
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    epoll_ctl(loop->loop_epoll_fd, EPOLL_CTL_DEL,
+        mailimap_async_get_fd(async), &ev);
+  }
+#endif
+
+  indx = async->async_loop_index;
+  carray_delete(loop->loop_sessions, indx);
+  if (indx < carray_count(loop->loop_sessions)) {
+    mailimap_async * moved;
+
+    moved = carray_get(loop->loop_sessions, indx);
+    moved->async_loop_index = indx;
+  }
+
+  async->async_loop = NULL;
+  async->async_loop_events = 0;
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+
+LIBETPAN_EXPORT
+int mailimap_async_loop_run_once(mailimap_async_loop * loop, int timeout)
+{
+  struct epoll_event * events;
+  int count;
+  int processed;
+  int i;
+
+  events = loop->loop_events;
+  count = epoll_wait(loop->loop_epoll_fd, events,
+      ASYNC_LOOP_MAX_EVENTS, timeout);
+  if (count < 0) {
+    if (errno == EINTR)
+      return 0;
+    return -1;
+  }
+
+  loop->loop_ready_count = count;
+  processed = 0;
+  for(i = 0 ; i < count ; i ++) {
+    mailimap_async * async;
+    int async_events;
+
+    async = events[i].data.ptr;
+    /* removed by a callback */
+    if (async == NULL)
+      continue;
+
+    async_events = 0;
+    if ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0)
+      async_events |= MAILIMAP_ASYNC_EVENT_READ;
+    if ((events[i].events & EPOLLOUT) != 0)
+      async_events |= MAILIMAP_ASYNC_EVENT_WRITE;
+
+    mailimap_async_process(async, async_events);
+    processed ++;
+  }
+  loop->loop_ready_count = 0;
+
+  return processed;
+}
+
+#else
+
+LIBETPAN_EXPORT
+int mailimap_async_loop_run_once(mailimap_async_loop * loop, int timeout)
+{
+  unsigned int count;
+  unsigned int i;
+  int processed;
+  int r;
+
+  count = carray_count(loop->loop_sessions);
+  if (count > loop->loop_pollfd_count) {
+    struct pollfd * pollfd;
+    mailimap_async ** ready;
+
+    pollfd = realloc(loop->loop_pollfd, count * sizeof(* pollfd));
+    if (pollfd == NULL)
+      return -1;
+    loop->loop_pollfd = pollfd;
+    ready = realloc(loop->loop_ready, count * sizeof(* ready));
+    if (ready == NULL)
+      return -1;
+    loop->loop_ready = ready;
+    loop->loop_pollfd_count = count;
+  }
+
+  for(i = 0 ; i < count ; i ++) {
+    mailimap_async * async;
+    int events;
+
+    async = carray_get(loop->loop_sessions, i);
+    loop->loop_ready[i] = async;
+    events = mailimap_async_get_events(async);
+
+    /* negative descriptors are ignored by poll() */
+    loop->loop_pollfd[i].fd = (events != 0) ? mailimap_async_get_fd(async) : -1;
+    loop->loop_pollfd[i].events = 0;
+    if ((events & MAILIMAP_ASYNC_EVENT_READ) != 0)
+      loop->loop_pollfd[i].events |= POLLIN;
+    if ((events & MAILIMAP_ASYNC_EVENT_WRITE) != 0)
+      loop->loop_pollfd[i].events |= POLLOUT;
+    loop->loop_pollfd[i].revents = 0;
+  }
+
+  r = poll(loop->loop_pollfd, count, timeout);
+  if (r < 0) {
+    if (errno == EINTR)
+      return 0;
+    return -1;
+  }
+
+  loop->loop_ready_count = count;
+  processed = 0;
+  for(i = 0 ; i < count ; i ++) {
+    int async_events;
+    short revents;
+
+    revents = loop->loop_pollfd[i].revents;
+    if (revents == 0)
+      continue;
+    /* removed by a callback */
+    if (loop->loop_ready[i] == NULL)
+      continue;
+
+    async_events = 0;
+    if ((revents & (POLLIN | POLLHUP | POLLERR)) != 0)
+      async_events |= MAILIMAP_ASYNC_EVENT_READ;
+    if ((revents & POLLOUT) != 0)
+      async_events |= MAILIMAP_ASYNC_EVENT_WRITE;
+
+    mailimap_async_process(loop->loop_ready[i], async_events);
+    processed ++;
+  }
+  loop->loop_ready_count = 0;
+
+  return processed;
+}
+
+#endif
@@ -0,0 +1,211 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2005 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MAILIMAP_ASYNC_H
+
+#define MAILIMAP_ASYNC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <libetpan/mailimap_types.h>
+
+/*
+  asynchronous IMAP session
+
+  mailimap_async_new() takes over a session that is already connected
+  (and usually logged in) with the blocking API. The underlying
+  connection is switched to non-blocking mode and the session must not
+  be used with the blocking mailimap_*() functions until
+  mailimap_async_free() is called.
+
+  Commands are queued and sent one at a time. The response of a command
+  is read incrementally as the connection becomes readable and is parsed
+  when the tagged response has been received. The callback is then
+  called with the error code and the result of the command :
+
+  - mailimap_async_noop(), mailimap_async_select(),
+    mailimap_async_examine(), mailimap_async_store(),
+    mailimap_async_uid_store() : result is NULL.
+  - mailimap_async_status() : result is a
+    (struct mailimap_mailbox_data_status *), to be freed with
+    mailimap_mailbox_data_status_free().
+  - mailimap_async_fetch(), mailimap_async_uid_fetch() : result is a
+    list of (struct mailimap_msg_att *), to be freed with
+    mailimap_fetch_list_free().
+  - mailimap_async_uid_search() : result is a list of (uint32_t *),
+    to be freed with mailimap_search_result_free().
+
+  The result is NULL when error is not MAILIMAP_NO_ERROR.
+  The other data of the response are available in
+  session->imap_response_info and session->imap_selection_info during
+  the callback.
+
+  A callback can queue new commands. It must not free the async session
+  it is called for, it can remove and free the other sessions of a loop.
+*/
+
+typedef struct mailimap_async mailimap_async;
+
+typedef void mailimap_async_callback(mailimap_async * async,
+    int error, void * result, void * cb_data);
+
+enum {
+  MAILIMAP_ASYNC_EVENT_READ = 1 << 0,
+  MAILIMAP_ASYNC_EVENT_WRITE = 1 << 1
+};
+
+LIBETPAN_EXPORT
+mailimap_async * mailimap_async_new(mailimap * session);
+
+/*
+  mailimap_async_free() calls the callbacks of the pending commands with
+  MAILIMAP_ERROR_STREAM and gives the session back to the blocking API,
+  in blocking mode and with the data received but not parsed yet.
+  The session can only be used to be closed if a command was pending.
+*/
+
+LIBETPAN_EXPORT
+void mailimap_async_free(mailimap_async * async);
+
+LIBETPAN_EXPORT
+mailimap * mailimap_async_get_session(mailimap_async * async);
+
+LIBETPAN_EXPORT
+int mailimap_async_get_fd(mailimap_async * async);
+
+/* events to wait for, MAILIMAP_ASYNC_EVENT_READ and/or WRITE */
+
+LIBETPAN_EXPORT
+int mailimap_async_get_events(mailimap_async * async);
+
+/*
+  mailimap_async_process() is called when the file descriptor
+  is ready, events tells which of read and write are possible.
+  It returns MAILIMAP_NO_ERROR or the error that closed the session.
+*/
+
+LIBETPAN_EXPORT
+int mailimap_async_process(mailimap_async * async, int events);
+
+/* number of commands queued or waiting for a response */
+
+LIBETPAN_EXPORT
+unsigned int mailimap_async_get_pending_count(mailimap_async * async);
+
+LIBETPAN_EXPORT
+int mailimap_async_noop(mailimap_async * async,
+    mailimap_async_callback * callback, void * cb_data);
+
+LIBETPAN_EXPORT
+int mailimap_async_select(mailimap_async * async, const char * mb,
+    mailimap_async_callback * callback, void * cb_data);
+
+LIBETPAN_EXPORT
+int mailimap_async_examine(mailimap_async * async, const char * mb,
+    mailimap_async_callback * callback, void * cb_data);
+
+LIBETPAN_EXPORT
+int mailimap_async_status(mailimap_async * async, const char * mb,
+    struct mailimap_status_att_list * status_att_list,
+    mailimap_async_callback * callback, void * cb_data);
+
+LIBETPAN_EXPORT
+int mailimap_async_fetch(mailimap_async * async,
+    struct mailimap_set * set,
+    struct mailimap_fetch_type * fetch_type,
+    mailimap_async_callback * callback, void * cb_data);
+
+LIBETPAN_EXPORT
+int mailimap_async_uid_fetch(mailimap_async * async,
+    struct mailimap_set * set,
+    struct mailimap_fetch_type * fetch_type,
+    mailimap_async_callback * callback, void * cb_data);
+
+LIBETPAN_EXPORT
+int mailimap_async_store(mailimap_async * async,
+    struct mailimap_set * set,
+    struct mailimap_store_att_flags * store_att_flags,
+    mailimap_async_callback * callback, void * cb_data);
+
+LIBETPAN_EXPORT
+int mailimap_async_uid_store(mailimap_async * async,
+    struct mailimap_set * set,
+    struct mailimap_store_att_flags * store_att_flags,
+    mailimap_async_callback * callback, void * cb_data);
+
+LIBETPAN_EXPORT
+int mailimap_async_uid_search(mailimap_async * async, const char * charset,
+    struct mailimap_search_key * key,
+    mailimap_async_callback * callback, void * cb_data);
+
+/*
+  event loop
+
+  The loop waits on many async sessions at once, using epoll when
+  available and poll otherwise, and calls mailimap_async_process() on
+  the sessions that are ready.
+*/
+
+typedef struct mailimap_async_loop mailimap_async_loop;
+
+LIBETPAN_EXPORT
+mailimap_async_loop * mailimap_async_loop_new(void);
+
+/* the sessions still in the loop are not freed */
+
+LIBETPAN_EXPORT
+void mailimap_async_loop_free(mailimap_async_loop * loop);
+
+LIBETPAN_EXPORT
+int mailimap_async_loop_add(mailimap_async_loop * loop,
+    mailimap_async * async);
+
+LIBETPAN_EXPORT
+void mailimap_async_loop_remove(mailimap_async_loop * loop,
+    mailimap_async * async);
+
+/*
+  mailimap_async_loop_run_once() waits at most timeout milliseconds
+  (-1 to wait forever) and processes the sessions that are ready.
+  It returns the number of sessions processed or -1 on error.
+  A session that failed stays in the loop until it is removed.
+*/
+
+LIBETPAN_EXPORT
+int mailimap_async_loop_run_once(mailimap_async_loop * loop, int timeout);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -47,6 +47,9 @@
 #include "namespace.h"
 #include "xlist.h"
 #include "xgmlabels.h"
+#include "enable.h"
+#include "condstore.h"
+#include "qresync.h"
 
 /*
   the list of registered extensions (struct mailimap_extension_api *)
@@ -64,6 +67,9 @@ static struct mailimap_extension_api * internal_extension_list[] = {
   &mailimap_extension_namespace,
   &mailimap_extension_xlist,
   &mailimap_extension_xgmlabels,
+  &mailimap_extension_enable,
+  &mailimap_extension_condstore,
+  &mailimap_extension_qresync,
 };
 
 LIBETPAN_EXPORT
@@ -77,7 +77,8 @@ typedef int mailimap_struct_parser_progress(mailstream * fd, MMAPString * buffer
                                             mailprogress_function * items_progr_fun,
                                             void * context,
                                             mailimap_msg_att_handler * msg_att_handler,
-                                            void * msg_att_context);
+                                            void * msg_att_context,
+                                            struct mailimap_literal_sink * literal_sink);
 
 static int mailimap_address_parse(mailstream * fd, MMAPString * buffer,
 				  size_t * indx,
@@ -481,7 +482,8 @@ static int mailimap_literal_parse_progress(mailstream * fd, MMAPString * buffer,
                                            mailprogress_function * items_progr_fun,
                                            void * context,
                                            mailimap_msg_att_handler * msg_att_handler,
-                                           void * msg_att_context);
+                                           void * msg_att_context,
+                                           struct mailimap_literal_sink * literal_sink);
 
 
 static int
@@ -578,7 +580,8 @@ mailimap_msg_att_parse_progress(mailstream * fd, MMAPString * buffer,
                                 mailprogress_function * items_progr_fun,
                                 void * context,
                                 mailimap_msg_att_handler * msg_att_handler,
-                                void * msg_att_context);
+                                void * msg_att_context,
+                                struct mailimap_literal_sink * literal_sink);
 
 
 static int
@@ -609,7 +612,8 @@ mailimap_msg_att_static_parse_progress(mailstream * fd, MMAPString * buffer,
                                        mailprogress_function * items_progr_fun,
                                        void * context,
                                        mailimap_msg_att_handler * msg_att_handler,
-                                       void * msg_att_context);
+                                       void * msg_att_context,
+                                       struct mailimap_literal_sink * literal_sink);
 
 static int
 mailimap_quoted_parse(mailstream * fd, MMAPString * buffer,
@@ -764,7 +768,8 @@ mailimap_response_data_parse_progress(mailstream * fd, MMAPString * buffer,
                                       mailprogress_function * items_progr_fun,
                                       void * context,
                                       mailimap_msg_att_handler * msg_att_handler,
-                                      void * msg_att_context);
+                                      void * msg_att_context,
+                                      struct mailimap_literal_sink * literal_sink);
 
 static int mailimap_nstring_parse_progress(mailstream * fd, MMAPString * buffer,
                                            size_t * indx, char ** result,
@@ -775,7 +780,8 @@ static int mailimap_nstring_parse_progress(mailstream * fd, MMAPString * buffer,
                                            mailprogress_function * items_progr_fun,
                                            void * context,
                                            mailimap_msg_att_handler * msg_att_handler,
-                                           void * msg_att_context);
+                                           void * msg_att_context,
+                                           struct mailimap_literal_sink * literal_sink);
 
 static int
 mailimap_string_parse_progress(mailstream * fd, MMAPString * buffer,
@@ -787,7 +793,8 @@ mailimap_string_parse_progress(mailstream * fd, MMAPString * buffer,
                                mailprogress_function * items_progr_fun,
                                void * context,
                                mailimap_msg_att_handler * msg_att_handler,
-                               void * msg_att_context);
+                               void * msg_att_context,
+                               struct mailimap_literal_sink * literal_sink);
 
 /* ************************************************************************* */
 /* ************************************************************************* */
@@ -952,7 +959,8 @@ mailimap_struct_multiple_parse_progress(mailstream * fd, MMAPString * buffer,
                                         mailprogress_function * items_progr_fun,
                                         void * context,
                                         mailimap_msg_att_handler * msg_att_handler,
-                                        void * msg_att_context)
+                                        void * msg_att_context,
+                                        struct mailimap_literal_sink * literal_sink)
 {
   clist * struct_list;
   size_t cur_token;
@@ -963,7 +971,7 @@ mailimap_struct_multiple_parse_progress(mailstream * fd, MMAPString * buffer,
   cur_token = * indx;
 
   r = parser(fd, buffer, &cur_token, &value, progr_rate, progr_fun,
-             body_progr_fun, items_progr_fun, context, msg_att_handler, msg_att_context);
+             body_progr_fun, items_progr_fun, context, msg_att_handler, msg_att_context, literal_sink);
   if (r != MAILIMAP_NO_ERROR) {
     res = r;
     goto err;
@@ -987,7 +995,7 @@ mailimap_struct_multiple_parse_progress(mailstream * fd, MMAPString * buffer,
 
   while (1) {
     r = parser(fd, buffer, &cur_token, &value, progr_rate, progr_fun,
-               body_progr_fun, items_progr_fun, context, msg_att_handler, msg_att_context);
+               body_progr_fun, items_progr_fun, context, msg_att_handler, msg_att_context, literal_sink);
     if (r == MAILIMAP_ERROR_PARSE)
       break;
     if (r != MAILIMAP_NO_ERROR) {
@@ -1094,7 +1102,8 @@ mailimap_struct_list_parse_progress(mailstream * fd, MMAPString * buffer,
                                     mailprogress_function * items_progr_fun,
                                     void * context,
                                     mailimap_msg_att_handler * msg_att_handler,
-                                    void * msg_att_context)
+                                    void * msg_att_context,
+                                    struct mailimap_literal_sink * literal_sink)
 {
   clist * struct_list;
   size_t cur_token;
@@ -1107,7 +1116,7 @@ mailimap_struct_list_parse_progress(mailstream * fd, MMAPString * buffer,
   struct_list = NULL;
 
   r = parser(fd, buffer, &cur_token, &value, progr_rate, progr_fun,
-             body_progr_fun, items_progr_fun, context, msg_att_handler, msg_att_context);
+             body_progr_fun, items_progr_fun, context, msg_att_handler, msg_att_context, literal_sink);
   if (r != MAILIMAP_NO_ERROR) {
     res = r;
     goto err;
@@ -1139,7 +1148,7 @@ mailimap_struct_list_parse_progress(mailstream * fd, MMAPString * buffer,
     }
 
     r = parser(fd, buffer, &cur_token, &value, progr_rate, progr_fun,
-               body_progr_fun, items_progr_fun, context, msg_att_handler, msg_att_context);
+               body_progr_fun, items_progr_fun, context, msg_att_handler, msg_att_context, literal_sink);
     if (r == MAILIMAP_ERROR_PARSE)
       break;
 
@@ -1275,13 +1284,14 @@ mailimap_struct_spaced_list_parse_progress(mailstream * fd, MMAPString * buffer,
                                            mailprogress_function * items_progr_fun,
                                            void * context,
                                            mailimap_msg_att_handler * msg_att_handler,
-                                           void * msg_att_context)
+                                           void * msg_att_context,
+                                           struct mailimap_literal_sink * literal_sink)
 {
   return mailimap_struct_list_parse_progress(fd, buffer, indx, result,
                                              ' ', parser, destructor,
                                              progr_rate, progr_fun,
                                              body_progr_fun, items_progr_fun, context,
-                                             msg_att_handler, msg_att_context);
+                                             msg_att_handler, msg_att_context, literal_sink);
 }
 
 
@@ -5952,7 +5962,8 @@ static int mailimap_literal_parse_progress(mailstream * fd, MMAPString * buffer,
                                            mailprogress_function * items_progr_fun,
                                            void * context,
                                            mailimap_msg_att_handler * msg_att_handler,
-                                           void * msg_att_context)
+                                           void * msg_att_context,
+                                           struct mailimap_literal_sink * literal_sink)
 {
   size_t cur_token;
   uint32_t number;
@@ -5963,7 +5974,7 @@ static int mailimap_literal_parse_progress(mailstream * fd, MMAPString * buffer,
   int res;
   size_t number_token;
   UNUSED(items_progr_fun);
-  UNUSED(msg_att_handler); UNUSED(msg_att_context);
+  UNUSED(msg_att_handler); UNUSED(msg_att_context); UNUSED(literal_sink);
 
   cur_token = * indx;
 
@@ -6123,6 +6134,154 @@ err:
   return res;
 }
 
+/*
+  delivers the content of a literal to a mailimap_literal_sink,
+  the bytes are handed to the sink straight from the response buffer
+  and from the read buffer of the stream.
+*/
+
+static int mailimap_literal_sink_deliver(struct mailimap_literal_sink * literal_sink,
+                                         const char * data, size_t length)
+{
+  int r;
+
+  if (length == 0)
+    return MAILIMAP_NO_ERROR;
+
+  r = literal_sink->sink_write(data, length, literal_sink->sink_context);
+  if (r < 0)
+    return MAILIMAP_ERROR_STREAM;
+
+  return MAILIMAP_NO_ERROR;
+}
+
+static int mailimap_literal_sink_parse_progress(mailstream * fd, MMAPString * buffer,
+                                                size_t * indx,
+                                                struct mailimap_section * section,
+                                                uint32_t origin_octet,
+                                                size_t * result_len,
+                                                size_t progr_rate,
+                                                progress_function * progr_fun,
+                                                mailprogress_function * body_progr_fun,
+                                                void * context,
+                                                struct mailimap_literal_sink * literal_sink)
+{
+  size_t cur_token;
+  uint32_t number;
+  uint32_t left;
+  size_t number_token;
+  int r;
+
+  cur_token = * indx;
+
+  r = mailimap_oaccolade_parse(fd, buffer, &cur_token);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  number_token = cur_token;
+
+  r = mailimap_number_parse(fd, buffer, &cur_token, &number);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_caccolade_parse(fd, buffer, &cur_token);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_crlf_parse(fd, buffer, &cur_token);
+  if (r == MAILIMAP_ERROR_PARSE) {
+    /* workaround for Lotus Domino IMAP server */
+    mailimap_space_parse(fd, buffer, &cur_token);
+    mailimap_space_parse(fd, buffer, &cur_token);
+  }
+  else if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  /* the sink declined, the literal will be parsed the usual way */
+  if (!literal_sink->sink_begin(section, origin_octet, number,
+                                literal_sink->sink_context))
+    return MAILIMAP_ERROR_PARSE;
+
+  left = buffer->len - cur_token;
+
+  if (left >= number) {
+    r = mailimap_literal_sink_deliver(literal_sink, buffer->str + cur_token,
+                                    number);
+    if (r != MAILIMAP_NO_ERROR)
+      return r;
+    cur_token = cur_token + number;
+  }
+  else {
+    uint32_t needed;
+    uint32_t current_prog = 0;
+    uint32_t last_prog = 0;
+
+    r = mailimap_literal_sink_deliver(literal_sink, buffer->str + cur_token,
+                                    left);
+    if (r != MAILIMAP_NO_ERROR)
+      return r;
+
+    needed = number - left;
+    current_prog = left;
+
+    while (needed > 0) {
+      size_t count;
+
+      if (mailstream_feed_read_buffer(fd) <= 0)
+        return MAILIMAP_ERROR_STREAM;
+
+      count = fd->read_buffer_len;
+      if (count > needed)
+        count = needed;
+
+      r = mailimap_literal_sink_deliver(literal_sink, fd->read_buffer, count);
+      if (r != MAILIMAP_NO_ERROR)
+        return r;
+
+      fd->read_buffer_len -= count;
+      if (fd->read_buffer_len != 0)
+        memmove(fd->read_buffer, fd->read_buffer + count,
+                fd->read_buffer_len);
+
+      needed -= count;
+      current_prog += count;
+      if (current_prog - last_prog > progr_rate) {
+        if (progr_fun != NULL) {
+          progr_fun(current_prog, number);
+        }
+        if (body_progr_fun != NULL) {
+          body_progr_fun(current_prog, number, context);
+        }
+        last_prog = current_prog;
+      }
+    }
+
+    if (mmap_string_truncate(buffer, number_token) == NULL)
+      return MAILIMAP_ERROR_MEMORY;
+
+    if (mmap_string_append(buffer, "0}\r\n") == NULL)
+      return MAILIMAP_ERROR_MEMORY;
+
+    cur_token = number_token + 4;
+  }
+  if (progr_rate != 0) {
+    if (progr_fun != NULL) {
+      progr_fun(number, number);
+    }
+    if (body_progr_fun != NULL) {
+      body_progr_fun(number, number, context);
+    }
+  }
+
+  if (mailstream_read_line_append(fd, buffer) == NULL)
+    return MAILIMAP_ERROR_STREAM;
+
+  * result_len = number;
+  * indx = cur_token;
+
+  return MAILIMAP_NO_ERROR;
+}
+
 #if 0
 /* TODO unused function ? */
 static int mailimap_literal_parse(mailstream * fd, MMAPString * buffer,
@@ -6133,7 +6292,7 @@ static int mailimap_literal_parse(mailstream * fd, MMAPString * buffer,
 {
   return mailimap_literal_parse_progress(fd, buffer, indx, result, result_len,
                                          progr_rate, progr_fun,
-                                         NULL, NULL, NULL, NULL, NULL);
+                                         NULL, NULL, NULL, NULL, NULL, NULL);
 }
 #endif
 
@@ -7381,7 +7540,8 @@ mailimap_message_data_parse_progress(mailstream * fd, MMAPString * buffer,
                                      mailprogress_function * items_progr_fun,
                                      void * context,
                                      mailimap_msg_att_handler * msg_att_handler,
-                                     void * msg_att_context)
+                                     void * msg_att_context,
+                                     struct mailimap_literal_sink * literal_sink)
 {
   size_t cur_token;
   uint32_t number;
@@ -7444,7 +7604,7 @@ mailimap_message_data_parse_progress(mailstream * fd, MMAPString * buffer,
     }
 
     r = mailimap_msg_att_parse_progress(fd, buffer, &cur_token, &msg_att,
-			       progr_rate, progr_fun, body_progr_fun, items_progr_fun, context, msg_att_handler, msg_att_context);
+			       progr_rate, progr_fun, body_progr_fun, items_progr_fun, context, msg_att_handler, msg_att_context, literal_sink);
     if (r != MAILIMAP_NO_ERROR) {
       res = r;
       goto err;
@@ -7491,7 +7651,7 @@ mailimap_message_data_parse(mailstream * fd, MMAPString * buffer,
 {
   return mailimap_message_data_parse_progress(fd, buffer, indx, result,
                                               progr_rate, progr_fun,
-                                              NULL, NULL, NULL, NULL, NULL);
+                                              NULL, NULL, NULL, NULL, NULL, NULL);
 }
 #endif
 
@@ -7514,7 +7674,8 @@ mailimap_msg_att_item_parse_progress(mailstream * fd, MMAPString * buffer,
                                      mailprogress_function * items_progr_fun,
                                      void * context,
                                      mailimap_msg_att_handler * msg_att_handler,
-                                     void * msg_att_context)
+                                     void * msg_att_context,
+                                     struct mailimap_literal_sink * literal_sink)
 {
   int type;
   struct mailimap_msg_att_dynamic * msg_att_dynamic;
@@ -7543,7 +7704,7 @@ mailimap_msg_att_item_parse_progress(mailstream * fd, MMAPString * buffer,
     r = mailimap_msg_att_static_parse_progress(fd, buffer, &cur_token,
                                                &msg_att_static,
                                                progr_rate, progr_fun,
-                                               body_progr_fun, items_progr_fun, context, msg_att_handler, msg_att_context);
+                                               body_progr_fun, items_progr_fun, context, msg_att_handler, msg_att_context, literal_sink);
     if (r == MAILIMAP_NO_ERROR)
       type = MAILIMAP_MSG_ATT_ITEM_STATIC;
   }
@@ -7593,7 +7754,7 @@ mailimap_msg_att_item_parse(mailstream * fd, MMAPString * buffer,
 {
   return mailimap_msg_att_item_parse_progress(fd, buffer, indx, result,
                                               progr_rate, progr_fun,
-                                              NULL, NULL, NULL, NULL, NULL);
+                                              NULL, NULL, NULL, NULL, NULL, NULL);
 
 }
 #endif
@@ -7612,7 +7773,8 @@ mailimap_msg_att_parse_progress(mailstream * fd, MMAPString * buffer,
                                 mailprogress_function * items_progr_fun,
                                 void * context,
                                 mailimap_msg_att_handler * msg_att_handler,
-                                void * msg_att_context)
+                                void * msg_att_context,
+                                struct mailimap_literal_sink * literal_sink)
 {
   size_t cur_token;
   clist * list;
@@ -7636,7 +7798,7 @@ mailimap_msg_att_parse_progress(mailstream * fd, MMAPString * buffer,
                                                  mailimap_msg_att_item_free,
                                                  progr_rate, progr_fun,
                                                  body_progr_fun, items_progr_fun,
-                                                 context, msg_att_handler, msg_att_context);
+                                                 context, msg_att_handler, msg_att_context, literal_sink);
   if (r != MAILIMAP_NO_ERROR) {
     res = r;
     goto err;
@@ -7676,7 +7838,7 @@ mailimap_msg_att_parse(mailstream * fd, MMAPString * buffer,
 {
   return mailimap_msg_att_parse_progress(fd, buffer, indx, result,
                                          progr_rate, progr_fun,
-                                         NULL, NULL, NULL, NULL, NULL);
+                                         NULL, NULL, NULL, NULL, NULL, NULL);
 }
 #endif
 
@@ -7860,7 +8022,8 @@ mailimap_msg_att_rfc822_parse_progress(mailstream * fd, MMAPString * buffer,
                                        mailprogress_function * items_progr_fun,
                                        void * context,
                                        mailimap_msg_att_handler * msg_att_handler,
-                                       void * msg_att_context)
+                                       void * msg_att_context,
+                                       struct mailimap_literal_sink * literal_sink)
 {
   size_t cur_token;
   char * rfc822_message;
@@ -7879,7 +8042,7 @@ mailimap_msg_att_rfc822_parse_progress(mailstream * fd, MMAPString * buffer,
     return r;
 
   r = mailimap_nstring_parse_progress(fd, buffer, &cur_token, &rfc822_message, &length,
-         progr_rate, progr_fun, body_progr_fun, items_progr_fun, context, msg_att_handler, msg_att_context);
+         progr_rate, progr_fun, body_progr_fun, items_progr_fun, context, msg_att_handler, msg_att_context, literal_sink);
   if (r != MAILIMAP_NO_ERROR)
     return r;
 
@@ -7902,7 +8065,7 @@ mailimap_msg_att_rfc822_parse(mailstream * fd, MMAPString * buffer,
 {
   return mailimap_msg_att_rfc822_parse_progress(fd, buffer, indx, result, result_len,
                                                 progr_rate, progr_fun,
-                                                NULL, NULL, NULL, NULL, NULL);
+                                                NULL, NULL, NULL, NULL, NULL, NULL);
 }
 #endif
 
@@ -7965,7 +8128,8 @@ mailimap_msg_att_rfc822_text_parse_progress(mailstream * fd, MMAPString * buffer
                                             mailprogress_function * items_progr_fun,
                                             void * context,
                                             mailimap_msg_att_handler * msg_att_handler,
-                                            void * msg_att_context)
+                                            void * msg_att_context,
+                                            struct mailimap_literal_sink * literal_sink)
 {
   size_t cur_token;
   char * rfc822_text;
@@ -7989,7 +8153,7 @@ mailimap_msg_att_rfc822_text_parse_progress(mailstream * fd, MMAPString * buffer
     return r;
 
   r = mailimap_nstring_parse_progress(fd, buffer, &cur_token, &rfc822_text, &length,
-                                      progr_rate, progr_fun, body_progr_fun, items_progr_fun, context, msg_att_handler, msg_att_context);
+                                      progr_rate, progr_fun, body_progr_fun, items_progr_fun, context, msg_att_handler, msg_att_context, literal_sink);
   if (r != MAILIMAP_NO_ERROR)
     return r;
 
@@ -8012,7 +8176,7 @@ mailimap_msg_att_rfc822_text_parse(mailstream * fd, MMAPString * buffer,
 {
   return mailimap_msg_att_rfc822_text_parse_progress(fd, buffer, indx, result, result_len,
                                                      progr_rate, progr_fun,
-                                                     NULL, NULL, NULL, NULL, NULL);
+                                                     NULL, NULL, NULL, NULL, NULL, NULL);
 }
 #endif
 
@@ -8144,7 +8308,8 @@ mailimap_msg_att_body_section_parse_progress(mailstream * fd, MMAPString * buffe
                                              mailprogress_function * items_progr_fun,
                                              void * context,
                                              mailimap_msg_att_handler * msg_att_handler,
-                                             void * msg_att_context)
+                                             void * msg_att_context,
+                                             struct mailimap_literal_sink * literal_sink)
 {
   size_t cur_token;
   uint32_t number;
@@ -8204,8 +8369,18 @@ mailimap_msg_att_body_section_parse_progress(mailstream * fd, MMAPString * buffe
     goto free_section;
   }
 
-  r = mailimap_nstring_parse_progress(fd, buffer, &cur_token, &body_part, &length,
-                                      progr_rate, progr_fun, body_progr_fun, items_progr_fun, context, msg_att_handler, msg_att_context);
+  r = MAILIMAP_ERROR_PARSE;
+  if (literal_sink != NULL) {
+    r = mailimap_literal_sink_parse_progress(fd, buffer, &cur_token,
+                                             section, number, &length,
+                                             progr_rate, progr_fun,
+                                             body_progr_fun, context,
+                                             literal_sink);
+  }
+  if (r == MAILIMAP_ERROR_PARSE) {
+    r = mailimap_nstring_parse_progress(fd, buffer, &cur_token, &body_part, &length,
+                                        progr_rate, progr_fun, body_progr_fun, items_progr_fun, context, msg_att_handler, msg_att_context, literal_sink);
+  }
   if (r != MAILIMAP_NO_ERROR) {
     res = r;
     goto free_section;
@@ -8244,7 +8419,7 @@ mailimap_msg_att_body_section_parse(mailstream * fd, MMAPString * buffer,
 {
   return mailimap_msg_att_body_section_parse_progress(fd, buffer, indx, result,
                                                       progr_rate, progr_fun,
-                                                      NULL, NULL, NULL, NULL, NULL);
+                                                      NULL, NULL, NULL, NULL, NULL, NULL);
 }
 #endif
 
@@ -8300,7 +8475,8 @@ mailimap_msg_att_static_parse_progress(mailstream * fd, MMAPString * buffer,
                                        mailprogress_function * items_progr_fun,
                                        void * context,
                                        mailimap_msg_att_handler * msg_att_handler,
-                                       void * msg_att_context)
+                                       void * msg_att_context,
+                                       struct mailimap_literal_sink * literal_sink)
 {
   size_t cur_token;
   struct mailimap_envelope * env;
@@ -8352,7 +8528,7 @@ mailimap_msg_att_static_parse_progress(mailstream * fd, MMAPString * buffer,
     r = mailimap_msg_att_rfc822_parse_progress(fd, buffer, &cur_token,
                                                &rfc822, &length,
                                                progr_rate, progr_fun,
-                                               body_progr_fun, items_progr_fun, context, msg_att_handler, msg_att_context);
+                                               body_progr_fun, items_progr_fun, context, msg_att_handler, msg_att_context, literal_sink);
     if (r == MAILIMAP_NO_ERROR)
       type = MAILIMAP_MSG_ATT_RFC822;
   }
@@ -8368,7 +8544,7 @@ mailimap_msg_att_static_parse_progress(mailstream * fd, MMAPString * buffer,
     r = mailimap_msg_att_rfc822_text_parse_progress(fd, buffer, &cur_token,
                                                     &rfc822_text, &length,
                                                     progr_rate, progr_fun,
-                                                    body_progr_fun, items_progr_fun, context, msg_att_handler, msg_att_context);
+                                                    body_progr_fun, items_progr_fun, context, msg_att_handler, msg_att_context, literal_sink);
     if (r == MAILIMAP_NO_ERROR)
       type = MAILIMAP_MSG_ATT_RFC822_TEXT;
   }
@@ -8399,7 +8575,7 @@ mailimap_msg_att_static_parse_progress(mailstream * fd, MMAPString * buffer,
     r = mailimap_msg_att_body_section_parse_progress(fd, buffer, &cur_token,
                                                      &body_section,
                                                      progr_rate, progr_fun,
-                                                     body_progr_fun, items_progr_fun, context, msg_att_handler, msg_att_context);
+                                                     body_progr_fun, items_progr_fun, context, msg_att_handler, msg_att_context, literal_sink);
     if (r == MAILIMAP_NO_ERROR)
       type = MAILIMAP_MSG_ATT_BODY_SECTION;
   }
@@ -8463,7 +8639,7 @@ mailimap_msg_att_static_parse(mailstream * fd, MMAPString * buffer,
 {
   return mailimap_msg_att_static_parse_progress(fd, buffer, indx, result,
                                                 progr_rate, progr_fun,
-                                                NULL, NULL, NULL, NULL, NULL);
+                                                NULL, NULL, NULL, NULL, NULL, NULL);
 }
 #endif
 
@@ -8490,13 +8666,14 @@ static int mailimap_nstring_parse_progress(mailstream * fd, MMAPString * buffer,
                                            mailprogress_function * items_progr_fun,
                                            void * context,
                                            mailimap_msg_att_handler * msg_att_handler,
-                                           void * msg_att_context)
+                                           void * msg_att_context,
+                                           struct mailimap_literal_sink * literal_sink)
 {
   int r;
 
   r = mailimap_string_parse_progress(fd, buffer, indx, result, result_len,
                                      progr_rate, progr_fun,
-                                     body_progr_fun, items_progr_fun, context, msg_att_handler, msg_att_context);
+                                     body_progr_fun, items_progr_fun, context, msg_att_handler, msg_att_context, literal_sink);
   switch (r) {
     case MAILIMAP_NO_ERROR:
       return MAILIMAP_NO_ERROR;
@@ -8524,7 +8701,7 @@ int mailimap_nstring_parse(mailstream * fd, MMAPString * buffer,
 				  progress_function * progr_fun)
 {
   return mailimap_nstring_parse_progress(fd, buffer, indx, result, result_len, progr_rate, progr_fun,
-                                         NULL, NULL, NULL, NULL, NULL);
+                                         NULL, NULL, NULL, NULL, NULL, NULL);
 }
 
 /*
@@ -8584,6 +8761,55 @@ mailimap_number_parse(mailstream * fd, MMAPString * buffer,
   return MAILIMAP_NO_ERROR;
 }
 
+/*
+   mod-sequence-value  = 1*DIGIT
+                          ;; Positive unsigned 63-bit integer
+                          ;; (mod-sequence)
+                          ;; (1 <= n <= 9,223,372,036,854,775,807).
+   (RFC 7162)
+*/
+
+#define MOD_SEQUENCE_VALUE_MAX 0x7fffffffffffffffULL
+
+int
+mailimap_mod_sequence_value_parse(mailstream * fd, MMAPString * buffer,
+    size_t * indx, uint64_t * result)
+{
+  size_t cur_token;
+  int digit;
+  uint64_t number;
+  int parsed;
+  int r;
+
+  cur_token = * indx;
+  parsed = FALSE;
+
+  number = 0;
+  while (1) {
+    r = mailimap_digit_parse(fd, buffer, &cur_token, &digit);
+    if (r == MAILIMAP_ERROR_PARSE)
+      break;
+    else if (r == MAILIMAP_NO_ERROR) {
+      /* larger than 63 bits */
+      if (number > (MOD_SEQUENCE_VALUE_MAX - digit) / 10)
+        return MAILIMAP_ERROR_PARSE;
+      number *= 10;
+      number += digit;
+      parsed = TRUE;
+    }
+    else
+      return r;
+  }
+
+  if (!parsed)
+    return MAILIMAP_ERROR_PARSE;
+
+  * result = number;
+  * indx = cur_token;
+
+  return MAILIMAP_NO_ERROR;
+}
+
 /*
    nz-number       = digit-nz *DIGIT
                        ; Non-zero unsigned 32-bit integer
@@ -8836,7 +9062,8 @@ mailimap_cont_req_or_resp_data_parse_progress(mailstream * fd, MMAPString * buff
                                               mailprogress_function * items_progr_fun,
                                               void * context,
                                               mailimap_msg_att_handler * msg_att_handler,
-                                              void * msg_att_context)
+                                              void * msg_att_context,
+                                              struct mailimap_literal_sink * literal_sink)
 {
   size_t cur_token;
   struct mailimap_cont_req_or_resp_data * cont_req_or_resp_data;
@@ -8874,7 +9101,7 @@ mailimap_cont_req_or_resp_data_parse_progress(mailstream * fd, MMAPString * buff
     r = mailimap_response_data_parse_progress(fd, buffer, &cur_token, &resp_data,
                                               progr_rate, progr_fun,
                                               body_progr_fun, items_progr_fun,
-                                              context, msg_att_handler, msg_att_context);
+                                              context, msg_att_handler, msg_att_context, literal_sink);
     if (r == MAILIMAP_NO_ERROR)
       type = MAILIMAP_RESP_RESP_DATA;
   }
@@ -8932,7 +9159,7 @@ mailimap_cont_req_or_resp_data_parse(mailstream * fd, MMAPString * buffer,
   return mailimap_cont_req_or_resp_data_parse_progress(fd, buffer, indx, result,
                                                        progr_rate,
                                                        progr_fun,
-                                                       NULL, NULL, NULL, NULL, NULL);
+                                                       NULL, NULL, NULL, NULL, NULL, NULL);
 }
 
 /*
@@ -8948,7 +9175,8 @@ mailimap_response_parse_progress(mailstream * fd, MMAPString * buffer,
                                  mailprogress_function * items_progr_fun,
                                  void * context,
                                  mailimap_msg_att_handler * msg_att_handler,
-                                 void * msg_att_context)
+                                 void * msg_att_context,
+                                 struct mailimap_literal_sink * literal_sink)
 {
   size_t cur_token;
   clist * cont_req_or_resp_data_list;
@@ -8972,7 +9200,8 @@ mailimap_response_parse_progress(mailstream * fd, MMAPString * buffer,
                                               items_progr_fun,
                                               context,
                                               msg_att_handler,
-                                              msg_att_context);
+                                              msg_att_context,
+                                              literal_sink);
 
   if ((r != MAILIMAP_NO_ERROR) && (r != MAILIMAP_ERROR_PARSE))
     return r;
@@ -9018,7 +9247,23 @@ mailimap_response_parse_with_context(mailstream * fd, MMAPString * buffer,
   return mailimap_response_parse_progress(fd, buffer, indx, result,
                                           4096, NULL,
                                           body_progr_fun, items_progr_fun, context,
-                                          msg_att_handler, msg_att_context);
+                                          msg_att_handler, msg_att_context, NULL);
+}
+
+int
+mailimap_response_parse_with_literal_sink(mailstream * fd, MMAPString * buffer,
+                                          size_t * indx, struct mailimap_response ** result,
+                                          mailprogress_function * body_progr_fun,
+                                          mailprogress_function * items_progr_fun,
+                                          void * context,
+                                          mailimap_msg_att_handler * msg_att_handler,
+                                          void * msg_att_context,
+                                          struct mailimap_literal_sink * literal_sink)
+{
+  return mailimap_response_parse_progress(fd, buffer, indx, result,
+                                          4096, NULL,
+                                          body_progr_fun, items_progr_fun, context,
+                                          msg_att_handler, msg_att_context, literal_sink);
 }
 
 int
@@ -9029,7 +9274,7 @@ mailimap_response_parse(mailstream * fd, MMAPString * buffer,
 {
   return mailimap_response_parse_progress(fd, buffer, indx, result,
                                           progr_rate, progr_fun,
-                                          NULL, NULL, NULL, NULL, NULL);
+                                          NULL, NULL, NULL, NULL, NULL, NULL);
 }
 
 /*
@@ -9047,7 +9292,8 @@ mailimap_response_data_parse_progress(mailstream * fd, MMAPString * buffer,
                                       mailprogress_function * items_progr_fun,
                                       void * context,
                                       mailimap_msg_att_handler * msg_att_handler,
-                                      void * msg_att_context)
+                                      void * msg_att_context,
+                                      struct mailimap_literal_sink * literal_sink)
 {
   struct mailimap_response_data * resp_data;
   size_t cur_token;
@@ -9106,7 +9352,7 @@ mailimap_response_data_parse_progress(mailstream * fd, MMAPString * buffer,
 
   if (r == MAILIMAP_ERROR_PARSE) {
     r = mailimap_message_data_parse_progress(fd, buffer, &cur_token, &msg_data,
-				    progr_rate, progr_fun, body_progr_fun, items_progr_fun, context, msg_att_handler, msg_att_context);
+				    progr_rate, progr_fun, body_progr_fun, items_progr_fun, context, msg_att_handler, msg_att_context, literal_sink);
     if (r == MAILIMAP_NO_ERROR)
       type = MAILIMAP_RESP_DATA_TYPE_MESSAGE_DATA;
   }
@@ -9194,7 +9440,7 @@ mailimap_response_data_parse(mailstream * fd, MMAPString * buffer,
 {
   return mailimap_response_data_parse_progress(fd, buffer, indx, result,
                                                progr_rate, progr_fun,
-                                               NULL, NULL, NULL, NULL, NULL);
+                                               NULL, NULL, NULL, NULL, NULL, NULL);
 }
 
 /*
@@ -10655,7 +10901,8 @@ mailimap_string_parse_progress(mailstream * fd, MMAPString * buffer,
                                mailprogress_function * items_progr_fun,
                                void * context,
                                mailimap_msg_att_handler * msg_att_handler,
-                               void * msg_att_context)
+                               void * msg_att_context,
+                               struct mailimap_literal_sink * literal_sink)
 {
   size_t cur_token;
   char * string;
@@ -10673,7 +10920,7 @@ mailimap_string_parse_progress(mailstream * fd, MMAPString * buffer,
     len = strlen(string);
   else if (r == MAILIMAP_ERROR_PARSE) {
     r = mailimap_literal_parse_progress(fd, buffer, &cur_token, &string, &len,
-			       progr_rate, progr_fun, body_progr_fun, items_progr_fun, context, msg_att_handler, msg_att_context);
+			       progr_rate, progr_fun, body_progr_fun, items_progr_fun, context, msg_att_handler, msg_att_context, literal_sink);
   }
 
   if (r != MAILIMAP_NO_ERROR)
@@ -10696,7 +10943,7 @@ mailimap_string_parse(mailstream * fd, MMAPString * buffer,
 {
   return mailimap_string_parse_progress(fd, buffer, indx, result,
                                         result_len, progr_rate, progr_fun,
-                                        NULL, NULL, NULL, NULL, NULL);
+                                        NULL, NULL, NULL, NULL, NULL, NULL);
 }
 
 /*
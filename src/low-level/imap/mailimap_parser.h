@@ -63,6 +63,16 @@ mailimap_response_parse_with_context(mailstream * fd, MMAPString * buffer,
                                      void * context,
                                      mailimap_msg_att_handler * msg_att_handler,
                                      void * msg_att_context);
+
+int
+mailimap_response_parse_with_literal_sink(mailstream * fd, MMAPString * buffer,
+                                          size_t * indx, struct mailimap_response ** result,
+                                          mailprogress_function * body_progr_fun,
+                                          mailprogress_function * items_progr_fun,
+                                          void * context,
+                                          mailimap_msg_att_handler * msg_att_handler,
+                                          void * msg_att_context,
+                                          struct mailimap_literal_sink * literal_sink);
   
 int
 mailimap_continue_req_parse(mailstream * fd, MMAPString * buffer,
@@ -144,6 +154,10 @@ int
 mailimap_nz_number_parse(mailstream * fd, MMAPString * buffer,
 			 size_t * indx, uint32_t * result);
 
+int
+mailimap_mod_sequence_value_parse(mailstream * fd, MMAPString * buffer,
+    size_t * indx, uint64_t * result);
+
 int
 mailimap_struct_list_parse(mailstream * fd, MMAPString * buffer,
     size_t * indx, clist ** result,
@@ -0,0 +1,957 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2005 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include "mailimap_pipeline.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "mailimap.h"
+#include "mailimap_sender.h"
+#include "mailstream_low.h"
+#include "carray.h"
+#include "mail.h"
+
+enum {
+  PIPELINE_COMMAND_NOOP,
+  PIPELINE_COMMAND_STATUS,
+  PIPELINE_COMMAND_FETCH,
+  PIPELINE_COMMAND_UID_FETCH,
+  PIPELINE_COMMAND_STORE,
+  PIPELINE_COMMAND_UID_STORE,
+  PIPELINE_COMMAND_UID_SEARCH
+};
+
+struct mailimap_pipeline_command {
+  int cmd_type;
+  int cmd_tag;
+  int cmd_done;
+  MMAPString * cmd_data;
+  mailimap_pipeline_callback * cmd_callback;
+  void * cmd_cb_data;
+  /* STATUS : mailbox the untagged STATUS responses are matched with */
+  char * cmd_mailbox;
+  /* FETCH, UID FETCH : ranges of the set, as (first, last) pairs */
+  uint32_t * cmd_ranges;
+  unsigned int cmd_range_count;
+};
+
+struct mailimap_pipeline {
+  mailimap * pipeline_session;
+  unsigned int pipeline_max_in_flight;
+  /* stream used to serialize the commands with the usual senders */
+  mailstream * pipeline_capture_stream;
+  MMAPString * pipeline_capture;
+  carray * pipeline_commands;
+  /* untagged responses not given to a command yet */
+  clist * pipeline_status_list;
+  clist * pipeline_fetch_list;
+};
+
+#define PIPELINE_DEFAULT_MAX_IN_FLIGHT 100
+
+static ssize_t capture_read(mailstream_low * s, void * buf, size_t count)
+{
+  UNUSED(s);
+  UNUSED(buf);
+  UNUSED(count);
+  return -1;
+}
+
+static ssize_t capture_write(mailstream_low * s,
+    const void * buf, size_t count)
+{
+  mailimap_pipeline * pipeline;
+
+  pipeline = s->data;
+  if (pipeline->pipeline_capture == NULL)
+    return -1;
+
+  if (mmap_string_append_len(pipeline->pipeline_capture, buf, count) == NULL)
+    return -1;
+
+  return count;
+}
+
+static int capture_close(mailstream_low * s)
+{
+  UNUSED(s);
+  return 0;
+}
+
+static int capture_get_fd(mailstream_low * s)
+{
+  UNUSED(s);
+  return -1;
+}
+
+static void capture_free(mailstream_low * s)
+{
+  free(s);
+}
+
+static void capture_cancel(mailstream_low * s)
+{
+  UNUSED(s);
+}
+
+static struct mailstream_cancel * capture_get_cancel(mailstream_low * s)
+{
+  UNUSED(s);
+  return NULL;
+}
+
+static mailstream_low_driver capture_driver = {
+  /* mailstream_read */ capture_read,
+  /* mailstream_write */ capture_write,
+  /* mailstream_close */ capture_close,
+  /* mailstream_get_fd */ capture_get_fd,
+  /* mailstream_free */ capture_free,
+  /* mailstream_cancel */ capture_cancel,
+  /* mailstream_get_cancel */ capture_get_cancel,
+  /* mailstream_set_nonblocking */ NULL,
+};
+
+LIBETPAN_EXPORT
+mailimap_pipeline * mailimap_pipeline_new(mailimap * session)
+{
+  mailimap_pipeline * pipeline;
+  mailstream_low * low;
+
+  pipeline = malloc(sizeof(* pipeline));
+  if (pipeline == NULL)
+    goto err;
+
+  pipeline->pipeline_session = session;
+  pipeline->pipeline_max_in_flight = PIPELINE_DEFAULT_MAX_IN_FLIGHT;
+  pipeline->pipeline_capture = NULL;
+
+  pipeline->pipeline_commands = carray_new(16);
+  if (pipeline->pipeline_commands == NULL)
+    goto free;
+
+  pipeline->pipeline_status_list = clist_new();
+  if (pipeline->pipeline_status_list == NULL)
+    goto free_commands;
+
+  pipeline->pipeline_fetch_list = clist_new();
+  if (pipeline->pipeline_fetch_list == NULL)
+    goto free_status_list;
+
+  low = mailstream_low_new(pipeline, &capture_driver);
+  if (low == NULL)
+    goto free_fetch_list;
+
+  pipeline->pipeline_capture_stream = mailstream_new(low, 8192);
+  if (pipeline->pipeline_capture_stream == NULL)
+    goto free_low;
+
+  return pipeline;
+
+ free_low:
+  mailstream_low_free(low);
+ free_fetch_list:
+  clist_free(pipeline->pipeline_fetch_list);
+ free_status_list:
+  clist_free(pipeline->pipeline_status_list);
+ free_commands:
+  carray_free(pipeline->pipeline_commands);
+ free:
+  free(pipeline);
+ err:
+  return NULL;
+}
+
+static void command_free(struct mailimap_pipeline_command * cmd)
+{
+  free(cmd->cmd_ranges);
+  free(cmd->cmd_mailbox);
+  mmap_string_free(cmd->cmd_data);
+  free(cmd);
+}
+
+static void pending_clear(clist * list, clist_func free_func)
+{
+  clist_foreach(list, free_func, NULL);
+  while (!clist_isempty(list))
+    clist_delete(list, clist_begin(list));
+}
+
+static void pipeline_clear(mailimap_pipeline * pipeline)
+{
+  unsigned int i;
+
+  for(i = 0 ; i < carray_count(pipeline->pipeline_commands) ; i ++)
+    command_free(carray_get(pipeline->pipeline_commands, i));
+  carray_set_size(pipeline->pipeline_commands, 0);
+
+  pending_clear(pipeline->pipeline_status_list,
+      (clist_func) mailimap_mailbox_data_status_free);
+  pending_clear(pipeline->pipeline_fetch_list,
+      (clist_func) mailimap_msg_att_free);
+}
+
+LIBETPAN_EXPORT
+void mailimap_pipeline_free(mailimap_pipeline * pipeline)
+{
+  pipeline_clear(pipeline);
+  mailstream_close(pipeline->pipeline_capture_stream);
+  clist_free(pipeline->pipeline_fetch_list);
+  clist_free(pipeline->pipeline_status_list);
+  carray_free(pipeline->pipeline_commands);
+  free(pipeline);
+}
+
+LIBETPAN_EXPORT
+mailimap * mailimap_pipeline_get_session(mailimap_pipeline * pipeline)
+{
+  return pipeline->pipeline_session;
+}
+
+LIBETPAN_EXPORT
+void mailimap_pipeline_set_max_in_flight(mailimap_pipeline * pipeline,
+    unsigned int max_in_flight)
+{
+  if (max_in_flight == 0)
+    max_in_flight = 1;
+  pipeline->pipeline_max_in_flight = max_in_flight;
+}
+
+LIBETPAN_EXPORT
+unsigned int mailimap_pipeline_get_count(mailimap_pipeline * pipeline)
+{
+  return carray_count(pipeline->pipeline_commands);
+}
+
+/* serializing commands */
+
+static int command_begin(mailimap_pipeline * pipeline, int type,
+    mailimap_pipeline_callback * callback, void * cb_data,
+    struct mailimap_pipeline_command ** result)
+{
+  struct mailimap_pipeline_command * cmd;
+  mailimap * session;
+  mailstream * stream;
+  int r;
+
+  session = pipeline->pipeline_session;
+  if (session->imap_stream == NULL)
+    return MAILIMAP_ERROR_STREAM;
+
+  cmd = malloc(sizeof(* cmd));
+  if (cmd == NULL)
+    return MAILIMAP_ERROR_MEMORY;
+
+  cmd->cmd_data = mmap_string_new("");
+  if (cmd->cmd_data == NULL) {
+    free(cmd);
+    return MAILIMAP_ERROR_MEMORY;
+  }
+  cmd->cmd_type = type;
+  cmd->cmd_done = 0;
+  cmd->cmd_callback = callback;
+  cmd->cmd_cb_data = cb_data;
+  cmd->cmd_mailbox = NULL;
+  cmd->cmd_ranges = NULL;
+  cmd->cmd_range_count = 0;
+
+  /* the senders write to the session stream */
+  pipeline->pipeline_capture = cmd->cmd_data;
+  stream = session->imap_stream;
+  session->imap_stream = pipeline->pipeline_capture_stream;
+  r = mailimap_send_current_tag(session);
+  session->imap_stream = stream;
+  if (r != MAILIMAP_NO_ERROR) {
+    pipeline->pipeline_capture = NULL;
+    pipeline->pipeline_capture_stream->write_buffer_len = 0;
+    command_free(cmd);
+    return r;
+  }
+  cmd->cmd_tag = session->imap_tag;
+
+  * result = cmd;
+
+  return MAILIMAP_NO_ERROR;
+}
+
+/* '*' is sent as 0 and stands for the largest number in use */
+
+static int command_set_ranges(struct mailimap_pipeline_command * cmd,
+    struct mailimap_set * set)
+{
+  clistiter * cur;
+  unsigned int i;
+
+  cmd->cmd_ranges = malloc(2 * clist_count(set->set_list) *
+      sizeof(* cmd->cmd_ranges));
+  if (cmd->cmd_ranges == NULL)
+    return MAILIMAP_ERROR_MEMORY;
+
+  i = 0;
+  for(cur = clist_begin(set->set_list) ; cur != NULL ; cur = clist_next(cur)) {
+    struct mailimap_set_item * item;
+    uint32_t first;
+    uint32_t last;
+
+    item = clist_content(cur);
+    first = item->set_first;
+    last = item->set_last;
+    if (first == 0) {
+      first = last;
+      last = 0;
+    }
+    if (last == 0)
+      last = (uint32_t) -1;
+    else if (first > last) {
+      first = item->set_last;
+      last = item->set_first;
+    }
+    cmd->cmd_ranges[i ++] = first;
+    cmd->cmd_ranges[i ++] = last;
+  }
+  cmd->cmd_range_count = i / 2;
+
+  return MAILIMAP_NO_ERROR;
+}
+
+static int command_end(mailimap_pipeline * pipeline,
+    struct mailimap_pipeline_command * cmd, int r)
+{
+  mailstream * stream;
+  unsigned int indx;
+
+  stream = pipeline->pipeline_capture_stream;
+  if (r == MAILIMAP_NO_ERROR)
+    r = mailimap_crlf_send(stream);
+  if (r == MAILIMAP_NO_ERROR) {
+    if (mailstream_flush(stream) == -1)
+      r = MAILIMAP_ERROR_STREAM;
+  }
+  pipeline->pipeline_capture = NULL;
+  if (r != MAILIMAP_NO_ERROR) {
+    stream->write_buffer_len = 0;
+    goto free_cmd;
+  }
+
+  r = carray_add(pipeline->pipeline_commands, cmd, &indx);
+  if (r < 0) {
+    r = MAILIMAP_ERROR_MEMORY;
+    goto free_cmd;
+  }
+
+  return MAILIMAP_NO_ERROR;
+
+ free_cmd:
+  command_free(cmd);
+  return r;
+}
+
+/* running */
+
+static void command_complete(mailimap_pipeline * pipeline,
+    struct mailimap_pipeline_command * cmd, int error, void * result)
+{
+  cmd->cmd_done = 1;
+  if (cmd->cmd_callback != NULL)
+    cmd->cmd_callback(pipeline, error, result, cmd->cmd_cb_data);
+}
+
+/*
+  untagged responses don't carry the tag of their command and a server
+  may answer commands in any order. They are kept until the command
+  they answer completes: STATUS responses are matched by mailbox name,
+  FETCH responses by message number or UID.
+*/
+
+static int is_same_mailbox(const char * mb1, const char * mb2)
+{
+  if ((strcasecmp(mb1, "INBOX") == 0) && (strcasecmp(mb2, "INBOX") == 0))
+    return 1;
+
+  return strcmp(mb1, mb2) == 0;
+}
+
+static struct mailimap_mailbox_data_status *
+pipeline_take_status(mailimap_pipeline * pipeline,
+    struct mailimap_pipeline_command * cmd)
+{
+  struct mailimap_mailbox_data_status * status;
+  clistiter * cur;
+
+  for(cur = clist_begin(pipeline->pipeline_status_list) ; cur != NULL ;
+      cur = clist_next(cur)) {
+    status = clist_content(cur);
+    if (is_same_mailbox(status->st_mailbox, cmd->cmd_mailbox)) {
+      clist_delete(pipeline->pipeline_status_list, cur);
+      return status;
+    }
+  }
+
+  return NULL;
+}
+
+static int msg_att_get_uid(struct mailimap_msg_att * msg_att, uint32_t * uid)
+{
+  clistiter * cur;
+
+  for(cur = clist_begin(msg_att->att_list) ; cur != NULL ;
+      cur = clist_next(cur)) {
+    struct mailimap_msg_att_item * item;
+
+    item = clist_content(cur);
+    if ((item->att_type == MAILIMAP_MSG_ATT_ITEM_STATIC) &&
+        (item->att_data.att_static->att_type == MAILIMAP_MSG_ATT_UID)) {
+      * uid = item->att_data.att_static->att_data.att_uid;
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+static int command_has_msg_att(struct mailimap_pipeline_command * cmd,
+    struct mailimap_msg_att * msg_att)
+{
+  uint32_t value;
+  unsigned int i;
+
+  if ((cmd->cmd_type != PIPELINE_COMMAND_FETCH) &&
+      (cmd->cmd_type != PIPELINE_COMMAND_UID_FETCH))
+    return 0;
+
+  if (cmd->cmd_type == PIPELINE_COMMAND_UID_FETCH) {
+    if (!msg_att_get_uid(msg_att, &value))
+      return 0;
+  }
+  else
+    value = msg_att->att_number;
+
+  for(i = 0 ; i < cmd->cmd_range_count ; i ++) {
+    if ((value >= cmd->cmd_ranges[2 * i]) &&
+        (value <= cmd->cmd_ranges[2 * i + 1]))
+      return 1;
+  }
+
+  return 0;
+}
+
+static int pipeline_claims_status(mailimap_pipeline * pipeline,
+    unsigned int oldest, unsigned int sent,
+    struct mailimap_mailbox_data_status * status)
+{
+  unsigned int i;
+
+  for(i = oldest ; i < sent ; i ++) {
+    struct mailimap_pipeline_command * cmd;
+
+    cmd = carray_get(pipeline->pipeline_commands, i);
+    if (!cmd->cmd_done && (cmd->cmd_type == PIPELINE_COMMAND_STATUS) &&
+        is_same_mailbox(status->st_mailbox, cmd->cmd_mailbox))
+      return 1;
+  }
+
+  return 0;
+}
+
+static int pipeline_claims_msg_att(mailimap_pipeline * pipeline,
+    unsigned int oldest, unsigned int sent,
+    struct mailimap_msg_att * msg_att)
+{
+  unsigned int i;
+
+  for(i = oldest ; i < sent ; i ++) {
+    struct mailimap_pipeline_command * cmd;
+
+    cmd = carray_get(pipeline->pipeline_commands, i);
+    if (!cmd->cmd_done && command_has_msg_att(cmd, msg_att))
+      return 1;
+  }
+
+  return 0;
+}
+
+/*
+  the responses that no command in flight can claim, such as the
+  FETCH responses to a STORE, are dropped.
+*/
+
+static int pipeline_keep_untagged(mailimap_pipeline * pipeline,
+    unsigned int oldest, unsigned int sent)
+{
+  struct mailimap_response_info * info;
+  clist * list;
+  clistiter * cur;
+  int r;
+
+  info = pipeline->pipeline_session->imap_response_info;
+  if (info == NULL)
+    return MAILIMAP_NO_ERROR;
+
+  if (info->rsp_status != NULL) {
+    r = clist_append(info->rsp_status_list, info->rsp_status);
+    if (r < 0)
+      return MAILIMAP_ERROR_MEMORY;
+    info->rsp_status = NULL;
+  }
+
+  list = info->rsp_status_list;
+  while ((cur = clist_begin(list)) != NULL) {
+    struct mailimap_mailbox_data_status * status;
+
+    status = clist_content(cur);
+    clist_delete(list, cur);
+    if (!pipeline_claims_status(pipeline, oldest, sent, status)) {
+      mailimap_mailbox_data_status_free(status);
+      continue;
+    }
+    r = clist_append(pipeline->pipeline_status_list, status);
+    if (r < 0) {
+      mailimap_mailbox_data_status_free(status);
+      return MAILIMAP_ERROR_MEMORY;
+    }
+  }
+
+  list = info->rsp_fetch_list;
+  while ((cur = clist_begin(list)) != NULL) {
+    struct mailimap_msg_att * msg_att;
+
+    msg_att = clist_content(cur);
+    clist_delete(list, cur);
+    if (!pipeline_claims_msg_att(pipeline, oldest, sent, msg_att)) {
+      mailimap_msg_att_free(msg_att);
+      continue;
+    }
+    r = clist_append(pipeline->pipeline_fetch_list, msg_att);
+    if (r < 0) {
+      mailimap_msg_att_free(msg_att);
+      return MAILIMAP_ERROR_MEMORY;
+    }
+  }
+
+  return MAILIMAP_NO_ERROR;
+}
+
+static int pipeline_take_fetch_list(mailimap_pipeline * pipeline,
+    struct mailimap_pipeline_command * cmd, clist ** result)
+{
+  clist * list;
+  clistiter * cur;
+  int r;
+
+  list = clist_new();
+  if (list == NULL)
+    return MAILIMAP_ERROR_MEMORY;
+
+  cur = clist_begin(pipeline->pipeline_fetch_list);
+  while (cur != NULL) {
+    struct mailimap_msg_att * msg_att;
+
+    msg_att = clist_content(cur);
+    if (!command_has_msg_att(cmd, msg_att)) {
+      cur = clist_next(cur);
+      continue;
+    }
+
+    r = clist_append(list, msg_att);
+    if (r < 0) {
+      mailimap_fetch_list_free(list);
+      return MAILIMAP_ERROR_MEMORY;
+    }
+    cur = clist_delete(pipeline->pipeline_fetch_list, cur);
+  }
+
+  * result = list;
+
+  return MAILIMAP_NO_ERROR;
+}
+
+static int command_finish(mailimap_pipeline * pipeline,
+    struct mailimap_pipeline_command * cmd,
+    struct mailimap_response * response, void ** result)
+{
+  mailimap * session;
+  struct mailimap_mailbox_data_status * status;
+  clist * list;
+  int error_code;
+  int r;
+
+  session = pipeline->pipeline_session;
+  * result = NULL;
+
+  error_code = response->rsp_resp_done->rsp_data.rsp_tagged->rsp_cond_state->rsp_type;
+  if (error_code == MAILIMAP_RESP_COND_STATE_BAD)
+    return MAILIMAP_ERROR_PROTOCOL;
+
+  switch (cmd->cmd_type) {
+  case PIPELINE_COMMAND_NOOP:
+    if (error_code != MAILIMAP_RESP_COND_STATE_OK)
+      return MAILIMAP_ERROR_NOOP;
+    return MAILIMAP_NO_ERROR;
+
+  case PIPELINE_COMMAND_STATUS:
+    if (error_code != MAILIMAP_RESP_COND_STATE_OK)
+      return MAILIMAP_ERROR_STATUS;
+    status = pipeline_take_status(pipeline, cmd);
+    if (status == NULL)
+      return MAILIMAP_ERROR_STATUS;
+    * result = status;
+    return MAILIMAP_NO_ERROR;
+
+  case PIPELINE_COMMAND_FETCH:
+  case PIPELINE_COMMAND_UID_FETCH:
+    r = pipeline_take_fetch_list(pipeline, cmd, &list);
+    if (r != MAILIMAP_NO_ERROR)
+      return r;
+    /* same as mailimap_fetch(), results are kept on NO */
+    if ((clist_count(list) == 0) &&
+        (error_code != MAILIMAP_RESP_COND_STATE_OK)) {
+      mailimap_fetch_list_free(list);
+      if (cmd->cmd_type == PIPELINE_COMMAND_FETCH)
+        return MAILIMAP_ERROR_FETCH;
+      else
+        return MAILIMAP_ERROR_UID_FETCH;
+    }
+    * result = list;
+    return MAILIMAP_NO_ERROR;
+
+  case PIPELINE_COMMAND_STORE:
+    if (error_code != MAILIMAP_RESP_COND_STATE_OK)
+      return MAILIMAP_ERROR_STORE;
+    return MAILIMAP_NO_ERROR;
+
+  case PIPELINE_COMMAND_UID_STORE:
+    if (error_code != MAILIMAP_RESP_COND_STATE_OK)
+      return MAILIMAP_ERROR_UID_STORE;
+    return MAILIMAP_NO_ERROR;
+
+  case PIPELINE_COMMAND_UID_SEARCH:
+    list = session->imap_response_info->rsp_search_result;
+    session->imap_response_info->rsp_search_result = NULL;
+    if (error_code != MAILIMAP_RESP_COND_STATE_OK) {
+      if (list != NULL)
+        mailimap_search_result_free(list);
+      return MAILIMAP_ERROR_UID_SEARCH;
+    }
+    * result = list;
+    return MAILIMAP_NO_ERROR;
+
+  default:
+    return MAILIMAP_ERROR_INVAL;
+  }
+}
+
+/*
+  tags are not always consecutive, a blocking command or a failed
+  queue call between two queued commands also takes a tag. The
+  commands in flight, from the oldest one still pending, are searched.
+*/
+
+static struct mailimap_pipeline_command *
+pipeline_find_command(mailimap_pipeline * pipeline, unsigned int oldest,
+    unsigned int sent, const char * tag)
+{
+  struct mailimap_pipeline_command * cmd;
+  unsigned int i;
+  char * end;
+  long value;
+
+  value = strtol(tag, &end, 10);
+  if ((end == tag) || (* end != '\0'))
+    return NULL;
+
+  for(i = oldest ; i < sent ; i ++) {
+    cmd = carray_get(pipeline->pipeline_commands, i);
+    if ((cmd->cmd_tag == value) && !cmd->cmd_done)
+      return cmd;
+  }
+
+  return NULL;
+}
+
+LIBETPAN_EXPORT
+int mailimap_pipeline_run(mailimap_pipeline * pipeline)
+{
+  mailimap * session;
+  unsigned int count;
+  unsigned int sent;
+  unsigned int completed;
+  unsigned int oldest;
+  unsigned int i;
+  int res;
+  int r;
+
+  session = pipeline->pipeline_session;
+  count = carray_count(pipeline->pipeline_commands);
+  sent = 0;
+  completed = 0;
+  oldest = 0;
+
+  while (completed < count) {
+    struct mailimap_response * response;
+    struct mailimap_pipeline_command * cmd;
+    void * result;
+
+    /* refill the window when half of it has been answered, so that
+       the commands are written in few large writes */
+    if ((sent < count) &&
+        (sent - completed <= pipeline->pipeline_max_in_flight / 2)) {
+      while ((sent < count) &&
+          (sent - completed < pipeline->pipeline_max_in_flight)) {
+        cmd = carray_get(pipeline->pipeline_commands, sent);
+        if (mailstream_write(session->imap_stream,
+                cmd->cmd_data->str, cmd->cmd_data->len) == -1) {
+          res = MAILIMAP_ERROR_STREAM;
+          goto fail;
+        }
+        sent ++;
+      }
+      if (mailstream_flush(session->imap_stream) == -1) {
+        res = MAILIMAP_ERROR_STREAM;
+        goto fail;
+      }
+    }
+
+    if (mailimap_read_line(session) == NULL) {
+      res = MAILIMAP_ERROR_STREAM;
+      goto fail;
+    }
+
+    r = mailimap_parse_response_any_tag(session, &response);
+    if (r != MAILIMAP_NO_ERROR) {
+      res = r;
+      goto fail;
+    }
+
+    cmd = pipeline_find_command(pipeline, oldest, sent,
+        response->rsp_resp_done->rsp_data.rsp_tagged->rsp_tag);
+    if (cmd == NULL) {
+      mailimap_response_free(response);
+      res = MAILIMAP_ERROR_PROTOCOL;
+      goto fail;
+    }
+
+    r = pipeline_keep_untagged(pipeline, oldest, sent);
+    if (r != MAILIMAP_NO_ERROR) {
+      mailimap_response_free(response);
+      res = r;
+      goto fail;
+    }
+
+    r = command_finish(pipeline, cmd, response, &result);
+    mailimap_response_free(response);
+    completed ++;
+    command_complete(pipeline, cmd, r, result);
+
+    while (oldest < sent) {
+      cmd = carray_get(pipeline->pipeline_commands, oldest);
+      if (!cmd->cmd_done)
+        break;
+      oldest ++;
+    }
+  }
+
+  pipeline_clear(pipeline);
+
+  return MAILIMAP_NO_ERROR;
+
+ fail:
+  for(i = 0 ; i < count ; i ++) {
+    struct mailimap_pipeline_command * cmd;
+
+    cmd = carray_get(pipeline->pipeline_commands, i);
+    if (!cmd->cmd_done)
+      command_complete(pipeline, cmd, res, NULL);
+  }
+  pipeline_clear(pipeline);
+  return res;
+}
+
+/* commands */
+
+LIBETPAN_EXPORT
+int mailimap_pipeline_noop(mailimap_pipeline * pipeline,
+    mailimap_pipeline_callback * callback, void * cb_data)
+{
+  struct mailimap_pipeline_command * cmd;
+  int r;
+
+  r = command_begin(pipeline, PIPELINE_COMMAND_NOOP, callback, cb_data, &cmd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_noop_send(pipeline->pipeline_capture_stream);
+
+  return command_end(pipeline, cmd, r);
+}
+
+LIBETPAN_EXPORT
+int mailimap_pipeline_status(mailimap_pipeline * pipeline, const char * mb,
+    struct mailimap_status_att_list * status_att_list,
+    mailimap_pipeline_callback * callback, void * cb_data)
+{
+  struct mailimap_pipeline_command * cmd;
+  mailimap * session;
+  int r;
+
+  session = pipeline->pipeline_session;
+  if ((session->imap_state != MAILIMAP_STATE_AUTHENTICATED) &&
+      (session->imap_state != MAILIMAP_STATE_SELECTED))
+    return MAILIMAP_ERROR_BAD_STATE;
+
+  r = command_begin(pipeline, PIPELINE_COMMAND_STATUS, callback, cb_data, &cmd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  cmd->cmd_mailbox = strdup(mb);
+  if (cmd->cmd_mailbox == NULL)
+    r = MAILIMAP_ERROR_MEMORY;
+  else
+    r = mailimap_status_send(pipeline->pipeline_capture_stream,
+        mb, status_att_list);
+
+  return command_end(pipeline, cmd, r);
+}
+
+LIBETPAN_EXPORT
+int mailimap_pipeline_fetch(mailimap_pipeline * pipeline,
+    struct mailimap_set * set,
+    struct mailimap_fetch_type * fetch_type,
+    mailimap_pipeline_callback * callback, void * cb_data)
+{
+  struct mailimap_pipeline_command * cmd;
+  int r;
+
+  if (pipeline->pipeline_session->imap_state != MAILIMAP_STATE_SELECTED)
+    return MAILIMAP_ERROR_BAD_STATE;
+
+  r = command_begin(pipeline, PIPELINE_COMMAND_FETCH, callback, cb_data, &cmd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = command_set_ranges(cmd, set);
+  if (r == MAILIMAP_NO_ERROR)
+    r = mailimap_fetch_send(pipeline->pipeline_capture_stream,
+        set, fetch_type);
+
+  return command_end(pipeline, cmd, r);
+}
+
+LIBETPAN_EXPORT
+int mailimap_pipeline_uid_fetch(mailimap_pipeline * pipeline,
+    struct mailimap_set * set,
+    struct mailimap_fetch_type * fetch_type,
+    mailimap_pipeline_callback * callback, void * cb_data)
+{
+  struct mailimap_pipeline_command * cmd;
+  int r;
+
+  if (pipeline->pipeline_session->imap_state != MAILIMAP_STATE_SELECTED)
+    return MAILIMAP_ERROR_BAD_STATE;
+
+  r = command_begin(pipeline, PIPELINE_COMMAND_UID_FETCH, callback, cb_data, &cmd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = command_set_ranges(cmd, set);
+  if (r == MAILIMAP_NO_ERROR)
+    r = mailimap_uid_fetch_send(pipeline->pipeline_capture_stream,
+        set, fetch_type);
+
+  return command_end(pipeline, cmd, r);
+}
+
+LIBETPAN_EXPORT
+int mailimap_pipeline_store(mailimap_pipeline * pipeline,
+    struct mailimap_set * set,
+    struct mailimap_store_att_flags * store_att_flags,
+    mailimap_pipeline_callback * callback, void * cb_data)
+{
+  struct mailimap_pipeline_command * cmd;
+  int r;
+
+  if (pipeline->pipeline_session->imap_state != MAILIMAP_STATE_SELECTED)
+    return MAILIMAP_ERROR_BAD_STATE;
+
+  r = command_begin(pipeline, PIPELINE_COMMAND_STORE, callback, cb_data, &cmd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_store_send(pipeline->pipeline_capture_stream,
+      set, store_att_flags);
+
+  return command_end(pipeline, cmd, r);
+}
+
+LIBETPAN_EXPORT
+int mailimap_pipeline_uid_store(mailimap_pipeline * pipeline,
+    struct mailimap_set * set,
+    struct mailimap_store_att_flags * store_att_flags,
+    mailimap_pipeline_callback * callback, void * cb_data)
+{
+  struct mailimap_pipeline_command * cmd;
+  int r;
+
+  if (pipeline->pipeline_session->imap_state != MAILIMAP_STATE_SELECTED)
+    return MAILIMAP_ERROR_BAD_STATE;
+
+  r = command_begin(pipeline, PIPELINE_COMMAND_UID_STORE, callback, cb_data, &cmd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_uid_store_send(pipeline->pipeline_capture_stream,
+      set, store_att_flags);
+
+  return command_end(pipeline, cmd, r);
+}
+
+LIBETPAN_EXPORT
+int mailimap_pipeline_uid_search(mailimap_pipeline * pipeline,
+    const char * charset, struct mailimap_search_key * key,
+    mailimap_pipeline_callback * callback, void * cb_data)
+{
+  struct mailimap_pipeline_command * cmd;
+  int r;
+
+  if (pipeline->pipeline_session->imap_state != MAILIMAP_STATE_SELECTED)
+    return MAILIMAP_ERROR_BAD_STATE;
+
+  r = command_begin(pipeline, PIPELINE_COMMAND_UID_SEARCH, callback, cb_data, &cmd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_uid_search_send(pipeline->pipeline_capture_stream, charset, key);
+
+  return command_end(pipeline, cmd, r);
+}
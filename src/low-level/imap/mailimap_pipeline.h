@@ -0,0 +1,151 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2005 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MAILIMAP_PIPELINE_H
+
+#define MAILIMAP_PIPELINE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <libetpan/mailimap_types.h>
+
+/*
+  command pipelining
+
+  Commands are queued in the pipeline and are sent together by
+  mailimap_pipeline_run(), without waiting for the response of the
+  previous command. The responses are matched with the commands by
+  their tag and the callback of each command is called when its
+  response has been received, with the error code and the result of
+  the command :
+
+  - mailimap_pipeline_noop(), mailimap_pipeline_store(),
+    mailimap_pipeline_uid_store() : result is NULL.
+  - mailimap_pipeline_status() : result is a
+    (struct mailimap_mailbox_data_status *), to be freed with
+    mailimap_mailbox_data_status_free().
+  - mailimap_pipeline_fetch(), mailimap_pipeline_uid_fetch() : result
+    is a list of (struct mailimap_msg_att *), to be freed with
+    mailimap_fetch_list_free().
+  - mailimap_pipeline_uid_search() : result is a list of (uint32_t *),
+    to be freed with mailimap_search_result_free().
+
+  The result is NULL when error is not MAILIMAP_NO_ERROR.
+  Untagged responses are given to the command of the same mailbox,
+  message numbers or UIDs, whatever the order of the answers. A STATUS
+  command that gets no STATUS response fails with MAILIMAP_ERROR_STATUS.
+  Commands that change the selected mailbox can't be pipelined.
+*/
+
+typedef struct mailimap_pipeline mailimap_pipeline;
+
+typedef void mailimap_pipeline_callback(mailimap_pipeline * pipeline,
+    int error, void * result, void * cb_data);
+
+LIBETPAN_EXPORT
+mailimap_pipeline * mailimap_pipeline_new(mailimap * session);
+
+/* the commands not run yet are dropped without calling their callback */
+
+LIBETPAN_EXPORT
+void mailimap_pipeline_free(mailimap_pipeline * pipeline);
+
+LIBETPAN_EXPORT
+mailimap * mailimap_pipeline_get_session(mailimap_pipeline * pipeline);
+
+/*
+  maximum number of commands sent and waiting for their response,
+  so that the server never blocks on its output while we are still
+  sending. Default is 100.
+*/
+
+LIBETPAN_EXPORT
+void mailimap_pipeline_set_max_in_flight(mailimap_pipeline * pipeline,
+    unsigned int max_in_flight);
+
+LIBETPAN_EXPORT
+unsigned int mailimap_pipeline_get_count(mailimap_pipeline * pipeline);
+
+/*
+  mailimap_pipeline_run() sends the queued commands and waits for all
+  the responses. The pipeline is then empty and can be reused.
+  It returns MAILIMAP_NO_ERROR or the error that stopped the
+  processing, the commands that didn't complete get that error.
+*/
+
+LIBETPAN_EXPORT
+int mailimap_pipeline_run(mailimap_pipeline * pipeline);
+
+LIBETPAN_EXPORT
+int mailimap_pipeline_noop(mailimap_pipeline * pipeline,
+    mailimap_pipeline_callback * callback, void * cb_data);
+
+LIBETPAN_EXPORT
+int mailimap_pipeline_status(mailimap_pipeline * pipeline, const char * mb,
+    struct mailimap_status_att_list * status_att_list,
+    mailimap_pipeline_callback * callback, void * cb_data);
+
+LIBETPAN_EXPORT
+int mailimap_pipeline_fetch(mailimap_pipeline * pipeline,
+    struct mailimap_set * set,
+    struct mailimap_fetch_type * fetch_type,
+    mailimap_pipeline_callback * callback, void * cb_data);
+
+LIBETPAN_EXPORT
+int mailimap_pipeline_uid_fetch(mailimap_pipeline * pipeline,
+    struct mailimap_set * set,
+    struct mailimap_fetch_type * fetch_type,
+    mailimap_pipeline_callback * callback, void * cb_data);
+
+LIBETPAN_EXPORT
+int mailimap_pipeline_store(mailimap_pipeline * pipeline,
+    struct mailimap_set * set,
+    struct mailimap_store_att_flags * store_att_flags,
+    mailimap_pipeline_callback * callback, void * cb_data);
+
+LIBETPAN_EXPORT
+int mailimap_pipeline_uid_store(mailimap_pipeline * pipeline,
+    struct mailimap_set * set,
+    struct mailimap_store_att_flags * store_att_flags,
+    mailimap_pipeline_callback * callback, void * cb_data);
+
+LIBETPAN_EXPORT
+int mailimap_pipeline_uid_search(mailimap_pipeline * pipeline,
+    const char * charset, struct mailimap_search_key * key,
+    mailimap_pipeline_callback * callback, void * cb_data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
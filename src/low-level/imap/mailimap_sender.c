@@ -126,8 +126,6 @@ static int
 mailimap_header_list_send(mailstream * fd,
 			  struct mailimap_header_list * header_list);
 
-static int mailimap_number_send(mailstream * fd, uint32_t number);
-
 static int mailimap_password_send(mailstream * fd, const char * pass);
 
 static int mailimap_quoted_char_send(mailstream * fd, char ch);
@@ -1692,7 +1690,7 @@ int mailimap_mailbox_send(mailstream * fd, const char * mb)
                        ; (0 < n < 4,294,967,296)
 */
 
-static int mailimap_number_send(mailstream * fd, uint32_t number)
+int mailimap_number_send(mailstream * fd, uint32_t number)
 {
   int r;
 
@@ -1709,6 +1707,29 @@ static int mailimap_number_send(mailstream * fd, uint32_t number)
   return MAILIMAP_NO_ERROR;
 }
 
+/*
+   mod-sequence-value  = 1*DIGIT
+                          ;; Positive unsigned 63-bit integer
+   (RFC 7162)
+*/
+
+int mailimap_mod_sequence_value_send(mailstream * fd, uint64_t modseq)
+{
+  int r;
+
+  if (modseq / 10 != 0) {
+    r = mailimap_mod_sequence_value_send(fd, modseq / 10);
+    if (r != MAILIMAP_NO_ERROR)
+      return r;
+  }
+
+  r = mailimap_digit_send(fd, (int) (modseq % 10));
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  return MAILIMAP_NO_ERROR;
+}
+
 /*
 =>   password        = astring
 */
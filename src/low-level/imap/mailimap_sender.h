@@ -184,6 +184,10 @@ int mailimap_astring_send(mailstream * fd, const char * astring);
 int mailimap_set_send(mailstream * fd,
     struct mailimap_set * set);
 
+int mailimap_number_send(mailstream * fd, uint32_t number);
+
+int mailimap_mod_sequence_value_send(mailstream * fd, uint64_t modseq);
+
 #ifdef __cplusplus
 }
 #endif
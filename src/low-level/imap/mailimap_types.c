@@ -2962,9 +2962,14 @@ mailimap_response_info_new(void)
     goto free_expunged;
   resp_info->rsp_atom = NULL;
   resp_info->rsp_value = NULL;
+  resp_info->rsp_status_list = clist_new();
+  if (resp_info->rsp_status_list == NULL)
+    goto free_fetch_list;
   
   return resp_info;
 
+ free_fetch_list:
+  clist_free(resp_info->rsp_fetch_list);
  free_expunged:
   clist_free(resp_info->rsp_expunged);
  free_search_result:
@@ -3014,6 +3019,11 @@ mailimap_response_info_free(struct mailimap_response_info * resp_info)
     mailimap_mailbox_data_search_free(resp_info->rsp_search_result);
   if (resp_info->rsp_status != NULL)
     mailimap_mailbox_data_status_free(resp_info->rsp_status);
+  if (resp_info->rsp_status_list != NULL) {
+    clist_foreach(resp_info->rsp_status_list,
+        (clist_func) mailimap_mailbox_data_status_free, NULL);
+    clist_free(resp_info->rsp_status_list);
+  }
   if (resp_info->rsp_expunged != NULL) {
     clist_foreach(resp_info->rsp_expunged,
 		   (clist_func) mailimap_number_alloc_free, NULL);
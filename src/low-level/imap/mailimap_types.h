@@ -3130,6 +3130,37 @@ enum {
 
 typedef void mailimap_msg_att_handler(struct mailimap_msg_att * msg_att, void * context);
 
+/*
+  mailimap_literal_sink lets the caller receive the content of a fetched
+  body section as it is read from the network, instead of having it
+  stored in memory.
+
+  - begin is called when the literal of a BODY[section]<origin> item
+    is about to be read, size is the length of the literal.
+    It should return 1 to have the content delivered to write(),
+    0 to have it stored in sec_body_part as usual.
+
+  - write is called for each chunk of the content, the data is only
+    valid during the call. It should return 0 on success, -1 will
+    abort the parse with MAILIMAP_ERROR_STREAM.
+
+  When the content has been delivered to the sink, sec_body_part
+  of the parsed mailimap_msg_att_body_section is NULL and sec_length
+  is the size of the literal.
+*/
+
+typedef int mailimap_literal_sink_begin(struct mailimap_section * section,
+    uint32_t origin_octet, size_t size, void * context);
+
+typedef int mailimap_literal_sink_write(const char * data, size_t length,
+    void * context);
+
+struct mailimap_literal_sink {
+  mailimap_literal_sink_begin * sink_begin;
+  mailimap_literal_sink_write * sink_write;
+  void * sink_context;
+};
+
 struct mailimap {
   char * imap_response;
   
@@ -3167,6 +3198,7 @@ struct mailimap {
   void * imap_progress_context;
   mailimap_msg_att_handler * imap_msg_att_handler;
   void * imap_msg_att_handler_context;
+  struct mailimap_literal_sink imap_literal_sink;
 };
 
 typedef struct mailimap mailimap;
@@ -3262,6 +3294,9 @@ mailimap_selection_info_free(struct mailimap_selection_info * sel_info);
 
   - status is a STATUS response
 
+  - status_list is the list of the STATUS responses received before
+    status, when the response contains several of them
+
   - expunged is a list of message numbers
 
   - fetch_list is a list of fetch response
@@ -3281,6 +3316,7 @@ struct mailimap_response_info {
   clist * rsp_extension_list; /* list of (struct mailimap_extension_data *) */
   char * rsp_atom;
   char * rsp_value;
+  clist * rsp_status_list; /* list of (struct mailimap_mailbox_data_status *) */
 };
 
 struct mailimap_response_info *
@@ -3334,7 +3370,8 @@ enum {
   MAILIMAP_ERROR_INVAL,
   MAILIMAP_ERROR_EXTENSION,
   MAILIMAP_ERROR_SASL,
-  MAILIMAP_ERROR_SSL
+  MAILIMAP_ERROR_SSL,
+  MAILIMAP_ERROR_COMPRESS
 };
 
 
@@ -0,0 +1,525 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2011 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include "qresync.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "clist.h"
+#include "mailimap_types_helper.h"
+#include "mailimap_extension.h"
+#include "mailimap_keywords.h"
+#include "mailimap_parser.h"
+#include "mailimap_sender.h"
+#include "mailimap.h"
+#include "uidplus_parser.h"
+#include "condstore.h"
+#include "enable.h"
+#include "mail.h"
+
+static int
+mailimap_qresync_extension_parse(int calling_parser, mailstream * fd,
+    MMAPString * buffer, size_t * indx,
+    struct mailimap_extension_data ** result,
+    size_t progr_rate, progress_function * progr_fun);
+
+static void
+mailimap_qresync_extension_data_free(struct mailimap_extension_data * ext_data);
+
+LIBETPAN_EXPORT
+struct mailimap_extension_api mailimap_extension_qresync = {
+  /* name */          "QRESYNC",
+  /* extension_id */  MAILIMAP_EXTENSION_QRESYNC,
+  /* parser */        mailimap_qresync_extension_parse,
+  /* free */          mailimap_qresync_extension_data_free
+};
+
+LIBETPAN_EXPORT
+struct mailimap_qresync_vanished *
+mailimap_qresync_vanished_new(int qr_earlier,
+    struct mailimap_set * qr_known_uids)
+{
+  struct mailimap_qresync_vanished * vanished;
+
+  vanished = malloc(sizeof(* vanished));
+  if (vanished == NULL)
+    return NULL;
+
+  vanished->qr_earlier = qr_earlier;
+  vanished->qr_known_uids = qr_known_uids;
+
+  return vanished;
+}
+
+LIBETPAN_EXPORT
+void mailimap_qresync_vanished_free(struct mailimap_qresync_vanished * vanished)
+{
+  mailimap_set_free(vanished->qr_known_uids);
+  free(vanished);
+}
+
+LIBETPAN_EXPORT
+int mailimap_has_qresync(mailimap * session)
+{
+  return mailimap_has_extension(session, "QRESYNC");
+}
+
+LIBETPAN_EXPORT
+int mailimap_qresync_enable(mailimap * session)
+{
+  int enabled;
+  int r;
+
+  r = mailimap_enable(session, "QRESYNC", &enabled);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  if (!enabled)
+    return MAILIMAP_ERROR_EXTENSION;
+
+  return MAILIMAP_NO_ERROR;
+}
+
+/* parser */
+
+/*
+   expunged-resp       =  "VANISHED" [SP "(EARLIER)"] SP known-uids
+
+   known-uids          =  sequence-set
+                          ;; sequence of UIDs, "*" is not allowed
+*/
+
+static int vanished_parse(mailstream * fd,
+    MMAPString * buffer, size_t * indx,
+    struct mailimap_qresync_vanished ** result)
+{
+  size_t cur_token;
+  size_t earlier_token;
+  int earlier;
+  struct mailimap_set * set;
+  struct mailimap_qresync_vanished * vanished;
+  int r;
+
+  cur_token = * indx;
+
+  r = mailimap_token_case_insensitive_parse(fd, buffer,
+      &cur_token, "VANISHED");
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_space_parse(fd, buffer, &cur_token);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  earlier = 0;
+  earlier_token = cur_token;
+  r = mailimap_token_case_insensitive_parse(fd, buffer,
+      &earlier_token, "(EARLIER)");
+  if (r == MAILIMAP_NO_ERROR) {
+    r = mailimap_space_parse(fd, buffer, &earlier_token);
+    if (r != MAILIMAP_NO_ERROR)
+      return r;
+
+    earlier = 1;
+    cur_token = earlier_token;
+  }
+  else if (r != MAILIMAP_ERROR_PARSE)
+    return r;
+
+  r = mailimap_uid_set_parse(fd, buffer, &cur_token, &set);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  vanished = mailimap_qresync_vanished_new(earlier, set);
+  if (vanished == NULL) {
+    mailimap_set_free(set);
+    return MAILIMAP_ERROR_MEMORY;
+  }
+
+  * indx = cur_token;
+  * result = vanished;
+
+  return MAILIMAP_NO_ERROR;
+}
+
+static int
+mailimap_qresync_extension_parse(int calling_parser, mailstream * fd,
+    MMAPString * buffer, size_t * indx,
+    struct mailimap_extension_data ** result,
+    size_t progr_rate, progress_function * progr_fun)
+{
+  size_t cur_token;
+  struct mailimap_qresync_vanished * vanished;
+  struct mailimap_extension_data * ext_data;
+  int r;
+  UNUSED(progr_rate); UNUSED(progr_fun);
+
+  if (calling_parser != MAILIMAP_EXTENDED_PARSER_RESPONSE_DATA)
+    return MAILIMAP_ERROR_PARSE;
+
+  cur_token = * indx;
+
+  r = vanished_parse(fd, buffer, &cur_token, &vanished);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  ext_data = mailimap_extension_data_new(&mailimap_extension_qresync,
+      MAILIMAP_QRESYNC_TYPE_VANISHED, vanished);
+  if (ext_data == NULL) {
+    mailimap_qresync_vanished_free(vanished);
+    return MAILIMAP_ERROR_MEMORY;
+  }
+
+  * result = ext_data;
+  * indx = cur_token;
+
+  return MAILIMAP_NO_ERROR;
+}
+
+static void
+mailimap_qresync_extension_data_free(struct mailimap_extension_data * ext_data)
+{
+  if (ext_data == NULL)
+    return;
+
+  if (ext_data->ext_data != NULL) {
+    if (ext_data->ext_type == MAILIMAP_QRESYNC_TYPE_VANISHED)
+      mailimap_qresync_vanished_free(ext_data->ext_data);
+  }
+  free(ext_data);
+}
+
+/* sender */
+
+/*
+   select-param        =/ "QRESYNC" SP "(" uidvalidity SP
+                          mod-sequence-value [SP known-uids]
+                          [SP seq-match-data] ")"
+*/
+
+static int mailimap_select_qresync_send(mailstream * fd, const char * mb,
+    uint32_t uidvalidity, uint64_t modseq_value,
+    struct mailimap_set * known_uids)
+{
+  int r;
+
+  r = mailimap_select_send(fd, mb);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_space_send(fd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_token_send(fd, "(QRESYNC");
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_space_send(fd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_char_send(fd, '(');
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_number_send(fd, uidvalidity);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_space_send(fd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_mod_sequence_value_send(fd, modseq_value);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  if (known_uids != NULL) {
+    r = mailimap_space_send(fd);
+    if (r != MAILIMAP_NO_ERROR)
+      return r;
+
+    r = mailimap_set_send(fd, known_uids);
+    if (r != MAILIMAP_NO_ERROR)
+      return r;
+  }
+
+  r = mailimap_token_send(fd, "))");
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  return MAILIMAP_NO_ERROR;
+}
+
+/*
+   fetch-modifier      =/ chgsince-fetch-mod
+
+   chgsince-fetch-mod  = "CHANGEDSINCE" SP mod-sequence-value
+
+   rexpunges-fetch-mod = "VANISHED"
+*/
+
+static int mailimap_uid_fetch_qresync_send(mailstream * fd,
+    struct mailimap_set * set,
+    struct mailimap_fetch_type * fetch_type,
+    uint64_t mod_sequence_value)
+{
+  int r;
+
+  r = mailimap_uid_fetch_send(fd, set, fetch_type);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_space_send(fd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_token_send(fd, "(CHANGEDSINCE");
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_space_send(fd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_mod_sequence_value_send(fd, mod_sequence_value);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_space_send(fd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_token_send(fd, "VANISHED)");
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  return MAILIMAP_NO_ERROR;
+}
+
+/* commands */
+
+/*
+  merges the VANISHED responses of the last command into a single set,
+  the set items are moved out of the stored responses.
+*/
+
+static int get_vanished(mailimap * session,
+    struct mailimap_qresync_vanished ** result)
+{
+  struct mailimap_qresync_vanished * vanished;
+  clistiter * cur;
+  int r;
+
+  vanished = NULL;
+
+  for(cur = clist_begin(session->imap_response_info->rsp_extension_list) ;
+      cur != NULL ; cur = clist_next(cur)) {
+    struct mailimap_extension_data * ext_data;
+    struct mailimap_qresync_vanished * item;
+
+    ext_data = clist_content(cur);
+    if (ext_data->ext_extension != &mailimap_extension_qresync)
+      continue;
+    if (ext_data->ext_type != MAILIMAP_QRESYNC_TYPE_VANISHED)
+      continue;
+
+    item = ext_data->ext_data;
+    if (vanished == NULL) {
+      vanished = item;
+      ext_data->ext_data = NULL;
+      continue;
+    }
+
+    while (clist_begin(item->qr_known_uids->set_list) != NULL) {
+      struct mailimap_set_item * set_item;
+
+      set_item = clist_content(clist_begin(item->qr_known_uids->set_list));
+      r = mailimap_set_add(vanished->qr_known_uids, set_item);
+      if (r != MAILIMAP_NO_ERROR) {
+        mailimap_qresync_vanished_free(vanished);
+        return MAILIMAP_ERROR_MEMORY;
+      }
+      clist_delete(item->qr_known_uids->set_list,
+          clist_begin(item->qr_known_uids->set_list));
+    }
+  }
+
+  * result = vanished;
+
+  return MAILIMAP_NO_ERROR;
+}
+
+LIBETPAN_EXPORT
+int mailimap_select_qresync(mailimap * session, const char * mb,
+    uint32_t uidvalidity, uint64_t modseq_value,
+    struct mailimap_set * known_uids,
+    clist ** fetch_result,
+    struct mailimap_qresync_vanished ** p_vanished,
+    uint64_t * p_mod_sequence_value)
+{
+  struct mailimap_response * response;
+  int r;
+  int error_code;
+  uint64_t modseq;
+  clist * fetch_list;
+  struct mailimap_qresync_vanished * vanished;
+
+  if ((session->imap_state != MAILIMAP_STATE_AUTHENTICATED) &&
+      (session->imap_state != MAILIMAP_STATE_SELECTED))
+    return MAILIMAP_ERROR_BAD_STATE;
+
+  r = mailimap_send_current_tag(session);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_select_qresync_send(session->imap_stream, mb,
+      uidvalidity, modseq_value, known_uids);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_crlf_send(session->imap_stream);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  if (mailstream_flush(session->imap_stream) == -1)
+    return MAILIMAP_ERROR_STREAM;
+
+  if (mailimap_read_line(session) == NULL)
+    return MAILIMAP_ERROR_STREAM;
+
+  if (session->imap_selection_info != NULL)
+    mailimap_selection_info_free(session->imap_selection_info);
+  session->imap_selection_info = mailimap_selection_info_new();
+
+  r = mailimap_parse_response(session, &response);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  error_code = response->rsp_resp_done->rsp_data.rsp_tagged->rsp_cond_state->rsp_type;
+
+  mailimap_response_free(response);
+
+  switch (error_code) {
+  case MAILIMAP_RESP_COND_STATE_OK:
+    break;
+
+  default:
+    mailimap_selection_info_free(session->imap_selection_info);
+    session->imap_selection_info = NULL;
+    session->imap_state = MAILIMAP_STATE_AUTHENTICATED;
+    return MAILIMAP_ERROR_SELECT;
+  }
+
+  session->imap_state = MAILIMAP_STATE_SELECTED;
+
+  r = get_vanished(session, &vanished);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  if (!mailimap_get_highestmodseq(session, &modseq))
+    modseq = 0;
+
+  fetch_list = session->imap_response_info->rsp_fetch_list;
+  session->imap_response_info->rsp_fetch_list = NULL;
+
+  * fetch_result = fetch_list;
+  * p_vanished = vanished;
+  * p_mod_sequence_value = modseq;
+
+  return MAILIMAP_NO_ERROR;
+}
+
+LIBETPAN_EXPORT
+int mailimap_uid_fetch_qresync(mailimap * session,
+    struct mailimap_set * set,
+    struct mailimap_fetch_type * fetch_type,
+    uint64_t mod_sequence_value,
+    clist ** fetch_result,
+    struct mailimap_qresync_vanished ** p_vanished)
+{
+  struct mailimap_response * response;
+  int r;
+  int error_code;
+  clist * fetch_list;
+  struct mailimap_qresync_vanished * vanished;
+
+  if (session->imap_state != MAILIMAP_STATE_SELECTED)
+    return MAILIMAP_ERROR_BAD_STATE;
+
+  r = mailimap_send_current_tag(session);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_uid_fetch_qresync_send(session->imap_stream,
+      set, fetch_type, mod_sequence_value);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_crlf_send(session->imap_stream);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  if (mailstream_flush(session->imap_stream) == -1)
+    return MAILIMAP_ERROR_STREAM;
+
+  if (mailimap_read_line(session) == NULL)
+    return MAILIMAP_ERROR_STREAM;
+
+  r = mailimap_parse_response(session, &response);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  error_code = response->rsp_resp_done->rsp_data.rsp_tagged->rsp_cond_state->rsp_type;
+
+  mailimap_response_free(response);
+
+  if (error_code != MAILIMAP_RESP_COND_STATE_OK)
+    return MAILIMAP_ERROR_UID_FETCH;
+
+  r = get_vanished(session, &vanished);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  fetch_list = session->imap_response_info->rsp_fetch_list;
+  session->imap_response_info->rsp_fetch_list = NULL;
+
+  * fetch_result = fetch_list;
+  * p_vanished = vanished;
+
+  return MAILIMAP_NO_ERROR;
+}
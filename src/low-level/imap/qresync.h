@@ -0,0 +1,123 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2011 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef QRESYNC_H
+
+#define QRESYNC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <libetpan/libetpan-config.h>
+#include <libetpan/mailimap_extension.h>
+
+/* QRESYNC (RFC 7162) */
+
+enum {
+  MAILIMAP_QRESYNC_TYPE_VANISHED
+};
+
+/*
+  VANISHED response
+
+  - qr_earlier is 1 when the response is VANISHED (EARLIER), the UIDs
+    were then expunged before the command and not by the command.
+  - qr_known_uids is the set of expunged UIDs.
+*/
+
+struct mailimap_qresync_vanished {
+  int qr_earlier;
+  struct mailimap_set * qr_known_uids;
+};
+
+LIBETPAN_EXPORT
+extern struct mailimap_extension_api mailimap_extension_qresync;
+
+LIBETPAN_EXPORT
+struct mailimap_qresync_vanished *
+mailimap_qresync_vanished_new(int qr_earlier,
+    struct mailimap_set * qr_known_uids);
+
+LIBETPAN_EXPORT
+void mailimap_qresync_vanished_free(struct mailimap_qresync_vanished * vanished);
+
+LIBETPAN_EXPORT
+int mailimap_has_qresync(mailimap * session);
+
+/*
+  mailimap_qresync_enable() sends ENABLE QRESYNC, it must be called
+  before selecting a mailbox. Once enabled, the server reports the
+  expunged messages with VANISHED responses instead of EXPUNGE.
+*/
+
+LIBETPAN_EXPORT
+int mailimap_qresync_enable(mailimap * session);
+
+/*
+  mailimap_select_qresync() sends
+  SELECT mb (QRESYNC (uidvalidity modseq [known_uids])).
+
+  When uidvalidity and modseq match the state of the mailbox, the
+  server answers with the messages whose flags changed since modseq,
+  returned in fetch_result, and the UIDs of known_uids that were
+  expunged, returned in p_vanished (NULL if none).
+  p_mod_sequence_value is set to the new HIGHESTMODSEQ.
+  known_uids can be NULL.
+*/
+
+LIBETPAN_EXPORT
+int mailimap_select_qresync(mailimap * session, const char * mb,
+    uint32_t uidvalidity, uint64_t modseq_value,
+    struct mailimap_set * known_uids,
+    clist ** fetch_result,
+    struct mailimap_qresync_vanished ** p_vanished,
+    uint64_t * p_mod_sequence_value);
+
+/*
+  mailimap_uid_fetch_qresync() sends UID FETCH with the modifiers
+  (CHANGEDSINCE modseq VANISHED). The UIDs of the set that were expunged
+  are returned in p_vanished (NULL if none).
+*/
+
+LIBETPAN_EXPORT
+int mailimap_uid_fetch_qresync(mailimap * session,
+    struct mailimap_set * set,
+    struct mailimap_fetch_type * fetch_type,
+    uint64_t mod_sequence_value,
+    clist ** fetch_result,
+    struct mailimap_qresync_vanished ** p_vanished);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
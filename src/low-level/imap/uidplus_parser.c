@@ -78,7 +78,7 @@ static void uid_set_item_destructor(struct mailimap_set_item * set_item)
   mailimap_set_item_free(set_item);
 }
 
-static int mailimap_uid_set_parse(mailstream * fd, MMAPString *buffer,
+int mailimap_uid_set_parse(mailstream * fd, MMAPString *buffer,
     size_t * indx,
     struct mailimap_set ** result)
 {
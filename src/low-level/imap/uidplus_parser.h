@@ -18,6 +18,10 @@ int mailimap_uidplus_parse(int calling_parser, mailstream * fd,
     size_t progr_rate,
     progress_function * progr_fun);
 
+int mailimap_uid_set_parse(mailstream * fd, MMAPString *buffer,
+    size_t * indx,
+    struct mailimap_set ** result);
+
 #ifdef __cplusplus
 }
 #endif
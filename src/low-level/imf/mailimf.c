@@ -53,6 +53,7 @@
 
 #include <ctype.h>
 #include "mmapstring.h"
+#include "mailarena_private.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -561,7 +562,7 @@ mailimf_custom_string_parse(const char * message, size_t length,
     /*
     gstr = strndup(message + begin, end - begin);
     */
-    gstr = malloc(end - begin + 1);
+    gstr = mailarena_malloc(end - begin + 1);
     if (gstr == NULL)
       return MAILIMF_ERROR_MEMORY;
     strncpy(gstr, message + begin, end - begin);
@@ -1197,7 +1198,7 @@ int mailimf_atom_parse(const char * message, size_t length,
     goto err;
   }
 
-  atom = malloc(end - cur_token + 1);
+  atom = mailarena_malloc(end - cur_token + 1);
   if (atom == NULL) {
     res = MAILIMF_ERROR_MEMORY;
     goto err;
@@ -1249,7 +1250,7 @@ int mailimf_fws_atom_parse(const char * message, size_t length,
     goto err;
   }
 
-  atom = malloc(end - cur_token + 1);
+  atom = mailarena_malloc(end - cur_token + 1);
   if (atom == NULL) {
     res = MAILIMF_ERROR_MEMORY;
     goto err;
@@ -1440,7 +1441,7 @@ int mailimf_quoted_string_parse(const char * message, size_t length,
   }
 #endif
 
-  str = strdup(gstr->str);
+  str = mailarena_strdup(gstr->str);
   if (str == NULL) {
     res = MAILIMF_ERROR_MEMORY;
     goto free_gstr;
@@ -1536,7 +1537,7 @@ int mailimf_fws_quoted_string_parse(const char * message, size_t length,
   }
 #endif
 
-  str = strdup(gstr->str);
+  str = mailarena_strdup(gstr->str);
   if (str == NULL) {
     res = MAILIMF_ERROR_MEMORY;
     goto free_gstr;
@@ -1660,7 +1661,7 @@ static int mailimf_phrase_parse(const char * message, size_t length,
     goto free;
   }
 
-  str = strdup(gphrase->str);
+  str = mailarena_strdup(gphrase->str);
   if (str == NULL) {
     res = MAILIMF_ERROR_MEMORY;
     goto free;
@@ -1795,7 +1796,7 @@ static int mailimf_unstructured_parse(const char * message, size_t length,
     cur_token ++;
   }
 
-  str = malloc(terminal - begin + 1);
+  str = mailarena_malloc(terminal - begin + 1);
   if (str == NULL)
     return MAILIMF_ERROR_MEMORY;
   strncpy(str, message + begin,  terminal - begin);
@@ -2975,7 +2976,7 @@ static int mailimf_angle_addr_parse(const char * message, size_t length,
   
   r = mailimf_greater_parse(message, length, &cur_token);
   if (r != MAILIMF_NO_ERROR) {
-    free(addr_spec);
+    mailarena_release(addr_spec);
     return r;
   }
 
@@ -3232,7 +3233,7 @@ static int mailimf_addr_spec_parse(const char * message, size_t length,
     goto err;
   }
   
-  addr_spec = malloc(end - cur_token + 1);
+  addr_spec = mailarena_malloc(end - cur_token + 1);
   if (addr_spec == NULL) {
     res = MAILIMF_ERROR_MEMORY;
     goto err;
@@ -3284,7 +3285,7 @@ static int mailimf_addr_spec_parse(const char * message, size_t length,
   }
 
   if (domain) {
-    addr_spec = malloc(strlen(local_part) + strlen(domain) + 2);
+    addr_spec = mailarena_malloc(strlen(local_part) + strlen(domain) + 2);
     if (addr_spec == NULL) {
       res = MAILIMF_ERROR_MEMORY;
       goto free_domain;
@@ -3378,7 +3379,7 @@ static int mailimf_addr_spec_msg_id_parse(const char * message, size_t length,
         goto err;
     }
     
-    addr_spec = malloc(end - cur_token + 1);
+    addr_spec = mailarena_malloc(end - cur_token + 1);
     if (addr_spec == NULL) {
         res = MAILIMF_ERROR_MEMORY;
         goto err;
@@ -3541,7 +3542,7 @@ static int mailimf_domain_literal_parse(const char * message, size_t length,
 
   len = cur_token - begin;
 
-  domain_literal = malloc(len + 1);
+  domain_literal = mailarena_malloc(len + 1);
   if (domain_literal == NULL)
     return MAILIMF_ERROR_MEMORY;
   strncpy(domain_literal, message + begin, len);
@@ -4079,139 +4080,140 @@ field           =       delivering-info /
                         optional-field
 */
 
-enum {
-  HEADER_START,
-  HEADER_C,
-  HEADER_R,
-  HEADER_RE,
-  HEADER_S,
-  HEADER_RES
+/*
+  Header field names are looked up in a table of the names known by
+  mailimf and mailmime. The position of a name in the table is given
+  by header_name_hash(), the multipliers were chosen so that each
+  known name has its own slot, only one comparison is needed.
+*/
+
+#define HEADER_NAME_TABLE_SIZE 64
+
+struct header_name {
+  const char * hn_name;
+  size_t hn_length;
+  int hn_type;
 };
 
-static int guess_header_type(const char * message, size_t length, size_t indx)
+static struct header_name header_name_table[HEADER_NAME_TABLE_SIZE] = {
+  { "Resent-From", 11, MAILIMF_FIELD_RESENT_FROM },
+  { "Return-Path", 11, MAILIMF_FIELD_RETURN_PATH },
+  { NULL, 0, MAILIMF_FIELD_NONE },
+  { "Content-Location", 16, MAILIMF_HEADER_MIME_LOCATION },
+  { NULL, 0, MAILIMF_FIELD_NONE },
+  { NULL, 0, MAILIMF_FIELD_NONE },
+  { NULL, 0, MAILIMF_FIELD_NONE },
+  { NULL, 0, MAILIMF_FIELD_NONE },
+  { "Resent-Cc", 9, MAILIMF_FIELD_RESENT_CC },
+  { "MIME-Version", 12, MAILIMF_HEADER_MIME_VERSION },
+  { NULL, 0, MAILIMF_FIELD_NONE },
+  { "In-Reply-To", 11, MAILIMF_FIELD_IN_REPLY_TO },
+  { "Resent-To", 9, MAILIMF_FIELD_RESENT_TO },
+  { "References", 10, MAILIMF_FIELD_REFERENCES },
+  { "Bcc", 3, MAILIMF_FIELD_BCC },
+  { "Reply-To", 8, MAILIMF_FIELD_REPLY_TO },
+  { "Cc", 2, MAILIMF_FIELD_CC },
+  { "Resent-Bcc", 10, MAILIMF_FIELD_RESENT_BCC },
+  { NULL, 0, MAILIMF_FIELD_NONE },
+  { "Content-Transfer-Encoding", 25, MAILIMF_HEADER_MIME_TRANSFER_ENCODING },
+  { "Subject", 7, MAILIMF_FIELD_SUBJECT },
+  { NULL, 0, MAILIMF_FIELD_NONE },
+  { NULL, 0, MAILIMF_FIELD_NONE },
+  { "To", 2, MAILIMF_FIELD_TO },
+  { NULL, 0, MAILIMF_FIELD_NONE },
+  { "From", 4, MAILIMF_FIELD_FROM },
+  { NULL, 0, MAILIMF_FIELD_NONE },
+  { NULL, 0, MAILIMF_FIELD_NONE },
+  { NULL, 0, MAILIMF_FIELD_NONE },
+  { NULL, 0, MAILIMF_FIELD_NONE },
+  { "Comments", 8, MAILIMF_FIELD_COMMENTS },
+  { NULL, 0, MAILIMF_FIELD_NONE },
+  { "Content-Language", 16, MAILIMF_HEADER_MIME_LANGUAGE },
+  { NULL, 0, MAILIMF_FIELD_NONE },
+  { "Content-Disposition", 19, MAILIMF_HEADER_MIME_DISPOSITION },
+  { NULL, 0, MAILIMF_FIELD_NONE },
+  { NULL, 0, MAILIMF_FIELD_NONE },
+  { "Resent-Sender", 13, MAILIMF_FIELD_RESENT_SENDER },
+  { NULL, 0, MAILIMF_FIELD_NONE },
+  { "Content-ID", 10, MAILIMF_HEADER_MIME_ID },
+  { "Resent-Date", 11, MAILIMF_FIELD_RESENT_DATE },
+  { NULL, 0, MAILIMF_FIELD_NONE },
+  { NULL, 0, MAILIMF_FIELD_NONE },
+  { NULL, 0, MAILIMF_FIELD_NONE },
+  { NULL, 0, MAILIMF_FIELD_NONE },
+  { NULL, 0, MAILIMF_FIELD_NONE },
+  { "Keywords", 8, MAILIMF_FIELD_KEYWORDS },
+  { "Resent-Message-ID", 17, MAILIMF_FIELD_RESENT_MSG_ID },
+  { NULL, 0, MAILIMF_FIELD_NONE },
+  { "Message-ID", 10, MAILIMF_FIELD_MESSAGE_ID },
+  { "Content-Description", 19, MAILIMF_HEADER_MIME_DESCRIPTION },
+  { NULL, 0, MAILIMF_FIELD_NONE },
+  { NULL, 0, MAILIMF_FIELD_NONE },
+  { "Sender", 6, MAILIMF_FIELD_SENDER },
+  { NULL, 0, MAILIMF_FIELD_NONE },
+  { "Date", 4, MAILIMF_FIELD_ORIG_DATE },
+  { NULL, 0, MAILIMF_FIELD_NONE },
+  { NULL, 0, MAILIMF_FIELD_NONE },
+  { NULL, 0, MAILIMF_FIELD_NONE },
+  { NULL, 0, MAILIMF_FIELD_NONE },
+  { "Content-Type", 12, MAILIMF_HEADER_MIME_TYPE },
+  { NULL, 0, MAILIMF_FIELD_NONE },
+  { NULL, 0, MAILIMF_FIELD_NONE },
+  { NULL, 0, MAILIMF_FIELD_NONE }
+};
+
+static inline unsigned int header_name_hash(const char * name, size_t length)
 {
-  int state;
-  int r;
+  unsigned int hash;
 
-  state = HEADER_START;
-  
-  while (1) {
+  /* case is ignored, the other characters only need to be stable */
+  hash = length;
+  hash += 3 * ((unsigned char) name[0] | 0x20);
+  hash += 11 * ((unsigned char) name[length - 1] | 0x20);
+  hash += 12 * ((unsigned char) name[length / 2] | 0x20);
 
-    if (indx >= length)
-      return MAILIMF_FIELD_NONE;
+  return hash % HEADER_NAME_TABLE_SIZE;
+}
 
-    switch(state) {
-    case HEADER_START:
-      switch((char) toupper((unsigned char) message[indx])) {
-      case 'B':
-	return MAILIMF_FIELD_BCC;
-      case 'C':
-	state = HEADER_C;
-	break;
-      case 'D':
-	return MAILIMF_FIELD_ORIG_DATE;
-      case 'F':
-	return MAILIMF_FIELD_FROM;
-      case 'I':
-	return MAILIMF_FIELD_IN_REPLY_TO;
-      case 'K':
-	return MAILIMF_FIELD_KEYWORDS;
-      case 'M':
-	return MAILIMF_FIELD_MESSAGE_ID;
-      case 'R':
-	state = HEADER_R;
-	break;
-      case 'T':
-	return MAILIMF_FIELD_TO;
-	break;
-      case 'S':
-	state = HEADER_S;
-	break;
-      default:
-	return MAILIMF_FIELD_NONE;
-      }
-      break;
-    case HEADER_C:
-      switch((char) toupper((unsigned char) message[indx])) {
-      case 'O':
-	return MAILIMF_FIELD_COMMENTS;
-      case 'C':
-	return MAILIMF_FIELD_CC;
-      default:
-	return MAILIMF_FIELD_NONE;
-      }
-      break;
-    case HEADER_R:
-      switch((char) toupper((unsigned char) message[indx])) {
-      case 'E':
-	state = HEADER_RE;
-	break;
-      default:
-	return MAILIMF_FIELD_NONE;
-      }
-      break;
-    case HEADER_RE:
-      switch((char) toupper((unsigned char) message[indx])) {
-      case 'F':
-	return MAILIMF_FIELD_REFERENCES;
-      case 'P':
-	return MAILIMF_FIELD_REPLY_TO;
-      case 'S':
-        state = HEADER_RES;
-        break;
-      case 'T':
-        return MAILIMF_FIELD_RETURN_PATH;
-      default:
-	return MAILIMF_FIELD_NONE;
-      }
-      break;
-    case HEADER_S:
-      switch((char) toupper((unsigned char) message[indx])) {
-      case 'E':
-	return MAILIMF_FIELD_SENDER;
-      case 'U':
-	return MAILIMF_FIELD_SUBJECT;
-      default:
-	return MAILIMF_FIELD_NONE;
-      }
-      break;
+int mailimf_header_name_lookup(const char * name, size_t length)
+{
+  struct header_name * entry;
 
-    case HEADER_RES:
-      r = mailimf_token_case_insensitive_parse(message,
-          length, &indx, "ent-");
-      if (r != MAILIMF_NO_ERROR)
-        return MAILIMF_FIELD_NONE;
-      
-      if (indx >= length)
-        return MAILIMF_FIELD_NONE;
-      
-      switch((char) toupper((unsigned char) message[indx])) {
-      case 'D':
-        return MAILIMF_FIELD_RESENT_DATE;
-      case 'F':
-        return MAILIMF_FIELD_RESENT_FROM;
-      case 'S':
-        return MAILIMF_FIELD_RESENT_SENDER;
-      case 'T':
-        return MAILIMF_FIELD_RESENT_TO;
-      case 'C':
-        return MAILIMF_FIELD_RESENT_CC;
-      case 'B':
-        return MAILIMF_FIELD_RESENT_BCC;
-      case 'M':
-        return MAILIMF_FIELD_RESENT_MSG_ID;
-      default:
-        return MAILIMF_FIELD_NONE;
-      }
-      break;
-    }
-    indx ++;
-  }
+  if (length == 0)
+    return MAILIMF_FIELD_NONE;
+
+  entry = &header_name_table[header_name_hash(name, length)];
+  if (entry->hn_length != length)
+    return MAILIMF_FIELD_NONE;
+
+  if (strncasecmp(entry->hn_name, name, length) != 0)
+    return MAILIMF_FIELD_NONE;
+
+  return entry->hn_type;
 }
 
-static int mailimf_field_parse(const char * message, size_t length,
-			       size_t * indx,
-			       struct mailimf_field ** result)
+static inline int is_ftext(char ch);
+
+static int guess_header_type(const char * message, size_t length, size_t indx)
+{
+  size_t end;
+
+  end = indx;
+  while ((end < length) && is_ftext(message[end]))
+    end ++;
+
+  return mailimf_header_name_lookup(message + indx, end - indx);
+}
+
+/*
+  parse a field of the given type, guessed from its name, the field
+  is parsed as an optional field if its content does not match
+  the type.
+*/
+
+static int mailimf_typed_field_parse(const char * message, size_t length,
+    size_t * indx, int guessed_type,
+    struct mailimf_field ** result)
 {
   size_t cur_token;
   int type;
@@ -4238,7 +4240,6 @@ static int mailimf_field_parse(const char * message, size_t length,
   struct mailimf_keywords * keywords;
   struct mailimf_optional_field * optional_field;
   struct mailimf_field * field;
-  int guessed_type;
   int r;
   int res;
   
@@ -4267,7 +4268,6 @@ static int mailimf_field_parse(const char * message, size_t length,
   keywords = NULL;
   optional_field = NULL;
 
-  guessed_type = guess_header_type(message, length, cur_token);
   type = MAILIMF_FIELD_NONE;
 
   switch (guessed_type) {
@@ -4622,6 +4622,18 @@ static int mailimf_field_parse(const char * message, size_t length,
 }
 
 
+static int mailimf_field_parse(const char * message, size_t length,
+			       size_t * indx,
+			       struct mailimf_field ** result)
+{
+  int guessed_type;
+
+  guessed_type = guess_header_type(message, length, * indx);
+
+  return mailimf_typed_field_parse(message, length, indx, guessed_type,
+      result);
+}
+
 /*
 fields          =       *(delivering-info /
 			orig-date /
@@ -5485,7 +5497,7 @@ int mailimf_msg_id_parse(const char * message, size_t length,
     goto free_id_right;
   }
 
-  msg_id = malloc(strlen(id_left) + strlen(id_right) + 2);
+  msg_id = mailarena_malloc(strlen(id_left) + strlen(id_right) + 2);
   if (msg_id == NULL) {
     res = MAILIMF_ERROR_MEMORY;
     goto free_id_right;
@@ -5514,7 +5526,7 @@ int mailimf_msg_id_parse(const char * message, size_t length,
   mailimf_atom_free(msg_id);
   */
  err:
-  if(*result != msg_id) free(msg_id);
+  if(*result != msg_id) mailarena_release(msg_id);
   return res;
 }
 
@@ -5618,7 +5630,7 @@ static int mailimf_unstrict_msg_id_parse(const char * message, size_t length,
 
   r = mailimf_parse_unwanted_msg_id(message, length, &cur_token);
   if (r != MAILIMF_NO_ERROR) {
-    free(msgid);
+    mailarena_release(msgid);
     return r;
   }
 
@@ -5761,7 +5773,7 @@ static int mailimf_no_fold_quote_parse(const char * message, size_t length,
   }
 
   /*  no_fold_quote = strndup(message + begin, cur_token - begin); */
-  no_fold_quote = malloc(cur_token - begin + 1);
+  no_fold_quote = mailarena_malloc(cur_token - begin + 1);
   if (no_fold_quote == NULL) {
     res = MAILIMF_ERROR_MEMORY;
     goto err;
@@ -5859,7 +5871,7 @@ static int mailimf_no_fold_literal_parse(const char * message, size_t length,
   /*
   no_fold_literal = strndup(message + begin, cur_token - begin);
   */
-  no_fold_literal = malloc(cur_token - begin + 1);
+  no_fold_literal = mailarena_malloc(cur_token - begin + 1);
   if (no_fold_literal == NULL) {
     res = MAILIMF_NO_ERROR;
     goto err;
@@ -6934,7 +6946,7 @@ static int mailimf_item_name_parse(const char * message, size_t length,
     }
   }
 
-  item_name = strndup(message + begin, cur_token - begin);
+  item_name = mailarena_strndup(message + begin, cur_token - begin);
   if (item_name == NULL) {
     res = MAILIMF_ERROR_MEMORY;
     goto err;
@@ -7188,7 +7200,7 @@ static int mailimf_field_name_parse(const char * message, size_t length,
   }
 
   /*  field_name = strndup(message + cur_token, end - cur_token); */
-  field_name = malloc(end - cur_token + 1);
+  field_name = mailarena_malloc(end - cur_token + 1);
   if (field_name == NULL) {
     return MAILIMF_ERROR_MEMORY;
   }
@@ -7538,6 +7550,87 @@ int mailimf_envelope_fields_parse(const char * message, size_t length,
 }
 
 
+int mailimf_selected_fields_parse(const char * message, size_t length,
+				  size_t * indx, unsigned int types,
+				  struct mailimf_fields ** result)
+{
+  size_t cur_token;
+  clist * list;
+  struct mailimf_fields * fields;
+  int r;
+  int res;
+
+  cur_token = * indx;
+
+  list = clist_new();
+  if (list == NULL) {
+    res = MAILIMF_ERROR_MEMORY;
+    goto err;
+  }
+
+  while (1) {
+    struct mailimf_field * elt;
+    int guessed_type;
+    int selected_type;
+
+    guessed_type = guess_header_type(message, length, cur_token);
+    if ((guessed_type == MAILIMF_FIELD_NONE) ||
+        (guessed_type > MAILIMF_FIELD_OPTIONAL_FIELD))
+      selected_type = MAILIMF_FIELD_OPTIONAL_FIELD;
+    else
+      selected_type = guessed_type;
+
+    if ((types & MAILIMF_FIELD_MASK(selected_type)) != 0) {
+      r = mailimf_typed_field_parse(message, length, &cur_token,
+          guessed_type, &elt);
+      if (r == MAILIMF_NO_ERROR) {
+        r = clist_append(list, elt);
+        if (r < 0) {
+          mailimf_field_free(elt);
+          res = MAILIMF_ERROR_MEMORY;
+          goto free;
+        }
+        continue;
+      }
+      else if (r != MAILIMF_ERROR_PARSE) {
+        res = r;
+        goto free;
+      }
+    }
+
+    /* the content of the fields that were not requested is not parsed */
+    r = mailimf_ignore_field_parse(message, length, &cur_token);
+    if (r == MAILIMF_NO_ERROR) {
+      /* do nothing */
+    }
+    else if (r == MAILIMF_ERROR_PARSE) {
+      break;
+    }
+    else {
+      res = r;
+      goto free;
+    }
+  }
+
+  fields = mailimf_fields_new(list);
+  if (fields == NULL) {
+    res = MAILIMF_ERROR_MEMORY;
+    goto free;
+  }
+
+  * result = fields;
+  * indx = cur_token;
+
+  return MAILIMF_NO_ERROR;
+
+ free:
+  clist_foreach(list, (clist_func) mailimf_field_free, NULL);
+  clist_free(list);
+ err:
+  return res;
+}
+
+
 static int
 mailimf_envelope_or_optional_field_parse(const char * message,
 					 size_t length,
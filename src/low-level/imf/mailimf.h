@@ -46,6 +46,7 @@ extern "C" {
 #include <libetpan/mailimf_write_file.h>
 #include <libetpan/mailimf_write_mem.h>
 #include <libetpan/mailimf_types_helper.h>
+#include <libetpan/mailimf_lazy.h>
 
 #ifdef HAVE_INTTYPES_H
 #	include <inttypes.h>
@@ -220,6 +221,33 @@ int mailimf_envelope_fields_parse(const char * message, size_t length,
 				  size_t * indx,
 				  struct mailimf_fields ** result);
 
+/*
+  mailimf_selected_fields_parse will parse the given header fields
+  of the given types, the other fields are skipped without parsing
+  their content
+
+  @param message this is a string containing the header fields
+  @param length this is the size of the given string
+  @param indx this is a pointer to the start of the header fields in
+    the given string, (* indx) is modified to point at the end
+    of the parsed data
+  @param types this is the set of the types of fields to parse,
+    MAILIMF_FIELD_MASK(MAILIMF_FIELD_XXX) combined with '|'.
+    MAILIMF_FIELD_MASK(MAILIMF_FIELD_OPTIONAL_FIELD) selects the
+    fields that are not defined by RFC 2822.
+  @param result the result of the parse operation is stored in
+    (* result)
+
+  @return MAILIMF_NO_ERROR on success, MAILIMF_ERROR_XXX on error
+*/
+
+#define MAILIMF_FIELD_MASK(type) (1U << (type))
+
+LIBETPAN_EXPORT
+int mailimf_selected_fields_parse(const char * message, size_t length,
+				  size_t * indx, unsigned int types,
+				  struct mailimf_fields ** result);
+
 /*
   mailimf_ignore_field_parse will skip the given field
   
@@ -282,6 +310,27 @@ mailimf_optional_fields_parse(const char * message, size_t length,
 
 /* internal use, exported for MIME */
 
+/*
+  mailimf_header_name_lookup() returns the type of the field with
+  the given name: MAILIMF_FIELD_XXX for the fields of RFC 2822,
+  MAILIMF_HEADER_MIME_XXX for the fields of MIME and
+  MAILIMF_FIELD_NONE for the other ones.
+*/
+
+enum {
+  MAILIMF_HEADER_MIME_TYPE = MAILIMF_FIELD_OPTIONAL_FIELD + 1,
+  MAILIMF_HEADER_MIME_TRANSFER_ENCODING,
+  MAILIMF_HEADER_MIME_ID,
+  MAILIMF_HEADER_MIME_DESCRIPTION,
+  MAILIMF_HEADER_MIME_VERSION,
+  MAILIMF_HEADER_MIME_DISPOSITION,
+  MAILIMF_HEADER_MIME_LANGUAGE,
+  MAILIMF_HEADER_MIME_LOCATION
+};
+
+int mailimf_header_name_lookup(const char * name, size_t length);
+
+
 int mailimf_fws_parse(const char * message, size_t length, size_t * indx);
 
 int mailimf_cfws_parse(const char * message, size_t length,
@@ -0,0 +1,318 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2011 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include "mailimf_lazy.h"
+
+#include "mailimf.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+/* ftext, see mailimf.c */
+
+static inline int is_ftext(char ch)
+{
+  unsigned char uch = (unsigned char) ch;
+
+  if (uch < 33)
+    return FALSE;
+
+  if (uch == 58)
+    return FALSE;
+
+  return TRUE;
+}
+
+/* the types parsed by mailimf_envelope_and_optional_fields_parse() */
+
+static int envelope_field_type(int type)
+{
+  switch (type) {
+  case MAILIMF_FIELD_ORIG_DATE:
+  case MAILIMF_FIELD_FROM:
+  case MAILIMF_FIELD_SENDER:
+  case MAILIMF_FIELD_REPLY_TO:
+  case MAILIMF_FIELD_TO:
+  case MAILIMF_FIELD_CC:
+  case MAILIMF_FIELD_BCC:
+  case MAILIMF_FIELD_MESSAGE_ID:
+  case MAILIMF_FIELD_IN_REPLY_TO:
+  case MAILIMF_FIELD_REFERENCES:
+  case MAILIMF_FIELD_SUBJECT:
+    return type;
+  default:
+    return MAILIMF_FIELD_OPTIONAL_FIELD;
+  }
+}
+
+int mailimf_lazy_fields_parse(const char * message, size_t length,
+			      size_t * indx,
+			      struct mailimf_lazy_fields ** result)
+{
+  struct mailimf_lazy_fields * fields;
+  struct mailimf_lazy_field * list;
+  unsigned int count;
+  unsigned int allocated;
+  size_t begin;
+  size_t cur_token;
+  int res;
+  int r;
+
+  begin = * indx;
+  cur_token = begin;
+
+  list = NULL;
+  count = 0;
+  allocated = 0;
+
+  while (1) {
+    size_t field_begin;
+    size_t name_end;
+    size_t p;
+
+    /* a field is a name followed by a colon, the header ends
+       at the first line that is not a field */
+    field_begin = cur_token;
+    name_end = field_begin;
+    while ((name_end < length) && is_ftext(message[name_end]))
+      name_end ++;
+    if (name_end == field_begin)
+      break;
+
+    p = name_end;
+    while ((p < length) && ((message[p] == ' ') || (message[p] == '\t')))
+      p ++;
+    if ((p >= length) || (message[p] != ':'))
+      break;
+
+    r = mailimf_ignore_field_parse(message, length, &cur_token);
+    if (r == MAILIMF_ERROR_PARSE)
+      break;
+    if (r != MAILIMF_NO_ERROR) {
+      res = r;
+      goto free_list;
+    }
+
+    if (count == allocated) {
+      struct mailimf_lazy_field * new_list;
+
+      allocated = (allocated == 0) ? 32 : allocated * 2;
+      new_list = realloc(list, allocated * sizeof(* list));
+      if (new_list == NULL) {
+        res = MAILIMF_ERROR_MEMORY;
+        goto free_list;
+      }
+      list = new_list;
+    }
+
+    list[count].lf_type =
+      envelope_field_type(mailimf_header_name_lookup(message + field_begin,
+                              name_end - field_begin));
+    list[count].lf_begin = field_begin - begin;
+    list[count].lf_end = cur_token - begin;
+    list[count].lf_field = NULL;
+    count ++;
+  }
+
+  fields = malloc(sizeof(* fields));
+  if (fields == NULL) {
+    res = MAILIMF_ERROR_MEMORY;
+    goto free_list;
+  }
+
+  fields->lz_length = cur_token - begin;
+  fields->lz_data = malloc(fields->lz_length + 1);
+  if (fields->lz_data == NULL) {
+    res = MAILIMF_ERROR_MEMORY;
+    goto free_fields;
+  }
+  memcpy(fields->lz_data, message + begin, fields->lz_length);
+  fields->lz_data[fields->lz_length] = '\0';
+  fields->lz_list = list;
+  fields->lz_count = count;
+
+  * result = fields;
+  * indx = cur_token;
+
+  return MAILIMF_NO_ERROR;
+
+ free_fields:
+  free(fields);
+ free_list:
+  free(list);
+  return res;
+}
+
+void mailimf_lazy_fields_free(struct mailimf_lazy_fields * fields)
+{
+  unsigned int i;
+
+  for(i = 0 ; i < fields->lz_count ; i ++) {
+    if (fields->lz_list[i].lf_field != NULL)
+      mailimf_field_free(fields->lz_list[i].lf_field);
+  }
+  free(fields->lz_list);
+  free(fields->lz_data);
+  free(fields);
+}
+
+int mailimf_lazy_fields_get_field(struct mailimf_lazy_fields * fields,
+				  unsigned int indx,
+				  struct mailimf_field ** result)
+{
+  struct mailimf_lazy_field * lazy_field;
+  struct mailimf_fields * parsed;
+  struct mailimf_field * field;
+  size_t cur_token;
+  int r;
+
+  if (indx >= fields->lz_count)
+    return MAILIMF_ERROR_INVAL;
+
+  lazy_field = &fields->lz_list[indx];
+  if (lazy_field->lf_field != NULL) {
+    * result = lazy_field->lf_field;
+    return MAILIMF_NO_ERROR;
+  }
+
+  /* the field is parsed alone, as it would be in the whole header */
+  cur_token = lazy_field->lf_begin;
+  r = mailimf_envelope_and_optional_fields_parse(fields->lz_data,
+      lazy_field->lf_end, &cur_token, &parsed);
+  if (r != MAILIMF_NO_ERROR)
+    return r;
+
+  if (clist_isempty(parsed->fld_list)) {
+    mailimf_fields_free(parsed);
+    return MAILIMF_ERROR_PARSE;
+  }
+
+  field = clist_content(clist_begin(parsed->fld_list));
+  clist_delete(parsed->fld_list, clist_begin(parsed->fld_list));
+  mailimf_fields_free(parsed);
+
+  lazy_field->lf_field = field;
+  * result = field;
+
+  return MAILIMF_NO_ERROR;
+}
+
+int mailimf_lazy_fields_find(struct mailimf_lazy_fields * fields,
+			     int type, struct mailimf_field ** result)
+{
+  unsigned int i;
+  int r;
+
+  for(i = 0 ; i < fields->lz_count ; i ++) {
+    struct mailimf_field * field;
+
+    if (fields->lz_list[i].lf_type != type)
+      continue;
+
+    r = mailimf_lazy_fields_get_field(fields, i, &field);
+    if (r != MAILIMF_NO_ERROR)
+      return r;
+
+    /* the content of the field may not be valid for its name */
+    if (field->fld_type == type) {
+      * result = field;
+      return MAILIMF_NO_ERROR;
+    }
+  }
+
+  * result = NULL;
+
+  return MAILIMF_NO_ERROR;
+}
+
+int mailimf_lazy_fields_get_fields(struct mailimf_lazy_fields * fields,
+				   struct mailimf_fields ** result)
+{
+  struct mailimf_fields * all;
+  clist * list;
+  unsigned int i;
+  int res;
+  int r;
+
+  for(i = 0 ; i < fields->lz_count ; i ++) {
+    struct mailimf_field * field;
+
+    r = mailimf_lazy_fields_get_field(fields, i, &field);
+    if (r != MAILIMF_NO_ERROR) {
+      res = r;
+      goto err;
+    }
+  }
+
+  list = clist_new();
+  if (list == NULL) {
+    res = MAILIMF_ERROR_MEMORY;
+    goto err;
+  }
+
+  for(i = 0 ; i < fields->lz_count ; i ++) {
+    r = clist_append(list, fields->lz_list[i].lf_field);
+    if (r < 0) {
+      res = MAILIMF_ERROR_MEMORY;
+      goto free_list;
+    }
+  }
+
+  all = mailimf_fields_new(list);
+  if (all == NULL) {
+    res = MAILIMF_ERROR_MEMORY;
+    goto free_list;
+  }
+
+  for(i = 0 ; i < fields->lz_count ; i ++)
+    fields->lz_list[i].lf_field = NULL;
+
+  * result = all;
+
+  return MAILIMF_NO_ERROR;
+
+ free_list:
+  clist_free(list);
+ err:
+  return res;
+}
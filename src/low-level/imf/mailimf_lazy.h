@@ -0,0 +1,136 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2011 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MAILIMF_LAZY_H
+
+#define MAILIMF_LAZY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <libetpan/mailimf_types.h>
+
+/*
+  mailimf_lazy_fields is a header where the fields are only located
+  when it is parsed. The content of a field is parsed the first time
+  it is requested.
+
+  It gives the same fields as mailimf_envelope_and_optional_fields_parse()
+  while the fields which are never requested are not parsed.
+
+  - lz_data is a copy of the header
+
+  - lz_length is the size of lz_data
+
+  - lz_list is the array of the fields, in the order of the header
+
+  - lz_count is the number of fields
+*/
+
+struct mailimf_lazy_field {
+  int lf_type;
+  size_t lf_begin;
+  size_t lf_end;
+  struct mailimf_field * lf_field;
+};
+
+struct mailimf_lazy_fields {
+  char * lz_data;
+  size_t lz_length;
+  struct mailimf_lazy_field * lz_list;
+  unsigned int lz_count;
+};
+
+/*
+  mailimf_lazy_fields_parse will locate the given header fields
+
+  @param message this is a string containing the header fields
+  @param length this is the size of the given string
+  @param indx this is a pointer to the start of the header fields in
+    the given string, (* indx) is modified to point at the end
+    of the parsed data
+  @param result the result of the parse operation is stored in
+    (* result)
+
+  @return MAILIMF_NO_ERROR on success, MAILIMF_ERROR_XXX on error
+*/
+
+LIBETPAN_EXPORT
+int mailimf_lazy_fields_parse(const char * message, size_t length,
+			      size_t * indx,
+			      struct mailimf_lazy_fields ** result);
+
+LIBETPAN_EXPORT
+void mailimf_lazy_fields_free(struct mailimf_lazy_fields * fields);
+
+/*
+  mailimf_lazy_fields_get_field will return the field at the given
+  position, parsed if it was not parsed yet. The field is still
+  owned by the mailimf_lazy_fields.
+
+  @return MAILIMF_NO_ERROR on success, MAILIMF_ERROR_XXX on error
+*/
+
+LIBETPAN_EXPORT
+int mailimf_lazy_fields_get_field(struct mailimf_lazy_fields * fields,
+				  unsigned int indx,
+				  struct mailimf_field ** result);
+
+/*
+  mailimf_lazy_fields_find will return the first field of the given
+  type (MAILIMF_FIELD_XXX), (* result) is NULL if there is no such
+  field. Only the fields whose name matches the type are parsed.
+
+  @return MAILIMF_NO_ERROR on success, MAILIMF_ERROR_XXX on error
+*/
+
+LIBETPAN_EXPORT
+int mailimf_lazy_fields_find(struct mailimf_lazy_fields * fields,
+			     int type, struct mailimf_field ** result);
+
+/*
+  mailimf_lazy_fields_get_fields will parse all the fields and
+  return them as a mailimf_fields structure. The parsed fields
+  are given to the caller and removed from the mailimf_lazy_fields.
+
+  @return MAILIMF_NO_ERROR on success, MAILIMF_ERROR_XXX on error
+*/
+
+LIBETPAN_EXPORT
+int mailimf_lazy_fields_get_fields(struct mailimf_lazy_fields * fields,
+				   struct mailimf_fields ** result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -35,41 +35,42 @@
 
 #include "mailimf_types.h"
 #include "mmapstring.h"
+#include "mailarena_private.h"
 #include <stdlib.h>
 
 void mailimf_atom_free(char * atom)
 {
-  free(atom);
+  mailarena_release(atom);
 }
 
 void mailimf_dot_atom_free(char * dot_atom)
 {
-  free(dot_atom);
+  mailarena_release(dot_atom);
 }
 
 void mailimf_dot_atom_text_free(char * dot_atom)
 {
-  free(dot_atom);
+  mailarena_release(dot_atom);
 }
 
 void mailimf_quoted_string_free(char * quoted_string)
 {
-  free(quoted_string);
+  mailarena_release(quoted_string);
 }
 
 void mailimf_word_free(char * word)
 {
-  free(word);
+  mailarena_release(word);
 }
 
 void mailimf_phrase_free(char * phrase)
 {
-  free(phrase);
+  mailarena_release(phrase);
 }
 
 void mailimf_unstructured_free(char * unstructured)
 {
-  free(unstructured);
+  mailarena_release(unstructured);
 }
 
 
@@ -80,7 +81,7 @@ mailimf_date_time_new(int dt_day, int dt_month, int dt_year,
 {
   struct mailimf_date_time * date_time;
 
-  date_time = malloc(sizeof(* date_time));
+  date_time = mailarena_malloc(sizeof(* date_time));
   if (date_time == NULL)
     return NULL;
 
@@ -98,7 +99,7 @@ mailimf_date_time_new(int dt_day, int dt_month, int dt_year,
 LIBETPAN_EXPORT
 void mailimf_date_time_free(struct mailimf_date_time * date_time)
 {
-  free(date_time);
+  mailarena_release(date_time);
 }
 
 
@@ -110,7 +111,7 @@ mailimf_address_new(int ad_type, struct mailimf_mailbox * ad_mailbox,
 {
   struct mailimf_address * address;
 
-  address = malloc(sizeof(* address));
+  address = mailarena_malloc(sizeof(* address));
   if (address == NULL)
     return NULL;
 
@@ -137,7 +138,7 @@ void mailimf_address_free(struct mailimf_address * address)
   case MAILIMF_ADDRESS_GROUP:
     mailimf_group_free(address->ad_data.ad_group);
   }
-  free(address);
+  mailarena_release(address);
 }
 
 LIBETPAN_EXPORT
@@ -146,7 +147,7 @@ mailimf_mailbox_new(char * mb_display_name, char * mb_addr_spec)
 {
   struct mailimf_mailbox * mb;
 
-  mb = malloc(sizeof(* mb));
+  mb = mailarena_malloc(sizeof(* mb));
   if (mb == NULL)
     return NULL;
 
@@ -162,12 +163,12 @@ void mailimf_mailbox_free(struct mailimf_mailbox * mailbox)
   if (mailbox->mb_display_name != NULL)
     mailimf_display_name_free(mailbox->mb_display_name);
   mailimf_addr_spec_free(mailbox->mb_addr_spec);
-  free(mailbox);
+  mailarena_release(mailbox);
 }
 
 void mailimf_angle_addr_free(char * angle_addr)
 {
-  free(angle_addr);
+  mailarena_release(angle_addr);
 }
 
 LIBETPAN_EXPORT
@@ -177,7 +178,7 @@ mailimf_group_new(char * grp_display_name,
 {
   struct mailimf_group * group;
 
-  group = malloc(sizeof(* group));
+  group = mailarena_malloc(sizeof(* group));
   if (group == NULL)
     return NULL;
 
@@ -193,7 +194,7 @@ void mailimf_group_free(struct mailimf_group * group)
   if (group->grp_mb_list)
     mailimf_mailbox_list_free(group->grp_mb_list);
   mailimf_display_name_free(group->grp_display_name);
-  free(group);
+  mailarena_release(group);
 }
 
 void mailimf_display_name_free(char * display_name)
@@ -207,7 +208,7 @@ mailimf_mailbox_list_new(clist * mb_list)
 {
   struct mailimf_mailbox_list * mbl;
 
-  mbl = malloc(sizeof(* mbl));
+  mbl = mailarena_malloc(sizeof(* mbl));
   if (mbl == NULL)
     return NULL;
 
@@ -221,7 +222,7 @@ void mailimf_mailbox_list_free(struct mailimf_mailbox_list * mb_list)
 {
   clist_foreach(mb_list->mb_list, (clist_func) mailimf_mailbox_free, NULL);
   clist_free(mb_list->mb_list);
-  free(mb_list);
+  mailarena_release(mb_list);
 }
 
 
@@ -231,7 +232,7 @@ mailimf_address_list_new(clist * ad_list)
 {
   struct mailimf_address_list * addr_list;
 
-  addr_list = malloc(sizeof(* addr_list));
+  addr_list = mailarena_malloc(sizeof(* addr_list));
   if (addr_list == NULL)
     return NULL;
 
@@ -245,28 +246,28 @@ void mailimf_address_list_free(struct mailimf_address_list * addr_list)
 {
   clist_foreach(addr_list->ad_list, (clist_func) mailimf_address_free, NULL);
   clist_free(addr_list->ad_list);
-  free(addr_list);
+  mailarena_release(addr_list);
 }
 
 
 void mailimf_addr_spec_free(char * addr_spec)
 {
-  free(addr_spec);
+  mailarena_release(addr_spec);
 }
 
 void mailimf_local_part_free(char * local_part)
 {
-  free(local_part);
+  mailarena_release(local_part);
 }
 
 void mailimf_domain_free(char * domain)
 {
-  free(domain);
+  mailarena_release(domain);
 }
 
 void mailimf_domain_literal_free(char * domain_literal)
 {
-  free(domain_literal);
+  mailarena_release(domain_literal);
 }
 
 LIBETPAN_EXPORT
@@ -276,7 +277,7 @@ mailimf_message_new(struct mailimf_fields * msg_fields,
 {
   struct mailimf_message * message;
   
-  message = malloc(sizeof(* message));
+  message = mailarena_malloc(sizeof(* message));
   if (message == NULL)
     return NULL;
 
@@ -291,7 +292,7 @@ void mailimf_message_free(struct mailimf_message * message)
 {
   mailimf_body_free(message->msg_body);
   mailimf_fields_free(message->msg_fields);
-  free(message);
+  mailarena_release(message);
 }
 
 LIBETPAN_EXPORT
@@ -299,7 +300,7 @@ struct mailimf_body * mailimf_body_new(const char * bd_text, size_t bd_size)
 {
   struct mailimf_body * body;
 
-  body = malloc(sizeof(* body));
+  body = mailarena_malloc(sizeof(* body));
   if (body == NULL)
     return NULL;
   body->bd_text = bd_text;
@@ -311,7 +312,7 @@ struct mailimf_body * mailimf_body_new(const char * bd_text, size_t bd_size)
 LIBETPAN_EXPORT
 void mailimf_body_free(struct mailimf_body * body)
 {
-  free(body);
+  mailarena_release(body);
 }
 
 
@@ -343,7 +344,7 @@ mailimf_field_new(int fld_type,
 {
   struct mailimf_field * field;
 
-  field = malloc(sizeof(* field));
+  field = mailarena_malloc(sizeof(* field));
   if (field == NULL)
     return NULL;
 
@@ -492,7 +493,7 @@ void mailimf_field_free(struct mailimf_field * field)
     break;
   }
   
-  free(field);
+  mailarena_release(field);
 }
 
 LIBETPAN_EXPORT
@@ -500,7 +501,7 @@ struct mailimf_fields * mailimf_fields_new(clist * fld_list)
 {
   struct mailimf_fields * fields;
 
-  fields = malloc(sizeof(* fields));
+  fields = mailarena_malloc(sizeof(* fields));
   if (fields == NULL)
     return NULL;
 
@@ -516,7 +517,7 @@ void mailimf_fields_free(struct mailimf_fields * fields)
     clist_foreach(fields->fld_list, (clist_func) mailimf_field_free, NULL);
     clist_free(fields->fld_list);
   }
-  free(fields);
+  mailarena_release(fields);
 }
 
 LIBETPAN_EXPORT
@@ -525,7 +526,7 @@ struct mailimf_orig_date * mailimf_orig_date_new(struct mailimf_date_time *
 {
   struct mailimf_orig_date * orig_date;
 
-  orig_date = malloc(sizeof(* orig_date));
+  orig_date = mailarena_malloc(sizeof(* orig_date));
   if (orig_date == NULL)
     return NULL;
 
@@ -539,7 +540,7 @@ void mailimf_orig_date_free(struct mailimf_orig_date * orig_date)
 {
   if (orig_date->dt_date_time != NULL)
     mailimf_date_time_free(orig_date->dt_date_time);
-  free(orig_date);
+  mailarena_release(orig_date);
 }
 
 LIBETPAN_EXPORT
@@ -548,7 +549,7 @@ mailimf_from_new(struct mailimf_mailbox_list * frm_mb_list)
 {
   struct mailimf_from * from;
 
-  from = malloc(sizeof(* from));
+  from = mailarena_malloc(sizeof(* from));
   if (from == NULL)
     return NULL;
   
@@ -562,7 +563,7 @@ void mailimf_from_free(struct mailimf_from * from)
 {
   if (from->frm_mb_list != NULL)
     mailimf_mailbox_list_free(from->frm_mb_list);
-  free(from);
+  mailarena_release(from);
 }
 
 LIBETPAN_EXPORT
@@ -570,7 +571,7 @@ struct mailimf_sender * mailimf_sender_new(struct mailimf_mailbox * snd_mb)
 {
   struct mailimf_sender * sender;
 
-  sender = malloc(sizeof(* sender));
+  sender = mailarena_malloc(sizeof(* sender));
   if (sender == NULL)
     return NULL;
 
@@ -584,7 +585,7 @@ void mailimf_sender_free(struct mailimf_sender * sender)
 {
   if (sender->snd_mb != NULL)
     mailimf_mailbox_free(sender->snd_mb);
-  free(sender);
+  mailarena_release(sender);
 }
 
 LIBETPAN_EXPORT
@@ -593,7 +594,7 @@ mailimf_reply_to_new(struct mailimf_address_list * rt_addr_list)
 {
   struct mailimf_reply_to * reply_to;
 
-  reply_to = malloc(sizeof(* reply_to));
+  reply_to = mailarena_malloc(sizeof(* reply_to));
   if (reply_to == NULL)
     return NULL;
 
@@ -607,7 +608,7 @@ void mailimf_reply_to_free(struct mailimf_reply_to * reply_to)
 {
   if (reply_to->rt_addr_list != NULL)
     mailimf_address_list_free(reply_to->rt_addr_list);
-  free(reply_to);
+  mailarena_release(reply_to);
 }
 
 LIBETPAN_EXPORT
@@ -615,7 +616,7 @@ struct mailimf_to * mailimf_to_new(struct mailimf_address_list * to_addr_list)
 {
   struct mailimf_to * to;
 
-  to = malloc(sizeof(* to));
+  to = mailarena_malloc(sizeof(* to));
   if (to == NULL)
     return NULL;
 
@@ -629,7 +630,7 @@ void mailimf_to_free(struct mailimf_to * to)
 {
   if (to->to_addr_list != NULL)
     mailimf_address_list_free(to->to_addr_list);
-  free(to);
+  mailarena_release(to);
 }
 
 LIBETPAN_EXPORT
@@ -637,7 +638,7 @@ struct mailimf_cc * mailimf_cc_new(struct mailimf_address_list * cc_addr_list)
 {
   struct mailimf_cc * cc;
 
-  cc = malloc(sizeof(* cc));
+  cc = mailarena_malloc(sizeof(* cc));
   if (cc == NULL)
     return NULL;
 
@@ -651,7 +652,7 @@ void mailimf_cc_free(struct mailimf_cc * cc)
 {
   if (cc->cc_addr_list != NULL)
     mailimf_address_list_free(cc->cc_addr_list);
-  free(cc);
+  mailarena_release(cc);
 }
 
 LIBETPAN_EXPORT
@@ -660,7 +661,7 @@ mailimf_bcc_new(struct mailimf_address_list * bcc_addr_list)
 {
   struct mailimf_bcc * bcc;
 
-  bcc = malloc(sizeof(* bcc));
+  bcc = mailarena_malloc(sizeof(* bcc));
   if (bcc == NULL)
     return NULL;
 
@@ -674,7 +675,7 @@ void mailimf_bcc_free(struct mailimf_bcc * bcc)
 {
   if (bcc->bcc_addr_list != NULL)
     mailimf_address_list_free(bcc->bcc_addr_list);
-  free(bcc);
+  mailarena_release(bcc);
 }
 
 LIBETPAN_EXPORT
@@ -682,7 +683,7 @@ struct mailimf_message_id * mailimf_message_id_new(char * mid_value)
 {
   struct mailimf_message_id * message_id;
 
-  message_id = malloc(sizeof(* message_id));
+  message_id = mailarena_malloc(sizeof(* message_id));
   if (message_id == NULL)
     return NULL;
 
@@ -696,7 +697,7 @@ void mailimf_message_id_free(struct mailimf_message_id * message_id)
 {
   if (message_id->mid_value != NULL)
     mailimf_msg_id_free(message_id->mid_value);
-  free(message_id);
+  mailarena_release(message_id);
 }
 
 LIBETPAN_EXPORT
@@ -704,7 +705,7 @@ struct mailimf_in_reply_to * mailimf_in_reply_to_new(clist * mid_list)
 {
   struct mailimf_in_reply_to * in_reply_to;
 
-  in_reply_to = malloc(sizeof(* in_reply_to));
+  in_reply_to = mailarena_malloc(sizeof(* in_reply_to));
   if (in_reply_to == NULL)
     return NULL;
 
@@ -719,7 +720,7 @@ void mailimf_in_reply_to_free(struct mailimf_in_reply_to * in_reply_to)
   clist_foreach(in_reply_to->mid_list,
 		(clist_func) mailimf_msg_id_free, NULL);
   clist_free(in_reply_to->mid_list);
-  free(in_reply_to);
+  mailarena_release(in_reply_to);
 }
 
 LIBETPAN_EXPORT
@@ -727,7 +728,7 @@ struct mailimf_references * mailimf_references_new(clist * mid_list)
 {
   struct mailimf_references * ref;
 
-  ref = malloc(sizeof(* ref));
+  ref = mailarena_malloc(sizeof(* ref));
   if (ref == NULL)
     return NULL;
 
@@ -742,32 +743,32 @@ void mailimf_references_free(struct mailimf_references * references)
   clist_foreach(references->mid_list,
       (clist_func) mailimf_msg_id_free, NULL);
   clist_free(references->mid_list);
-  free(references);
+  mailarena_release(references);
 }
 
 void mailimf_msg_id_free(char * msg_id)
 {
-  free(msg_id);
+  mailarena_release(msg_id);
 }
 
 void mailimf_id_left_free(char * id_left)
 {
-  free(id_left);
+  mailarena_release(id_left);
 }
 
 void mailimf_id_right_free(char * id_right)
 {
-  free(id_right);
+  mailarena_release(id_right);
 }
 
 void mailimf_no_fold_quote_free(char * nfq)
 {
-  free(nfq);
+  mailarena_release(nfq);
 }
 
 void mailimf_no_fold_literal_free(char * nfl)
 {
-  free(nfl);
+  mailarena_release(nfl);
 }
 
 LIBETPAN_EXPORT
@@ -775,7 +776,7 @@ struct mailimf_subject * mailimf_subject_new(char * sbj_value)
 {
   struct mailimf_subject * subject;
 
-  subject = malloc(sizeof(* subject));
+  subject = mailarena_malloc(sizeof(* subject));
   if (subject == NULL)
     return NULL;
 
@@ -788,7 +789,7 @@ LIBETPAN_EXPORT
 void mailimf_subject_free(struct mailimf_subject * subject)
 {
   mailimf_unstructured_free(subject->sbj_value);
-  free(subject);
+  mailarena_release(subject);
 }
 
 LIBETPAN_EXPORT
@@ -796,7 +797,7 @@ struct mailimf_comments * mailimf_comments_new(char * cm_value)
 {
   struct mailimf_comments * comments;
 
-  comments = malloc(sizeof(* comments));
+  comments = mailarena_malloc(sizeof(* comments));
   if (comments == NULL)
     return NULL;
 
@@ -809,7 +810,7 @@ LIBETPAN_EXPORT
 void mailimf_comments_free(struct mailimf_comments * comments)
 {
   mailimf_unstructured_free(comments->cm_value);
-  free(comments);
+  mailarena_release(comments);
 }
 
 LIBETPAN_EXPORT
@@ -817,7 +818,7 @@ struct mailimf_keywords * mailimf_keywords_new(clist * kw_list)
 {
   struct mailimf_keywords * keywords;
 
-  keywords = malloc(sizeof(* keywords));
+  keywords = mailarena_malloc(sizeof(* keywords));
   if (keywords == NULL)
     return NULL;
 
@@ -831,7 +832,7 @@ void mailimf_keywords_free(struct mailimf_keywords * keywords)
 {
   clist_foreach(keywords->kw_list, (clist_func) mailimf_phrase_free, NULL);
   clist_free(keywords->kw_list);
-  free(keywords);
+  mailarena_release(keywords);
 }
 
 LIBETPAN_EXPORT
@@ -840,7 +841,7 @@ mailimf_return_new(struct mailimf_path * ret_path)
 {
   struct mailimf_return * return_path;
 
-  return_path = malloc(sizeof(* return_path));
+  return_path = mailarena_malloc(sizeof(* return_path));
   if (return_path == NULL)
     return NULL;
 
@@ -853,7 +854,7 @@ LIBETPAN_EXPORT
 void mailimf_return_free(struct mailimf_return * return_path)
 {
   mailimf_path_free(return_path->ret_path);
-  free(return_path);
+  mailarena_release(return_path);
 }
 
 LIBETPAN_EXPORT
@@ -861,7 +862,7 @@ struct mailimf_path * mailimf_path_new(char * pt_addr_spec)
 {
   struct mailimf_path * path;
 
-  path = malloc(sizeof(* path));
+  path = mailarena_malloc(sizeof(* path));
   if (path == NULL)
     return NULL;
 
@@ -875,7 +876,7 @@ void mailimf_path_free(struct mailimf_path * path)
 {
   if (path->pt_addr_spec != NULL)
     mailimf_addr_spec_free(path->pt_addr_spec);
-  free(path);
+  mailarena_release(path);
 }
 
 LIBETPAN_EXPORT
@@ -884,7 +885,7 @@ mailimf_optional_field_new(char * fld_name, char * fld_value)
 {
   struct mailimf_optional_field * opt_field;
 
-  opt_field = malloc(sizeof(* opt_field));
+  opt_field = mailarena_malloc(sizeof(* opt_field));
   if (opt_field == NULL)
     return NULL;
   
@@ -899,10 +900,10 @@ void mailimf_optional_field_free(struct mailimf_optional_field * opt_field)
 {
   mailimf_field_name_free(opt_field->fld_name);
   mailimf_unstructured_free(opt_field->fld_value);
-  free(opt_field);
+  mailarena_release(opt_field);
 }
 
 void mailimf_field_name_free(char * field_name)
 {
-  free(field_name);
+  mailarena_release(field_name);
 }
@@ -47,6 +47,9 @@
 
 #include "mailimf.h"
 #include "timeutils.h"
+#include "mailarena_private.h"
+
+static char * fields_message_id_new(void);
 
 struct mailimf_mailbox_list *
 mailimf_mailbox_list_new_empty(void)
@@ -645,7 +648,7 @@ mailimf_resent_fields_new_with_data(struct mailimf_mailbox_list * from,
   if (date == NULL)
     goto err;
 
-  msg_id = mailimf_get_message_id();
+  msg_id = fields_message_id_new();
   if (msg_id == NULL)
     goto free_date;
 
@@ -657,7 +660,7 @@ mailimf_resent_fields_new_with_data(struct mailimf_mailbox_list * from,
   return fields;
 
  free_msg_id:
-  free(msg_id);
+  mailarena_release(msg_id);
  free_date:
   mailimf_date_time_free(date);
  err:
@@ -1241,7 +1244,7 @@ mailimf_fields_new_with_data(struct mailimf_mailbox_list * from,
   if (date == NULL)
     goto err;
 
-  msg_id = mailimf_get_message_id();
+  msg_id = fields_message_id_new();
   if (msg_id == NULL)
     goto free_date;
 
@@ -1257,7 +1260,7 @@ mailimf_fields_new_with_data(struct mailimf_mailbox_list * from,
   return fields;
 
  free_msg_id:
-  free(msg_id);
+  mailarena_release(msg_id);
  free_date:
   mailimf_date_time_free(date);
  err:
@@ -1268,9 +1271,8 @@ mailimf_fields_new_with_data(struct mailimf_mailbox_list * from,
 
 #define MAX_MESSAGE_ID 512
 
-char * mailimf_get_message_id(void)
+static void generate_message_id(char * id, size_t size)
 {
-  char id[MAX_MESSAGE_ID];
   time_t now;
   char name[MAX_MESSAGE_ID];
   long value;
@@ -1279,8 +1281,25 @@ char * mailimf_get_message_id(void)
   value = random();
 
   gethostname(name, MAX_MESSAGE_ID);
-  snprintf(id, MAX_MESSAGE_ID, "etPan.%lx.%lx.%x@%s",
+  snprintf(id, size, "etPan.%lx.%lx.%x@%s",
 	   (long) now, value, getpid(), name);
+}
+
+/* the message-id goes into a mailimf_fields tree */
+static char * fields_message_id_new(void)
+{
+  char id[MAX_MESSAGE_ID];
+
+  generate_message_id(id, sizeof(id));
+
+  return mailarena_strdup(id);
+}
+
+char * mailimf_get_message_id(void)
+{
+  char id[MAX_MESSAGE_ID];
+
+  generate_message_id(id, sizeof(id));
 
   return strdup(id);
 }
@@ -1457,7 +1476,7 @@ mailimf_single_fields_new(struct mailimf_fields * fields)
 {
   struct mailimf_single_fields * single_fields;
 
-  single_fields = malloc(sizeof(struct mailimf_single_fields));
+  single_fields = mailarena_malloc(sizeof(struct mailimf_single_fields));
   if (single_fields == NULL)
     goto err;
 
@@ -1472,7 +1491,7 @@ mailimf_single_fields_new(struct mailimf_fields * fields)
 void mailimf_single_fields_free(struct mailimf_single_fields *
                                 single_fields)
 {
-  free(single_fields);
+  mailarena_release(single_fields);
 }
 
 struct mailimf_field * mailimf_field_new_custom(char * name, char * value)
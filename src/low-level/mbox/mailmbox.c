@@ -61,6 +61,7 @@
 
 #include "mmapstring.h"
 #include "mailmbox_parse.h"
+#include "mailmbox_index.h"
 #include "maillock.h"
 
 #if 0
@@ -1154,20 +1155,16 @@ int mailmbox_copy_msg(struct mailmbox_folder * dest_folder,
   return res;
 }
 
-static int mailmbox_expunge_to_file_no_lock(char * dest_filename, int dest_fd,
-    struct mailmbox_folder * folder,
-    size_t * result_size)
+/* size of the messages from first_index once the mailbox is expunged */
+
+static size_t get_expunged_size(struct mailmbox_folder * folder,
+    unsigned int first_index)
 {
-  int r;
-  int res;
-  unsigned long i;
-  size_t cur_offset;
-  char * dest;
+  unsigned int i;
   size_t size;
-  UNUSED(dest_filename);
 
   size = 0;
-  for(i = 0 ; i < carray_count(folder->mb_tab) ; i ++) {
+  for(i = first_index ; i < carray_count(folder->mb_tab) ; i ++) {
     struct mailmbox_msg_info * info;
 
     info = carray_get(folder->mb_tab, i);
@@ -1196,6 +1193,23 @@ static int mailmbox_expunge_to_file_no_lock(char * dest_filename, int dest_fd,
     }
   }
 
+  return size;
+}
+
+static int mailmbox_expunge_to_file_no_lock(char * dest_filename, int dest_fd,
+    struct mailmbox_folder * folder,
+    size_t * result_size)
+{
+  int r;
+  int res;
+  unsigned long i;
+  size_t cur_offset;
+  char * dest;
+  size_t size;
+  UNUSED(dest_filename);
+
+  size = get_expunged_size(folder, 0);
+
   r = ftruncate(dest_fd, size);
   if (r < 0) {
     res = MAILMBOX_ERROR_FILE;
@@ -1319,9 +1333,460 @@ static int copy_to_old_file(char * source_filename,
   return res;
 }
 
-int mailmbox_expunge_no_lock(struct mailmbox_folder * folder)
+/*
+  expunge in place
+
+  When the first change is in the second half of the mailbox, only the
+  messages after it are written again, through a journal:
+  - the new content of the end of the mailbox is written to
+    .<mailbox name>.etpan-journal and synced, renaming it is the commit;
+  - the content is then copied to the mailbox which is truncated
+    and synced, and the journal is removed.
+  A journal left by an interrupted expunge is applied again when the
+  mailbox is opened.
+*/
+
+#define JOURNAL_SUFFIX ".etpan-journal"
+#define JOURNAL_MAGIC 0x6d626f786a726e6cULL
+#define JOURNAL_COPY_SIZE (64 * 1024)
+
+enum {
+  JOURNAL_HEADER_MAGIC,
+  JOURNAL_HEADER_DEV,
+  JOURNAL_HEADER_INO,
+  JOURNAL_HEADER_OFFSET,
+  JOURNAL_HEADER_OLD_SIZE,
+  JOURNAL_HEADER_NEW_SIZE,
+  JOURNAL_HEADER_FIELD_COUNT
+};
+
+static int journal_write_message(FILE * f, struct mailmbox_folder * folder,
+    struct mailmbox_msg_info * info)
+{
+  size_t len;
+
+  len = info->msg_start_len + info->msg_headers_len;
+  if (fwrite(folder->mb_mapping + info->msg_start, 1, len, f) != len)
+    return -1;
+
+  if (!folder->mb_no_uid) {
+    if (!info->msg_written_uid) {
+#ifdef CRLF_BADNESS
+      if (fprintf(f, UID_HEADER " %i\r\n", info->msg_uid) < 0)
+        return -1;
+#else
+      if (fprintf(f, UID_HEADER " %i\n", info->msg_uid) < 0)
+        return -1;
+#endif
+    }
+  }
+
+  len = info->msg_size - (info->msg_start_len + info->msg_headers_len)
+    + info->msg_padding;
+  if (fwrite(folder->mb_mapping + info->msg_headers + info->msg_headers_len,
+          1, len, f) != len)
+    return -1;
+
+  return 0;
+}
+
+/* the rename of the journal is durable once its directory is synced */
+
+static int journal_sync_dir(const char * journal_filename)
+{
+  char dirname[PATH_MAX];
+  char * p;
+  int fd;
+  int r;
+
+  strncpy(dirname, journal_filename, sizeof(dirname));
+  dirname[sizeof(dirname) - 1] = '\0';
+
+  p = strrchr(dirname, '/');
+  if (p == NULL)
+    strcpy(dirname, ".");
+  else if (p == dirname)
+    p[1] = '\0';
+  else
+    * p = '\0';
+
+  fd = open(dirname, O_RDONLY);
+  if (fd < 0)
+    return -1;
+
+  r = fsync(fd);
+  close(fd);
+  if (r < 0)
+    return -1;
+
+  return 0;
+}
+
+static int journal_write(struct mailmbox_folder * folder,
+    const char * journal_filename, unsigned int first_index)
 {
   char tmp_file[PATH_MAX];
+  uint64_t header[JOURNAL_HEADER_FIELD_COUNT];
+  struct stat stat_info;
+  struct mailmbox_msg_info * first;
+  mode_t old_mask;
+  unsigned int i;
+  FILE * f;
+  int fd;
+  int r;
+  int res;
+
+  r = fstat(folder->mb_fd, &stat_info);
+  if (r < 0) {
+    res = MAILMBOX_ERROR_FILE;
+    goto err;
+  }
+
+  first = carray_get(folder->mb_tab, first_index);
+
+  header[JOURNAL_HEADER_MAGIC] = JOURNAL_MAGIC;
+  header[JOURNAL_HEADER_DEV] = (uint64_t) stat_info.st_dev;
+  header[JOURNAL_HEADER_INO] = (uint64_t) stat_info.st_ino;
+  header[JOURNAL_HEADER_OFFSET] = first->msg_start;
+  header[JOURNAL_HEADER_OLD_SIZE] = folder->mb_mapping_size;
+  header[JOURNAL_HEADER_NEW_SIZE] = first->msg_start +
+    get_expunged_size(folder, first_index);
+
+  r = snprintf(tmp_file, sizeof(tmp_file), "%sXXXXXX", journal_filename);
+  if ((r < 0) || ((size_t) r >= sizeof(tmp_file))) {
+    res = MAILMBOX_ERROR_FILE;
+    goto err;
+  }
+
+  old_mask = umask(0077);
+  fd = mkstemp(tmp_file);
+  umask(old_mask);
+  if (fd < 0) {
+    res = MAILMBOX_ERROR_TEMPORARY_FILE;
+    goto err;
+  }
+
+  f = fdopen(fd, "w");
+  if (f == NULL) {
+    close(fd);
+    res = MAILMBOX_ERROR_FILE;
+    goto unlink;
+  }
+
+  if (fwrite(header, sizeof(header), 1, f) != 1) {
+    res = MAILMBOX_ERROR_FILE;
+    goto close;
+  }
+
+  for(i = first_index ; i < carray_count(folder->mb_tab) ; i ++) {
+    struct mailmbox_msg_info * info;
+
+    info = carray_get(folder->mb_tab, i);
+    if (info->msg_deleted)
+      continue;
+
+    r = journal_write_message(f, folder, info);
+    if (r < 0) {
+      res = MAILMBOX_ERROR_FILE;
+      goto close;
+    }
+  }
+
+  if ((fflush(f) != 0) || (fsync(fileno(f)) < 0)) {
+    res = MAILMBOX_ERROR_FILE;
+    goto close;
+  }
+  fclose(f);
+
+  r = rename(tmp_file, journal_filename);
+  if (r < 0) {
+    res = MAILMBOX_ERROR_FILE;
+    goto unlink;
+  }
+
+  r = journal_sync_dir(journal_filename);
+  if (r < 0) {
+    unlink(journal_filename);
+    res = MAILMBOX_ERROR_FILE;
+    goto err;
+  }
+
+  return MAILMBOX_NO_ERROR;
+
+ close:
+  fclose(f);
+ unlink:
+  unlink(tmp_file);
+ err:
+  return res;
+}
+
+/*
+  journal_apply() returns MAILMBOX_ERROR_INVAL when the journal
+  does not belong to the mailbox.
+*/
+
+static int journal_apply(int fd, const char * journal_filename)
+{
+  uint64_t header[JOURNAL_HEADER_FIELD_COUNT];
+  struct stat stat_info;
+  char * buffer;
+  int journal_fd;
+  size_t offset;
+  size_t new_size;
+  size_t left;
+  off_t old_size;
+  off_t size;
+  ssize_t read_bytes;
+  int r;
+  int res;
+
+  r = fstat(fd, &stat_info);
+  if (r < 0) {
+    res = MAILMBOX_ERROR_FILE;
+    goto err;
+  }
+
+  journal_fd = open(journal_filename, O_RDONLY);
+  if (journal_fd < 0) {
+    res = MAILMBOX_ERROR_FILE;
+    goto err;
+  }
+
+  read_bytes = read(journal_fd, header, sizeof(header));
+  if (read_bytes != sizeof(header)) {
+    res = MAILMBOX_ERROR_INVAL;
+    goto close;
+  }
+
+  offset = header[JOURNAL_HEADER_OFFSET];
+  new_size = header[JOURNAL_HEADER_NEW_SIZE];
+  old_size = header[JOURNAL_HEADER_OLD_SIZE];
+  size = stat_info.st_size;
+
+  /*
+    the mailbox still has its old size, or an interrupted apply
+    has written it up to a size inside the journalled range
+  */
+  if ((header[JOURNAL_HEADER_MAGIC] != JOURNAL_MAGIC) ||
+      (header[JOURNAL_HEADER_DEV] != (uint64_t) stat_info.st_dev) ||
+      (header[JOURNAL_HEADER_INO] != (uint64_t) stat_info.st_ino) ||
+      (offset > new_size) || (offset > (uint64_t) old_size) ||
+      ((size != old_size) && (size != (off_t) new_size) &&
+          ((size < old_size) || (size > (off_t) new_size)))) {
+    res = MAILMBOX_ERROR_INVAL;
+    goto close;
+  }
+
+  buffer = malloc(JOURNAL_COPY_SIZE);
+  if (buffer == NULL) {
+    res = MAILMBOX_ERROR_MEMORY;
+    goto close;
+  }
+
+  if (lseek(fd, offset, SEEK_SET) == (off_t) -1) {
+    res = MAILMBOX_ERROR_FILE;
+    goto free;
+  }
+
+  left = new_size - offset;
+  while (left > 0) {
+    size_t count;
+    ssize_t written;
+
+    count = left;
+    if (count > JOURNAL_COPY_SIZE)
+      count = JOURNAL_COPY_SIZE;
+
+    read_bytes = read(journal_fd, buffer, count);
+    if (read_bytes <= 0) {
+      res = MAILMBOX_ERROR_FILE;
+      goto free;
+    }
+
+    written = write(fd, buffer, read_bytes);
+    if (written != read_bytes) {
+      res = MAILMBOX_ERROR_FILE;
+      goto free;
+    }
+
+    left -= read_bytes;
+  }
+
+  r = ftruncate(fd, new_size);
+  if (r < 0) {
+    res = MAILMBOX_ERROR_FILE;
+    goto free;
+  }
+
+  r = fsync(fd);
+  if (r < 0) {
+    res = MAILMBOX_ERROR_FILE;
+    goto free;
+  }
+
+  free(buffer);
+  close(journal_fd);
+
+  return MAILMBOX_NO_ERROR;
+
+ free:
+  free(buffer);
+ close:
+  close(journal_fd);
+ err:
+  return res;
+}
+
+/* apply the journal of an interrupted expunge, the file must be locked */
+
+static void mailmbox_journal_recover(struct mailmbox_folder * folder)
+{
+  char journal_filename[PATH_MAX];
+  struct stat stat_info;
+  int r;
+
+  if (mailmbox_get_sidecar_filename(folder, JOURNAL_SUFFIX,
+          journal_filename, sizeof(journal_filename)) < 0)
+    return;
+
+  r = stat(journal_filename, &stat_info);
+  if (r < 0)
+    return;
+
+  r = journal_apply(folder->mb_fd, journal_filename);
+  if ((r == MAILMBOX_NO_ERROR) || (r == MAILMBOX_ERROR_INVAL)) {
+    unlink(journal_filename);
+    mailmbox_index_remove(folder);
+  }
+}
+
+/*
+  mailmbox_expunge_in_place_no_lock() returns MAILMBOX_ERROR_TEMPORARY_FILE
+  when the journal could not be written, the mailbox is then unchanged.
+*/
+
+static int mailmbox_expunge_in_place_no_lock(struct mailmbox_folder * folder,
+    unsigned int first_index)
+{
+  char journal_filename[PATH_MAX];
+  struct mailmbox_msg_info * first;
+  size_t cur_token;
+  unsigned int i;
+  int r;
+  int res;
+
+  if (mailmbox_get_sidecar_filename(folder, JOURNAL_SUFFIX,
+          journal_filename, sizeof(journal_filename)) < 0) {
+    res = MAILMBOX_ERROR_FILE;
+    goto err;
+  }
+
+  r = journal_write(folder, journal_filename, first_index);
+  if (r != MAILMBOX_NO_ERROR) {
+    res = MAILMBOX_ERROR_TEMPORARY_FILE;
+    goto err;
+  }
+
+  first = carray_get(folder->mb_tab, first_index);
+  cur_token = first->msg_start;
+
+  /* the index may describe the old content */
+  mailmbox_index_remove(folder);
+
+  mailmbox_unmap(folder);
+
+  r = journal_apply(folder->mb_fd, journal_filename);
+  if (r != MAILMBOX_NO_ERROR) {
+    /*
+      the journal is applied again when the mailbox is opened,
+      the content may have partly moved meanwhile
+    */
+    if (mailmbox_map(folder) == MAILMBOX_NO_ERROR)
+      mailmbox_parse(folder);
+    res = MAILMBOX_ERROR_FILE;
+    goto err;
+  }
+
+  unlink(journal_filename);
+
+  r = mailmbox_map(folder);
+  if (r != MAILMBOX_NO_ERROR) {
+    res = r;
+    goto err;
+  }
+
+  /* the messages before the first change did not move */
+
+  for(i = first_index ; i < carray_count(folder->mb_tab) ; i ++) {
+    struct mailmbox_msg_info * info;
+    chashdatum key;
+
+    info = carray_get(folder->mb_tab, i);
+
+    key.data = &info->msg_uid;
+    key.len = sizeof(info->msg_uid);
+    chash_delete(folder->mb_hash, &key, NULL);
+
+    mailmbox_msg_info_free(info);
+  }
+  carray_set_size(folder->mb_tab, first_index);
+
+  r = mailmbox_parse_additionnal(folder, &cur_token);
+  if (r != MAILMBOX_NO_ERROR) {
+    res = r;
+    goto err;
+  }
+
+  mailmbox_index_save(folder, 0);
+
+  return MAILMBOX_NO_ERROR;
+
+ err:
+  return res;
+}
+
+static int expunge_threshold_reached(struct mailmbox_folder * folder)
+{
+  size_t deleted_size;
+  unsigned int i;
+
+  if ((folder->mb_expunge_threshold_count == 0) &&
+      (folder->mb_expunge_threshold_size == 0))
+    return TRUE;
+
+  if ((folder->mb_expunge_threshold_count != 0) &&
+      (folder->mb_deleted_count >= folder->mb_expunge_threshold_count))
+    return TRUE;
+
+  if (folder->mb_expunge_threshold_size != 0) {
+    deleted_size = 0;
+    for(i = 0 ; i < carray_count(folder->mb_tab) ; i ++) {
+      struct mailmbox_msg_info * info;
+
+      info = carray_get(folder->mb_tab, i);
+      if (info->msg_deleted)
+        deleted_size += info->msg_size + info->msg_padding;
+    }
+
+    if (deleted_size >= folder->mb_expunge_threshold_size)
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+void mailmbox_set_expunge_threshold(struct mailmbox_folder * folder,
+    unsigned int deleted_count, size_t deleted_size)
+{
+  folder->mb_expunge_threshold_count = deleted_count;
+  folder->mb_expunge_threshold_size = deleted_size;
+}
+
+static int expunge_no_lock(struct mailmbox_folder * folder, int force)
+{
+  char tmp_file[PATH_MAX];
+  unsigned int first_index;
   int r;
   int res;
   int dest_fd;
@@ -1337,6 +1802,51 @@ int mailmbox_expunge_no_lock(struct mailmbox_folder * folder)
     return MAILMBOX_NO_ERROR;
   }
 
+  /*
+    when only deleted messages are pending, removing them is deferred
+    until the threshold is reached or the mailbox is closed.
+    UIDs that are not written yet are always written.
+  */
+  if (!force && ((folder->mb_written_uid >= folder->mb_max_uid) ||
+          folder->mb_no_uid) && !expunge_threshold_reached(folder))
+    return MAILMBOX_NO_ERROR;
+
+  /* first message that will be written again */
+  for(first_index = 0 ; first_index < carray_count(folder->mb_tab) ;
+      first_index ++) {
+    struct mailmbox_msg_info * info;
+
+    info = carray_get(folder->mb_tab, first_index);
+    if (info->msg_deleted)
+      break;
+    if (!folder->mb_no_uid && !info->msg_written_uid)
+      break;
+  }
+
+  if (first_index > 0) {
+    struct mailmbox_msg_info * first;
+
+    first = NULL;
+    if (first_index < carray_count(folder->mb_tab))
+      first = carray_get(folder->mb_tab, first_index);
+
+    /* the beginning of the mailbox is kept as is */
+    if ((first == NULL) || (first->msg_start > folder->mb_mapping_size / 2)) {
+      if (first == NULL)
+        goto done;
+
+      r = mailmbox_expunge_in_place_no_lock(folder, first_index);
+      if (r == MAILMBOX_NO_ERROR)
+        goto done;
+
+      /* without a journal, the whole mailbox is written again */
+      if (r != MAILMBOX_ERROR_TEMPORARY_FILE) {
+        res = r;
+        goto err;
+      }
+    }
+  }
+
   snprintf(tmp_file, PATH_MAX, "%sXXXXXX", folder->mb_filename);
   old_mask = umask(0077);
   dest_fd = mkstemp(tmp_file);
@@ -1386,6 +1896,9 @@ int mailmbox_expunge_no_lock(struct mailmbox_folder * folder)
     mailmbox_close(folder);
   }
 
+  /* offsets have changed */
+  mailmbox_index_remove(folder);
+
   r = mailmbox_open(folder);
   if (r != MAILMBOX_NO_ERROR) {
     res = r;
@@ -1404,6 +1917,7 @@ int mailmbox_expunge_no_lock(struct mailmbox_folder * folder)
     goto err;
   }
 
+ done:
   mailmbox_timestamp(folder);
 
   folder->mb_changed = FALSE;
@@ -1418,7 +1932,12 @@ int mailmbox_expunge_no_lock(struct mailmbox_folder * folder)
   return res;
 }
 
-int mailmbox_expunge(struct mailmbox_folder * folder)
+int mailmbox_expunge_no_lock(struct mailmbox_folder * folder)
+{
+  return expunge_no_lock(folder, FALSE);
+}
+
+static int expunge(struct mailmbox_folder * folder, int force)
 {
   int r;
   int res;
@@ -1429,7 +1948,7 @@ int mailmbox_expunge(struct mailmbox_folder * folder)
     goto err;
   }
 
-  r = mailmbox_expunge_no_lock(folder);
+  r = expunge_no_lock(folder, force);
   res = r;
 
   mailmbox_write_unlock(folder);
@@ -1437,6 +1956,11 @@ int mailmbox_expunge(struct mailmbox_folder * folder)
   return res;
 }
 
+int mailmbox_expunge(struct mailmbox_folder * folder)
+{
+  return expunge(folder, FALSE);
+}
+
 int mailmbox_delete_msg(struct mailmbox_folder * folder, uint32_t uid)
 {
   struct mailmbox_msg_info * info;
@@ -1481,6 +2005,7 @@ int mailmbox_delete_msg(struct mailmbox_folder * folder, uint32_t uid)
   INIT of MBOX
 
   - open file
+  - apply the journal of an interrupted expunge
   - map the file
 
   - lock the file
@@ -1518,6 +2043,15 @@ int mailmbox_init(const char * filename,
     goto free;
   }
 
+  /* finish an expunge that was interrupted */
+  if (!folder->mb_read_only) {
+    r = mailmbox_write_lock(folder);
+    if (r == MAILMBOX_NO_ERROR) {
+      mailmbox_journal_recover(folder);
+      mailmbox_write_unlock(folder);
+    }
+  }
+
   r = mailmbox_map(folder);
   if (r != MAILMBOX_NO_ERROR) {
     res = r;
@@ -1559,7 +2093,7 @@ int mailmbox_init(const char * filename,
 void mailmbox_done(struct mailmbox_folder * folder)
 {
   if (!folder->mb_read_only)
-    mailmbox_expunge(folder);
+    expunge(folder, TRUE);
 
   mailmbox_unmap(folder);
   mailmbox_close(folder);
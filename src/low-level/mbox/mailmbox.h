@@ -75,8 +75,27 @@ int mailmbox_copy_msg(struct mailmbox_folder * dest_folder,
 
 int mailmbox_expunge(struct mailmbox_folder * folder);
 
+/*
+  mailmbox_set_expunge_threshold() defers the removal of deleted
+  messages from the file: mailmbox_expunge() only compacts the mailbox
+  when at least deleted_count messages or deleted_size bytes are
+  deleted. Until then, deleted messages are only marked in memory.
+  0 disables a limit, the default is to compact on every expunge.
+  mailmbox_done() always compacts.
+*/
+
+void mailmbox_set_expunge_threshold(struct mailmbox_folder * folder,
+    unsigned int deleted_count, size_t deleted_size);
+
 int mailmbox_delete_msg(struct mailmbox_folder * folder, uint32_t uid);
 
+/*
+  mailmbox_set_parse_thread_count() sets the number of threads used to
+  parse large mailboxes, the default is 1.
+*/
+
+void mailmbox_set_parse_thread_count(unsigned int count);
+
 int mailmbox_init(const char * filename,
 		  int force_readonly,
 		  int force_no_uid,
@@ -0,0 +1,463 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2011 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include "mailmbox_index.h"
+
+#ifdef WIN32
+#	include "win_etpan.h"
+#else
+#	include <unistd.h>
+#endif
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mailmbox.h"
+
+/*
+  The index is a header followed by one entry per message, all fields
+  are 64 bits integers in host byte order. An index written on a host
+  with a different byte order is rejected because of the magic number.
+
+  Only the part of the mailbox before the last indexed message
+  (indexed size) is described, the index is used when the mailbox
+  is the same file, when a message still begins at the indexed size
+  and when the data right before it did not change.
+*/
+
+#define INDEX_SUFFIX ".etpan-index"
+#define INDEX_MAGIC 0x6d626f78696e6478ULL
+#define INDEX_VERSION 1
+#define INDEX_CHECKSUM_SIZE 4096
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+enum {
+  HEADER_MAGIC,
+  HEADER_VERSION,
+  HEADER_DEV,
+  HEADER_INO,
+  HEADER_SIZE,
+  HEADER_MTIME,
+  HEADER_INDEXED_SIZE,
+  HEADER_CHECKSUM,
+  HEADER_COUNT,
+  HEADER_FIELD_COUNT
+};
+
+enum {
+  ENTRY_START,
+  ENTRY_START_LEN,
+  ENTRY_HEADERS,
+  ENTRY_HEADERS_LEN,
+  ENTRY_BODY,
+  ENTRY_BODY_LEN,
+  ENTRY_SIZE,
+  ENTRY_PADDING,
+  ENTRY_UID,
+  ENTRY_FIELD_COUNT
+};
+
+int mailmbox_get_sidecar_filename(struct mailmbox_folder * folder,
+    const char * suffix, char * filename, size_t size)
+{
+  const char * name;
+  int r;
+
+  name = strrchr(folder->mb_filename, '/');
+  if (name == NULL)
+    r = snprintf(filename, size, ".%s%s", folder->mb_filename, suffix);
+  else
+    r = snprintf(filename, size, "%.*s/.%s%s",
+        (int) (name - folder->mb_filename), folder->mb_filename, name + 1,
+        suffix);
+  if ((r < 0) || ((size_t) r >= size))
+    return -1;
+
+  return 0;
+}
+
+/* FNV-1a */
+
+static uint64_t get_checksum(const char * data, size_t size)
+{
+  uint64_t hash;
+  size_t i;
+
+  hash = 0xcbf29ce484222325ULL;
+  for(i = 0 ; i < size ; i ++) {
+    hash ^= (unsigned char) data[i];
+    hash *= 0x100000001b3ULL;
+  }
+
+  return hash;
+}
+
+static uint64_t get_indexed_checksum(struct mailmbox_folder * folder,
+    size_t indexed_size)
+{
+  size_t begin;
+
+  if (indexed_size > INDEX_CHECKSUM_SIZE)
+    begin = indexed_size - INDEX_CHECKSUM_SIZE;
+  else
+    begin = 0;
+
+  return get_checksum(folder->mb_mapping + begin, indexed_size - begin);
+}
+
+static int read_full(int fd, void * buf, size_t count)
+{
+  char * p;
+  ssize_t r;
+
+  p = buf;
+  while (count > 0) {
+    r = read(fd, p, count);
+    if (r <= 0)
+      return -1;
+    p += r;
+    count -= r;
+  }
+
+  return 0;
+}
+
+static int write_full(int fd, const void * buf, size_t count)
+{
+  const char * p;
+  ssize_t r;
+
+  p = buf;
+  while (count > 0) {
+    r = write(fd, p, count);
+    if (r <= 0)
+      return -1;
+    p += r;
+    count -= r;
+  }
+
+  return 0;
+}
+
+/* the range [begin, begin + len] lies inside [first, last] */
+
+static int range_is_inside(uint64_t begin, uint64_t len,
+    uint64_t first, uint64_t last)
+{
+  return (begin >= first) && (begin <= last) && (len <= last - begin);
+}
+
+static int entry_is_valid(uint64_t * entry, size_t next, size_t indexed_size)
+{
+  uint64_t end;
+
+  /* messages must follow each other */
+  if ((entry[ENTRY_START] != next) ||
+      (entry[ENTRY_SIZE] > indexed_size - next) ||
+      (entry[ENTRY_PADDING] > indexed_size - next - entry[ENTRY_SIZE]))
+    return FALSE;
+  end = next + entry[ENTRY_SIZE];
+
+  /* start <= headers <= body, all within the message */
+  if (!range_is_inside(entry[ENTRY_START], entry[ENTRY_START_LEN],
+          next, end) ||
+      !range_is_inside(entry[ENTRY_HEADERS], entry[ENTRY_HEADERS_LEN],
+          next, end) ||
+      !range_is_inside(entry[ENTRY_BODY], entry[ENTRY_BODY_LEN],
+          entry[ENTRY_HEADERS], end))
+    return FALSE;
+
+  return TRUE;
+}
+
+int mailmbox_index_load(struct mailmbox_folder * folder, size_t * indx)
+{
+  char filename[PATH_MAX];
+  struct stat stat_info;
+  uint64_t header[HEADER_FIELD_COUNT];
+  uint64_t * entries;
+  size_t indexed_size;
+  size_t count;
+  size_t next;
+  size_t i;
+  int fd;
+  int r;
+  int res;
+
+  if (mailmbox_get_sidecar_filename(folder, INDEX_SUFFIX,
+      filename, sizeof(filename)) < 0) {
+    res = MAILMBOX_ERROR_FILE;
+    goto err;
+  }
+
+  r = fstat(folder->mb_fd, &stat_info);
+  if (r < 0) {
+    res = MAILMBOX_ERROR_FILE;
+    goto err;
+  }
+
+  fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    res = MAILMBOX_ERROR_FILE;
+    goto err;
+  }
+
+  r = read_full(fd, header, sizeof(header));
+  if (r < 0) {
+    res = MAILMBOX_ERROR_FILE;
+    goto close;
+  }
+
+  if ((header[HEADER_MAGIC] != INDEX_MAGIC) ||
+      (header[HEADER_VERSION] != INDEX_VERSION) ||
+      (header[HEADER_DEV] != (uint64_t) stat_info.st_dev) ||
+      (header[HEADER_INO] != (uint64_t) stat_info.st_ino)) {
+    res = MAILMBOX_ERROR_FILE;
+    goto close;
+  }
+
+  /* the last indexed message must still begin at the indexed size */
+  indexed_size = (size_t) header[HEADER_INDEXED_SIZE];
+  if ((header[HEADER_INDEXED_SIZE] != (uint64_t) indexed_size) ||
+      (indexed_size + 5 >= folder->mb_mapping_size) ||
+      (strncmp(folder->mb_mapping + indexed_size, "From ", 5) != 0)) {
+    res = MAILMBOX_ERROR_FILE;
+    goto close;
+  }
+
+  if ((header[HEADER_SIZE] != (uint64_t) folder->mb_mapping_size) ||
+      (header[HEADER_MTIME] != (uint64_t) stat_info.st_mtime)) {
+    if (get_indexed_checksum(folder, indexed_size) !=
+        header[HEADER_CHECKSUM]) {
+      res = MAILMBOX_ERROR_FILE;
+      goto close;
+    }
+  }
+
+  count = (size_t) header[HEADER_COUNT];
+  if ((header[HEADER_COUNT] != (uint64_t) count) || (count > indexed_size)) {
+    res = MAILMBOX_ERROR_FILE;
+    goto close;
+  }
+
+  entries = malloc(count * ENTRY_FIELD_COUNT * sizeof(* entries));
+  if (entries == NULL) {
+    res = MAILMBOX_ERROR_MEMORY;
+    goto close;
+  }
+
+  r = read_full(fd, entries, count * ENTRY_FIELD_COUNT * sizeof(* entries));
+  if (r < 0) {
+    res = MAILMBOX_ERROR_FILE;
+    goto free;
+  }
+
+  next = 0;
+  for(i = 0 ; i < count ; i ++) {
+    uint64_t * entry;
+    uint32_t uid;
+    chashdatum key;
+    chashdatum data;
+
+    entry = entries + i * ENTRY_FIELD_COUNT;
+
+    if (!entry_is_valid(entry, next, indexed_size)) {
+      res = MAILMBOX_ERROR_FILE;
+      goto free;
+    }
+    next += entry[ENTRY_SIZE] + entry[ENTRY_PADDING];
+
+    uid = (uint32_t) entry[ENTRY_UID];
+    if (uid != 0) {
+      key.data = &uid;
+      key.len = sizeof(uid);
+      r = chash_get(folder->mb_hash, &key, &data);
+      if (r == 0) {
+        res = MAILMBOX_ERROR_FILE;
+        goto free;
+      }
+    }
+
+    r = mailmbox_msg_info_update(folder,
+        entry[ENTRY_START], entry[ENTRY_START_LEN],
+        entry[ENTRY_HEADERS], entry[ENTRY_HEADERS_LEN],
+        entry[ENTRY_BODY], entry[ENTRY_BODY_LEN],
+        entry[ENTRY_SIZE], entry[ENTRY_PADDING], uid);
+    if (r != MAILMBOX_NO_ERROR) {
+      res = r;
+      goto free;
+    }
+  }
+
+  if (next != indexed_size) {
+    res = MAILMBOX_ERROR_FILE;
+    goto free;
+  }
+
+  free(entries);
+  close(fd);
+
+  * indx = indexed_size;
+
+  return MAILMBOX_NO_ERROR;
+
+ free:
+  free(entries);
+ close:
+  close(fd);
+ err:
+  return res;
+}
+
+void mailmbox_index_save(struct mailmbox_folder * folder, size_t indexed_size)
+{
+  char filename[PATH_MAX];
+  char tmp_file[PATH_MAX];
+  struct stat stat_info;
+  struct mailmbox_msg_info * last;
+  uint64_t * buffer;
+  uint64_t * entry;
+  size_t count;
+  size_t buffer_size;
+  size_t i;
+  mode_t old_mask;
+  int fd;
+  int r;
+
+  count = carray_count(folder->mb_tab);
+  if (count < 2)
+    return;
+
+  last = carray_get(folder->mb_tab, count - 1);
+  if (last->msg_start == indexed_size)
+    return;
+  count --;
+
+  if (mailmbox_get_sidecar_filename(folder, INDEX_SUFFIX,
+      filename, sizeof(filename)) < 0)
+    return;
+
+  r = fstat(folder->mb_fd, &stat_info);
+  if (r < 0)
+    return;
+
+  buffer_size = (HEADER_FIELD_COUNT + count * ENTRY_FIELD_COUNT) *
+    sizeof(* buffer);
+  buffer = malloc(buffer_size);
+  if (buffer == NULL)
+    return;
+
+  buffer[HEADER_MAGIC] = INDEX_MAGIC;
+  buffer[HEADER_VERSION] = INDEX_VERSION;
+  buffer[HEADER_DEV] = (uint64_t) stat_info.st_dev;
+  buffer[HEADER_INO] = (uint64_t) stat_info.st_ino;
+  buffer[HEADER_SIZE] = folder->mb_mapping_size;
+  buffer[HEADER_MTIME] = (uint64_t) stat_info.st_mtime;
+  buffer[HEADER_INDEXED_SIZE] = last->msg_start;
+  buffer[HEADER_CHECKSUM] = get_indexed_checksum(folder, last->msg_start);
+  buffer[HEADER_COUNT] = count;
+
+  entry = buffer + HEADER_FIELD_COUNT;
+  for(i = 0 ; i < count ; i ++) {
+    struct mailmbox_msg_info * info;
+
+    info = carray_get(folder->mb_tab, i);
+
+    entry[ENTRY_START] = info->msg_start;
+    entry[ENTRY_START_LEN] = info->msg_start_len;
+    entry[ENTRY_HEADERS] = info->msg_headers;
+    entry[ENTRY_HEADERS_LEN] = info->msg_headers_len;
+    entry[ENTRY_BODY] = info->msg_body;
+    entry[ENTRY_BODY_LEN] = info->msg_body_len;
+    entry[ENTRY_SIZE] = info->msg_size;
+    entry[ENTRY_PADDING] = info->msg_padding;
+    /* temporary UIDs are attributed again when loading */
+    if (info->msg_written_uid)
+      entry[ENTRY_UID] = info->msg_uid;
+    else
+      entry[ENTRY_UID] = 0;
+
+    entry += ENTRY_FIELD_COUNT;
+  }
+
+  r = snprintf(tmp_file, sizeof(tmp_file), "%sXXXXXX", filename);
+  if ((r < 0) || ((size_t) r >= sizeof(tmp_file)))
+    goto free;
+
+  old_mask = umask(0077);
+  fd = mkstemp(tmp_file);
+  umask(old_mask);
+  if (fd < 0)
+    goto free;
+
+  r = write_full(fd, buffer, buffer_size);
+  close(fd);
+  if (r < 0)
+    goto unlink;
+
+  r = rename(tmp_file, filename);
+  if (r < 0)
+    goto unlink;
+
+  free(buffer);
+
+  return;
+
+ unlink:
+  unlink(tmp_file);
+ free:
+  free(buffer);
+}
+
+void mailmbox_index_remove(struct mailmbox_folder * folder)
+{
+  char filename[PATH_MAX];
+
+  if (mailmbox_get_sidecar_filename(folder, INDEX_SUFFIX,
+      filename, sizeof(filename)) < 0)
+    return;
+
+  unlink(filename);
+}
@@ -0,0 +1,79 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2011 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MAILMBOX_INDEX_H
+
+#define MAILMBOX_INDEX_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "mailmbox_types.h"
+
+/*
+  The index is stored next to the mailbox in a file named
+  .<mailbox name>.etpan-index.
+  It records the parsed messages of the mailbox except the last one,
+  whose size changes when messages are appended.
+*/
+
+/*
+  mailmbox_index_load() fills the message table of an empty folder
+  from the index and stores in (* indx) the offset from which the
+  mailbox must still be parsed.
+  MAILMBOX_ERROR_FILE is returned when there is no index or when it
+  does not match the mailbox, the message table must then be flushed
+  before doing a full parse.
+*/
+
+int mailmbox_index_load(struct mailmbox_folder * folder, size_t * indx);
+
+/*
+  mailmbox_index_save() writes the index if the parsed messages
+  go further than indexed_size. Errors are ignored since the index
+  is only a cache.
+*/
+
+void mailmbox_index_save(struct mailmbox_folder * folder, size_t indexed_size);
+
+void mailmbox_index_remove(struct mailmbox_folder * folder);
+
+/* name of a file stored next to the mailbox, .<mailbox name><suffix> */
+
+int mailmbox_get_sidecar_filename(struct mailmbox_folder * folder,
+    const char * suffix, char * filename, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
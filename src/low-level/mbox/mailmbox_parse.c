@@ -40,11 +40,15 @@
 #include "mailmbox_parse.h"
 
 #include "mailmbox.h"
+#include "mailmbox_index.h"
 
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <string.h>
 #include <stdlib.h>
+#ifdef LIBETPAN_REENTRANT
+#include <pthread.h>
+#endif
 
 #define UID_HEADER "X-LibEtPan-UID:"
 
@@ -117,6 +121,36 @@ mailmbox_fields_parse(char * str, size_t length,
   return MAILMBOX_NO_ERROR;
 }
 
+/* position of the next c or length */
+
+static inline size_t skip_to_char(const char * str, size_t length,
+    size_t indx, char c)
+{
+  const char * p;
+
+  p = memchr(str + indx, c, length - indx);
+  if (p == NULL)
+    return length;
+
+  return p - str;
+}
+
+/* position of the next CR or LF or length */
+
+static inline size_t skip_to_line_break(const char * str, size_t length,
+    size_t indx)
+{
+  size_t lf;
+  const char * cr;
+
+  lf = skip_to_char(str, length, indx, '\n');
+  cr = memchr(str + indx, '\r', lf - indx);
+  if (cr == NULL)
+    return lf;
+
+  return cr - str;
+}
+
 enum {
   IN_MAIL,
   FIRST_CR,
@@ -177,12 +211,7 @@ mailmbox_single_parse(char * str, size_t length,
 
   if (cur_token + 5 < length) {
     if (strncmp(str + cur_token, "From ", 5) == 0) {
-      cur_token += 5;
-      while (str[cur_token] != '\n') {
-        cur_token ++;
-        if (cur_token >= length)
-          break;
-      }
+      cur_token = skip_to_char(str, length, cur_token + 5, '\n');
       if (cur_token < length) {
         cur_token ++;
         headers = cur_token;
@@ -234,6 +263,13 @@ mailmbox_single_parse(char * str, size_t length,
       break;
     }
 
+    if ((state == IN_MAIL) && (cur_token != body)) {
+      /* only a line break can change the state */
+      cur_token = skip_to_line_break(str, length, cur_token);
+      if (cur_token >= length)
+        continue;
+    }
+
     switch(state) {
     case IN_MAIL:
       switch(str[cur_token]) {
@@ -411,12 +447,7 @@ mailmbox_single_parse(char * str, size_t length,
 }
 
 
-int
-mailmbox_parse_additionnal(struct mailmbox_folder * folder,
-			   size_t * indx)
-{
-  size_t cur_token;
-
+struct mailmbox_parsed_msg {
   size_t start;
   size_t start_len;
   size_t headers;
@@ -426,8 +457,304 @@ mailmbox_parse_additionnal(struct mailmbox_folder * folder,
   size_t size;
   size_t padding;
   uint32_t uid;
+};
+
+static inline int
+mailmbox_parsed_msg_parse(char * str, size_t length, size_t * indx,
+    struct mailmbox_parsed_msg * msg)
+{
+  return mailmbox_single_parse(str, length, indx,
+      &msg->start, &msg->start_len,
+      &msg->headers, &msg->headers_len,
+      &msg->body, &msg->body_len,
+      &msg->size, &msg->padding, &msg->uid);
+}
+
+static int mailmbox_parsed_msg_add(struct mailmbox_folder * folder,
+    struct mailmbox_parsed_msg * msg,
+    uint32_t * p_max_uid, uint32_t * p_first_index)
+{
+  struct mailmbox_msg_info * info;
+  chashdatum key;
+  chashdatum data;
+  uint32_t uid;
+  int r;
+
+  uid = msg->uid;
+
+  key.data = &uid;
+  key.len = sizeof(uid);
+    
+  r = chash_get(folder->mb_hash, &key, &data);
+  if (r == 0) {
+    info = data.data;
+      
+    if (!info->msg_written_uid) {
+      /* some new mail has been written and override an
+         existing temporary UID */
+        
+      chash_delete(folder->mb_hash, &key, NULL);
+      info->msg_uid = 0;
+
+      if (info->msg_index < * p_first_index)
+        * p_first_index = info->msg_index;
+    }
+    else
+      uid = 0;
+  }
+
+  if (uid > * p_max_uid)
+    * p_max_uid = uid;
+
+  return mailmbox_msg_info_update(folder,
+      msg->start, msg->start_len, msg->headers, msg->headers_len,
+      msg->body, msg->body_len, msg->size, msg->padding, uid);
+}
+
+static unsigned int parse_thread_count = 1;
+
+void mailmbox_set_parse_thread_count(unsigned int count)
+{
+  if (count == 0)
+    count = 1;
+  parse_thread_count = count;
+}
+
+#ifdef LIBETPAN_REENTRANT
+
+/*
+  parallel parsing
+
+  The mapping is split in chunks that begin with a "\n\nFrom "
+  separator and that are parsed by one thread each. Parsing a message
+  only depends on where it begins, so the messages of a chunk are kept
+  as soon as the messages parsed before it end on the beginning of one
+  of them. Otherwise, the messages are parsed again from the end of the
+  previous ones until this happens.
+*/
+
+#define PARSE_CHUNK_MIN_SIZE (16 * 1024 * 1024)
+
+struct parse_chunk {
+  char * str;
+  size_t length;
+  size_t begin;
+  size_t limit;
+  size_t end;
+  struct mailmbox_parsed_msg * msg_tab;
+  size_t msg_count;
+  size_t msg_alloc;
+  int error;
+  pthread_t thread;
+  int thread_started;
+};
+
+static void parse_chunk(struct parse_chunk * chunk)
+{
+  size_t cur_token;
+  int r;
+
+  cur_token = chunk->begin;
+  while (cur_token < chunk->limit) {
+    struct mailmbox_parsed_msg msg;
+
+    r = mailmbox_parsed_msg_parse(chunk->str, chunk->length,
+        &cur_token, &msg);
+    if (r != MAILMBOX_NO_ERROR)
+      break;
+
+    if (chunk->msg_count == chunk->msg_alloc) {
+      struct mailmbox_parsed_msg * msg_tab;
+      size_t msg_alloc;
+
+      msg_alloc = chunk->msg_alloc * 2;
+      if (msg_alloc == 0)
+        msg_alloc = 1024;
+      msg_tab = realloc(chunk->msg_tab, msg_alloc * sizeof(* msg_tab));
+      if (msg_tab == NULL) {
+        chunk->error = MAILMBOX_ERROR_MEMORY;
+        break;
+      }
+      chunk->msg_tab = msg_tab;
+      chunk->msg_alloc = msg_alloc;
+    }
+    chunk->msg_tab[chunk->msg_count] = msg;
+    chunk->msg_count ++;
+  }
+
+  chunk->end = cur_token;
+}
+
+static void * parse_chunk_thread(void * data)
+{
+  parse_chunk(data);
+
+  return NULL;
+}
+
+/* position of the 'F' of the next "\n\nFrom " or length */
+
+static size_t find_separator(const char * str, size_t length, size_t indx)
+{
+  while (indx + 7 <= length) {
+    indx = skip_to_char(str, length, indx, '\n');
+    if (indx + 7 > length)
+      break;
+
+    if ((str[indx + 1] == '\n') &&
+        (strncmp(str + indx + 2, "From ", 5) == 0))
+      return indx + 2;
+
+    indx ++;
+  }
+
+  return length;
+}
+
+static int parse_parallel(struct mailmbox_folder * folder,
+    size_t * indx, unsigned int count,
+    uint32_t * p_max_uid, uint32_t * p_first_index)
+{
+  struct parse_chunk * chunk_tab;
+  unsigned int chunk_count;
+  size_t length;
+  size_t begin;
+  size_t cur_token;
+  unsigned int i;
+  int r;
+  int res;
+
+  length = folder->mb_mapping_size;
+
+  chunk_tab = calloc(count, sizeof(* chunk_tab));
+  if (chunk_tab == NULL) {
+    res = MAILMBOX_ERROR_MEMORY;
+    goto err;
+  }
+
+  chunk_count = 0;
+  begin = * indx;
+  for(i = 0 ; i < count ; i ++) {
+    struct parse_chunk * chunk;
+    size_t limit;
+
+    if (i == count - 1) {
+      limit = length;
+    }
+    else {
+      limit = * indx + (length - * indx) / count * (i + 1);
+      if (limit <= begin)
+        limit = begin + 1;
+      limit = find_separator(folder->mb_mapping, length, limit);
+    }
+
+    chunk = &chunk_tab[chunk_count];
+    chunk->str = folder->mb_mapping;
+    chunk->length = length;
+    chunk->begin = begin;
+    chunk->limit = limit;
+    chunk_count ++;
+
+    begin = limit;
+    if (begin >= length)
+      break;
+  }
+
+  for(i = 1 ; i < chunk_count ; i ++) {
+    r = pthread_create(&chunk_tab[i].thread, NULL,
+        parse_chunk_thread, &chunk_tab[i]);
+    if (r == 0)
+      chunk_tab[i].thread_started = 1;
+  }
+
+  parse_chunk(&chunk_tab[0]);
+
+  for(i = 1 ; i < chunk_count ; i ++) {
+    if (chunk_tab[i].thread_started)
+      pthread_join(chunk_tab[i].thread, NULL);
+    else
+      parse_chunk(&chunk_tab[i]);
+  }
+
+  /* add the messages in order */
+
+  cur_token = * indx;
+  for(i = 0 ; i < chunk_count ; i ++) {
+    struct parse_chunk * chunk;
+    size_t msg_index;
+
+    chunk = &chunk_tab[i];
+    if (chunk->error != MAILMBOX_NO_ERROR) {
+      res = chunk->error;
+      goto free;
+    }
+
+    msg_index = 0;
+    while (1) {
+      struct mailmbox_parsed_msg msg;
+
+      while ((msg_index < chunk->msg_count) &&
+          (chunk->msg_tab[msg_index].start < cur_token))
+        msg_index ++;
+
+      if ((msg_index < chunk->msg_count) &&
+          (chunk->msg_tab[msg_index].start == cur_token)) {
+        for( ; msg_index < chunk->msg_count ; msg_index ++) {
+          r = mailmbox_parsed_msg_add(folder, &chunk->msg_tab[msg_index],
+              p_max_uid, p_first_index);
+          if (r != MAILMBOX_NO_ERROR) {
+            res = r;
+            goto free;
+          }
+        }
+        cur_token = chunk->end;
+        break;
+      }
+
+      if (cur_token >= chunk->end)
+        break;
+
+      r = mailmbox_parsed_msg_parse(folder->mb_mapping, length,
+          &cur_token, &msg);
+      if (r != MAILMBOX_NO_ERROR)
+        break;
+
+      r = mailmbox_parsed_msg_add(folder, &msg, p_max_uid, p_first_index);
+      if (r != MAILMBOX_NO_ERROR) {
+        res = r;
+        goto free;
+      }
+    }
+  }
+
+  for(i = 0 ; i < chunk_count ; i ++)
+    free(chunk_tab[i].msg_tab);
+  free(chunk_tab);
+
+  * indx = cur_token;
+
+  return MAILMBOX_NO_ERROR;
+
+ free:
+  for(i = 0 ; i < chunk_count ; i ++)
+    free(chunk_tab[i].msg_tab);
+  free(chunk_tab);
+ err:
+  return res;
+}
+
+#endif
+
+int
+mailmbox_parse_additionnal(struct mailmbox_folder * folder,
+			   size_t * indx)
+{
+  size_t cur_token;
   int r;
   int res;
+#ifdef LIBETPAN_REENTRANT
+  unsigned int thread_count;
+#endif
 
   uint32_t max_uid;
   uint32_t first_index;
@@ -486,21 +813,40 @@ mailmbox_parse_additionnal(struct mailmbox_folder * folder,
   }
   carray_set_size(folder->mb_tab, j);
 
-  /* parse content */
+  /* messages loaded from the index have no temporary UID yet */
 
   first_index = j;
+  for(i = 0 ; i < j ; i ++) {
+    struct mailmbox_msg_info * info;
+
+    info = carray_get(folder->mb_tab, i);
+    if (info->msg_uid == 0) {
+      first_index = i;
+      break;
+    }
+  }
+
+  /* parse content */
+
+#ifdef LIBETPAN_REENTRANT
+  thread_count = parse_thread_count;
+  if (thread_count > (folder->mb_mapping_size - cur_token) / PARSE_CHUNK_MIN_SIZE)
+    thread_count = (folder->mb_mapping_size - cur_token) / PARSE_CHUNK_MIN_SIZE;
+  if ((cur_token < folder->mb_mapping_size) && (thread_count > 1)) {
+    r = parse_parallel(folder, &cur_token, thread_count,
+        &max_uid, &first_index);
+    if (r != MAILMBOX_NO_ERROR) {
+      res = r;
+      goto err;
+    }
+  }
+#endif
 
   while (1) {
-    struct mailmbox_msg_info * info;
-    chashdatum key;
-    chashdatum data;
+    struct mailmbox_parsed_msg msg;
     
-    r = mailmbox_single_parse(folder->mb_mapping, folder->mb_mapping_size,
-			      &cur_token,
-			      &start, &start_len,
-			      &headers, &headers_len,
-			      &body, &body_len,
-			      &size, &padding, &uid);
+    r = mailmbox_parsed_msg_parse(folder->mb_mapping,
+        folder->mb_mapping_size, &cur_token, &msg);
     if (r == MAILMBOX_NO_ERROR) {
       /* do nothing */
     }
@@ -511,33 +857,7 @@ mailmbox_parse_additionnal(struct mailmbox_folder * folder,
       goto err;
     }
     
-    key.data = &uid;
-    key.len = sizeof(uid);
-    
-    r = chash_get(folder->mb_hash, &key, &data);
-    if (r == 0) {
-      info = data.data;
-      
-      if (!info->msg_written_uid) {
-	/* some new mail has been written and override an
-	   existing temporary UID */
-        
-	chash_delete(folder->mb_hash, &key, NULL);
-	info->msg_uid = 0;
-
-	if (info->msg_index < first_index)
-	  first_index = info->msg_index;
-      }
-      else
-        uid = 0;
-    }
-
-    if (uid > max_uid)
-      max_uid = uid;
-
-    r = mailmbox_msg_info_update(folder,
-				 start, start_len, headers, headers_len,
-				 body, body_len, size, padding, uid);
+    r = mailmbox_parsed_msg_add(folder, &msg, &max_uid, &first_index);
     if (r != MAILMBOX_NO_ERROR) {
       res = r;
       goto err;
@@ -605,11 +925,19 @@ int mailmbox_parse(struct mailmbox_folder * folder)
   int r;
   int res;
   size_t cur_token;
+  size_t indexed_size;
 
   flush_uid(folder);
   
   cur_token = 0;
 
+  r = mailmbox_index_load(folder, &cur_token);
+  if (r != MAILMBOX_NO_ERROR) {
+    flush_uid(folder);
+    cur_token = 0;
+  }
+  indexed_size = cur_token;
+
   r = mailmbox_parse_additionnal(folder, &cur_token);
 
   if (r != MAILMBOX_NO_ERROR) {
@@ -617,6 +945,8 @@ int mailmbox_parse(struct mailmbox_folder * folder)
     goto err;
   }
 
+  mailmbox_index_save(folder, indexed_size);
+
   return MAILMBOX_NO_ERROR;
 
  err:
@@ -214,6 +214,9 @@ struct mailmbox_folder * mailmbox_folder_new(const char * mb_filename)
   folder->mb_written_uid = 0;
   folder->mb_max_uid = 0;
 
+  folder->mb_expunge_threshold_count = 0;
+  folder->mb_expunge_threshold_size = 0;
+
   folder->mb_hash = chash_new(CHASH_DEFAULTSIZE, CHASH_COPYKEY);
   if (folder->mb_hash == NULL)
     goto free;
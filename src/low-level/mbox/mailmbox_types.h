@@ -82,6 +82,10 @@ struct mailmbox_folder {
 
   chash * mb_hash;
   carray * mb_tab;
+
+  /* see mailmbox_set_expunge_threshold() */
+  unsigned int mb_expunge_threshold_count;
+  size_t mb_expunge_threshold_size;
 };
 
 struct mailmbox_folder * mailmbox_folder_new(const char * mb_filename);
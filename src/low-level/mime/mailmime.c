@@ -62,6 +62,7 @@
 #include "mailmime_types.h"
 #include "mailmime_disposition.h"
 #include "mailimf.h"
+#include "mailarena_private.h"
 
 #ifndef TRUE
 #define TRUE 1
@@ -238,7 +239,7 @@ int mailmime_content_parse(const char * message, size_t length,
     break;
 
   case MAILIMF_ERROR_PARSE:
-    subtype = strdup("unknown");
+    subtype = mailarena_strdup("unknown");
     break;
 
   default:
@@ -455,83 +456,27 @@ x  entity-headers := [ content CRLF ]
                     *( MIME-extension-field CRLF )
 		    */
 
-enum {
-  FIELD_STATE_START,
-  FIELD_STATE_T,
-  FIELD_STATE_D,
-  FIELD_STATE_L
-};
-
 static int guess_field_type(char * name)
 {
-  int state;
-
-  if (* name == 'M')
+  switch (mailimf_header_name_lookup(name, strlen(name))) {
+  case MAILIMF_HEADER_MIME_TYPE:
+    return MAILMIME_FIELD_TYPE;
+  case MAILIMF_HEADER_MIME_TRANSFER_ENCODING:
+    return MAILMIME_FIELD_TRANSFER_ENCODING;
+  case MAILIMF_HEADER_MIME_ID:
+    return MAILMIME_FIELD_ID;
+  case MAILIMF_HEADER_MIME_DESCRIPTION:
+    return MAILMIME_FIELD_DESCRIPTION;
+  case MAILIMF_HEADER_MIME_VERSION:
     return MAILMIME_FIELD_VERSION;
-
-  if (strncasecmp(name, "Content-", 8) != 0)
+  case MAILIMF_HEADER_MIME_DISPOSITION:
+    return MAILMIME_FIELD_DISPOSITION;
+  case MAILIMF_HEADER_MIME_LANGUAGE:
+    return MAILMIME_FIELD_LANGUAGE;
+  case MAILIMF_HEADER_MIME_LOCATION:
+    return MAILMIME_FIELD_LOCATION;
+  default:
     return MAILMIME_FIELD_NONE;
-
-  name += 8;
-
-  state = FIELD_STATE_START;
-
-  while (1) {
-    
-    switch (state) {
-        
-      case FIELD_STATE_START:
-        switch ((char) toupper((unsigned char) * name)) {
-          case 'T':
-            state = FIELD_STATE_T;
-            break;
-          case 'I':
-            return MAILMIME_FIELD_ID;
-          case 'D':
-            state = FIELD_STATE_D;
-            break;
-          case 'L':
-            state = FIELD_STATE_L;
-            break;
-          default:
-            return MAILMIME_FIELD_NONE;
-        }
-        break;
-        
-      case FIELD_STATE_T:
-        switch ((char) toupper((unsigned char) * name)) {
-          case 'Y':
-            return MAILMIME_FIELD_TYPE;
-          case 'R':
-            return MAILMIME_FIELD_TRANSFER_ENCODING;
-          default:
-            return MAILMIME_FIELD_NONE;
-        }
-        break;
-        
-      case FIELD_STATE_D:
-        switch ((char) toupper((unsigned char) * name)) {
-          case 'E':
-            return MAILMIME_FIELD_DESCRIPTION;
-          case 'I':
-            return MAILMIME_FIELD_DISPOSITION;
-          default:
-            return MAILMIME_FIELD_NONE;
-        }
-        break;
-        
-      case FIELD_STATE_L:
-        switch ((char) toupper((unsigned char) * name)) {
-          case 'A':
-            return MAILMIME_FIELD_LANGUAGE;
-          case 'O':
-            return MAILMIME_FIELD_LOCATION;
-          default:
-            return MAILMIME_FIELD_NONE;
-        }
-        break;
-    }
-    name ++;
   }
 }
 
@@ -573,32 +518,24 @@ mailmime_field_parse(struct mailimf_optional_field * field,
 
   switch (guessed_type) {
   case MAILMIME_FIELD_TYPE:
-    if (strcasecmp(name, "Content-Type") != 0)
-      return MAILIMF_ERROR_PARSE;
     r = mailmime_content_parse(value, strlen(value), &cur_token, &content);
     if (r != MAILIMF_NO_ERROR)
       return r;
     break;
 
   case MAILMIME_FIELD_TRANSFER_ENCODING:
-    if (strcasecmp(name, "Content-Transfer-Encoding") != 0)
-      return MAILIMF_ERROR_PARSE;
     r = mailmime_encoding_parse(value, strlen(value), &cur_token, &encoding);
     if (r != MAILIMF_NO_ERROR)
       return r;
     break;
 
   case MAILMIME_FIELD_ID:
-    if (strcasecmp(name, "Content-ID") != 0)
-      return MAILIMF_ERROR_PARSE;
     r = mailmime_id_parse(value, strlen(value), &cur_token, &id);
     if (r != MAILIMF_NO_ERROR)
       return r;
     break;
 
   case MAILMIME_FIELD_DESCRIPTION:
-    if (strcasecmp(name, "Content-Description") != 0)
-      return MAILIMF_ERROR_PARSE;
     r = mailmime_description_parse(value, strlen(value),
 				   &cur_token, &description);
     if (r != MAILIMF_NO_ERROR)
@@ -606,16 +543,12 @@ mailmime_field_parse(struct mailimf_optional_field * field,
     break;
 
   case MAILMIME_FIELD_VERSION:
-    if (strcasecmp(name, "MIME-Version") != 0)
-      return MAILIMF_ERROR_PARSE;
     r = mailmime_version_parse(value, strlen(value), &cur_token, &version);
     if (r != MAILIMF_NO_ERROR)
       return r;
     break;
 
   case MAILMIME_FIELD_DISPOSITION:
-    if (strcasecmp(name, "Content-Disposition") != 0)
-      return MAILIMF_ERROR_PARSE;
     r = mailmime_disposition_parse(value, strlen(value),
 				   &cur_token, &disposition);
     if (r != MAILIMF_NO_ERROR)
@@ -623,16 +556,12 @@ mailmime_field_parse(struct mailimf_optional_field * field,
     break;
 
   case MAILMIME_FIELD_LANGUAGE:
-    if (strcasecmp(name, "Content-Language") != 0)
-      return MAILIMF_ERROR_PARSE;
     r = mailmime_language_parse(value, strlen(value), &cur_token, &language);
     if (r != MAILIMF_NO_ERROR)
       return r;
     break;
 
   case MAILMIME_FIELD_LOCATION:
-    if (strcasecmp(name, "Content-Location") != 0)
-      return MAILIMF_ERROR_PARSE;
     r = mailmime_location_parse(value, strlen(value), &cur_token, &location);
     if (r != MAILIMF_NO_ERROR)
       return r;
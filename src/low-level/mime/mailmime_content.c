@@ -45,6 +45,7 @@
 #include "mailmime.h"
 #include "mailmime_types.h"
 #include "mmapstring.h"
+#include "mailarena_private.h"
 
 #ifndef TRUE
 #define TRUE 1
@@ -1582,35 +1583,39 @@ int mailmime_get_section(struct mailmime * mime,
 /* ************************************************************************* */
 /* MIME part decoding */
 
-static inline signed char get_base64_value(char ch)
-{
-  if ((ch >= 'A') && (ch <= 'Z'))
-    return ch - 'A';
-  if ((ch >= 'a') && (ch <= 'z'))
-    return ch - 'a' + 26;
-  if ((ch >= '0') && (ch <= '9'))
-    return ch - '0' + 52;
-  switch (ch) {
-  case '+':
-    return 62;
-  case '/':
-    return 63;
-  case '=': /* base64 padding */
-    return -1;
-  default:
-    return -1;
-  }
-}
+/*
+  value of each base64 character, -1 for the characters that are
+  skipped (line breaks, padding, garbage)
+*/
+
+static const signed char base64_values[256] = {
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63,
+  52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1,
+  -1,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+  15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, -1,
+  -1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+  41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+};
 
 int mailmime_base64_body_parse(const char * message, size_t length,
 			       size_t * indx, char ** result,
 			       size_t * result_len)
 {
   size_t cur_token;
-  char chunk[4];
+  signed char chunk[4];
   int chunk_index;
-  char out[3];
   MMAPString * mmapstr;
+  unsigned char * out;
   int res;
   int r;
   size_t written;
@@ -1624,22 +1629,47 @@ int mailmime_base64_body_parse(const char * message, size_t length,
   chunk_index = 0;
   written = 0;
 
-  mmapstr = mmap_string_sized_new((length - cur_token) * 3 / 4);
+  /* the output is never larger than 3 bytes for 4 input bytes */
+  mmapstr = mmap_string_sized_new((length - cur_token) / 4 * 3 + 3);
   if (mmapstr == NULL) {
     res = MAILIMF_ERROR_MEMORY;
     goto err;
   }
+  out = (unsigned char *) mmapstr->str;
 
   while (1) {
     signed char value;
 
+    /* fast path : decode groups of 4 valid characters */
+    if (chunk_index == 0) {
+      while (cur_token + 4 <= length) {
+        signed char v0;
+        signed char v1;
+        signed char v2;
+        signed char v3;
+
+        v0 = base64_values[(unsigned char) message[cur_token]];
+        v1 = base64_values[(unsigned char) message[cur_token + 1]];
+        v2 = base64_values[(unsigned char) message[cur_token + 2]];
+        v3 = base64_values[(unsigned char) message[cur_token + 3]];
+        if ((v0 | v1 | v2 | v3) < 0)
+          break;
+
+        out[written] = (v0 << 2) | (v1 >> 4);
+        out[written + 1] = (v1 << 4) | (v2 >> 2);
+        out[written + 2] = (v2 << 6) | v3;
+        written += 3;
+        cur_token += 4;
+      }
+    }
+
     value = -1;
     while (value == -1) {
 
       if (cur_token >= length)
 	break;
 
-      value = get_base64_value(message[cur_token]);
+      value = base64_values[(unsigned char) message[cur_token]];
       cur_token ++;
     }
 
@@ -1650,9 +1680,10 @@ int mailmime_base64_body_parse(const char * message, size_t length,
     chunk_index ++;
 
     if (chunk_index == 4) {
-      out[0] = (chunk[0] << 2) | (chunk[1] >> 4);
-      out[1] = (chunk[1] << 4) | (chunk[2] >> 2);
-      out[2] = (chunk[2] << 6) | (chunk[3]);
+      out[written] = (chunk[0] << 2) | (chunk[1] >> 4);
+      out[written + 1] = (chunk[1] << 4) | (chunk[2] >> 2);
+      out[written + 2] = (chunk[2] << 6) | (chunk[3]);
+      written += 3;
 
       chunk[0] = 0;
       chunk[1] = 0;
@@ -1660,32 +1691,22 @@ int mailmime_base64_body_parse(const char * message, size_t length,
       chunk[3] = 0;
       
       chunk_index = 0;
-
-      if (mmap_string_append_len(mmapstr, out, 3) == NULL) {
-	res = MAILIMF_ERROR_MEMORY;
-	goto free;
-      }
-      written += 3;
     }
   }
 
   if (chunk_index != 0) {
-    size_t len;
-
-    len = 0;
-    out[0] = (chunk[0] << 2) | (chunk[1] >> 4);
-    len ++;
+    out[written] = (chunk[0] << 2) | (chunk[1] >> 4);
+    written ++;
 
     if (chunk_index >= 3) {
-      out[1] = (chunk[1] << 4) | (chunk[2] >> 2);
-      len ++;
-    }
-	
-    if (mmap_string_append_len(mmapstr, out, len) == NULL) {
-      res = MAILIMF_ERROR_MEMORY;
-      goto free;
+      out[written] = (chunk[1] << 4) | (chunk[2] >> 2);
+      written ++;
     }
-    written += len;
+  }
+
+  if (mmap_string_set_size(mmapstr, written) == NULL) {
+    res = MAILIMF_ERROR_MEMORY;
+    goto free;
   }
 
   r = mmap_string_ref(mmapstr);
@@ -2156,7 +2177,7 @@ int mailmime_get_section_id(struct mailmime * mime,
 	id ++;
       }
       
-      p_id = malloc(sizeof(* p_id));
+      p_id = mailarena_malloc(sizeof(* p_id));
       if (p_id == NULL) {
 	res = MAILIMF_ERROR_MEMORY;
 	goto free;
@@ -2165,7 +2186,7 @@ int mailmime_get_section_id(struct mailmime * mime,
       
       r = clist_append(section_id->sec_list, p_id);
       if (r < 0) {
-        free(p_id);
+        mailarena_release(p_id);
 	res = MAILIMF_ERROR_MEMORY;
 	goto free;
       }
@@ -2174,7 +2195,7 @@ int mailmime_get_section_id(struct mailmime * mime,
     case MAILMIME_MESSAGE:
       if ((mime->mm_type == MAILMIME_SINGLE) ||
           (mime->mm_type == MAILMIME_MESSAGE)) {
-	p_id = malloc(sizeof(* p_id));
+	p_id = mailarena_malloc(sizeof(* p_id));
 	if (p_id == NULL) {
 	  res = MAILIMF_ERROR_MEMORY;
 	  goto free;
@@ -2183,7 +2204,7 @@ int mailmime_get_section_id(struct mailmime * mime,
 	
 	r = clist_append(section_id->sec_list, p_id);
 	if (r < 0) {
-          free(p_id);
+          mailarena_release(p_id);
 	  res = MAILIMF_ERROR_MEMORY;
 	  goto free;
 	}
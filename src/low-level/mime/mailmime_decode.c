@@ -59,6 +59,7 @@
 #include "charconv.h"
 #include "mmapstring.h"
 #include "mailimf.h"
+#include "mailarena_private.h"
 
 #ifndef TRUE
 #define TRUE 1
@@ -100,6 +101,48 @@ enum {
   TYPE_ENCODED_WORD
 };
 
+/*
+  Adjacent encoded words using the same charset are converted together:
+  their decoded bytes are accumulated in a run and converted only when
+  the charset changes or a non-encoded word is met. This saves a
+  conversion per word and allows multibyte characters split between two
+  encoded words to be decoded.
+*/
+
+static int flush_encoded_run(MMAPString * gphrase, const char * tocode,
+    const char * charset, MMAPString * run)
+{
+  char * wordutf8;
+  int r;
+
+  if (run->len == 0)
+    return MAILIMF_NO_ERROR;
+
+  wordutf8 = NULL;
+  r = charconv(tocode, charset, run->str, run->len, &wordutf8);
+  if (r == MAIL_CHARCONV_ERROR_UNKNOWN_CHARSET)
+    r = charconv(tocode, "iso-8859-1", run->str, run->len, &wordutf8);
+
+  switch (r) {
+    case MAIL_CHARCONV_ERROR_MEMORY:
+      return MAILIMF_ERROR_MEMORY;
+    case MAIL_CHARCONV_ERROR_CONV:
+      return MAILIMF_ERROR_PARSE;
+  }
+
+  mmap_string_truncate(run, 0);
+
+  if (wordutf8 != NULL) {
+    if (mmap_string_append(gphrase, wordutf8) == NULL) {
+      mailarena_release(wordutf8);
+      return MAILIMF_ERROR_MEMORY;
+    }
+    mailarena_release(wordutf8);
+  }
+
+  return MAILIMF_NO_ERROR;
+}
+
 LIBETPAN_EXPORT
 int mailmime_encoded_phrase_parse(const char * default_fromcode,
     const char * message, size_t length,
@@ -107,7 +150,9 @@ int mailmime_encoded_phrase_parse(const char * default_fromcode,
     char ** result)
 {
   MMAPString * gphrase;
+  MMAPString * run;
   struct mailmime_encoded_word * word;
+  struct mailmime_encoded_word * run_word;
   int first;
   size_t cur_token;
   int r;
@@ -118,12 +163,21 @@ int mailmime_encoded_phrase_parse(const char * default_fromcode,
 
   cur_token = * indx;
 
-  gphrase = mmap_string_new("");
+  /* decoded text is rarely longer than the encoded one, except when
+     8 bit charsets are converted to UTF-8 */
+  gphrase = mmap_string_sized_new(length - cur_token + 16);
   if (gphrase == NULL) {
     res = MAILIMF_ERROR_MEMORY;
     goto err;
   }
 
+  run = mmap_string_sized_new(length - cur_token + 1);
+  if (run == NULL) {
+    res = MAILIMF_ERROR_MEMORY;
+    goto free;
+  }
+  run_word = NULL;
+
   first = TRUE;
 
   type = TYPE_ERROR; /* XXX - removes a gcc warning */
@@ -139,51 +193,33 @@ int mailmime_encoded_phrase_parse(const char * default_fromcode,
           if (mmap_string_append_c(gphrase, ' ') == NULL) {
             mailmime_encoded_word_free(word);
             res = MAILIMF_ERROR_MEMORY;
-            goto free;
+            goto free_run;
           }
         }
       }
       type = TYPE_ENCODED_WORD;
-      wordutf8 = NULL;
-      r = charconv(tocode, word->wd_charset, word->wd_text,
-                   strlen(word->wd_text), &wordutf8);
-      switch (r) {
-        case MAIL_CHARCONV_ERROR_MEMORY:
-          mailmime_encoded_word_free(word);
-          res = MAILIMF_ERROR_MEMORY;
-          goto free;
-
-        case MAIL_CHARCONV_ERROR_UNKNOWN_CHARSET:
-          r = charconv(tocode, "iso-8859-1", word->wd_text,
-                       strlen(word->wd_text), &wordutf8);
-          break;
-        case MAIL_CHARCONV_ERROR_CONV:
-          mailmime_encoded_word_free(word);
-          res = MAILIMF_ERROR_PARSE;
-          goto free;
-      }
 
-      switch (r) {
-        case MAIL_CHARCONV_ERROR_MEMORY:
-          mailmime_encoded_word_free(word);
-          res = MAILIMF_ERROR_MEMORY;
-          goto free;
-        case MAIL_CHARCONV_ERROR_CONV:
+      if ((run_word != NULL) &&
+          (strcasecmp(run_word->wd_charset, word->wd_charset) != 0)) {
+        r = flush_encoded_run(gphrase, tocode, run_word->wd_charset, run);
+        if (r != MAILIMF_NO_ERROR) {
           mailmime_encoded_word_free(word);
-          res = MAILIMF_ERROR_PARSE;
-          goto free;
+          res = r;
+          goto free_run;
+        }
+        mailmime_encoded_word_free(run_word);
+        run_word = NULL;
       }
 
-      if (wordutf8 != NULL) {
-        if (mmap_string_append(gphrase, wordutf8) == NULL) {
-          mailmime_encoded_word_free(word);
-          free(wordutf8);
-          res = MAILIMF_ERROR_MEMORY;
-          goto free;
-        }
-        free(wordutf8);
+      if (mmap_string_append(run, word->wd_text) == NULL) {
+        mailmime_encoded_word_free(word);
+        res = MAILIMF_ERROR_MEMORY;
+        goto free_run;
       }
-      mailmime_encoded_word_free(word);
+      if (run_word == NULL)
+        run_word = word;
+      else
+        mailmime_encoded_word_free(word);
       first = FALSE;
     }
     else if (r == MAILIMF_ERROR_PARSE) {
@@ -191,21 +227,31 @@ int mailmime_encoded_phrase_parse(const char * default_fromcode,
     }
     else {
       res = r;
-      goto free;
+      goto free_run;
     }
 
     if (r == MAILIMF_ERROR_PARSE) {
       char * raw_word;
 
+      if (run_word != NULL) {
+        r = flush_encoded_run(gphrase, tocode, run_word->wd_charset, run);
+        if (r != MAILIMF_NO_ERROR) {
+          res = r;
+          goto free_run;
+        }
+        mailmime_encoded_word_free(run_word);
+        run_word = NULL;
+      }
+
       raw_word = NULL;
       r = mailmime_non_encoded_word_parse(message, length,
                                           &cur_token, &raw_word, &has_fwd);
       if (r == MAILIMF_NO_ERROR) {
         if ((!first) && has_fwd) {
           if (mmap_string_append_c(gphrase, ' ') == NULL) {
-            free(raw_word);
+            mailarena_release(raw_word);
             res = MAILIMF_ERROR_MEMORY;
-            goto free;
+            goto free_run;
           }
         }
         type = TYPE_WORD;
@@ -216,26 +262,26 @@ int mailmime_encoded_phrase_parse(const char * default_fromcode,
 
         switch (r) {
           case MAIL_CHARCONV_ERROR_MEMORY:
-            free(raw_word);
+            mailarena_release(raw_word);
             res = MAILIMF_ERROR_MEMORY;
-            goto free;
+            goto free_run;
 
           case MAIL_CHARCONV_ERROR_UNKNOWN_CHARSET:
           case MAIL_CHARCONV_ERROR_CONV:
-            free(raw_word);
+            mailarena_release(raw_word);
             res = MAILIMF_ERROR_PARSE;
-            goto free;
+            goto free_run;
         }
 
         if (mmap_string_append(gphrase, wordutf8) == NULL) {
-          free(wordutf8);
-          free(raw_word);
+          mailarena_release(wordutf8);
+          mailarena_release(raw_word);
           res = MAILIMF_ERROR_MEMORY;
-          goto free;
+          goto free_run;
         }
 
-        free(wordutf8);
-        free(raw_word);
+        mailarena_release(wordutf8);
+        mailarena_release(raw_word);
         first = FALSE;
       }
       else if (r == MAILIMF_ERROR_PARSE) {
@@ -246,14 +292,14 @@ int mailmime_encoded_phrase_parse(const char * default_fromcode,
 
         if (mmap_string_append_c(gphrase, ' ') == NULL) {
           res = MAILIMF_ERROR_MEMORY;
-          goto free;
+          goto free_run;
         }
         first = FALSE;
         break;
       }
       else {
         res = r;
-        goto free;
+        goto free_run;
       }
     }
   }
@@ -261,10 +307,12 @@ int mailmime_encoded_phrase_parse(const char * default_fromcode,
   if (first) {
     if (cur_token != length) {
       res = MAILIMF_ERROR_PARSE;
-      goto free;
+      goto free_run;
     }
   }
 
+  mmap_string_free(run);
+
   str = strdup(gphrase->str);
   if (str == NULL) {
     res = MAILIMF_ERROR_MEMORY;
@@ -277,6 +325,10 @@ int mailmime_encoded_phrase_parse(const char * default_fromcode,
 
   return MAILIMF_NO_ERROR;
 
+free_run:
+  if (run_word != NULL)
+    mailmime_encoded_word_free(run_word);
+  mmap_string_free(run);
 free:
   mmap_string_free(gphrase);
 err:
@@ -349,7 +401,7 @@ mailmime_non_encoded_word_parse(const char * message, size_t length,
     goto err;
   }
 
-  text = malloc(cur_token - begin + 1);
+  text = mailarena_malloc(cur_token - begin + 1);
   if (text == NULL) {
     res = MAILIMF_ERROR_MEMORY;
     goto err;
@@ -486,7 +538,7 @@ static int mailmime_encoded_word_parse(const char * message, size_t length,
     break;
   }
 
-  text = malloc(decoded_len + 1);
+  text = mailarena_malloc(decoded_len + 1);
   if (text == NULL) {
     res = MAILIMF_ERROR_MEMORY;
     goto free_charset;
@@ -518,8 +570,8 @@ static int mailmime_encoded_word_parse(const char * message, size_t length,
 
   /* fix charset */
   if (strcasecmp(charset, "utf8") == 0) {
-    free(charset);
-    charset = strdup("utf-8");
+    mailarena_release(charset);
+    charset = mailarena_strdup("utf-8");
   }
   ew = mailmime_encoded_word_new(charset, text);
   if (ew == NULL) {
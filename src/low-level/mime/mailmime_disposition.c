@@ -39,6 +39,7 @@
 
 #include "mailmime_disposition.h"
 #include "mailmime.h"
+#include "mailarena_private.h"
 
 #include <ctype.h>
 #include <stdlib.h>
@@ -236,7 +237,7 @@ mailmime_disposition_type_parse(const char * message, size_t length,
 
  free:
   if (extension != NULL)
-    free(extension);
+    mailarena_release(extension);
  err:
   return res;
 }
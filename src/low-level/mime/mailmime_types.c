@@ -39,6 +39,7 @@
 
 #include "mailmime_types.h"
 #include "mmapstring.h"
+#include "mailarena_private.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -55,7 +56,7 @@ mailmime_composite_type_new(int ct_type, char * ct_token)
 {
   struct mailmime_composite_type * ct;
 
-  ct = malloc(sizeof(* ct));
+  ct = mailarena_malloc(sizeof(* ct));
   if (ct == NULL)
     return NULL;
 
@@ -69,7 +70,7 @@ void mailmime_composite_type_free(struct mailmime_composite_type * ct)
 {
   if (ct->ct_token != NULL)
     mailmime_extension_token_free(ct->ct_token);
-  free(ct);
+  mailarena_release(ct);
 }
 
 
@@ -80,7 +81,7 @@ mailmime_content_new(struct mailmime_type * ct_type,
 {
   struct mailmime_content * content;
 
-  content = malloc(sizeof(* content));
+  content = mailarena_malloc(sizeof(* content));
   if (content == NULL)
     return NULL;
 
@@ -101,18 +102,18 @@ void mailmime_content_free(struct mailmime_content * content)
     clist_free(content->ct_parameters);
   }
 
-  free(content);
+  mailarena_release(content);
 }
 
 
 void mailmime_description_free(char * description)
 {
-  free(description);
+  mailarena_release(description);
 }
 
 void mailmime_location_free(char * location)
 {
-  free(location);
+  mailarena_release(location);
 }
 
 struct mailmime_discrete_type *
@@ -120,7 +121,7 @@ mailmime_discrete_type_new(int dt_type, char * dt_extension)
 {
   struct mailmime_discrete_type * discrete_type;
 
-  discrete_type = malloc(sizeof(* discrete_type));
+  discrete_type = mailarena_malloc(sizeof(* discrete_type));
   if (discrete_type == NULL)
     return NULL;
 
@@ -134,7 +135,7 @@ void mailmime_discrete_type_free(struct mailmime_discrete_type * discrete_type)
 {
   if (discrete_type->dt_extension != NULL)
     mailmime_extension_token_free(discrete_type->dt_extension);
-  free(discrete_type);
+  mailarena_release(discrete_type);
 }
 
 void mailmime_encoding_free(struct mailmime_mechanism * encoding)
@@ -156,7 +157,7 @@ struct mailmime_mechanism * mailmime_mechanism_new(int enc_type, char * enc_toke
 {
   struct mailmime_mechanism * mechanism;
 
-  mechanism = malloc(sizeof(* mechanism));
+  mechanism = mailarena_malloc(sizeof(* mechanism));
   if (mechanism == NULL)
     return NULL;
 
@@ -170,7 +171,7 @@ void mailmime_mechanism_free(struct mailmime_mechanism * mechanism)
 {
   if (mechanism->enc_token != NULL)
     mailmime_token_free(mechanism->enc_token);
-  free(mechanism);
+  mailarena_release(mechanism);
 }
 
 struct mailmime_parameter *
@@ -178,7 +179,7 @@ mailmime_parameter_new(char * pa_name, char * pa_value)
 {
   struct mailmime_parameter * parameter;
 
-  parameter = malloc(sizeof(* parameter));
+  parameter = mailarena_malloc(sizeof(* parameter));
   if (parameter == NULL)
     return NULL;
 
@@ -192,7 +193,7 @@ void mailmime_parameter_free(struct mailmime_parameter * parameter)
 {
   mailmime_attribute_free(parameter->pa_name);
   mailmime_value_free(parameter->pa_value);
-  free(parameter);
+  mailarena_release(parameter);
 }
 
 
@@ -204,7 +205,7 @@ void mailmime_subtype_free(char * subtype)
 
 void mailmime_token_free(char * token)
 {
-  free(token);
+  mailarena_release(token);
 }
 
 
@@ -215,7 +216,7 @@ mailmime_type_new(int tp_type,
 {
   struct mailmime_type * mime_type;
   
-  mime_type = malloc(sizeof(* mime_type));
+  mime_type = mailarena_malloc(sizeof(* mime_type));
   if (mime_type == NULL)
     return NULL;
 
@@ -242,12 +243,12 @@ void mailmime_type_free(struct mailmime_type * type)
     mailmime_composite_type_free(type->tp_data.tp_composite_type);
     break;
   }
-  free(type);
+  mailarena_release(type);
 }
 
 void mailmime_value_free(char * value)
 {
-  free(value);
+  mailarena_release(value);
 }
 
 
@@ -271,7 +272,7 @@ mailmime_field_new(int fld_type,
 {
   struct mailmime_field * field;
   
-  field = malloc(sizeof(* field));
+  field = mailarena_malloc(sizeof(* field));
   if (field == NULL)
     return NULL;
   field->fld_type = fld_type;
@@ -338,14 +339,14 @@ void mailmime_field_free(struct mailmime_field * field)
       break;
   }
 
-  free(field);
+  mailarena_release(field);
 }
 
 struct mailmime_fields * mailmime_fields_new(clist * fld_list)
 {
   struct mailmime_fields * fields;
 
-  fields = malloc(sizeof(* fields));
+  fields = mailarena_malloc(sizeof(* fields));
   if (fields == NULL)
     return NULL;
 
@@ -358,7 +359,7 @@ void mailmime_fields_free(struct mailmime_fields * fields)
 {
   clist_foreach(fields->fld_list, (clist_func) mailmime_field_free, NULL);
   clist_free(fields->fld_list);
-  free(fields);
+  mailarena_release(fields);
 }
 
 
@@ -389,7 +390,7 @@ mailmime_multipart_body_new(clist * bd_list)
 {
   struct mailmime_multipart_body * mp_body;
 
-  mp_body = malloc(sizeof(* mp_body));
+  mp_body = mailarena_malloc(sizeof(* mp_body));
   if (mp_body == NULL)
     return NULL;
 
@@ -402,7 +403,7 @@ void mailmime_multipart_body_free(struct mailmime_multipart_body * mp_body)
 {
   clist_foreach(mp_body->bd_list, (clist_func) mailimf_body_free, NULL);
   clist_free(mp_body->bd_list);
-  free(mp_body);
+  mailarena_release(mp_body);
 }
 
 
@@ -422,7 +423,7 @@ struct mailmime * mailmime_new(int mm_type,
   struct mailmime * mime;
   clistiter * cur;
 
-  mime = malloc(sizeof(* mime));
+  mime = mailarena_malloc(sizeof(* mime));
   if (mime == NULL)
     return NULL;
 
@@ -507,7 +508,7 @@ void mailmime_free(struct mailmime * mime)
     mailmime_fields_free(mime->mm_mime_fields);
   if (mime->mm_content_type != NULL)
     mailmime_content_free(mime->mm_content_type);
-  free(mime);
+  mailarena_release(mime);
 }
 
 
@@ -517,7 +518,7 @@ mailmime_encoded_word_new(char * wd_charset, char * wd_text)
 {
   struct mailmime_encoded_word * ew;
   
-  ew = malloc(sizeof(* ew));
+  ew = mailarena_malloc(sizeof(* ew));
   if (ew == NULL)
     return NULL;
   ew->wd_charset = wd_charset;
@@ -528,19 +529,19 @@ mailmime_encoded_word_new(char * wd_charset, char * wd_text)
 
 void mailmime_charset_free(char * charset)
 {
-  free(charset);
+  mailarena_release(charset);
 }
 
 void mailmime_encoded_text_free(char * text)
 {
-  free(text);
+  mailarena_release(text);
 }
 
 void mailmime_encoded_word_free(struct mailmime_encoded_word * ew)
 {
   mailmime_charset_free(ew->wd_charset);
   mailmime_encoded_text_free(ew->wd_text);
-  free(ew);
+  mailarena_release(ew);
 }
 
 
@@ -554,7 +555,7 @@ mailmime_disposition_new(struct mailmime_disposition_type * dsp_type,
 {
   struct mailmime_disposition * dsp;
 
-  dsp = malloc(sizeof(* dsp));
+  dsp = mailarena_malloc(sizeof(* dsp));
   if (dsp == NULL)
     return NULL;
   dsp->dsp_type = dsp_type;
@@ -569,7 +570,7 @@ void mailmime_disposition_free(struct mailmime_disposition * dsp)
   clist_foreach(dsp->dsp_parms,
       (clist_func) mailmime_disposition_parm_free, NULL);
   clist_free(dsp->dsp_parms);
-  free(dsp);
+  mailarena_release(dsp);
 }
 
 
@@ -579,7 +580,7 @@ mailmime_disposition_type_new(int dsp_type, char * dsp_extension)
 {
   struct mailmime_disposition_type * m_dsp_type;
 
-  m_dsp_type = malloc(sizeof(* m_dsp_type));
+  m_dsp_type = mailarena_malloc(sizeof(* m_dsp_type));
   if (m_dsp_type == NULL)
     return NULL;
 
@@ -592,8 +593,8 @@ mailmime_disposition_type_new(int dsp_type, char * dsp_extension)
 void mailmime_disposition_type_free(struct mailmime_disposition_type * dsp_type)
 {
   if (dsp_type->dsp_extension != NULL)
-    free(dsp_type->dsp_extension);
-  free(dsp_type);
+    mailarena_release(dsp_type->dsp_extension);
+  mailarena_release(dsp_type);
 }
 
 
@@ -608,7 +609,7 @@ mailmime_disposition_parm_new(int pa_type,
 {
   struct mailmime_disposition_parm * dsp_parm;
 
-  dsp_parm = malloc(sizeof(* dsp_parm));
+  dsp_parm = mailarena_malloc(sizeof(* dsp_parm));
   if (dsp_parm == NULL)
     return NULL;
 
@@ -658,7 +659,7 @@ void mailmime_disposition_parm_free(struct mailmime_disposition_parm *
     break;
   }
   
-  free(dsp_parm);
+  mailarena_release(dsp_parm);
 }
 
 
@@ -691,7 +692,7 @@ struct mailmime_section * mailmime_section_new(clist * sec_list)
 {
   struct mailmime_section * section;
 
-  section = malloc(sizeof(* section));
+  section = mailarena_malloc(sizeof(* section));
   if (section == NULL)
     return NULL;
 
@@ -702,9 +703,9 @@ struct mailmime_section * mailmime_section_new(clist * sec_list)
 
 void mailmime_section_free(struct mailmime_section * section)
 {
-  clist_foreach(section->sec_list, (clist_func) free, NULL);
+  clist_foreach(section->sec_list, (clist_func) mailarena_release, NULL);
   clist_free(section->sec_list);
-  free(section);
+  mailarena_release(section);
 }
 
 
@@ -713,7 +714,7 @@ struct mailmime_language * mailmime_language_new(clist * lg_list)
 {
   struct mailmime_language * lang;
 
-  lang = malloc(sizeof(* lang));
+  lang = mailarena_malloc(sizeof(* lang));
   if (lang == NULL)
     return NULL;
 
@@ -726,7 +727,7 @@ void mailmime_language_free(struct mailmime_language * lang)
 {
   clist_foreach(lang->lg_list, (clist_func) mailimf_atom_free, NULL);
   clist_free(lang->lg_list);
-  free(lang);
+  mailarena_release(lang);
 }
 
 void mailmime_decoded_part_free(char * part)
@@ -739,7 +740,7 @@ struct mailmime_data * mailmime_data_new(int dt_type, int dt_encoding,
 {
   struct mailmime_data * mime_data;
 
-  mime_data = malloc(sizeof(* mime_data));
+  mime_data = mailarena_malloc(sizeof(* mime_data));
   if (mime_data == NULL)
     return NULL;
 
@@ -763,8 +764,8 @@ void mailmime_data_free(struct mailmime_data * mime_data)
 {
   switch (mime_data->dt_type) {
   case MAILMIME_DATA_FILE:
-    free(mime_data->dt_data.dt_filename);
+    mailarena_release(mime_data->dt_data.dt_filename);
     break;
   }
-  free(mime_data);
+  mailarena_release(mime_data);
 }
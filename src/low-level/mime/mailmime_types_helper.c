@@ -41,6 +41,7 @@
 
 #include "clist.h"
 #include "mailmime.h"
+#include "mailarena_private.h"
 
 #include <string.h>
 #include <time.h>
@@ -308,7 +309,7 @@ struct mailmime_content * mailmime_get_content_message(void)
   if (list == NULL)
     goto free_mime_type;
 
-  subtype = strdup("rfc822");
+  subtype = mailarena_strdup("rfc822");
   if (subtype == NULL)
     goto free_list;
 
@@ -319,7 +320,7 @@ struct mailmime_content * mailmime_get_content_message(void)
   return content;
 
  free_subtype:
-  free(subtype);
+  mailarena_release(subtype);
  free_list:
   clist_free(list);
  free_mime_type:
@@ -354,7 +355,7 @@ struct mailmime_content * mailmime_get_content_text(void)
   if (list == NULL)
     goto free_type;
 
-  subtype = strdup("plain");
+  subtype = mailarena_strdup("plain");
   if (subtype == NULL)
     goto free_list;
   
@@ -365,7 +366,7 @@ struct mailmime_content * mailmime_get_content_text(void)
   return content;
 
  free_subtype:
-  free(subtype);
+  mailarena_release(subtype);
  free_list:
   clist_free(list);
  free_type:
@@ -507,9 +508,8 @@ mailmime_new_message_data(struct mailmime * msg_mime)
 
 #define MAX_MESSAGE_ID 512
 
-char * mailmime_generate_boundary(void)
+static void generate_boundary(char * id, size_t size)
 {
-  char id[MAX_MESSAGE_ID];
   time_t now;
   char name[MAX_MESSAGE_ID];
   long value;
@@ -518,7 +518,14 @@ char * mailmime_generate_boundary(void)
   value = random();
 
   gethostname(name, MAX_MESSAGE_ID);
-  snprintf(id, MAX_MESSAGE_ID, "%lx_%lx_%x", now, value, getpid());
+  snprintf(id, size, "%lx_%lx_%x", now, value, getpid());
+}
+
+char * mailmime_generate_boundary(void)
+{
+  char id[MAX_MESSAGE_ID];
+
+  generate_boundary(id, sizeof(id));
 
   return strdup(id);
 }
@@ -566,27 +573,28 @@ mailmime_new_empty(struct mailmime_content * content,
     char * attr_value;
     struct mailmime_parameter * param;
     clist * parameters;
-    char * boundary;
+    char boundary[MAX_MESSAGE_ID];
 
     list = clist_new();
     if (list == NULL)
       goto err;
 
-    attr_name = strdup("boundary");
+    attr_name = mailarena_strdup("boundary");
     if (attr_name == NULL)
       goto free_list;
 
-    boundary = mailmime_generate_boundary();
-    attr_value = boundary;
-    if (attr_name == NULL) {
-      free(attr_name);
+    /* the boundary goes into the parameter list of the content */
+    generate_boundary(boundary, sizeof(boundary));
+    attr_value = mailarena_strdup(boundary);
+    if (attr_value == NULL) {
+      mailarena_release(attr_name);
       goto free_list;
     }
 
     param = mailmime_parameter_new(attr_name, attr_value);
     if (param == NULL) {
-      free(attr_value);
-      free(attr_name);
+      mailarena_release(attr_value);
+      mailarena_release(attr_name);
       goto free_list;
     }
 
@@ -1332,7 +1340,7 @@ mailmime_single_fields_new(struct mailmime_fields * fld_fields,
 {
   struct mailmime_single_fields * single_fields;
 
-  single_fields = malloc(sizeof(struct mailmime_single_fields));
+  single_fields = mailarena_malloc(sizeof(struct mailmime_single_fields));
   if (single_fields == NULL)
     goto err;
 
@@ -1348,7 +1356,7 @@ mailmime_single_fields_new(struct mailmime_fields * fld_fields,
 void mailmime_single_fields_free(struct mailmime_single_fields *
     single_fields)
 {
-  free(single_fields);
+  mailarena_release(single_fields);
 }
 
 struct mailmime_fields * mailmime_fields_new_filename(int dsp_type,
@@ -1153,83 +1153,168 @@ static int mailmime_text_content_write_driver(int (* do_write)(void *, const cha
 }
 
 
+/*
+  Encoded output is accumulated in a buffer and given to do_write()
+  once per chunk instead of once per group or per line.
+  Line breaks are normalized to CRLF when appending, the same way
+  mailimf_string_write_driver() does.
+*/
+
+#define ENCODE_BUFFER_SIZE 4096
+
+struct encode_buffer {
+  int (* do_write)(void *, const char *, size_t);
+  void * data;
+  int * col;
+  size_t len;
+  char str[ENCODE_BUFFER_SIZE];
+};
+
+static void encode_buffer_init(struct encode_buffer * buffer,
+    int (* do_write)(void *, const char *, size_t), void * data, int * col)
+{
+  buffer->do_write = do_write;
+  buffer->data = data;
+  buffer->col = col;
+  buffer->len = 0;
+}
+
+static int encode_buffer_flush(struct encode_buffer * buffer)
+{
+  int r;
+
+  if (buffer->len == 0)
+    return MAILIMF_NO_ERROR;
+
+  r = buffer->do_write(buffer->data, buffer->str, buffer->len);
+  if (r == 0)
+    return MAILIMF_ERROR_FILE;
+  buffer->len = 0;
+
+  return MAILIMF_NO_ERROR;
+}
+
+static int encode_buffer_append(struct encode_buffer * buffer,
+    const char * str, size_t length)
+{
+  int r;
+  size_t i;
+
+  for(i = 0 ; i < length ; i ++) {
+    if (buffer->len + 2 > ENCODE_BUFFER_SIZE) {
+      r = encode_buffer_flush(buffer);
+      if (r != MAILIMF_NO_ERROR)
+        return r;
+    }
+
+    switch (str[i]) {
+    case '\r':
+      if ((i + 1 < length) && (str[i + 1] == '\n'))
+        i ++;
+      /* fall through */
+    case '\n':
+      buffer->str[buffer->len ++] = '\r';
+      buffer->str[buffer->len ++] = '\n';
+      * buffer->col = 0;
+      break;
+
+    default:
+      buffer->str[buffer->len ++] = str[i];
+      (* buffer->col) ++;
+      break;
+    }
+  }
+
+  return MAILIMF_NO_ERROR;
+}
+
 static const char base64_encoding[] =
 "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
 #define BASE64_MAX_COL 76
+#define BASE64_LINE_INPUT_SIZE (BASE64_MAX_COL / 4 * 3)
+
+static inline void base64_encode_group(char * dest, const unsigned char * src)
+{
+  dest[0] = base64_encoding[src[0] >> 2];
+  dest[1] = base64_encoding[((src[0] & 3) << 4) | (src[1] >> 4)];
+  dest[2] = base64_encoding[((src[1] & 0xF) << 2) | (src[2] >> 6)];
+  dest[3] = base64_encoding[src[2] & 0x3F];
+}
 
 int mailmime_base64_write_driver(int (* do_write)(void *, const char *, size_t), void * data, int * col,
     const char * text, size_t size)
 {
-  int a;
-  int b;
-  int c;
+  struct encode_buffer buffer;
+  const unsigned char * p;
   size_t remains;
-  const char * p;
-  size_t count;
-  char ogroup[4];
+  unsigned char tail[3];
   int r;
 
+  encode_buffer_init(&buffer, do_write, data, col);
+
   remains = size;
-  p = text;
+  p = (const unsigned char *) text;
 
   while (remains > 0) {
-    switch (remains) {
-    case 1:
-      a = (unsigned char) p[0];
-      b = 0;
-      c = 0;
-      count = 1;
-      break;
-    case 2:
-      a = (unsigned char) p[0];
-      b = (unsigned char) p[1];
-      c = 0;
-      count = 2;
-      break;
-    default:
-      a = (unsigned char) p[0];
-      b = (unsigned char) p[1];
-      c = (unsigned char) p[2];
-      count = 3;
-      break;
-    }
-
-    ogroup[0]= base64_encoding[a >> 2];
-    ogroup[1]= base64_encoding[((a & 3) << 4) | (b >> 4)];
-    ogroup[2]= base64_encoding[((b & 0xF) << 2) | (c >> 6)];
-    ogroup[3]= base64_encoding[c & 0x3F];
-
-    switch (count) {
-    case 1:
-      ogroup[2]= '=';
-      ogroup[3]= '=';
-      break;
-    case 2:
-      ogroup[3]= '=';
-      break;
+    if (buffer.len + BASE64_MAX_COL + 2 > ENCODE_BUFFER_SIZE) {
+      r = encode_buffer_flush(&buffer);
+      if (r != MAILIMF_NO_ERROR)
+        return r;
     }
 
     if (* col + 4 > BASE64_MAX_COL) {
-      r = mailimf_string_write_driver(do_write, data, col, "\r\n", 2);
-      if (r != MAILIMF_NO_ERROR)
-	return r;
-#if 0
+      buffer.str[buffer.len ++] = '\r';
+      buffer.str[buffer.len ++] = '\n';
       * col = 0;
-#endif
     }
-    
-    r = mailimf_string_write_driver(do_write, data, col, ogroup, 4);
-    if (r != MAILIMF_NO_ERROR)
-      return r;
 
-    remains -= count;
-    p += count;
+    /*
+      whole line, the line break is added before the next group
+      so that the input must not end with this line.
+    */
+    if ((* col == 0) && (remains > BASE64_LINE_INPUT_SIZE)) {
+      char * dest;
+      const unsigned char * end;
+
+      dest = buffer.str + buffer.len;
+      end = p + BASE64_LINE_INPUT_SIZE;
+      while (p < end) {
+        base64_encode_group(dest, p);
+        dest += 4;
+        p += 3;
+      }
+      buffer.len += BASE64_MAX_COL;
+      * col = BASE64_MAX_COL;
+      remains -= BASE64_LINE_INPUT_SIZE;
+      continue;
+    }
+
+    if (remains >= 3) {
+      base64_encode_group(buffer.str + buffer.len, p);
+      p += 3;
+      remains -= 3;
+    }
+    else {
+      tail[0] = p[0];
+      tail[1] = (remains == 2) ? p[1] : 0;
+      tail[2] = 0;
+      base64_encode_group(buffer.str + buffer.len, tail);
+      if (remains == 1)
+        buffer.str[buffer.len + 2] = '=';
+      buffer.str[buffer.len + 3] = '=';
+      p += remains;
+      remains = 0;
+    }
+    buffer.len += 4;
+    * col += 4;
   }
 
-  r = mailimf_string_write_driver(do_write, data, col, "\r\n", 2);
+  r = encode_buffer_append(&buffer, "\r\n", 2);
+  if (r != MAILIMF_NO_ERROR)
+    return r;
 
-  return MAILIMF_NO_ERROR;
+  return encode_buffer_flush(&buffer);
 }
 
 #if 0
@@ -1260,13 +1345,13 @@ static inline int write_try_buf(int (* do_write)(void *, const char *, size_t),
 }
 #endif
 
-static inline int write_remaining(int (* do_write)(void *, const char *, size_t), void * data, int * col,
+static inline int write_remaining(struct encode_buffer * buffer,
 				  const char ** pstart, size_t * plen)
 {
   int r;
 
   if (* plen > 0) {
-    r = mailimf_string_write_driver(do_write, data, col, * pstart, * plen);
+    r = encode_buffer_append(buffer, * pstart, * plen);
     if (r != MAILIMF_NO_ERROR)
       return r;
     * plen = 0;
@@ -1279,6 +1364,42 @@ static inline int write_remaining(int (* do_write)(void *, const char *, size_t)
 
 #define QP_MAX_COL 72
 
+enum {
+  QP_CLASS_LITERAL,
+  QP_CLASS_ENCODE,
+  QP_CLASS_SPACE,
+  QP_CLASS_CR,
+  QP_CLASS_LF
+};
+
+/*
+  class of each character when not after a space or a CR.
+  '!', '"', '#', '$', '@', '[', '\\', ']', '^', '`', '{', '|', '}', '~',
+  '=', '?', '_' and 'F' are always encoded,
+  there is no more 'From' at the beginning of a line.
+*/
+
+static const unsigned char qp_char_class[256] = {
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 4, 1, 1, 3, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  2, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 1,
+  1, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1,
+  1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1
+};
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
 int mailmime_quoted_printable_write_driver(int (* do_write)(void *, const char *, size_t), void * data, int * col, int istext,
                                            const char * text, size_t size)
 {
@@ -1288,6 +1409,9 @@ int mailmime_quoted_printable_write_driver(int (* do_write)(void *, const char *
   char hexstr[6];
   int r;
   int state;
+  struct encode_buffer buffer;
+  
+  encode_buffer_init(&buffer, do_write, data, col);
   
   start = text;
   len = 0;
@@ -1298,12 +1422,12 @@ int mailmime_quoted_printable_write_driver(int (* do_write)(void *, const char *
     unsigned char ch;
     
     if (* col + len > QP_MAX_COL) {
-      r = write_remaining(do_write, data, col, &start, &len);
+      r = write_remaining(&buffer, &start, &len);
       if (r != MAILIMF_NO_ERROR)
         return r;
       start = text + i;
       
-      r = mailimf_string_write_driver(do_write, data, col, "=\r\n", 3);
+      r = encode_buffer_append(&buffer, "=\r\n", 3);
       if (r != MAILIMF_NO_ERROR)
         return r;
     }
@@ -1313,84 +1437,59 @@ int mailmime_quoted_printable_write_driver(int (* do_write)(void *, const char *
     switch (state) {
         
       case STATE_INIT:
-        switch (ch) {
-          case ' ':
-          case '\t':
+        switch (qp_char_class[ch]) {
+          case QP_CLASS_SPACE:
             state = STATE_SPACE;
             len ++;
             i ++;
             break;
             
-          case '\r':
+          case QP_CLASS_CR:
             state = STATE_CR;
             len ++;
             i ++;
             break;
             
-          case '!':
-          case '"':
-          case '#':
-          case '$':
-          case '@':
-          case '[':
-          case '\\':
-          case ']':
-          case '^':
-          case '`':
-          case '{':
-          case '|':
-          case '}':
-          case '~':
-          case '=':
-          case '?':
-          case '_':
-          case 'F': /* there is no more 'From' at the beginning of a line */
-            r = write_remaining(do_write, data, col, &start, &len);
+          case QP_CLASS_LF:
+            if (istext) {
+              r = write_remaining(&buffer, &start, &len);
+              if (r != MAILIMF_NO_ERROR)
+                return r;
+              start = text + i + 1;
+              
+              r = encode_buffer_append(&buffer, "\r\n", 2);
+              if (r != MAILIMF_NO_ERROR)
+                return r;
+              i ++;
+              break;
+            }
+            /* fall through */
+            
+          case QP_CLASS_ENCODE:
+            r = write_remaining(&buffer, &start, &len);
             if (r != MAILIMF_NO_ERROR)
               return r;
             start = text + i + 1;
             
-            snprintf(hexstr, 6, "=%02X", ch);
+            hexstr[0] = '=';
+            hexstr[1] = hex_digits[ch >> 4];
+            hexstr[2] = hex_digits[ch & 0xF];
             
-            r = mailimf_string_write_driver(do_write, data, col, hexstr, 3);
+            r = encode_buffer_append(&buffer, hexstr, 3);
             if (r != MAILIMF_NO_ERROR)
               return r;
             i ++;
             break;
             
           default:
-            if (istext && (ch == '\n')) {
-              r = write_remaining(do_write, data, col, &start, &len);
-              if (r != MAILIMF_NO_ERROR)
-                return r;
-              start = text + i + 1;
-              
-              r = mailimf_string_write_driver(do_write, data, col, "\r\n", 2);
-              if (r != MAILIMF_NO_ERROR)
-                return r;
+            len ++;
+            i ++;
+            /* take the rest of the run of plain characters at once */
+            while ((i < size) && (* col + len <= QP_MAX_COL) &&
+                (qp_char_class[(unsigned char) text[i]] == QP_CLASS_LITERAL)) {
+              len ++;
               i ++;
-              break;
             }
-            else {
-              if (((ch >= 33) && (ch <= 60)) || ((ch >= 62) && (ch <= 126))) {
-                len ++;
-                i ++;
-              }
-              else {
-                r = write_remaining(do_write, data, col, &start, &len);
-                if (r != MAILIMF_NO_ERROR)
-                  return r;
-                start = text + i + 1;
-                
-                snprintf(hexstr, 6, "=%02X", ch);
-                
-                r = mailimf_string_write_driver(do_write, data, col, hexstr, 3);
-                if (r != MAILIMF_NO_ERROR)
-                  return r;
-                i ++;
-              }
-            }
-            
             break;
         }
         break;
@@ -1398,11 +1497,11 @@ int mailmime_quoted_printable_write_driver(int (* do_write)(void *, const char *
       case STATE_CR:
         switch (ch) {
           case '\n':
-            r = write_remaining(do_write, data, col, &start, &len);
+            r = write_remaining(&buffer, &start, &len);
             if (r != MAILIMF_NO_ERROR)
               return r;
             start = text + i + 1;
-            r = mailimf_string_write_driver(do_write, data, col, "\r\n", 2);
+            r = encode_buffer_append(&buffer, "\r\n", 2);
             if (r != MAILIMF_NO_ERROR)
               return r;
             i ++;
@@ -1410,12 +1509,12 @@ int mailmime_quoted_printable_write_driver(int (* do_write)(void *, const char *
             break;
             
           default:
-            r = write_remaining(do_write, data, col, &start, &len);
+            r = write_remaining(&buffer, &start, &len);
             if (r != MAILIMF_NO_ERROR)
               return r;
             start = text + i;
             snprintf(hexstr, 6, "=%02X", '\r');
-            r = mailimf_string_write_driver(do_write, data, col, hexstr, 3);
+            r = encode_buffer_append(&buffer, hexstr, 3);
             if (r != MAILIMF_NO_ERROR)
               return r;
             state = STATE_INIT;
@@ -1431,12 +1530,12 @@ int mailmime_quoted_printable_write_driver(int (* do_write)(void *, const char *
             break;
             
           case '\n':
-            r = write_remaining(do_write, data, col, &start, &len);
+            r = write_remaining(&buffer, &start, &len);
             if (r != MAILIMF_NO_ERROR)
               return r;
             start = text + i + 1;
             snprintf(hexstr, 6, "=%02X\r\n", text[i - 1]);
-            r = mailimf_string_write_driver(do_write, data, col, hexstr, strlen(hexstr));
+            r = encode_buffer_append(&buffer, hexstr, strlen(hexstr));
             if (r != MAILIMF_NO_ERROR)
               return r;
             state = STATE_INIT;
@@ -1464,12 +1563,12 @@ int mailmime_quoted_printable_write_driver(int (* do_write)(void *, const char *
       case STATE_SPACE_CR:
         switch (ch) {
           case '\n':
-            r = write_remaining(do_write, data, col, &start, &len);
+            r = write_remaining(&buffer, &start, &len);
             if (r != MAILIMF_NO_ERROR)
               return r;
             start = text + i + 1;
             snprintf(hexstr, 6, "=%02X\r\n", text[i - 2]);
-            r = mailimf_string_write_driver(do_write, data, col, hexstr, strlen(hexstr));
+            r = encode_buffer_append(&buffer, hexstr, strlen(hexstr));
             if (r != MAILIMF_NO_ERROR)
               return r;
             state = STATE_INIT;
@@ -1477,12 +1576,12 @@ int mailmime_quoted_printable_write_driver(int (* do_write)(void *, const char *
             break;
             
           default:
-            r = write_remaining(do_write, data, col, &start, &len);
+            r = write_remaining(&buffer, &start, &len);
             if (r != MAILIMF_NO_ERROR)
               return r;
             start = text + i + 1;
             snprintf(hexstr, 6, "%c=%02X", text[i - 2], '\r');
-            r = mailimf_string_write_driver(do_write, data, col, hexstr, strlen(hexstr));
+            r = encode_buffer_append(&buffer, hexstr, strlen(hexstr));
             if (r != MAILIMF_NO_ERROR)
               return r;
             state = STATE_INIT;
@@ -1493,9 +1592,9 @@ int mailmime_quoted_printable_write_driver(int (* do_write)(void *, const char *
     }
   }
   
-  r = write_remaining(do_write, data, col, &start, &len);
+  r = write_remaining(&buffer, &start, &len);
   if (r != MAILIMF_NO_ERROR)
     return r;
   
-  return MAILIMF_NO_ERROR;
+  return encode_buffer_flush(&buffer);
 }
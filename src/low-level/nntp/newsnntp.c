@@ -41,7 +41,9 @@
 
 
 #include <stdio.h>
-#ifndef WIN32
+#ifdef WIN32
+#	include "win_etpan.h"
+#else
 #	include <unistd.h>
 #	include <netinet/in.h>
 #	include <netdb.h>
@@ -54,12 +56,15 @@
 #include "connect.h"
 #include "mail.h"
 #include "clist.h"
+#include "mailstream_compress.h"
 
 /*
   NNTP Protocol
 
   RFC 977
   RFC 2980
+  RFC 3977 (CAPABILITIES, OVER, pipelining)
+  RFC 8054 (COMPRESS)
 
   TODO :
 
@@ -82,6 +87,7 @@ static int parse_response(newsnntp * f, char * response);
 
 static int send_command(newsnntp * f, char * command);
 static int send_command_private(newsnntp * f, char * command, int can_be_published);
+static void capabilities_free(newsnntp * f);
 
 newsnntp * newsnntp_new(size_t progr_rate, progress_function * progr_fun)
 {
@@ -97,6 +103,8 @@ newsnntp * newsnntp_new(size_t progr_rate, progress_function * progr_fun)
   f->nntp_progr_rate = progr_rate;
   f->nntp_progr_fun = progr_fun;
 
+  f->nntp_capabilities = NULL;
+
   f->nntp_stream_buffer = mmap_string_new("");
   if (f->nntp_stream_buffer == NULL)
     goto free_f;
@@ -120,6 +128,8 @@ void newsnntp_free(newsnntp * f)
   if (f->nntp_stream)
     newsnntp_quit(f);
 
+  capabilities_free(f);
+
   mmap_string_free(f->nntp_response_buffer);
   mmap_string_free(f->nntp_stream_buffer);
 
@@ -173,6 +183,7 @@ int newsnntp_quit(newsnntp * f)
   mailstream_close(f->nntp_stream);
 
   f->nntp_stream = NULL;
+  capabilities_free(f);
   
   return res;
 }
@@ -185,6 +196,7 @@ int newsnntp_connect(newsnntp * f, mailstream * s)
   if (f->nntp_stream != NULL)
     return NEWSNNTP_ERROR_BAD_STATE;
 
+  capabilities_free(f);
   f->nntp_stream = s;
 
   response = read_line(f);
@@ -382,6 +394,104 @@ int newsnntp_body(newsnntp * f, uint32_t indx, char ** result,
   return newsnntp_get_content(f, result, result_len);
 }
 
+/* ******************** PIPELINED ARTICLE / BODY ******************** */
+
+#define NNTP_PIPELINE_WINDOW 32
+
+static int newsnntp_get_content_pipelined(newsnntp * f,
+    const char * command_name,
+    const uint32_t * indexes, unsigned int count, unsigned int window,
+    newsnntp_content_callback * callback, void * context)
+{
+  char command[NNTP_STRING_SIZE];
+  unsigned int sent;
+  unsigned int received;
+  uint32_t indx;
+  char * content;
+  size_t content_len;
+  int res;
+  int r;
+
+  if (window == 0)
+    window = NNTP_PIPELINE_WINDOW;
+
+  res = NEWSNNTP_NO_ERROR;
+  sent = 0;
+  received = 0;
+
+  while (received < count) {
+    /* refill the window once half of it has been answered */
+    if ((res == NEWSNNTP_NO_ERROR) && (sent < count) &&
+        (sent - received <= window / 2)) {
+      mailstream_set_privacy(f->nntp_stream, 1);
+      while ((sent < count) && (sent - received < window)) {
+        snprintf(command, NNTP_STRING_SIZE, "%s %u\r\n",
+            command_name, indexes[sent]);
+        if (mailstream_write(f->nntp_stream,
+                command, strlen(command)) == -1)
+          return NEWSNNTP_ERROR_STREAM;
+        sent ++;
+      }
+
+      if (mailstream_flush(f->nntp_stream) == -1)
+        return NEWSNNTP_ERROR_STREAM;
+    }
+
+    if (received == sent)
+      break;
+
+    content = NULL;
+    content_len = 0;
+    r = newsnntp_get_content(f, &content, &content_len);
+    indx = indexes[received];
+    received ++;
+
+    switch (r) {
+    case NEWSNNTP_ERROR_STREAM:
+    case NEWSNNTP_ERROR_MEMORY:
+      /* the responses can't be followed anymore */
+      return r;
+
+    case NEWSNNTP_ERROR_REQUEST_AUTHORIZATION_USERNAME:
+    case NEWSNNTP_WARNING_REQUEST_AUTHORIZATION_PASSWORD:
+      if (res == NEWSNNTP_NO_ERROR)
+        res = r;
+      break;
+
+    case NEWSNNTP_NO_ERROR:
+      if (res != NEWSNNTP_NO_ERROR) {
+        newsnntp_multiline_response_free(content);
+        break;
+      }
+      res = callback(indx, NEWSNNTP_NO_ERROR, content, content_len, context);
+      break;
+
+    default:
+      if (res == NEWSNNTP_NO_ERROR)
+        res = callback(indx, r, NULL, 0, context);
+      break;
+    }
+  }
+
+  return res;
+}
+
+int newsnntp_article_pipelined(newsnntp * f,
+    const uint32_t * indexes, unsigned int count, unsigned int window,
+    newsnntp_content_callback * callback, void * context)
+{
+  return newsnntp_get_content_pipelined(f, "ARTICLE",
+      indexes, count, window, callback, context);
+}
+
+int newsnntp_body_pipelined(newsnntp * f,
+    const uint32_t * indexes, unsigned int count, unsigned int window,
+    newsnntp_content_callback * callback, void * context)
+{
+  return newsnntp_get_content_pipelined(f, "BODY",
+      indexes, count, window, callback, context);
+}
+
 /* ******************** GROUP ******************************** */
 
 static struct newsnntp_group_info *
@@ -614,6 +724,7 @@ int newsnntp_authinfo_username(newsnntp * f, const char * username)
     return NEWSNNTP_WARNING_REQUEST_AUTHORIZATION_PASSWORD;
 
   case 281:
+    capabilities_free(f);
     return NEWSNNTP_NO_ERROR;
       
   default:
@@ -652,6 +763,7 @@ int newsnntp_authinfo_password(newsnntp * f, const char * password)
     return NEWSNNTP_WARNING_REQUEST_AUTHORIZATION_PASSWORD;
 
   case 281:
+    capabilities_free(f);
     return NEWSNNTP_NO_ERROR;
       
   default:
@@ -715,6 +827,179 @@ void newsnntp_list_overview_fmt_free(clist * l)
 
 
 
+/* ******************** CAPABILITIES ******************************** */
+
+static void capabilities_free(newsnntp * f)
+{
+  if (f->nntp_capabilities == NULL)
+    return;
+
+  headers_list_free(f->nntp_capabilities);
+  f->nntp_capabilities = NULL;
+}
+
+int newsnntp_capabilities(newsnntp * f)
+{
+  char command[NNTP_STRING_SIZE];
+  int r;
+  char * response;
+  clist * capabilities;
+
+  snprintf(command, NNTP_STRING_SIZE, "CAPABILITIES\r\n");
+  r = send_command(f, command);
+  if (r == -1)
+    return NEWSNNTP_ERROR_STREAM;
+
+  response = read_line(f);
+  if (response == NULL)
+    return NEWSNNTP_ERROR_STREAM;
+
+  r = parse_response(f, response);
+
+  switch (r) {
+  case 480:
+    return NEWSNNTP_ERROR_REQUEST_AUTHORIZATION_USERNAME;
+      
+  case 381:
+    return NEWSNNTP_WARNING_REQUEST_AUTHORIZATION_PASSWORD;
+      
+  case 101:
+    capabilities = read_headers_list(f);
+    if (capabilities == NULL)
+      return NEWSNNTP_ERROR_STREAM;
+
+    capabilities_free(f);
+    f->nntp_capabilities = capabilities;
+    return NEWSNNTP_NO_ERROR;
+
+  case 500:
+    return NEWSNNTP_ERROR_COMMAND_NOT_UNDERSTOOD;
+
+  default:
+    return NEWSNNTP_ERROR_UNEXPECTED_RESPONSE;
+  }
+}
+
+static int match_word(const char * str, const char * word)
+{
+  size_t len;
+
+  len = strlen(word);
+  if (strncasecmp(str, word, len) != 0)
+    return FALSE;
+
+  return (str[len] == '\0') || (str[len] == ' ') || (str[len] == '\t');
+}
+
+static char * get_capability(newsnntp * f, const char * capability)
+{
+  clistiter * cur;
+
+  if (f->nntp_capabilities == NULL)
+    return NULL;
+
+  for(cur = clist_begin(f->nntp_capabilities) ; cur != NULL ;
+      cur = clist_next(cur)) {
+    char * line;
+
+    line = clist_content(cur);
+    if (match_word(line, capability))
+      return line;
+  }
+
+  return NULL;
+}
+
+int newsnntp_has_capability(newsnntp * f, const char * capability)
+{
+  return get_capability(f, capability) != NULL;
+}
+
+int newsnntp_has_over(newsnntp * f)
+{
+  return newsnntp_has_capability(f, "OVER");
+}
+
+int newsnntp_has_compress_deflate(newsnntp * f)
+{
+  char * p;
+
+  p = get_capability(f, "COMPRESS");
+  if (p == NULL)
+    return FALSE;
+
+  /* look for DEFLATE in the arguments */
+  p += strlen("COMPRESS");
+  while (* p != '\0') {
+    while ((* p == ' ') || (* p == '\t'))
+      p ++;
+
+    if (match_word(p, "DEFLATE"))
+      return TRUE;
+
+    while ((* p != '\0') && (* p != ' ') && (* p != '\t'))
+      p ++;
+  }
+
+  return FALSE;
+}
+
+/* ******************** COMPRESS ******************************** */
+
+int newsnntp_compress(newsnntp * f)
+{
+  char command[NNTP_STRING_SIZE];
+  int r;
+  char * response;
+  mailstream_low * low;
+  mailstream_low * compressed_low;
+
+  if (mailstream_compress_driver == NULL)
+    return NEWSNNTP_ERROR_COMPRESS;
+
+  snprintf(command, NNTP_STRING_SIZE, "COMPRESS DEFLATE\r\n");
+  r = send_command(f, command);
+  if (r == -1)
+    return NEWSNNTP_ERROR_STREAM;
+
+  response = read_line(f);
+  if (response == NULL)
+    return NEWSNNTP_ERROR_STREAM;
+
+  r = parse_response(f, response);
+
+  switch (r) {
+  case 480:
+    return NEWSNNTP_ERROR_REQUEST_AUTHORIZATION_USERNAME;
+      
+  case 381:
+    return NEWSNNTP_WARNING_REQUEST_AUTHORIZATION_PASSWORD;
+      
+  case 206:
+    break;
+
+  default:
+    return NEWSNNTP_ERROR_COMPRESS;
+  }
+
+  low = mailstream_get_low(f->nntp_stream);
+  compressed_low = mailstream_low_compress_open(low);
+  if (compressed_low == NULL)
+    return NEWSNNTP_ERROR_MEMORY;
+
+  mailstream_set_low(f->nntp_stream, compressed_low);
+
+  /* COMPRESS is no longer advertised */
+  capabilities_free(f);
+
+  return NEWSNNTP_NO_ERROR;
+}
+
+
+
+
+
+
 /* ******************** LIST ACTIVE ******************************** */
 
 int newsnntp_list_active(newsnntp * f, const char * wildcard, clist ** result)
@@ -1319,6 +1604,7 @@ int newsnntp_mode_reader(newsnntp * f)
       
   case 200:
   case 201:
+    capabilities_free(f);
     return NEWSNNTP_NO_ERROR;
 
   default:
@@ -1601,8 +1887,72 @@ void newsnntp_xover_resp_list_free(clist * l)
   clist_free(l);
 }
 
-static clist * read_xover_resp_list(newsnntp * f);
+static int xover_resp_list_add(struct newsnntp_over_line * line,
+    void * context)
+{
+  clist * xover_resp_list;
+  struct newsnntp_xover_resp_item * n;
+  clist * others;
+  char * p;
+  int r;
+
+  xover_resp_list = context;
+
+  /* make a copy of the other data */
+  others = clist_new();
+  if (others == NULL)
+    goto err;
+
+  p = line->ovr_others;
+  while (p != NULL) {
+    char * next;
+    char * val;
+
+    next = strchr(p, '\t');
+    if (next != NULL) {
+      * next = '\0';
+      next ++;
+    }
+
+    val = strdup(p);
+    if (val == NULL)
+      goto free_others;
+
+    r = clist_append(others, val);
+    if (r < 0) {
+      free(val);
+      goto free_others;
+    }
+
+    p = next;
+  }
+
+  n = xover_resp_item_new(line->ovr_article, line->ovr_subject,
+      line->ovr_author, line->ovr_date, line->ovr_message_id,
+      line->ovr_references, line->ovr_size, line->ovr_line_count, others);
+  if (n == NULL)
+    goto free_others;
+
+  r = clist_append(xover_resp_list, n);
+  if (r < 0) {
+    xover_resp_item_free(n);
+    goto err;
+  }
+
+  return NEWSNNTP_NO_ERROR;
+
+ free_others:
+  clist_foreach(others, (clist_func) free, NULL);
+  clist_free(others);
+ err:
+  return NEWSNNTP_ERROR_MEMORY;
+}
+
+static int read_over_lines(newsnntp * f,
+    newsnntp_over_callback * callback, void * context);
 
+static int newsnntp_over_resp(newsnntp * f,
+    newsnntp_over_callback * callback, void * context);
 
 static int newsnntp_xover_resp(newsnntp * f, clist ** result);
 
@@ -1625,8 +1975,13 @@ int newsnntp_xover_single(newsnntp * f, uint32_t article,
     return r;
 
   cur = clist_begin(list);
+  if (cur == NULL) {
+    clist_free(list);
+    return NEWSNNTP_ERROR_INVALID_ARTICLE_NUMBER;
+  }
   item = clist_content(cur);
-  clist_free(list);
+  clist_delete(list, cur);
+  newsnntp_xover_resp_list_free(list);
   
   * result = item;
 
@@ -1648,6 +2003,65 @@ int newsnntp_xover_range(newsnntp * f, uint32_t rangeinf, uint32_t rangesup,
 }
 
 static int newsnntp_xover_resp(newsnntp * f, clist ** result)
+{
+  clist * xover_resp_list;
+  int r;
+
+  xover_resp_list = clist_new();
+  if (xover_resp_list == NULL)
+    return NEWSNNTP_ERROR_MEMORY;
+
+  r = newsnntp_over_resp(f, xover_resp_list_add, xover_resp_list);
+  if (r != NEWSNNTP_NO_ERROR) {
+    newsnntp_xover_resp_list_free(xover_resp_list);
+    return r;
+  }
+
+  * result = xover_resp_list;
+
+  return NEWSNNTP_NO_ERROR;
+}
+
+int newsnntp_over_range(newsnntp * f, uint32_t rangeinf, uint32_t rangesup,
+    newsnntp_over_callback * callback, void * context)
+{
+  char command[NNTP_STRING_SIZE];
+  const char * over;
+  int r;
+
+  if (newsnntp_has_over(f))
+    over = "OVER";
+  else
+    over = "XOVER";
+
+  if (rangesup == 0)
+    snprintf(command, NNTP_STRING_SIZE, "%s %u-\r\n", over, rangeinf);
+  else
+    snprintf(command, NNTP_STRING_SIZE, "%s %u-%u\r\n",
+        over, rangeinf, rangesup);
+  r = send_command(f, command);
+  if (r == -1)
+    return NEWSNNTP_ERROR_STREAM;
+
+  return newsnntp_over_resp(f, callback, context);
+}
+
+int newsnntp_over_message_id(newsnntp * f, const char * msg_id,
+    newsnntp_over_callback * callback, void * context)
+{
+  char command[NNTP_STRING_SIZE];
+  int r;
+
+  snprintf(command, NNTP_STRING_SIZE, "OVER <%s>\r\n", msg_id);
+  r = send_command(f, command);
+  if (r == -1)
+    return NEWSNNTP_ERROR_STREAM;
+
+  return newsnntp_over_resp(f, callback, context);
+}
+
+static int newsnntp_over_resp(newsnntp * f,
+    newsnntp_over_callback * callback, void * context)
 {
   int r;
   char * response;
@@ -1666,8 +2080,7 @@ static int newsnntp_xover_resp(newsnntp * f, clist ** result)
     return NEWSNNTP_WARNING_REQUEST_AUTHORIZATION_PASSWORD;
       
   case 224:
-    * result = read_xover_resp_list(f);
-    return NEWSNNTP_NO_ERROR;
+    return read_over_lines(f, callback, context);
 
   case 412:
     return NEWSNNTP_ERROR_NO_NEWSGROUP_SELECTED;
@@ -1675,9 +2088,24 @@ static int newsnntp_xover_resp(newsnntp * f, clist ** result)
   case 420:
     return NEWSNNTP_ERROR_NO_ARTICLE_SELECTED;
 
+  case 423:
+    return NEWSNNTP_ERROR_INVALID_ARTICLE_NUMBER;
+
+  case 430:
+    return NEWSNNTP_ERROR_ARTICLE_NOT_FOUND;
+
+  case 500:
+    return NEWSNNTP_ERROR_COMMAND_NOT_UNDERSTOOD;
+
+  case 501:
+    return NEWSNNTP_ERROR_COMMAND_NOT_SUPPORTED;
+
   case 502:
     return NEWSNNTP_ERROR_NO_PERMISSION;
 
+  case 503:
+    return NEWSNNTP_ERROR_PROGRAM_ERROR;
+
   default:
     return NEWSNNTP_ERROR_UNEXPECTED_RESPONSE;
   }
@@ -1718,6 +2146,7 @@ int newsnntp_authinfo_generic(newsnntp * f, const char * authentificator,
     return NEWSNNTP_WARNING_REQUEST_AUTHORIZATION_PASSWORD;
       
   case 281:
+    capabilities_free(f);
     return NEWSNNTP_NO_ERROR;
 
   case 500:
@@ -2337,181 +2766,73 @@ static clist * read_xhdr_resp_list(newsnntp * f)
 }
 
 
-static clist * read_xover_resp_list(newsnntp * f)
-{
-  char * line;
-  clist * xover_resp_list;
-  struct newsnntp_xover_resp_item * n;
-  clist * values_list;
-  clistiter * current;
-  uint32_t article;
-  char * subject;
-  char * author;
-  char * date;
-  char * message_id;
-  char * references;
-  size_t size;
-  uint32_t line_count;
-  clist * others;
-  int r;
-  
-  xover_resp_list = clist_new();
-  if (xover_resp_list == NULL)
-    goto err;
+/* split the line in place, the fields are separated with \t */
 
-  while (1) {
-    char * p;
-      
-    line = read_line(f);
+static int parse_over_line(char * line, struct newsnntp_over_line * item)
+{
+  char * fields[8];
+  char * p;
+  unsigned int i;
 
-    if (line == NULL)
-      goto free_list;
+  for(i = 0 ; i < 8 ; i ++) {
+    fields[i] = line;
 
-    if (mailstream_is_end_multiline(line))
+    p = strchr(line, '\t');
+    if (p == NULL) {
+      if (i < 7)
+        return -1;
+      line = NULL;
       break;
-
-    /* parse the data separated with \t */
-
-    values_list = clist_new();
-    if (values_list == NULL)
-      goto free_list;
-
-    while ((p = strchr(line, '\t')) != NULL) {
-      * p = 0;
-      p ++;
-
-      r = clist_append(values_list, line);
-      if (r < 0)
-        goto free_values_list;
-      line = p;
     }
 
-    r = clist_append(values_list, line);
-    if (r < 0)
-      goto free_values_list;
+    * p = '\0';
+    line = p + 1;
+  }
 
-    /* set the known data */
-    current = clist_begin(values_list);
-    if (current == NULL) {
-      clist_free(values_list);
-      continue;
-    }
-    article = 0;
-    if (clist_content(current) != NULL) {
-      article = atoi((char *) clist_content(current));
-    }
+  item->ovr_article = strtoul(fields[0], NULL, 10);
+  item->ovr_subject = fields[1];
+  item->ovr_author = fields[2];
+  item->ovr_date = fields[3];
+  item->ovr_message_id = fields[4];
+  item->ovr_references = fields[5];
+  item->ovr_size = strtoul(fields[6], NULL, 10);
+  item->ovr_line_count = strtoul(fields[7], NULL, 10);
+  item->ovr_others = line;
 
-    current = clist_next(current);
-    if (current == NULL) {
-      clist_free(values_list);
-      continue;
-    }
-    subject = clist_content(current);
+  return 0;
+}
 
-    current = clist_next(current);
-    if (current == NULL) {
-      clist_free(values_list);
-      continue;
-    }
-    author = clist_content(current);
+static int read_over_lines(newsnntp * f,
+    newsnntp_over_callback * callback, void * context)
+{
+  char * line;
+  struct newsnntp_over_line item;
+  int res;
+  int r;
 
-    current = clist_next(current);
-    if (current == NULL) {
-      clist_free(values_list);
-      continue;
-    }
-    date = clist_content(current);
+  res = NEWSNNTP_NO_ERROR;
 
-    current = clist_next(current);
-    if (current == NULL) {
-      clist_free(values_list);
-      continue;
-    }
-    message_id = clist_content(current);
+  while (1) {
+    line = read_line(f);
 
-    current = clist_next(current);
-    if (current == NULL) {
-      clist_free(values_list);
-      continue;
-    }
-    references = clist_content(current);
+    if (line == NULL)
+      return NEWSNNTP_ERROR_STREAM;
 
-    current = clist_next(current);
-    if (current == NULL) {
-      clist_free(values_list);
-      continue;
-    }
-    size = 0;
-    if (clist_content(current) != NULL) {
-      size = atoi((char *) clist_content(current));
-    }
+    if (mailstream_is_end_multiline(line))
+      break;
 
-    current = clist_next(current);
-    if (current == NULL) {
-      clist_free(values_list);
+    /* the callback asked to stop, skip the end of the response */
+    if (res != NEWSNNTP_NO_ERROR)
       continue;
-    }
-    line_count = 0;
-    if (clist_content(current) != NULL) {
-      line_count = atoi((char *) clist_content(current));
-    }
-
-    current = clist_next(current);
-
-    /* make a copy of the other data */
-    others = clist_new();
-    if (others == NULL) {
-      goto free_values_list;
-    }
-
-    while (current) {
-      char * val;
-      char * original_val;
 
-      original_val = clist_content(current);
-      val = strdup(original_val);
-      if (val == NULL) {
-	clist_foreach(others, (clist_func) free, NULL);
-	clist_free(others);
-	goto free_list;
-      }
-
-      r = clist_append(others, val);
-      if (r < 0) {
-	goto free_list;
-      }
-
-      current = clist_next(current);
-    }
-
-    clist_free(values_list);
-
-    n = xover_resp_item_new(article, subject, author, date, message_id,
-			    references, size, line_count, others);
-    if (n == NULL) {
-      clist_foreach(others, (clist_func) free, NULL);
-      clist_free(others);
-      goto free_list;
-    }
+    r = parse_over_line(line, &item);
+    if (r < 0)
+      continue;
 
-    r = clist_append(xover_resp_list, n);
-    if (r < 0) {
-      xover_resp_item_free(n);
-      goto free_list;
-    }
+    res = callback(&item, context);
   }
 
-  return xover_resp_list;
-
- free_list:
-  newsnntp_xover_resp_list_free(xover_resp_list);
- err:
-  return NULL;
-
- free_values_list:
-  clist_foreach(values_list, (clist_func) free, NULL);
-  clist_free(values_list);
-  return NULL;
+  return res;
 }
 
 static int send_command(newsnntp * f, char * command)
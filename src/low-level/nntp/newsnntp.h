@@ -74,6 +74,25 @@ void newsnntp_head_free(char * str);
 void newsnntp_article_free(char * str);
 void newsnntp_body_free(char * str);
 
+/*
+  newsnntp_article_pipelined() and newsnntp_body_pipelined() fetch
+  several articles, keeping up to window commands in flight instead
+  of waiting for each response (0 selects a default window).
+
+  Errors specific to an article are given to the callback. If the
+  server asks for authentication or if the callback stops the fetch,
+  no further command is sent, the pending responses are skipped and
+  the error is returned. The callback was then called for the
+  articles that were processed, the caller can resume from there.
+*/
+
+int newsnntp_article_pipelined(newsnntp * f,
+    const uint32_t * indexes, unsigned int count, unsigned int window,
+    newsnntp_content_callback * callback, void * context);
+int newsnntp_body_pipelined(newsnntp * f,
+    const uint32_t * indexes, unsigned int count, unsigned int window,
+    newsnntp_content_callback * callback, void * context);
+
 int newsnntp_mode_reader(newsnntp * f);
 
 int newsnntp_date(newsnntp * f, struct tm * tm);
@@ -86,6 +105,27 @@ int newsnntp_authinfo_password(newsnntp * f, const char * password);
 
 int newsnntp_post(newsnntp * f, const char * message, size_t size);
 
+/*
+  newsnntp_capabilities() sends CAPABILITIES (RFC 3977) and keeps the
+  result until the capabilities can change (authentication,
+  MODE READER, COMPRESS).
+  newsnntp_has_capability() checks the first word of the lines, it
+  returns FALSE if the capabilities were not fetched.
+*/
+
+int newsnntp_capabilities(newsnntp * f);
+int newsnntp_has_capability(newsnntp * f, const char * capability);
+int newsnntp_has_over(newsnntp * f);
+int newsnntp_has_compress_deflate(newsnntp * f);
+
+/*
+  newsnntp_compress() sends COMPRESS DEFLATE (RFC 8054) and compresses
+  the rest of the session. NEWSNNTP_ERROR_COMPRESS is returned when
+  the server refuses it or when libetpan was built without zlib.
+*/
+
+int newsnntp_compress(newsnntp * f);
+
 
 
 
@@ -184,6 +224,22 @@ int newsnntp_xover_range(newsnntp * f, uint32_t rangeinf, uint32_t rangesup,
 void xover_resp_item_free(struct newsnntp_xover_resp_item * n);
 void newsnntp_xover_resp_list_free(clist * l);
 
+/*
+  newsnntp_over_range() and newsnntp_over_message_id() call callback
+  for each overview line instead of building a list, nothing is
+  copied. OVER is sent when the server advertises it, XOVER otherwise.
+  If rangesup is 0, the range has no upper bound. As for
+  newsnntp_article_by_message_id(), msg_id is given without the angle
+  brackets.
+  NEWSNNTP_ERROR_INVALID_ARTICLE_NUMBER is returned when there is no
+  article in the range.
+*/
+
+int newsnntp_over_range(newsnntp * f, uint32_t rangeinf, uint32_t rangesup,
+    newsnntp_over_callback * callback, void * context);
+int newsnntp_over_message_id(newsnntp * f, const char * msg_id,
+    newsnntp_over_callback * callback, void * context);
+
 #ifdef __cplusplus
 }
 #endif
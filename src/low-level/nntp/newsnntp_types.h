@@ -73,6 +73,7 @@ enum {
   NEWSNNTP_ERROR_BAD_STATE,
   NEWSNNTP_ERROR_SSL,
   NEWSNNTP_ERROR_AUTHENTICATION_OUT_OF_SEQUENCE,
+  NEWSNNTP_ERROR_COMPRESS,
 };
 
 struct newsnntp
@@ -88,6 +89,8 @@ struct newsnntp
   MMAPString * nntp_response_buffer;
 
   char * nntp_response;
+
+  clist * nntp_capabilities;
 };
 
 typedef struct newsnntp newsnntp;
@@ -140,6 +143,51 @@ struct newsnntp_xover_resp_item {
   clist * ovr_others;
 };
 
+/*
+  overview line given to the newsnntp_over_range() and
+  newsnntp_over_message_id() callback.
+
+  The strings point into the line that was just read and are only
+  valid during the call. ovr_others is the rest of the line, the
+  remaining fields still being separated with tabulations, or NULL.
+*/
+
+struct newsnntp_over_line {
+  uint32_t ovr_article;
+  char * ovr_subject;
+  char * ovr_author;
+  char * ovr_date;
+  char * ovr_message_id;
+  char * ovr_references;
+  size_t ovr_size;
+  uint32_t ovr_line_count;
+  char * ovr_others;
+};
+
+/*
+  returns NEWSNNTP_NO_ERROR to get the next line. Any other value
+  stops the callbacks, the rest of the response is skipped and the
+  value is returned to the caller.
+*/
+
+typedef int newsnntp_over_callback(struct newsnntp_over_line * line,
+    void * context);
+
+/*
+  called by newsnntp_article_pipelined() and newsnntp_body_pipelined()
+  for each article, in the order of the request.
+
+  If error is NEWSNNTP_NO_ERROR, content belongs to the callback and
+  is freed with newsnntp_article_free() or newsnntp_body_free().
+  Otherwise, content is NULL and error tells why the article could
+  not be fetched (NEWSNNTP_ERROR_ARTICLE_NOT_FOUND, ...).
+
+  Returning anything else than NEWSNNTP_NO_ERROR stops the fetch.
+*/
+
+typedef int newsnntp_content_callback(uint32_t indx, int error,
+    char * content, size_t content_len, void * context);
+
 #ifdef __cplusplus
 }
 #endif
@@ -75,6 +75,7 @@
 #endif
 
 #include "mailsasl.h"
+#include "mailmime_write_generic.h"
 
 /*
   RFC 2821 : SMTP
@@ -165,6 +166,7 @@ void mailsmtp_free(mailsmtp * session)
 
 static int send_command(mailsmtp * f, char * command);
 static int send_command_private(mailsmtp * f, char * command, int can_be_published);
+static int write_command(mailsmtp * f, char * command);
 
 static int read_response(mailsmtp * session);
 
@@ -365,18 +367,9 @@ int mailsmtp_rcpt(mailsmtp * session, const char * to)
   return mailesmtp_rcpt(session, to, 0, NULL);
 }
 
-int mailsmtp_data(mailsmtp * session)
+static int data_response(int code)
 {
-  int r;
-  char command[SMTP_STRING_SIZE];
-
-  snprintf(command, SMTP_STRING_SIZE, "DATA\r\n");
-  r = send_command(session, command);
-  if (r == -1)
-    return MAILSMTP_ERROR_STREAM;
-  r = read_response(session);
-
-  switch (r) {
+  switch (code) {
   case 354:
     return MAILSMTP_NO_ERROR;
 
@@ -394,21 +387,25 @@ int mailsmtp_data(mailsmtp * session)
   }
 }
 
-static int send_data(mailsmtp * session, const char * message, size_t size);
-
-int mailsmtp_data_message(mailsmtp * session,
-			   const char * message,
-			   size_t size)
+int mailsmtp_data(mailsmtp * session)
 {
   int r;
+  char command[SMTP_STRING_SIZE];
 
-  r = send_data(session, message, size);
+  snprintf(command, SMTP_STRING_SIZE, "DATA\r\n");
+  r = send_command(session, command);
   if (r == -1)
     return MAILSMTP_ERROR_STREAM;
-
   r = read_response(session);
 
-  switch(r) {
+  return data_response(r);
+}
+
+static int send_data(mailsmtp * session, const char * message, size_t size);
+
+static int data_message_response(int code)
+{
+  switch(code) {
   case 250:
     return MAILSMTP_NO_ERROR;
 
@@ -432,6 +429,21 @@ int mailsmtp_data_message(mailsmtp * session,
   }
 }
 
+int mailsmtp_data_message(mailsmtp * session,
+			   const char * message,
+			   size_t size)
+{
+  int r;
+
+  r = send_data(session, message, size);
+  if (r == -1)
+    return MAILSMTP_ERROR_STREAM;
+
+  r = read_response(session);
+
+  return data_message_response(r);
+}
+
 int mailsmtp_data_message_quit(mailsmtp * session,
                                const char * message,
                                size_t size)
@@ -449,28 +461,117 @@ int mailsmtp_data_message_quit(mailsmtp * session,
     mailstream_close(session->stream);
     session->stream = NULL;
 
-    switch(r) {
-        case 250:
-            return MAILSMTP_NO_ERROR;
+    return data_message_response(r);
+}
+
+/*
+  The streamed variants of mailsmtp_data_message() send the message as
+  it is read or rendered, line breaks are fixed and dots are quoted on
+  the fly. When the message can't be read completely, the connection is
+  closed since ending DATA would send a truncated message.
+*/
+
+#define DATA_BUFFER_SIZE 16384
 
-        case 552:
-            return MAILSMTP_ERROR_EXCEED_STORAGE_ALLOCATION;
+static int send_data_end(mailsmtp * session, int state)
+{
+  if (mailstream_send_data_crlf_finish(session->stream, &state) == -1)
+    return -1;
+  if (mailstream_write(session->stream, "\r\n.\r\n", 5) == -1)
+    return -1;
+  if (mailstream_flush(session->stream) == -1)
+    return -1;
 
-        case 554:
-            return MAILSMTP_ERROR_TRANSACTION_FAILED;
+  return 0;
+}
 
-        case 451:
-            return MAILSMTP_ERROR_IN_PROCESSING;
+static void send_data_abort(mailsmtp * session)
+{
+  mailstream_close(session->stream);
+  session->stream = NULL;
+}
 
-        case 452:
-            return MAILSMTP_ERROR_INSUFFICIENT_SYSTEM_STORAGE;
+int mailsmtp_data_message_reader(mailsmtp * session,
+    mailsmtp_data_reader * reader, void * context)
+{
+  char buffer[DATA_BUFFER_SIZE];
+  int state;
 
-        case 0:
-            return MAILSMTP_ERROR_STREAM;
+  state = MAILSTREAM_DATA_LINE_BEGIN;
+  while (1) {
+    ssize_t r;
 
-        default:
-            return MAILSMTP_ERROR_UNEXPECTED_CODE;
+    r = reader(context, buffer, sizeof(buffer));
+    if (r < 0) {
+      send_data_abort(session);
+      return MAILSMTP_ERROR_STREAM;
     }
+    if (r == 0)
+      break;
+
+    if (mailstream_send_data_crlf_partial(session->stream, buffer, r,
+            1, &state) == -1)
+      return MAILSMTP_ERROR_STREAM;
+  }
+
+  if (send_data_end(session, state) == -1)
+    return MAILSMTP_ERROR_STREAM;
+
+  return data_message_response(read_response(session));
+}
+
+static ssize_t fd_reader(void * context, char * buffer, size_t size)
+{
+  int * fd;
+
+  fd = context;
+
+  return read(* fd, buffer, size);
+}
+
+int mailsmtp_data_message_fd(mailsmtp * session, int fd)
+{
+  return mailsmtp_data_message_reader(session, fd_reader, &fd);
+}
+
+struct mime_data_writer {
+  mailstream * stream;
+  int state;
+};
+
+static int mime_data_write(void * data, const char * str, size_t length)
+{
+  struct mime_data_writer * writer;
+
+  writer = data;
+  if (mailstream_send_data_crlf_partial(writer->stream, str, length,
+          1, &writer->state) == -1)
+    return 0;
+
+  return (int) length;
+}
+
+int mailsmtp_data_message_mime(mailsmtp * session, struct mailmime * mime)
+{
+  struct mime_data_writer writer;
+  int col;
+  int r;
+
+  writer.stream = session->stream;
+  writer.state = MAILSTREAM_DATA_LINE_BEGIN;
+  col = 0;
+  r = mailmime_write_driver(mime_data_write, &writer, &col, mime);
+  if (r != MAILIMF_NO_ERROR) {
+    send_data_abort(session);
+    if (r == MAILIMF_ERROR_MEMORY)
+      return MAILSMTP_ERROR_MEMORY;
+    return MAILSMTP_ERROR_STREAM;
+  }
+
+  if (send_data_end(session, writer.state) == -1)
+    return MAILSMTP_ERROR_STREAM;
+
+  return data_message_response(read_response(session));
 }
 
 /* esmtp operations */
@@ -502,6 +603,8 @@ int mailesmtp_parse_ehlo(mailsmtp * session)
      SIZE [<n>]
      ETRN
      STARTTLS
+     PIPELINING
+     CHUNKING
      AUTH <mechanisms...>
   */
   while (response != NULL) {
@@ -530,6 +633,9 @@ int mailesmtp_parse_ehlo(mailsmtp * session)
     else if (!strncasecmp(response, "PIPELINING", 10) && isdelim(response[10])) {
       session->esmtp |= MAILSMTP_ESMTP_PIPELINING;
     }
+    else if (!strncasecmp(response, "CHUNKING", 8) && isdelim(response[8])) {
+      session->esmtp |= MAILSMTP_ESMTP_CHUNKING;
+    }
     else if (!strncasecmp(response, "AUTH ", 5)) {
       response += 5;       /* remove "AUTH " */
       while (response[0] != '\n' && response[0] != '\0') {
@@ -662,13 +768,9 @@ int mailesmtp_mail(mailsmtp * session,
 	return mailesmtp_mail_size(session, from, return_full, envid, 0);
 }
 
-int mailesmtp_mail_size(mailsmtp * session,
-		    const char * from,
-		    int return_full,
-		    const char * envid, size_t size)
+static void mail_command(mailsmtp * session, char * command,
+    const char * from, int return_full, const char * envid, size_t size)
 {
-  int r;
-  char command[SMTP_STRING_SIZE];
   char ret_param[SMTP_STRING_SIZE];
   char envid_param[SMTP_STRING_SIZE];
   char size_param[SMTP_STRING_SIZE];
@@ -687,13 +789,11 @@ int mailesmtp_mail_size(mailsmtp * session,
   }
   snprintf(command, SMTP_STRING_SIZE, "MAIL FROM:<%s>%s%s%s\r\n",
     from, ret_param, envid_param, size_param);
+}
 
-  r = send_command(session, command);
-  if (r == -1)
-    return MAILSMTP_ERROR_STREAM;
-  r = read_response(session);
-
-  switch (r) {
+static int mail_response(int code)
+{
+  switch (code) {
   case 250:
     return MAILSMTP_NO_ERROR;
 
@@ -723,13 +823,26 @@ int mailesmtp_mail_size(mailsmtp * session,
   }
 }
 
-int mailesmtp_rcpt(mailsmtp * session,
-		    const char * to,
-		    int notify,
-		    const char * orcpt)
+int mailesmtp_mail_size(mailsmtp * session,
+		    const char * from,
+		    int return_full,
+		    const char * envid, size_t size)
 {
   int r;
   char command[SMTP_STRING_SIZE];
+
+  mail_command(session, command, from, return_full, envid, size);
+  r = send_command(session, command);
+  if (r == -1)
+    return MAILSMTP_ERROR_STREAM;
+  r = read_response(session);
+
+  return mail_response(r);
+}
+
+static void rcpt_command(mailsmtp * session, char * command,
+    const char * to, int notify, const char * orcpt)
+{
   char notify_str[30] = "";
   char notify_info_str[30] = "";
 
@@ -755,13 +868,11 @@ int mailesmtp_rcpt(mailsmtp * session,
 	     to, notify_str, orcpt);
   else
     snprintf(command, SMTP_STRING_SIZE, "RCPT TO:<%s>%s\r\n", to, notify_str);
+}
 
-  r = send_command(session, command);
-  if (r == -1)
-    return MAILSMTP_ERROR_STREAM;
-  r = read_response(session);
-
-  switch (r) {
+static int rcpt_response(int code)
+{
+  switch (code) {
   case 250:
     return MAILSMTP_NO_ERROR;
 
@@ -798,6 +909,261 @@ int mailesmtp_rcpt(mailsmtp * session,
   }
 }
 
+int mailesmtp_rcpt(mailsmtp * session,
+		    const char * to,
+		    int notify,
+		    const char * orcpt)
+{
+  int r;
+  char command[SMTP_STRING_SIZE];
+
+  rcpt_command(session, command, to, notify, orcpt);
+  r = send_command(session, command);
+  if (r == -1)
+    return MAILSMTP_ERROR_STREAM;
+  r = read_response(session);
+
+  return rcpt_response(r);
+}
+
+/*
+  When the server supports PIPELINING (RFC 2920), MAIL FROM, all the
+  RCPT TO and DATA are written at once and the stream is flushed a single
+  time. The replies are read afterwards, in the order of the commands.
+  Without PIPELINING, each command waits for its reply.
+*/
+
+int mailesmtp_envelope(mailsmtp * session,
+    const char * from, int return_full, const char * envid, size_t size,
+    clist * addresses, int with_data, int * rcpt_results)
+{
+  char command[SMTP_STRING_SIZE];
+  clistiter * cur;
+  unsigned int i;
+  int pipelining;
+  int accepted;
+  int mail_res;
+  int rcpt_res;
+  int data_res;
+  int res;
+  int r;
+
+  pipelining = (session->esmtp & MAILSMTP_ESMTP_PIPELINING) != 0;
+
+  mail_command(session, command, from, return_full, envid, size);
+  if (pipelining) {
+    if (write_command(session, command) == -1)
+      return MAILSMTP_ERROR_STREAM;
+
+    for(cur = clist_begin(addresses) ; cur != NULL ; cur = clist_next(cur)) {
+      struct esmtp_address * addr;
+
+      addr = clist_content(cur);
+      rcpt_command(session, command, addr->address, addr->notify, addr->orcpt);
+      if (write_command(session, command) == -1)
+        return MAILSMTP_ERROR_STREAM;
+    }
+
+    if (with_data) {
+      snprintf(command, SMTP_STRING_SIZE, "DATA\r\n");
+      if (write_command(session, command) == -1)
+        return MAILSMTP_ERROR_STREAM;
+    }
+
+    if (mailstream_flush(session->stream) == -1)
+      return MAILSMTP_ERROR_STREAM;
+
+    mail_res = mail_response(read_response(session));
+    if (mail_res == MAILSMTP_ERROR_STREAM)
+      return mail_res;
+  }
+  else {
+    if (send_command(session, command) == -1)
+      return MAILSMTP_ERROR_STREAM;
+
+    mail_res = mail_response(read_response(session));
+    if (mail_res != MAILSMTP_NO_ERROR)
+      return mail_res;
+  }
+
+  /* all the replies have to be read, even when MAIL FROM failed */
+  accepted = 0;
+  rcpt_res = MAILSMTP_NO_ERROR;
+  i = 0;
+  for(cur = clist_begin(addresses) ; cur != NULL ; cur = clist_next(cur)) {
+    if (!pipelining) {
+      struct esmtp_address * addr;
+
+      addr = clist_content(cur);
+      rcpt_command(session, command, addr->address, addr->notify, addr->orcpt);
+      if (send_command(session, command) == -1)
+        return MAILSMTP_ERROR_STREAM;
+    }
+
+    r = rcpt_response(read_response(session));
+    if (r == MAILSMTP_ERROR_STREAM)
+      return r;
+
+    if (rcpt_results != NULL)
+      rcpt_results[i] = r;
+    if (r == MAILSMTP_NO_ERROR)
+      accepted ++;
+    else if (rcpt_res == MAILSMTP_NO_ERROR)
+      rcpt_res = r;
+    i ++;
+  }
+
+  if (mail_res != MAILSMTP_NO_ERROR)
+    res = mail_res;
+  else if (accepted == 0)
+    res = rcpt_res;
+  else
+    res = MAILSMTP_NO_ERROR;
+
+  if (!with_data)
+    return res;
+
+  if (!pipelining) {
+    if (res != MAILSMTP_NO_ERROR)
+      return res;
+
+    return mailsmtp_data(session);
+  }
+
+  r = read_response(session);
+  if (r == 0)
+    return MAILSMTP_ERROR_STREAM;
+  data_res = data_response(r);
+
+  if (res == MAILSMTP_NO_ERROR)
+    return data_res;
+
+  if (data_res == MAILSMTP_NO_ERROR) {
+    /* DATA was accepted though the transaction failed, end it empty */
+    snprintf(command, SMTP_STRING_SIZE, ".\r\n");
+    if (send_command(session, command) == -1)
+      return MAILSMTP_ERROR_STREAM;
+    read_response(session);
+  }
+
+  return res;
+}
+
+int mailesmtp_bdat(mailsmtp * session,
+    const char * data, size_t size, int last)
+{
+  char command[SMTP_STRING_SIZE];
+
+  snprintf(command, SMTP_STRING_SIZE, "BDAT %lu%s\r\n",
+      (unsigned long) size, last ? " LAST" : "");
+  if (write_command(session, command) == -1)
+    return MAILSMTP_ERROR_STREAM;
+  if (mailstream_write(session->stream, data, size) == -1)
+    return MAILSMTP_ERROR_STREAM;
+  if (mailstream_flush(session->stream) == -1)
+    return MAILSMTP_ERROR_STREAM;
+
+  return data_message_response(read_response(session));
+}
+
+/*
+  The message is cut after a line break every BDAT_CHUNK_SIZE bytes so
+  that a CRLF is never split between two chunks. With PIPELINING, up to
+  BDAT_MAX_PENDING chunks are sent before their replies are read.
+*/
+
+#define BDAT_CHUNK_SIZE (256 * 1024)
+#define BDAT_MAX_PENDING 16
+
+int mailesmtp_bdat_message(mailsmtp * session,
+    const char * message, size_t size)
+{
+  char command[SMTP_STRING_SIZE];
+  const char * current;
+  size_t remaining;
+  unsigned int max_pending;
+  unsigned int pending;
+  int add_crlf;
+  int res;
+  int r;
+
+  if ((session->esmtp & MAILSMTP_ESMTP_PIPELINING) != 0)
+    max_pending = BDAT_MAX_PENDING;
+  else
+    max_pending = 1;
+
+  /* like DATA, make sure the message ends with a line break */
+  add_crlf = (size == 0) ||
+    ((message[size - 1] != '\n') && (message[size - 1] != '\r'));
+
+  current = message;
+  remaining = size;
+  pending = 0;
+  res = MAILSMTP_NO_ERROR;
+  do {
+    size_t chunk_size;
+    size_t fixed_size;
+    int last;
+
+    chunk_size = remaining;
+    if (remaining > BDAT_CHUNK_SIZE) {
+      const char * lf;
+
+      lf = memchr(current + BDAT_CHUNK_SIZE - 1, '\n',
+          remaining - BDAT_CHUNK_SIZE + 1);
+      if (lf != NULL)
+        chunk_size = lf + 1 - current;
+    }
+    last = (chunk_size == remaining);
+
+    fixed_size = mailstream_get_data_crlf_size(current, chunk_size);
+    if (last && add_crlf)
+      fixed_size += 2;
+
+    snprintf(command, SMTP_STRING_SIZE, "BDAT %lu%s\r\n",
+        (unsigned long) fixed_size, last ? " LAST" : "");
+    if (write_command(session, command) == -1)
+      return MAILSMTP_ERROR_STREAM;
+    if (mailstream_send_data_crlf(session->stream, current, chunk_size,
+            0, NULL) == -1)
+      return MAILSMTP_ERROR_STREAM;
+    if (last && add_crlf) {
+      if (mailstream_write(session->stream, "\r\n", 2) == -1)
+        return MAILSMTP_ERROR_STREAM;
+    }
+    pending ++;
+
+    current += chunk_size;
+    remaining -= chunk_size;
+
+    if (session->smtp_progress_fun != NULL)
+      session->smtp_progress_fun(size - remaining, size,
+          session->smtp_progress_context);
+    else if (session->progr_fun != NULL)
+      session->progr_fun(size - remaining, size);
+
+    if (last || (pending >= max_pending)) {
+      if (mailstream_flush(session->stream) == -1)
+        return MAILSMTP_ERROR_STREAM;
+
+      while (pending > 0) {
+        r = data_message_response(read_response(session));
+        if (r == MAILSMTP_ERROR_STREAM)
+          return r;
+        if (res == MAILSMTP_NO_ERROR)
+          res = r;
+        pending --;
+      }
+
+      if (res != MAILSMTP_NO_ERROR)
+        return res;
+    }
+  }
+  while (remaining > 0);
+
+  return res;
+}
+
 int auth_map_errors(int err)
 {
   switch (err) {
@@ -1033,6 +1399,15 @@ static int send_command(mailsmtp * f, char * command)
   return send_command_private(f, command, 1);
 }
 
+static int write_command(mailsmtp * f, char * command)
+{
+  mailstream_set_privacy(f->stream, 1);
+  if (mailstream_write(f->stream, command, strlen(command)) == -1)
+    return -1;
+
+  return 0;
+}
+
 static int send_command_private(mailsmtp * f, char * command, int can_be_published)
 {
   ssize_t r;
@@ -45,6 +45,7 @@ extern "C" {
 #include <libetpan/mailsmtp_helper.h>
 #include <libetpan/mailsmtp_socket.h>
 #include <libetpan/mailsmtp_ssl.h>
+#include <libetpan/mailsmtp_pool.h>
 
 
 LIBETPAN_EXPORT
@@ -103,6 +104,22 @@ int mailsmtp_data_message_quit(mailsmtp * session,
                                const char * message,
                                size_t size);
 
+/*
+  mailsmtp_data_message_reader() sends the message returned by reader
+  after mailsmtp_data(). The message is never loaded in memory as a whole.
+*/
+LIBETPAN_EXPORT
+int mailsmtp_data_message_reader(mailsmtp * session,
+    mailsmtp_data_reader * reader, void * context);
+
+/* mailsmtp_data_message_fd() sends the message read from fd */
+LIBETPAN_EXPORT
+int mailsmtp_data_message_fd(mailsmtp * session, int fd);
+
+/* mailsmtp_data_message_mime() sends the message rendered from a MIME tree */
+LIBETPAN_EXPORT
+int mailsmtp_data_message_mime(mailsmtp * session, struct mailmime * mime);
+
 LIBETPAN_EXPORT
 int mailesmtp_ehlo(mailsmtp * session);
 
@@ -127,6 +144,37 @@ int mailesmtp_rcpt(mailsmtp * session,
 		    int notify,
 		    const char * orcpt);
 
+/*
+  mailesmtp_envelope() sends MAIL FROM, a RCPT TO for each esmtp_address
+  of the list and, if with_data is set, DATA. The commands are pipelined
+  when the server supports it.
+  rcpt_results can be NULL or an array of clist_count(addresses) integers
+  that receives the MAILSMTP_* result of each recipient once MAIL FROM
+  was accepted.
+  The MAIL FROM error is returned, or the first recipient error when no
+  recipient was accepted, or the DATA result.
+*/
+LIBETPAN_EXPORT
+int mailesmtp_envelope(mailsmtp * session,
+    const char * from, int return_full, const char * envid, size_t size,
+    clist * addresses, int with_data, int * rcpt_results);
+
+/*
+  mailesmtp_bdat() sends a chunk of the message with BDAT (RFC 3030),
+  data is sent as is and last must be set for the final chunk.
+*/
+LIBETPAN_EXPORT
+int mailesmtp_bdat(mailsmtp * session,
+    const char * data, size_t size, int last);
+
+/*
+  mailesmtp_bdat_message() sends the message with BDAT instead of DATA,
+  line breaks are fixed to CRLF but no dot-stuffing is needed.
+*/
+LIBETPAN_EXPORT
+int mailesmtp_bdat_message(mailsmtp * session,
+    const char * message, size_t size);
+
 LIBETPAN_EXPORT
 int mailesmtp_starttls(mailsmtp * session);
 
@@ -38,8 +38,11 @@
 #endif
 
 #include "mailsmtp.h"
+#include "mailsmtp_private.h"
 #include <string.h>
 #include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 #include "mail.h"
 
 int mailsmtp_init(mailsmtp * session)
@@ -63,19 +66,62 @@ int mailsmtp_init_with_ip(mailsmtp * session, int useip)
   return r;
 }
 
-int mailesmtp_send(mailsmtp * session,
-		    const char * from,
-		    int return_full,
-		    const char * envid,
-		    clist * addresses,
-		    const char * message, size_t size)
+/*
+  With PIPELINING, MAIL FROM and all the RCPT TO take a single round
+  trip. DATA is not sent along with them: the message must not be sent
+  if one of the recipients is rejected.
+*/
+
+static int send_envelope(mailsmtp * session,
+    const char * from, int return_full, const char * envid,
+    clist * addresses, size_t size)
 {
+  int * rcpt_results;
+  unsigned int i;
+  int res;
   int r;
-  clistiter * l;
 
-  if (!session->esmtp)
-    return mailsmtp_send(session, from, addresses, message, size);
+  if ((session->esmtp & MAILSMTP_ESMTP_PIPELINING) == 0) {
+    clistiter * l;
+
+    r = mailesmtp_mail_size(session, from, return_full, envid, size);
+    if (r != MAILSMTP_NO_ERROR)
+      return r;
+
+    for(l = clist_begin(addresses) ; l != NULL; l = clist_next(l)) {
+      struct esmtp_address * addr;
+
+      addr = clist_content(l);
+
+      r = mailesmtp_rcpt(session, addr->address, addr->notify, addr->orcpt);
+      if (r != MAILSMTP_NO_ERROR)
+        return r;
+    }
 
+    return MAILSMTP_NO_ERROR;
+  }
+
+  rcpt_results = malloc(sizeof(* rcpt_results) * (clist_count(addresses) + 1));
+  if (rcpt_results == NULL)
+    return MAILSMTP_ERROR_MEMORY;
+
+  res = mailesmtp_envelope(session, from, return_full, envid, size,
+      addresses, 0, rcpt_results);
+  if (res == MAILSMTP_NO_ERROR) {
+    for(i = 0 ; i < (unsigned int) clist_count(addresses) ; i ++) {
+      if (rcpt_results[i] != MAILSMTP_NO_ERROR) {
+        res = rcpt_results[i];
+        break;
+      }
+    }
+  }
+  free(rcpt_results);
+
+  return res;
+}
+
+static int check_size(mailsmtp * session, size_t size)
+{
   if ((session->esmtp & MAILSMTP_ESMTP_SIZE) != 0) {
     if (session->smtp_max_msg_size != 0) {
       if (size > session->smtp_max_msg_size) {
@@ -84,24 +130,68 @@ int mailesmtp_send(mailsmtp * session,
     }
   }
 
-  r = mailesmtp_mail_size(session, from, return_full, envid, size);
-  if (r != MAILSMTP_NO_ERROR)
-    return r;
+  return MAILSMTP_NO_ERROR;
+}
 
-  for(l = clist_begin(addresses) ; l != NULL; l = clist_next(l)) {
-    struct esmtp_address * addr;
-    
-    addr = clist_content(l);
+int mailesmtp_send(mailsmtp * session,
+		    const char * from,
+		    int return_full,
+		    const char * envid,
+		    clist * addresses,
+		    const char * message, size_t size)
+{
+  int content_sent;
+
+  return mailesmtp_send_private(session, from, return_full, envid,
+      addresses, message, size, &content_sent);
+}
+
+int mailesmtp_send_private(mailsmtp * session,
+    const char * from, int return_full, const char * envid,
+    clist * addresses, const char * message, size_t size,
+    int * p_content_sent)
+{
+  int r;
+
+  * p_content_sent = 0;
+
+  if (!session->esmtp) {
+    clistiter * l;
+
+    r = mailsmtp_mail(session, from);
+    if (r != MAILSMTP_NO_ERROR)
+      return r;
+
+    for(l = clist_begin(addresses) ; l != NULL; l = clist_next(l)) {
+      struct esmtp_address * addr;
+
+      addr = clist_content(l);
 
-    r = mailesmtp_rcpt(session, addr->address, addr->notify, addr->orcpt);
+      r = mailsmtp_rcpt(session, addr->address);
+      if (r != MAILSMTP_NO_ERROR)
+        return r;
+    }
+  }
+  else {
+    r = check_size(session, size);
     if (r != MAILSMTP_NO_ERROR)
       return r;
+
+    r = send_envelope(session, from, return_full, envid, addresses, size);
+    if (r != MAILSMTP_NO_ERROR)
+      return r;
+
+    if ((session->esmtp & MAILSMTP_ESMTP_CHUNKING) != 0) {
+      * p_content_sent = 1;
+      return mailesmtp_bdat_message(session, message, size);
+    }
   }
 
   r = mailsmtp_data(session);
   if (r != MAILSMTP_NO_ERROR)
     return r;
 
+  * p_content_sent = 1;
   r = mailsmtp_data_message(session, message, size);
   if (r != MAILSMTP_NO_ERROR)
     return r;
@@ -109,6 +199,118 @@ int mailesmtp_send(mailsmtp * session,
   return MAILSMTP_NO_ERROR;
 }
 
+/*
+  Unlike mailesmtp_send(), the message is delivered to the recipients
+  that were accepted, the result of each recipient is stored in
+  rcpt_results. With PIPELINING and without CHUNKING, DATA is sent
+  along with the envelope.
+*/
+
+int mailesmtp_send_with_results(mailsmtp * session,
+    const char * from,
+    int return_full,
+    const char * envid,
+    clist * addresses,
+    int * rcpt_results,
+    const char * message, size_t size)
+{
+  int chunking;
+  int r;
+
+  r = check_size(session, size);
+  if (r != MAILSMTP_NO_ERROR)
+    return r;
+
+  chunking = (session->esmtp & MAILSMTP_ESMTP_CHUNKING) != 0;
+
+  r = mailesmtp_envelope(session, from, return_full, envid, size,
+      addresses, !chunking, rcpt_results);
+  if (r != MAILSMTP_NO_ERROR)
+    return r;
+
+  if (chunking)
+    return mailesmtp_bdat_message(session, message, size);
+
+  return mailsmtp_data_message(session, message, size);
+}
+
+/*
+  The streamed variants of mailesmtp_send() always use DATA: BDAT needs
+  the size of each chunk before it is sent.
+*/
+
+int mailesmtp_send_reader(mailsmtp * session,
+    const char * from,
+    int return_full,
+    const char * envid,
+    clist * addresses,
+    mailsmtp_data_reader * reader, void * context)
+{
+  int r;
+
+  r = send_envelope(session, from, return_full, envid, addresses, 0);
+  if (r != MAILSMTP_NO_ERROR)
+    return r;
+
+  r = mailsmtp_data(session);
+  if (r != MAILSMTP_NO_ERROR)
+    return r;
+
+  return mailsmtp_data_message_reader(session, reader, context);
+}
+
+int mailesmtp_send_fd(mailsmtp * session,
+    const char * from,
+    int return_full,
+    const char * envid,
+    clist * addresses,
+    int fd)
+{
+  struct stat stat_info;
+  size_t size;
+  int r;
+
+  size = 0;
+  if (fstat(fd, &stat_info) == 0) {
+    if (S_ISREG(stat_info.st_mode))
+      size = stat_info.st_size;
+  }
+
+  r = check_size(session, size);
+  if (r != MAILSMTP_NO_ERROR)
+    return r;
+
+  r = send_envelope(session, from, return_full, envid, addresses, size);
+  if (r != MAILSMTP_NO_ERROR)
+    return r;
+
+  r = mailsmtp_data(session);
+  if (r != MAILSMTP_NO_ERROR)
+    return r;
+
+  return mailsmtp_data_message_fd(session, fd);
+}
+
+int mailesmtp_send_mime(mailsmtp * session,
+    const char * from,
+    int return_full,
+    const char * envid,
+    clist * addresses,
+    struct mailmime * mime)
+{
+  int r;
+
+  r = send_envelope(session, from, return_full, envid, addresses, 0);
+  if (r != MAILSMTP_NO_ERROR)
+    return r;
+
+  r = mailsmtp_data(session);
+  if (r != MAILSMTP_NO_ERROR)
+    return r;
+
+  return mailsmtp_data_message_mime(session, mime);
+}
+
 int mailesmtp_send_quit(mailsmtp * session,
                         const char * from,
                         int return_full,
@@ -117,32 +319,17 @@ int mailesmtp_send_quit(mailsmtp * session,
                         const char * message, size_t size)
 {
   int r;
-  clistiter * l;
   
   if (!session->esmtp)
     return mailsmtp_send(session, from, addresses, message, size);
   
-  if ((session->esmtp & MAILSMTP_ESMTP_SIZE) != 0) {
-    if (session->smtp_max_msg_size != 0) {
-      if (size > session->smtp_max_msg_size) {
-        return MAILSMTP_ERROR_EXCEED_STORAGE_ALLOCATION;
-      }
-    }
-  }
-  
-  r = mailesmtp_mail_size(session, from, return_full, envid, size);
+  r = check_size(session, size);
   if (r != MAILSMTP_NO_ERROR)
     return r;
   
-  for(l = clist_begin(addresses) ; l != NULL; l = clist_next(l)) {
-    struct esmtp_address * addr;
-    
-    addr = clist_content(l);
-    
-    r = mailesmtp_rcpt(session, addr->address, addr->notify, addr->orcpt);
-    if (r != MAILSMTP_NO_ERROR)
-      return r;
-  }
+  r = send_envelope(session, from, return_full, envid, addresses, size);
+  if (r != MAILSMTP_NO_ERROR)
+    return r;
   
   r = mailsmtp_data(session);
   if (r != MAILSMTP_NO_ERROR)
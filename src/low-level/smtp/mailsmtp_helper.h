@@ -54,6 +54,35 @@ int mailesmtp_send(mailsmtp * session,
 		    clist * addresses,
 		    const char * message, size_t size);
 
+int mailesmtp_send_with_results(mailsmtp * session,
+    const char * from,
+    int return_full,
+    const char * envid,
+    clist * addresses,
+    int * rcpt_results,
+    const char * message, size_t size);
+
+int mailesmtp_send_reader(mailsmtp * session,
+    const char * from,
+    int return_full,
+    const char * envid,
+    clist * addresses,
+    mailsmtp_data_reader * reader, void * context);
+
+int mailesmtp_send_fd(mailsmtp * session,
+    const char * from,
+    int return_full,
+    const char * envid,
+    clist * addresses,
+    int fd);
+
+int mailesmtp_send_mime(mailsmtp * session,
+    const char * from,
+    int return_full,
+    const char * envid,
+    clist * addresses,
+    struct mailmime * mime);
+
 int mailesmtp_send_quit(mailsmtp * session,
                         const char * from,
                         int return_full,
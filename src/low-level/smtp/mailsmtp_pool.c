@@ -0,0 +1,463 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2011 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include "mailsmtp_pool.h"
+
+#include "mailsmtp.h"
+#include "mailsmtp_private.h"
+#include "carray.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef WIN32
+#	include "win_etpan.h"
+#endif
+#ifdef LIBETPAN_REENTRANT
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+#endif
+
+#define DEFAULT_CHECK_DELAY 30
+
+struct mailsmtp_pool_session {
+  mailsmtp * ps_session;
+  time_t ps_last_used;
+};
+
+struct mailsmtp_pool {
+  char * pl_server;
+  uint16_t pl_port;
+  int pl_connection_type;
+  char * pl_auth_type;
+  char * pl_login;
+  char * pl_password;
+
+  unsigned int pl_max_connections;
+  time_t pl_check_delay;
+
+  /* number of open sessions, in use or idle */
+  unsigned int pl_count;
+  /* idle sessions, the most recently used one is the last */
+  carray * pl_idle;
+
+#ifdef LIBETPAN_REENTRANT
+#	if HAVE_PTHREAD_H
+  pthread_mutex_t pl_lock;
+  pthread_cond_t pl_released;
+#	elif (defined WIN32)
+  CRITICAL_SECTION pl_lock;
+  CONDITION_VARIABLE pl_released;
+#	endif
+#endif
+};
+
+#ifdef LIBETPAN_REENTRANT
+#	if HAVE_PTHREAD_H
+#		define POOL_LOCK(pool) pthread_mutex_lock(&(pool)->pl_lock)
+#		define POOL_UNLOCK(pool) pthread_mutex_unlock(&(pool)->pl_lock)
+#		define POOL_WAIT(pool) \
+			pthread_cond_wait(&(pool)->pl_released, &(pool)->pl_lock)
+#		define POOL_SIGNAL(pool) pthread_cond_signal(&(pool)->pl_released)
+#	elif (defined WIN32)
+#		define POOL_LOCK(pool) EnterCriticalSection(&(pool)->pl_lock)
+#		define POOL_UNLOCK(pool) LeaveCriticalSection(&(pool)->pl_lock)
+#		define POOL_WAIT(pool) \
+			SleepConditionVariableCS(&(pool)->pl_released, &(pool)->pl_lock, \
+			    INFINITE)
+#		define POOL_SIGNAL(pool) WakeConditionVariable(&(pool)->pl_released)
+#	else
+#		error "What are your threads?"
+#	endif
+#else
+#	define POOL_LOCK(pool)
+#	define POOL_UNLOCK(pool)
+#	define POOL_SIGNAL(pool)
+#endif
+
+static int pool_lock_init(struct mailsmtp_pool * pool)
+{
+#ifdef LIBETPAN_REENTRANT
+#	if HAVE_PTHREAD_H
+  if (pthread_mutex_init(&pool->pl_lock, NULL) != 0)
+    return -1;
+  if (pthread_cond_init(&pool->pl_released, NULL) != 0) {
+    pthread_mutex_destroy(&pool->pl_lock);
+    return -1;
+  }
+#	elif (defined WIN32)
+  InitializeCriticalSection(&pool->pl_lock);
+  InitializeConditionVariable(&pool->pl_released);
+#	endif
+#endif
+
+  return 0;
+}
+
+static void pool_lock_destroy(struct mailsmtp_pool * pool)
+{
+#ifdef LIBETPAN_REENTRANT
+#	if HAVE_PTHREAD_H
+  pthread_cond_destroy(&pool->pl_released);
+  pthread_mutex_destroy(&pool->pl_lock);
+#	elif (defined WIN32)
+  DeleteCriticalSection(&pool->pl_lock);
+#	endif
+#endif
+}
+
+static char * dup_or_null(const char * str, int * p_error)
+{
+  char * dup;
+
+  if (str == NULL)
+    return NULL;
+
+  dup = strdup(str);
+  if (dup == NULL)
+    * p_error = 1;
+
+  return dup;
+}
+
+struct mailsmtp_pool * mailsmtp_pool_new(const char * server, uint16_t port,
+    int connection_type, const char * auth_type,
+    const char * login, const char * password,
+    unsigned int max_connections)
+{
+  struct mailsmtp_pool * pool;
+  int error;
+
+  pool = malloc(sizeof(* pool));
+  if (pool == NULL)
+    goto err;
+
+  error = 0;
+  pool->pl_server = dup_or_null(server, &error);
+  pool->pl_auth_type = dup_or_null(auth_type, &error);
+  pool->pl_login = dup_or_null(login, &error);
+  pool->pl_password = dup_or_null(password, &error);
+  if (error)
+    goto free_strings;
+
+  pool->pl_port = port;
+  pool->pl_connection_type = connection_type;
+  if (max_connections == 0)
+    max_connections = 1;
+  pool->pl_max_connections = max_connections;
+  pool->pl_check_delay = DEFAULT_CHECK_DELAY;
+  pool->pl_count = 0;
+
+  pool->pl_idle = carray_new(max_connections);
+  if (pool->pl_idle == NULL)
+    goto free_strings;
+
+  if (pool_lock_init(pool) < 0)
+    goto free_idle;
+
+  return pool;
+
+ free_idle:
+  carray_free(pool->pl_idle);
+ free_strings:
+  free(pool->pl_password);
+  free(pool->pl_login);
+  free(pool->pl_auth_type);
+  free(pool->pl_server);
+  free(pool);
+ err:
+  return NULL;
+}
+
+void mailsmtp_pool_free(struct mailsmtp_pool * pool)
+{
+  unsigned int i;
+
+  for(i = 0 ; i < carray_count(pool->pl_idle) ; i ++) {
+    struct mailsmtp_pool_session * ps;
+
+    ps = carray_get(pool->pl_idle, i);
+    mailsmtp_free(ps->ps_session);
+    free(ps);
+  }
+  carray_free(pool->pl_idle);
+
+  pool_lock_destroy(pool);
+
+  free(pool->pl_password);
+  free(pool->pl_login);
+  free(pool->pl_auth_type);
+  free(pool->pl_server);
+  free(pool);
+}
+
+void mailsmtp_pool_set_check_delay(struct mailsmtp_pool * pool,
+    time_t check_delay)
+{
+  POOL_LOCK(pool);
+  pool->pl_check_delay = check_delay;
+  POOL_UNLOCK(pool);
+}
+
+static int pool_connect(struct mailsmtp_pool * pool, mailsmtp ** result)
+{
+  mailsmtp * session;
+  int res;
+  int r;
+
+  session = mailsmtp_new(0, NULL);
+  if (session == NULL) {
+    res = MAILSMTP_ERROR_MEMORY;
+    goto err;
+  }
+
+  if (pool->pl_connection_type == MAILSMTP_POOL_CONNECTION_TLS)
+    r = mailsmtp_ssl_connect(session, pool->pl_server, pool->pl_port);
+  else
+    r = mailsmtp_socket_connect(session, pool->pl_server, pool->pl_port);
+  if (r != MAILSMTP_NO_ERROR) {
+    res = r;
+    goto free;
+  }
+
+  r = mailsmtp_init(session);
+  if (r != MAILSMTP_NO_ERROR) {
+    res = r;
+    goto free;
+  }
+
+  if (pool->pl_connection_type == MAILSMTP_POOL_CONNECTION_STARTTLS) {
+    r = mailsmtp_socket_starttls(session);
+    if (r != MAILSMTP_NO_ERROR) {
+      res = r;
+      goto free;
+    }
+
+    r = mailsmtp_init(session);
+    if (r != MAILSMTP_NO_ERROR) {
+      res = r;
+      goto free;
+    }
+  }
+
+  if (pool->pl_login != NULL) {
+    if (pool->pl_auth_type != NULL)
+      r = mailesmtp_auth_sasl(session, pool->pl_auth_type,
+          pool->pl_server, NULL, NULL,
+          pool->pl_login, pool->pl_login, pool->pl_password, NULL);
+    else
+      r = mailsmtp_auth(session, pool->pl_login, pool->pl_password);
+    if (r != MAILSMTP_NO_ERROR) {
+      res = r;
+      goto free;
+    }
+  }
+
+  * result = session;
+
+  return MAILSMTP_NO_ERROR;
+
+ free:
+  mailsmtp_free(session);
+ err:
+  return res;
+}
+
+/*
+  mailsmtp_pool_get() takes the most recently used idle session, it is
+  checked with NOOP when it was idle for too long. When there is no idle
+  session, a new one is opened if the limit is not reached, otherwise
+  the caller waits for a session to be released.
+*/
+
+static int pool_get(struct mailsmtp_pool * pool, mailsmtp ** result,
+    int * p_reused)
+{
+  mailsmtp * session;
+  int r;
+
+  POOL_LOCK(pool);
+  while (1) {
+    struct mailsmtp_pool_session * ps;
+    unsigned int count;
+    time_t last_used;
+
+    count = carray_count(pool->pl_idle);
+    if (count == 0) {
+      if (pool->pl_count < pool->pl_max_connections)
+        break;
+
+#ifdef LIBETPAN_REENTRANT
+      POOL_WAIT(pool);
+      continue;
+#else
+      POOL_UNLOCK(pool);
+      return MAILSMTP_ERROR_SERVICE_NOT_AVAILABLE;
+#endif
+    }
+
+    ps = carray_get(pool->pl_idle, count - 1);
+    carray_delete(pool->pl_idle, count - 1);
+    session = ps->ps_session;
+    last_used = ps->ps_last_used;
+    free(ps);
+    POOL_UNLOCK(pool);
+
+    if (time(NULL) - last_used < pool->pl_check_delay) {
+      * result = session;
+      * p_reused = 1;
+      return MAILSMTP_NO_ERROR;
+    }
+
+    r = mailsmtp_noop(session);
+    if ((r == MAILSMTP_NO_ERROR) && (session->response_code == 250)) {
+      * result = session;
+      * p_reused = 1;
+      return MAILSMTP_NO_ERROR;
+    }
+
+    /* the server closed the connection */
+    mailsmtp_free(session);
+    POOL_LOCK(pool);
+    pool->pl_count --;
+  }
+
+  /* the slot is reserved before connecting, outside the lock */
+  pool->pl_count ++;
+  POOL_UNLOCK(pool);
+
+  r = pool_connect(pool, &session);
+  if (r != MAILSMTP_NO_ERROR) {
+    POOL_LOCK(pool);
+    pool->pl_count --;
+    POOL_SIGNAL(pool);
+    POOL_UNLOCK(pool);
+    return r;
+  }
+
+  * result = session;
+  * p_reused = 0;
+
+  return MAILSMTP_NO_ERROR;
+}
+
+int mailsmtp_pool_get(struct mailsmtp_pool * pool, mailsmtp ** result)
+{
+  int reused;
+
+  return pool_get(pool, result, &reused);
+}
+
+void mailsmtp_pool_release(struct mailsmtp_pool * pool,
+    mailsmtp * session, int error)
+{
+  struct mailsmtp_pool_session * ps;
+  int r;
+
+  switch (error) {
+  case MAILSMTP_NO_ERROR:
+    break;
+
+  case MAILSMTP_ERROR_STREAM:
+  case MAILSMTP_ERROR_SSL:
+  case MAILSMTP_ERROR_MEMORY:
+    goto close;
+
+  default:
+    /* a failed transaction leaves the session in an unknown state */
+    r = mailsmtp_reset(session);
+    if ((r != MAILSMTP_NO_ERROR) || (session->response_code != 250))
+      goto close;
+    break;
+  }
+
+  ps = malloc(sizeof(* ps));
+  if (ps == NULL)
+    goto close;
+  ps->ps_session = session;
+  ps->ps_last_used = time(NULL);
+
+  POOL_LOCK(pool);
+  r = carray_add(pool->pl_idle, ps, NULL);
+  if (r < 0) {
+    POOL_UNLOCK(pool);
+    free(ps);
+    goto close;
+  }
+  POOL_SIGNAL(pool);
+  POOL_UNLOCK(pool);
+
+  return;
+
+ close:
+  mailsmtp_free(session);
+  POOL_LOCK(pool);
+  pool->pl_count --;
+  POOL_SIGNAL(pool);
+  POOL_UNLOCK(pool);
+}
+
+int mailsmtp_pool_send(struct mailsmtp_pool * pool,
+    const char * from, int return_full, const char * envid,
+    clist * addresses, const char * message, size_t size)
+{
+  mailsmtp * session;
+  int reused;
+  int content_sent;
+  int retry;
+  int r;
+
+  for(retry = 0 ; retry < 2 ; retry ++) {
+    r = pool_get(pool, &session, &reused);
+    if (r != MAILSMTP_NO_ERROR)
+      return r;
+
+    r = mailesmtp_send_private(session, from, return_full, envid,
+        addresses, message, size, &content_sent);
+    mailsmtp_pool_release(pool, session, r);
+
+    /*
+      a new attempt is only made when a kept session was closed by the
+      server before any content was sent, otherwise the message may
+      have been accepted already.
+    */
+    if ((r != MAILSMTP_ERROR_STREAM) || !reused || content_sent)
+      break;
+  }
+
+  return r;
+}
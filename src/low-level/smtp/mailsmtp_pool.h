@@ -0,0 +1,126 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2011 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MAILSMTP_POOL_H
+
+#define MAILSMTP_POOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <libetpan/libetpan-config.h>
+#include <libetpan/mailsmtp_types.h>
+#include <libetpan/clist.h>
+#include <time.h>
+
+/*
+  A mailsmtp_pool keeps connected and authenticated SMTP sessions to a
+  server for a given login, so that messages can be sent without a new
+  connection, TLS handshake and authentication each time.
+  Several threads can use the same pool, at most max_connections
+  sessions are open at the same time.
+*/
+
+enum {
+  MAILSMTP_POOL_CONNECTION_PLAIN,
+  MAILSMTP_POOL_CONNECTION_STARTTLS,
+  MAILSMTP_POOL_CONNECTION_TLS
+};
+
+struct mailsmtp_pool;
+
+/*
+  mailsmtp_pool_new() creates a pool of sessions.
+
+  @param server is the hostname of the SMTP server
+  @param port is the port of the server, 0 for the default port
+  @param connection_type is MAILSMTP_POOL_CONNECTION_PLAIN,
+    MAILSMTP_POOL_CONNECTION_STARTTLS or MAILSMTP_POOL_CONNECTION_TLS
+  @param auth_type is the SASL mechanism, NULL to use the best one
+    supported by the server
+  @param login is the login used for authentication, NULL when no
+    authentication is needed
+  @param password is the password of the login
+  @param max_connections is the maximum number of open sessions
+*/
+LIBETPAN_EXPORT
+struct mailsmtp_pool * mailsmtp_pool_new(const char * server, uint16_t port,
+    int connection_type, const char * auth_type,
+    const char * login, const char * password,
+    unsigned int max_connections);
+
+/* all sessions must have been released */
+LIBETPAN_EXPORT
+void mailsmtp_pool_free(struct mailsmtp_pool * pool);
+
+/*
+  a session that was not used for check_delay seconds is checked with
+  NOOP before being reused, the default is 30 seconds
+*/
+LIBETPAN_EXPORT
+void mailsmtp_pool_set_check_delay(struct mailsmtp_pool * pool,
+    time_t check_delay);
+
+/*
+  mailsmtp_pool_get() returns a session ready for a new transaction.
+  It waits for a session to be released when max_connections sessions
+  are in use.
+*/
+LIBETPAN_EXPORT
+int mailsmtp_pool_get(struct mailsmtp_pool * pool, mailsmtp ** result);
+
+/*
+  mailsmtp_pool_release() gives the session back to the pool.
+  error is the result of the last transaction, the session is reset
+  when the transaction failed and closed on a connection error.
+*/
+LIBETPAN_EXPORT
+void mailsmtp_pool_release(struct mailsmtp_pool * pool,
+    mailsmtp * session, int error);
+
+/*
+  mailsmtp_pool_send() sends a message with a session of the pool,
+  the arguments are the ones of mailesmtp_send().
+  When a session kept by the pool was found closed by the server
+  before any content of the message was sent, the message is sent
+  again with another session. It is never sent twice.
+*/
+LIBETPAN_EXPORT
+int mailsmtp_pool_send(struct mailsmtp_pool * pool,
+    const char * from, int return_full, const char * envid,
+    clist * addresses, const char * message, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
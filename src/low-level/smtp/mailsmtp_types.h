@@ -96,7 +96,8 @@ enum {
   MAILSMTP_ESMTP_ETRN = 16,
   MAILSMTP_ESMTP_STARTTLS = 32,
   MAILSMTP_ESMTP_DSN = 64,
-  MAILSMTP_ESMTP_PIPELINING = 128
+  MAILSMTP_ESMTP_PIPELINING = 128,
+  MAILSMTP_ESMTP_CHUNKING = 256
 };
   
 struct mailsmtp {
@@ -133,6 +134,15 @@ struct mailsmtp {
 
 typedef struct mailsmtp mailsmtp;
 
+/*
+  a mailsmtp_data_reader fills buffer with at most size bytes of the
+  message and returns the number of bytes, 0 at the end of the message
+  or -1 on error
+*/
+typedef ssize_t mailsmtp_data_reader(void * context, char * buffer, size_t size);
+
+struct mailmime;
+
 #define MAILSMTP_DSN_NOTIFY_SUCCESS 1
 #define MAILSMTP_DSN_NOTIFY_FAILURE 2
 #define MAILSMTP_DSN_NOTIFY_DELAY   4
@@ -53,6 +53,7 @@ extern "C" {
 #include <libetpan/carray.h>
 #include <libetpan/chash.h>
 #include <libetpan/maillock.h>
+#include <libetpan/mailarena.h>
 
 /* mbox driver */
 #include <libetpan/mboxdriver.h>
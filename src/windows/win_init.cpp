@@ -12,6 +12,7 @@ Special class, initializers for windows
 #ifdef _MSC_VER
 #include "mailstream_ssl_private.h"
 #include "mmapstring_private.h"
+#include "charconv_private.h"
 #endif
 
 class win_init {
@@ -23,6 +24,7 @@ class win_init {
 #ifdef _MSC_VER
 		/* Initialise Mutexs */
 		mmapstring_init_lock();
+		charconv_init_lock();
 		mailstream_ssl_init_lock();
 #endif
 	}